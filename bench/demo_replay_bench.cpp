@@ -0,0 +1,134 @@
+// Demo replay benchmark: maps a demo (recorded with GAME_DEMO_RECORD=<file> on a client or
+// game_server --record-demo <file>) and decodes every snapshot in it as fast as it can, the work a
+// client does per received snapshot, then times seeks to random ticks. With no demo given it records
+// a synthetic one first, so a clean checkout has a reproducible workload too.
+//
+//   ./demo_replay_bench [demo file] [passes]
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <random>
+#include <thread>
+
+#include "engine/net/demo.h"
+#include "engine/net/game_net_common.h"
+
+namespace {
+
+using namespace game_engine;
+using Clock = std::chrono::steady_clock;
+
+// a minute of a busy room at 60 Hz: 4 players, 64 enemies, a few bullets, all moving
+void recordSyntheticDemo(const std::filesystem::path& path) {
+  DemoWriter writer;
+  if (!writer.open(path, 10001, kDefaultRoomID)) {
+    std::fprintf(stderr, "could not write %s\n", path.c_str());
+    std::exit(1);
+  }
+  for (uint64_t tick = 1; tick <= 3600; ++tick) {
+    NetGameStateSnapshot snap{};
+    snap.serverTick = tick;
+    snap.levelId = LevelIndex::LEVEL_1;
+    const auto add = [&](ObjectClass type, uint32_t id) {
+      NetGameObjectSnapshot obj{};
+      obj.id = id;
+      obj.type = type;
+      obj.layer = 1;
+      obj.position = {37.5f * static_cast<float>(id % 97) + static_cast<float>(tick), 400.0f};
+      obj.velocity = {1.25f * static_cast<float>(id % 5), 0.0f};
+      obj.direction = (id % 2) ? 1.0f : -1.0f;
+      obj.spriteFrame = static_cast<uint32_t>((tick + id) % 8);
+      snap.m_gameObjects[{type, id}] = obj;
+    };
+    for (uint32_t p = 1; p <= 4; ++p) {
+      add(ObjectClass::Player, 10000 + p);
+    }
+    for (uint32_t e = 0; e < 64; ++e) {
+      add(ObjectClass::Enemy, 100 + e);
+    }
+    for (uint32_t b = 0; b < tick % 16; ++b) {
+      add(ObjectClass::Projectile, 5000 + b);
+    }
+    writer.recordSnapshot(tick, snap.serealizeNetGameStateSnapshot());
+    if (tick % 512 == 0) {
+      std::this_thread::yield(); // let the writer drain instead of overflowing its queue
+    }
+  }
+  writer.close();
+  if (writer.droppedRecords() > 0) {
+    std::printf("warning: %llu records dropped while recording\n",
+                static_cast<unsigned long long>(writer.droppedRecords()));
+  }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  std::filesystem::path path = argc > 1 ? argv[1] : "";
+  const int passes = argc > 2 ? std::max(1, std::atoi(argv[2])) : 5;
+  if (path.empty()) {
+    path = std::filesystem::temp_directory_path() / "demo_replay_bench.demo";
+    recordSyntheticDemo(path);
+    std::printf("recorded synthetic demo %s\n", path.c_str());
+  }
+
+  const auto openStart = Clock::now();
+  DemoReader reader;
+  if (!reader.open(path)) {
+    std::fprintf(stderr, "not a demo: %s\n", path.c_str());
+    return 1;
+  }
+  const double openMs = std::chrono::duration<double, std::milli>(Clock::now() - openStart).count();
+  std::printf("opened in %.2f ms, %zu keyframes%s\n", openMs, reader.keyframes().size(),
+              reader.hadIndex() ? "" : " (index rebuilt, demo has no trailer)");
+
+  uint64_t snapshots = 0;
+  uint64_t inputs = 0;
+  uint64_t bytes = 0;
+  uint64_t objects = 0;
+  uint64_t firstTick = UINT64_MAX;
+  uint64_t lastTick = 0;
+  NetGameStateSnapshot snap;
+  const auto decodeStart = Clock::now();
+  for (int pass = 0; pass < passes; ++pass) {
+    DemoRecordView record;
+    for (uint64_t offset = reader.firstOffset(); reader.nextPayload(offset, record); offset = record.nextOffset) {
+      if (record.kind != DemoRecordKind::Snapshot) {
+        ++inputs;
+        continue;
+      }
+      snap.deserealizeNetGameStateSnapshot(record.data, record.size);
+      ++snapshots;
+      bytes += record.size;
+      objects += snap.m_gameObjects.size();
+      firstTick = std::min(firstTick, record.tick);
+      lastTick = record.tick;
+    }
+  }
+  const double decodeSec = std::chrono::duration<double>(Clock::now() - decodeStart).count();
+  if (snapshots == 0) {
+    std::printf("no snapshots in demo\n");
+    return 0;
+  }
+  std::printf("decode: %llu snapshots (%llu inputs) in %.3f s: %.0f snapshots/s, %.1f MB/s, %.2f us/snapshot, "
+              "%.0f objects/snapshot\n",
+              static_cast<unsigned long long>(snapshots), static_cast<unsigned long long>(inputs), decodeSec,
+              snapshots / decodeSec, bytes / decodeSec / (1024.0 * 1024.0), decodeSec * 1e6 / snapshots,
+              static_cast<double>(objects) / snapshots);
+
+  constexpr int kSeeks = 10000;
+  std::mt19937_64 rng(1);
+  std::uniform_int_distribution<uint64_t> pickTick(firstTick, lastTick);
+  uint64_t found = 0;
+  const auto seekStart = Clock::now();
+  for (int i = 0; i < kSeeks; ++i) {
+    DemoRecordView record;
+    found += reader.findSnapshot(pickTick(rng), record) ? 1 : 0;
+  }
+  const double seekUs = std::chrono::duration<double, std::micro>(Clock::now() - seekStart).count() / kSeeks;
+  std::printf("seek: %.2f us per random tick (%llu/%d found)\n", seekUs, static_cast<unsigned long long>(found),
+              kSeeks);
+  return 0;
+}
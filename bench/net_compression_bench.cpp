@@ -0,0 +1,119 @@
+// Snapshot compression benchmark: raw encode vs encode + lz compress, and decompress on the receive
+// side, across snapshot sizes. Prints bytes saved per microsecond of CPU so the threshold in
+// CompressionConfig can be picked from numbers rather than guesses.
+//
+//   ./net_compression_bench [iterations]
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "engine/net/game_net_common.h"
+#include "net/net_compression.h"
+
+namespace {
+
+using namespace game_engine;
+using Clock = std::chrono::steady_clock;
+
+NetGameObjectSnapshot makeObject(ObjectClass type, uint32_t id, uint32_t salt) {
+  NetGameObjectSnapshot obj{};
+  obj.id = id;
+  obj.layer = 1;
+  obj.type = type;
+  obj.position = {100.0f + 37.5f * static_cast<float>(id), 400.0f - static_cast<float>(salt % 7)};
+  obj.velocity = {(id % 3 == 0) ? 0.0f : 1.25f * static_cast<float>(id % 5), 0.0f};
+  obj.acceleration = {30.0f, 0.0f};
+  obj.direction = (id % 2) ? 1.0f : -1.0f;
+  obj.maxSpeedX = 15.0f;
+  obj.spriteFrame = salt % 8;
+  obj.currentAnimation = 1;
+  obj.animElapsed = 0.016f * static_cast<float>(salt % 30);
+  obj.grounded = true;
+  obj.presentationVariant = PresentationVariant::Run;
+  switch (type) {
+    case ObjectClass::Player:
+      obj.spriteType = SpriteType::Player_Marie;
+      new (&obj.data.player) PlayerData{};
+      obj.data.player.healthPoints = 100;
+      break;
+    case ObjectClass::Projectile:
+      obj.spriteType = SpriteType::Player_Mage;
+      new (&obj.data.bullet) BulletData{};
+      break;
+    default:
+      obj.spriteType = SpriteType::Skeleton_Warrior;
+      new (&obj.data.enemy) EnemyData{};
+      obj.data.enemy.healthPoints = 40;
+      break;
+  }
+  return obj;
+}
+
+NetGameStateSnapshot makeSnapshot(uint32_t enemies, uint32_t salt) {
+  NetGameStateSnapshot snap{};
+  snap.serverTick = 1000 + salt;
+  snap.levelId = LevelIndex::LEVEL_1;
+  for (uint32_t p = 1; p <= 4; ++p) {
+    snap.m_gameObjects[{ObjectClass::Player, 10000 + p}] = makeObject(ObjectClass::Player, 10000 + p, salt);
+  }
+  for (uint32_t e = 0; e < enemies; ++e) {
+    snap.m_gameObjects[{ObjectClass::Enemy, 100 + e}] = makeObject(ObjectClass::Enemy, 100 + e, salt + e);
+  }
+  for (uint32_t b = 0; b < enemies / 4; ++b) {
+    snap.m_gameObjects[{ObjectClass::Projectile, 5000 + b}] = makeObject(ObjectClass::Projectile, 5000 + b, salt + b);
+  }
+  return snap;
+}
+
+template<typename Fn>
+double microsPerCall(int iterations, Fn&& fn) {
+  const auto start = Clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    fn(i);
+  }
+  return std::chrono::duration<double, std::micro>(Clock::now() - start).count() / iterations;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  const int iterations = argc > 1 ? std::atoi(argv[1]) : 2000;
+
+  std::printf("%8s %9s %9s %7s %10s %10s %10s %12s\n",
+    "enemies", "raw B", "lz B", "ratio", "encode us", "lz us", "unlz us", "saved B/us");
+
+  for (uint32_t enemies : {0u, 8u, 32u, 128u, 512u}) {
+    const NetGameStateSnapshot snap = makeSnapshot(enemies, 7);
+
+    net::message<GameMsgHeaders> raw;
+    raw.header.id = GameMsgHeaders::Game_Snapshot;
+    raw.body = snap.serealizeNetGameStateSnapshot();
+    raw.header.bodySize = raw.body.size();
+
+    const double encodeUs = microsPerCall(iterations, [&](int) {
+      auto body = snap.serealizeNetGameStateSnapshot();
+      (void)body;
+    });
+
+    net::message<GameMsgHeaders> packed;
+    const double compressUs = microsPerCall(iterations, [&](int) {
+      packed = raw;
+      net::compress_message(packed, 0);
+    });
+
+    const bool didPack = (packed.header.bodySize & net::kCompressedBodyFlag) != 0;
+    net::message<GameMsgHeaders> unpacked;
+    const double decompressUs = didPack ? microsPerCall(iterations, [&](int) {
+      unpacked = packed;
+      net::decompress_message(unpacked);
+    }) : 0.0;
+
+    const double rawBytes = static_cast<double>(raw.body.size());
+    const double lzBytes = static_cast<double>(didPack ? packed.body.size() : raw.body.size());
+    std::printf("%8u %9.0f %9.0f %7.2f %10.2f %10.2f %10.2f %12.1f\n",
+      enemies, rawBytes, lzBytes, rawBytes / lzBytes, encodeUs, compressUs, decompressUs,
+      (rawBytes - lzBytes) / std::max(compressUs + decompressUs, 1e-3));
+  }
+
+  return 0;
+}
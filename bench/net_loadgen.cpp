@@ -0,0 +1,335 @@
+// Synthetic client swarm: opens N connections to a server on loopback, registers each one as a player and
+// streams scripted (or randomized) inputs at 60 Hz, decoding every snapshot that comes back. At the end it
+// reports how steadily the server ticked, input -> ack latency percentiles, and per-client bandwidth.
+//
+// start a server first (./game_server --no-lan), then:
+//   ./net_loadgen [--clients N] [--seconds S] [--port N] [--input-rate HZ] [--random] [--rooms N]
+//
+// with --rooms N client i joins room i % N (the server needs --rooms N or more to open them).
+//
+// each client_interface runs its own io thread, so a few hundred clients is a few hundred threads.
+// NET_IMPAIR_IN / NET_IMPAIR_OUT (see net/net_impairment.h) put simulated latency and loss on the swarm's side.
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+
+#include "engine/net/game_net_common.h"
+#include "net/net_client.h"
+
+namespace {
+
+using game_engine::GameMsgHeaders;
+using game_engine::NetGameInput;
+using game_engine::NetGameStateSnapshot;
+using game_engine::NetInputPacket;
+using Clock = std::chrono::steady_clock;
+
+struct LoadgenOptions {
+  uint32_t clients = 100;
+  double seconds = 10.0;
+  uint16_t port = 9000;
+  double inputRate = 60.0;
+  bool randomInput = false;
+  uint32_t rooms = 1;
+};
+
+double msBetween(Clock::time_point a, Clock::time_point b) {
+  return std::chrono::duration<double, std::milli>(b - a).count();
+}
+
+// sorts v in place
+double percentile(std::vector<double>& v, double p) {
+  if (v.empty()) {
+    return 0.0;
+  }
+  std::sort(v.begin(), v.end());
+  const size_t idx = std::min(v.size() - 1, static_cast<size_t>(p * double(v.size() - 1) + 0.5));
+  return v[idx];
+}
+
+class SwarmClient : public net::client_interface<GameMsgHeaders> {
+public:
+  SwarmClient(uint32_t index, uint32_t roomID, bool randomInput)
+    : m_index(index), m_roomID(roomID), m_randomInput(randomInput), m_rng(0x9E3779B9u ^ index) {
+    SetPingMessage(GameMsgHeaders::Server_GetPing);
+    // as GameClient does; matters when NET_IMPAIR_IN / NET_IMPAIR_OUT simulate a lossy network
+    SetUnreliableMessage(GameMsgHeaders::Game_Snapshot);
+    SetUnreliableMessage(GameMsgHeaders::Game_PlayerInput);
+  }
+
+  bool registered() const { return m_registered; }
+
+  // drain everything that arrived since the last call
+  void pump(Clock::time_point now) {
+    if (!IsConnected()) {
+      return;
+    }
+    m_vBatch.clear();
+    Incoming().pop_all(m_vBatch);
+    for (auto& owned : m_vBatch) {
+      auto& msg = owned.msg;
+      switch (msg.header.id) {
+        case GameMsgHeaders::Client_Accepted: {
+          net::message<GameMsgHeaders> reg;
+          reg.header.id = GameMsgHeaders::Client_RegisterWithServer;
+          net::ByteWriter writer;
+          writer.write_enum(m_index % 2 ? SpriteType::Player_Marie : SpriteType::Player_Bonkfather);
+          writer.write_u32(m_roomID);
+          reg.body = std::move(writer.buff);
+          reg.header.bodySize = reg.body.size();
+          Send(reg);
+          break;
+        }
+        case GameMsgHeaders::Client_AssignID: {
+          net::ByteReader reader(msg.body);
+          m_playerID = reader.read_u32();
+          m_registered = true;
+          registeredAt = now;
+          break;
+        }
+        case GameMsgHeaders::Game_Snapshot:
+          onSnapshot(msg, now);
+          break;
+        default:
+          break;
+      }
+      Recycle(msg);
+    }
+  }
+
+  void sendInput(Clock::time_point now, uint64_t frame) {
+    if (!m_registered || !IsConnected()) {
+      return;
+    }
+    NetGameInput input = m_randomInput ? randomInput() : scriptedInput(frame);
+    input.playerID = m_playerID;
+    input.inputSeq = ++m_nextSeq;
+    m_sentAt[input.inputSeq % m_sentAt.size()] = now;
+
+    m_packet.frames.assign(1, input);
+    net::message<GameMsgHeaders> msg;
+    msg.header.id = GameMsgHeaders::Game_PlayerInput;
+    msg.body = m_packet.serealizeNetInputPacket();
+    msg.header.bodySize = msg.body.size();
+    Send(msg);
+    if (frame % 60 == 0) {
+      SendPing();
+    }
+  }
+
+  // results, read once the run is over
+  std::vector<double> ackLatencyMs;
+  std::vector<double> snapshotIntervalMs;
+  std::vector<double> ticksPerSnapshot;
+  uint64_t snapshots = 0;
+  uint64_t decodeFailures = 0;
+  uint64_t firstTick = 0;
+  uint64_t lastTick = 0;
+  Clock::time_point firstTickAt;
+  Clock::time_point lastTickAt;
+  Clock::time_point registeredAt;
+
+private:
+  void onSnapshot(net::message<GameMsgHeaders>& msg, Clock::time_point now) {
+    NetGameStateSnapshot snapshot;
+    try {
+      snapshot.deserealizeNetGameStateSnapshot(msg.body);
+    } catch (const std::exception&) {
+      ++decodeFailures;
+      return;
+    }
+    if (snapshots++ == 0) {
+      firstTick = snapshot.serverTick;
+      firstTickAt = now;
+    } else if (snapshot.serverTick > lastTick) {
+      snapshotIntervalMs.push_back(msBetween(lastTickAt, now));
+      ticksPerSnapshot.push_back(double(snapshot.serverTick - lastTick));
+    }
+    if (snapshot.serverTick >= lastTick) {
+      lastTick = snapshot.serverTick;
+      lastTickAt = now;
+    }
+
+    auto it = snapshot.m_gameObjects.find({ObjectClass::Player, m_playerID});
+    if (it == snapshot.m_gameObjects.end()) {
+      return;
+    }
+    // only the newest acked seq is timed; older ones in the same ack were simulated earlier
+    const uint32_t acked = it->second.ackedInputSeq;
+    if (acked > m_lastAcked && acked <= m_nextSeq && m_nextSeq - acked < m_sentAt.size()) {
+      ackLatencyMs.push_back(msBetween(m_sentAt[acked % m_sentAt.size()], now));
+    }
+    m_lastAcked = std::max(m_lastAcked, acked);
+  }
+
+  // walk back and forth, jumping and attacking on a fixed rhythm; clients are offset so they dont move in lockstep
+  NetGameInput scriptedInput(uint64_t frame) const {
+    const uint64_t f = frame + m_index * 17;
+    NetGameInput in;
+    in.rightHeld = (f / 120) % 2 == 0;
+    in.leftHeld = !in.rightHeld;
+    in.jumpPressed = f % 45 == 0;
+    in.meleePressed = f % 90 == 30;
+    in.fireHeld = (f / 30) % 4 == 1;
+    return in;
+  }
+
+  NetGameInput randomInput() {
+    std::uniform_int_distribution<int> d(0, 59);
+    if (d(m_rng) < 4) {
+      m_held = static_cast<uint32_t>(d(m_rng)) & 7u; // left / right / fire
+    }
+    NetGameInput in;
+    NetInputPacket::unpackButtons(m_held, in);
+    in.jumpPressed = d(m_rng) == 0;
+    in.meleePressed = d(m_rng) == 1;
+    in.ultimatePressed = d(m_rng) == 2 && d(m_rng) == 2;
+    return in;
+  }
+
+  const uint32_t m_index;
+  const uint32_t m_roomID;
+  const bool m_randomInput;
+  std::mt19937 m_rng;
+  uint32_t m_held = 0;
+  bool m_registered = false;
+  uint32_t m_playerID = 0;
+  uint32_t m_nextSeq = 0;
+  uint32_t m_lastAcked = 0;
+  std::array<Clock::time_point, 512> m_sentAt{};
+  NetInputPacket m_packet;
+  std::vector<net::owned_message<GameMsgHeaders>> m_vBatch;
+};
+
+bool parseOptions(int argc, char** argv, LoadgenOptions& opts) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--random") {
+      opts.randomInput = true;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      return false;
+    }
+    const char* v = argv[++i];
+    if (arg == "--clients") {
+      opts.clients = static_cast<uint32_t>(std::max(1l, std::strtol(v, nullptr, 10)));
+    } else if (arg == "--seconds") {
+      opts.seconds = std::max(1.0, std::strtod(v, nullptr));
+    } else if (arg == "--port") {
+      opts.port = static_cast<uint16_t>(std::strtoul(v, nullptr, 10));
+    } else if (arg == "--rooms") {
+      opts.rooms = static_cast<uint32_t>(std::max(1l, std::strtol(v, nullptr, 10)));
+    } else if (arg == "--input-rate") {
+      opts.inputRate = std::clamp(std::strtod(v, nullptr), 1.0, 1000.0);
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  LoadgenOptions opts;
+  if (!parseOptions(argc, argv, opts)) {
+    std::printf("usage: %s [--clients N] [--seconds S] [--port N] [--input-rate HZ] [--random] [--rooms N]\n",
+                argv[0]);
+    return 1;
+  }
+
+  std::printf("%u clients in %u rooms -> 127.0.0.1:%u, %.0f Hz %s input for %.0f s\n",
+    opts.clients, opts.rooms, opts.port, opts.inputRate, opts.randomInput ? "random" : "scripted", opts.seconds);
+
+  std::vector<std::unique_ptr<SwarmClient>> clients;
+  clients.reserve(opts.clients);
+  for (uint32_t i = 0; i < opts.clients; ++i) {
+    auto client = std::make_unique<SwarmClient>(i, i % opts.rooms, opts.randomInput);
+    if (client->Connect("127.0.0.1", opts.port)) {
+      clients.push_back(std::move(client));
+    }
+  }
+
+  const auto step = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / opts.inputRate));
+  const auto start = Clock::now();
+  const auto end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(opts.seconds));
+  auto nextFrame = start;
+  auto nextReport = start + std::chrono::seconds(1);
+  uint64_t frame = 0;
+
+  while (Clock::now() < end) {
+    const auto now = Clock::now();
+    for (auto& c : clients) {
+      c->pump(now);
+      c->sendInput(now, frame);
+    }
+    ++frame;
+
+    if (now >= nextReport) {
+      nextReport += std::chrono::seconds(1);
+      size_t connected = 0;
+      size_t registered = 0;
+      uint64_t snapshots = 0;
+      for (auto& c : clients) {
+        connected += c->IsConnected() ? 1 : 0;
+        registered += c->registered() ? 1 : 0;
+        snapshots += c->snapshots;
+      }
+      std::printf("  %5.1fs  connected %zu  registered %zu  snapshots %llu\n",
+        std::chrono::duration<double>(now - start).count(), connected, registered,
+        static_cast<unsigned long long>(snapshots));
+    }
+
+    nextFrame += step;
+    std::this_thread::sleep_until(nextFrame);
+  }
+  const auto stoppedAt = Clock::now();
+
+  std::vector<double> latency, interval, ticksPer, tickRate, kbIn, kbOut;
+  size_t registered = 0;
+  uint64_t decodeFailures = 0;
+  for (auto& c : clients) {
+    decodeFailures += c->decodeFailures;
+    if (!c->registered()) {
+      continue;
+    }
+    ++registered;
+    latency.insert(latency.end(), c->ackLatencyMs.begin(), c->ackLatencyMs.end());
+    interval.insert(interval.end(), c->snapshotIntervalMs.begin(), c->snapshotIntervalMs.end());
+    ticksPer.insert(ticksPer.end(), c->ticksPerSnapshot.begin(), c->ticksPerSnapshot.end());
+    const double tickSpan = std::chrono::duration<double>(c->lastTickAt - c->firstTickAt).count();
+    if (tickSpan > 0.0) {
+      tickRate.push_back(double(c->lastTick - c->firstTick) / tickSpan);
+    }
+    const net::connection_stats stats = c->GetStats();
+    const double alive = std::max(1e-3, std::chrono::duration<double>(stoppedAt - c->registeredAt).count());
+    kbIn.push_back(double(stats.bytesIn) / 1024.0 / alive);
+    kbOut.push_back(double(stats.bytesOut) / 1024.0 / alive);
+  }
+
+  std::printf("\nregistered %zu/%u  decode failures %llu\n",
+    registered, opts.clients, static_cast<unsigned long long>(decodeFailures));
+  std::printf("server tick rate (Hz)        min %7.2f  p50 %7.2f  max %7.2f\n",
+    percentile(tickRate, 0.0), percentile(tickRate, 0.5), percentile(tickRate, 1.0));
+  std::printf("snapshot interval (ms)       p50 %7.2f  p95 %7.2f  p99 %7.2f  max %7.2f\n",
+    percentile(interval, 0.5), percentile(interval, 0.95), percentile(interval, 0.99), percentile(interval, 1.0));
+  std::printf("ticks per snapshot           p50 %7.0f  p99 %7.0f  max %7.0f\n",
+    percentile(ticksPer, 0.5), percentile(ticksPer, 0.99), percentile(ticksPer, 1.0));
+  std::printf("input -> ack latency (ms)    p50 %7.2f  p90 %7.2f  p99 %7.2f  max %7.2f  (%zu samples)\n",
+    percentile(latency, 0.5), percentile(latency, 0.9), percentile(latency, 0.99), percentile(latency, 1.0),
+    latency.size());
+  std::printf("per-client in (KB/s)         min %7.1f  p50 %7.1f  max %7.1f\n",
+    percentile(kbIn, 0.0), percentile(kbIn, 0.5), percentile(kbIn, 1.0));
+  std::printf("per-client out (KB/s)        min %7.1f  p50 %7.1f  max %7.1f\n",
+    percentile(kbOut, 0.0), percentile(kbOut, 0.5), percentile(kbOut, 1.0));
+
+  for (auto& c : clients) {
+    c->Disconnect();
+  }
+  return 0;
+}
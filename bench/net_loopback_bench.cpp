@@ -0,0 +1,120 @@
+// Loopback throughput: C clients each stream compressed messages at one server, for a few
+// server io thread counts. Reads, header parsing and decompression all happen on the server's
+// io threads, so throughput should climb with them until the clients or the consumer saturate.
+//
+//   ./net_loopback_bench [clients] [messagesPerClient]
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "net/net_client.h"
+#include "net/net_server.h"
+
+namespace {
+
+enum class BenchMsg : uint32_t {
+  Payload = 1,
+};
+
+using Clock = std::chrono::steady_clock;
+
+class CountingServer : public net::server_interface<BenchMsg> {
+public:
+  using net::server_interface<BenchMsg>::server_interface;
+
+  uint64_t received = 0;
+  uint64_t bytes = 0;
+
+protected:
+  bool OnClientConnect(std::shared_ptr<net::connection<BenchMsg>>) override {
+    return true;
+  }
+
+  void OnMessage(std::shared_ptr<net::connection<BenchMsg>>, net::message<BenchMsg>& msg) override {
+    ++received;
+    bytes += msg.body.size();
+  }
+};
+
+// snapshot-like body: repetitive enough to compress, not so repetitive that it is free to inflate
+net::message<BenchMsg> makePayload() {
+  net::message<BenchMsg> msg;
+  msg.header.id = BenchMsg::Payload;
+  net::ByteWriter w;
+  for (uint32_t i = 0; i < 256; ++i) {
+    w.write_u32(i % 7);
+    w.write_u32(i * 2654435761u >> 20);
+    w.write_u32(100 + i);
+  }
+  msg.body = std::move(w.buff);
+  msg.header.bodySize = msg.body.size();
+  net::compress_message(msg, 0);
+  return msg;
+}
+
+double run(size_t ioThreads, uint32_t clients, uint32_t perClient, uint16_t port, double& mbPerSec) {
+  CountingServer server(port);
+  server.Start(ioThreads);
+
+  std::vector<std::unique_ptr<net::client_interface<BenchMsg>>> conns;
+  for (uint32_t c = 0; c < clients; ++c) {
+    conns.push_back(std::make_unique<net::client_interface<BenchMsg>>());
+    conns.back()->Connect("127.0.0.1", port);
+  }
+  while (server.ConnectionCount() < clients) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(100)); // let the handshakes finish
+
+  const net::message<BenchMsg> payload = makePayload();
+  const uint64_t total = uint64_t(clients) * perClient;
+  const auto start = Clock::now();
+
+  std::vector<std::thread> senders;
+  for (auto& conn : conns) {
+    senders.emplace_back([&conn, &payload, perClient]() {
+      for (uint32_t i = 0; i < perClient; ++i) {
+        conn->Send(payload);
+      }
+    });
+  }
+
+  while (server.received < total && Clock::now() - start < std::chrono::seconds(30)) {
+    server.ProcessIncomingMessages(-1, false);
+  }
+  const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  mbPerSec = double(server.bytes) / (1024.0 * 1024.0) / seconds;
+
+  for (auto& t : senders) {
+    t.join();
+  }
+  if (server.received < total) {
+    std::printf("  only %llu/%llu messages arrived\n",
+      static_cast<unsigned long long>(server.received), static_cast<unsigned long long>(total));
+  }
+  for (auto& conn : conns) {
+    conn->Disconnect();
+  }
+  server.Stop();
+  return seconds;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  const uint32_t clients = argc > 1 ? static_cast<uint32_t>(std::atoi(argv[1])) : 8;
+  const uint32_t perClient = argc > 2 ? static_cast<uint32_t>(std::atoi(argv[2])) : 20000;
+
+  std::printf("%u clients x %u compressed messages\n", clients, perClient);
+  uint16_t port = 47100;
+  for (size_t ioThreads : {1u, 2u, 4u}) {
+    double mbPerSec = 0.0;
+    const double seconds = run(ioThreads, clients, perClient, port++, mbPerSec);
+    std::printf("  io threads %zu: %8.1f ms  %10.0f msg/s  %8.1f MB/s inflated\n",
+      ioThreads,
+      seconds * 1000.0,
+      double(clients) * perClient / seconds,
+      mbPerSec);
+  }
+  return 0;
+}
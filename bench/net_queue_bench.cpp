@@ -0,0 +1,111 @@
+// Contention microbenchmark: net::tsqueue vs net::mpsc_queue / net::spsc_queue.
+// N producer threads push small items while one consumer drains, the same shape as
+// connections feeding the server's incoming queue.
+//
+//   ./net_queue_bench [itemsPerProducer]
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "net/net_ts_queue.h"
+#include "net/net_lockfree_queue.h"
+
+namespace {
+
+struct Item {
+  uint32_t producer = 0;
+  uint32_t seq = 0;
+  uint64_t payload = 0;
+};
+
+using Clock = std::chrono::steady_clock;
+
+double secondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// consumers sleep when the queue runs dry, as the server loop does, rather than spinning on empty()
+// tsqueue has no batched drain, so the consumer does what ProcessIncomingMessages used to do
+double runTsQueue(uint32_t producers, uint32_t perProducer) {
+  net::tsqueue<Item> q;
+  const uint64_t total = uint64_t(producers) * perProducer;
+  const auto start = Clock::now();
+
+  std::vector<std::thread> threads;
+  for (uint32_t p = 0; p < producers; ++p) {
+    threads.emplace_back([&q, p, perProducer]() {
+      for (uint32_t i = 0; i < perProducer; ++i) {
+        q.push_back(Item{p, i, i});
+      }
+    });
+  }
+
+  uint64_t received = 0;
+  while (received < total) {
+    q.wait();
+    while (!q.empty()) {
+      q.pop_front();
+      ++received;
+    }
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  return secondsSince(start);
+}
+
+template<typename Queue>
+double runRingQueue(Queue& q, uint32_t producers, uint32_t perProducer) {
+  const uint64_t total = uint64_t(producers) * perProducer;
+  const auto start = Clock::now();
+
+  std::vector<std::thread> threads;
+  for (uint32_t p = 0; p < producers; ++p) {
+    threads.emplace_back([&q, p, perProducer]() {
+      for (uint32_t i = 0; i < perProducer; ++i) {
+        q.push_back(Item{p, i, i});
+      }
+    });
+  }
+
+  std::vector<Item> batch;
+  batch.reserve(q.capacity());
+  uint64_t received = 0;
+  while (received < total) {
+    batch.clear();
+    if (q.pop_all(batch) == 0) {
+      q.wait();
+    }
+    received += batch.size();
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  return secondsSince(start);
+}
+
+void report(const char* name, uint32_t producers, uint32_t perProducer, double seconds) {
+  const double total = double(producers) * perProducer;
+  std::printf("%-12s producers=%-2u items=%-9.0f %8.2f ms  %8.2f Mitems/s\n",
+    name, producers, total, seconds * 1000.0, total / seconds / 1e6);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  const uint32_t perProducer = argc > 1 ? static_cast<uint32_t>(std::strtoul(argv[1], nullptr, 10)) : 1'000'000;
+  const uint32_t hw = std::max(2u, std::thread::hardware_concurrency());
+
+  {
+    net::spsc_queue<Item> q(8192);
+    report("spsc_queue", 1, perProducer, runRingQueue(q, 1, perProducer));
+  }
+
+  for (uint32_t producers = 1; producers <= hw; producers *= 2) {
+    report("tsqueue", producers, perProducer, runTsQueue(producers, perProducer));
+    net::mpsc_queue<Item> q(8192);
+    report("mpsc_queue", producers, perProducer, runRingQueue(q, producers, perProducer));
+  }
+
+  return 0;
+}
@@ -198,9 +198,17 @@ namespace game_engine {
 
       game_engine::NetGameStateSnapshot extractNetSnapshot() const {
         NetGameStateSnapshot snapshot;
+        extractNetSnapshot(snapshot);
+        return snapshot;
+      }
+
+      // refills snapshot in place, so a reused one keeps its object storage
+      void extractNetSnapshot(game_engine::NetGameStateSnapshot& snapshot) const {
         snapshot.serverTick = m_stateLastUpdatedAt;
         snapshot.levelId = currentLevelId;
         snapshot.m_stateLastUpdatedAt = m_stateLastUpdatedAt;
+        snapshot.hitStopEvent = {};
+        snapshot.m_gameObjects.clear();
 
         for (size_t layerIdx = 0; layerIdx < layers.size(); ++layerIdx) {
             for (const auto& obj : layers[layerIdx]) {
@@ -232,7 +240,7 @@ namespace game_engine {
                     : false;
                 s.presentationVariant = obj.presentationVariant;
                 s.data = obj.data; // union to be handled in encodeNetGameStateSnapshot
-                snapshot.m_gameObjects[{obj.objClass, obj.id}] = s;
+                snapshot.m_gameObjects.append_unsorted({obj.objClass, obj.id}, s);
               };
             };
         };
@@ -265,11 +273,10 @@ namespace game_engine {
               ? obj.animations[obj.currentAnimation].isDone()
               : false;
           s.presentationVariant = obj.presentationVariant;
-          snapshot.m_gameObjects[{obj.objClass, obj.id}] = s;
+          snapshot.m_gameObjects.append_unsorted({obj.objClass, obj.id}, s);
           // }
         };
-
-          return snapshot;
+        snapshot.m_gameObjects.sort_unique(); // layers aren't in key order
         };
 
   };
@@ -349,6 +356,8 @@ namespace game_engine {
       std::optional<LevelIndex> consumePendingHostLevelTransition();
       void broadcastHostSnapshot();
       bool copyHostSnapshot(NetGameStateSnapshot& out) const;
+      std::vector<std::pair<uint32_t, net::connection_stats>> copyHostClientStats() const;
+      TickTimingStats copyHostTickTiming() const;
       std::vector<DiscoveredSessionInfo> copyDiscoveredSessions() const;
       bool selectDiscoveredSession(size_t index);
       bool hasSelectedJoinTarget() const;
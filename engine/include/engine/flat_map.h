@@ -0,0 +1,139 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace game_engine {
+
+  // map backed by one vector of (key, value) pairs kept sorted by key. lookups are a binary search,
+  // iteration is a linear walk over packed memory in key order, and clear() keeps the capacity so a
+  // map that is rebuilt every tick stops allocating once it has grown to its working size.
+  //
+  // member names follow std::map so it drops in where the snapshot code used an unordered_map.
+  // inserting in key order appends; inserting out of order shifts the tail, so bulk builds from an
+  // unordered source should use append_unsorted() and a single sort_unique() at the end.
+  // don't modify keys through iterators.
+  template <typename K, typename V, typename Less = std::less<K>>
+  class FlatMap {
+    public:
+      using key_type = K;
+      using mapped_type = V;
+      using value_type = std::pair<K, V>;
+      using container_type = std::vector<value_type>;
+      using iterator = typename container_type::iterator;
+      using const_iterator = typename container_type::const_iterator;
+      using size_type = typename container_type::size_type;
+
+      iterator begin() { return m_entries.begin(); }
+      iterator end() { return m_entries.end(); }
+      const_iterator begin() const { return m_entries.begin(); }
+      const_iterator end() const { return m_entries.end(); }
+
+      size_type size() const { return m_entries.size(); }
+      bool empty() const { return m_entries.empty(); }
+      size_type capacity() const { return m_entries.capacity(); }
+      void reserve(size_type n) { m_entries.reserve(n); }
+      void clear() { m_entries.clear(); }
+
+      const container_type& entries() const { return m_entries; }
+
+      iterator find(const K& key) {
+        const auto it = lowerBound(key);
+        return (it != m_entries.end() && !Less{}(key, it->first)) ? it : m_entries.end();
+      }
+
+      const_iterator find(const K& key) const {
+        return const_cast<FlatMap*>(this)->find(key);
+      }
+
+      bool contains(const K& key) const { return find(key) != end(); }
+
+      V& at(const K& key) {
+        const auto it = find(key);
+        if (it == m_entries.end()) {
+          throw std::out_of_range("FlatMap::at: key not found");
+        }
+        return it->second;
+      }
+
+      const V& at(const K& key) const { return const_cast<FlatMap*>(this)->at(key); }
+
+      V& operator[](const K& key) { return try_emplace(key).first->second; }
+
+      // inserts only if key is absent, like std::map::try_emplace
+      template <typename... Args>
+      std::pair<iterator, bool> try_emplace(const K& key, Args&&... args) {
+        const auto it = lowerBound(key);
+        if (it != m_entries.end() && !Less{}(key, it->first)) {
+          return {it, false};
+        }
+        return {m_entries.emplace(it, std::piecewise_construct, std::forward_as_tuple(key),
+                                  std::forward_as_tuple(std::forward<Args>(args)...)),
+                true};
+      }
+
+      std::pair<iterator, bool> emplace(const K& key, const V& value) { return try_emplace(key, value); }
+
+      template <typename M>
+      std::pair<iterator, bool> insert_or_assign(const K& key, M&& value) {
+        auto [it, inserted] = try_emplace(key, std::forward<M>(value));
+        if (!inserted) {
+          it->second = std::forward<M>(value);
+        }
+        return {it, inserted};
+      }
+
+      size_type erase(const K& key) {
+        const auto it = find(key);
+        if (it == m_entries.end()) {
+          return 0;
+        }
+        m_entries.erase(it);
+        return 1;
+      }
+
+      iterator erase(const_iterator pos) { return m_entries.erase(pos); }
+
+      // bulk build: push in any order, then sort_unique() once before the next lookup.
+      // the map is not valid for find/insert until then.
+      template <typename M>
+      void append_unsorted(const K& key, M&& value) {
+        m_entries.emplace_back(key, std::forward<M>(value));
+      }
+
+      // sorts appended entries; for duplicate keys the one appended last wins, matching repeated
+      // operator[] assignment
+      void sort_unique() {
+        std::stable_sort(m_entries.begin(), m_entries.end(),
+                         [](const value_type& a, const value_type& b) { return Less{}(a.first, b.first); });
+        auto out = m_entries.begin();
+        for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+          const auto next = std::next(it);
+          if (next != m_entries.end() && !Less{}(it->first, next->first)) {
+            continue; // a later duplicate overrides this one
+          }
+          if (out != it) {
+            *out = std::move(*it);
+          }
+          ++out;
+        }
+        m_entries.erase(out, m_entries.end());
+      }
+
+    private:
+      iterator lowerBound(const K& key) {
+        // snapshots are built and decoded in key order, so check the append case first
+        if (m_entries.empty() || Less{}(m_entries.back().first, key)) {
+          return m_entries.end();
+        }
+        return std::lower_bound(m_entries.begin(), m_entries.end(), key,
+                                [](const value_type& e, const K& k) { return Less{}(e.first, k); });
+      }
+
+      container_type m_entries;
+  };
+
+} // namespace game_engine
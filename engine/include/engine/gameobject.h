@@ -9,6 +9,9 @@ enum class PlayerState: std::uint32_t {
   idle, running, jumping, swingWeapon, ultimate, hurt, dead
 };
 
+template <>
+struct net::enum_range<PlayerState> { static constexpr PlayerState last = PlayerState::dead; };
+
 enum class PlayerSwingStage: std::uint32_t {
   None,
   Attack1,
@@ -19,10 +22,16 @@ enum class BulletState: std::uint32_t {
   moving, colliding, inactive
 };
 
+template <>
+struct net::enum_range<BulletState> { static constexpr BulletState last = BulletState::inactive; };
+
 enum class EnemyState: std::uint32_t {
   idle, hurt, dead, attack
 };
 
+template <>
+struct net::enum_range<EnemyState> { static constexpr EnemyState last = EnemyState::attack; };
+
 enum class PresentationVariant : std::uint32_t {
   Idle,
   Run,
@@ -42,11 +51,17 @@ enum class PresentationVariant : std::uint32_t {
   ProjectileHit,
 };
 
+template <>
+struct net::enum_range<PresentationVariant> { static constexpr PresentationVariant last = PresentationVariant::ProjectileHit; };
+
 enum class HitStopStrength : uint8_t {
   Normal,
   Heavy,
 };
 
+template <>
+struct net::enum_range<HitStopStrength> { static constexpr HitStopStrength last = HitStopStrength::Heavy; };
+
 struct PlayerData {
   PlayerState state;
   Timer damageTimer;
@@ -149,6 +164,9 @@ enum class ObjectClass : std::uint32_t
   Player, Level, Portal, Background, Enemy, Projectile
 };
 
+template <>
+struct net::enum_range<ObjectClass> { static constexpr ObjectClass last = ObjectClass::Projectile; };
+
 // define all objects in the game
 struct GameObject {
   uint32_t id = 0;
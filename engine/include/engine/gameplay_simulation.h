@@ -28,6 +28,9 @@ struct GameplaySimulationHooks {
   std::function<void(GameObjectKey, GameObjectKey, HitStopStrength)> onHitConfirmed;
   bool cullProjectilesByViewport = false;
   SDL_FRect projectileViewport{};
+  // client-side prediction: the player moves as usual but anything that would change other objects
+  // (spawning bullets, damaging enemies) is left to the server
+  bool predictionOnly = false;
 };
 
 float hitStopDurationSeconds(HitStopStrength strength);
@@ -40,4 +43,19 @@ void stepGameplaySimulation(
   float deltaTime,
   const GameplaySimulationHooks& hooks = {});
 
+// advances only the given player (which must live in state.layers) by one input, colliding against
+// whatever else is in state. used by clients to predict their own player ahead of the server.
+void stepPredictedPlayer(
+  GameState& state,
+  GameObject& player,
+  const NetGameInput& input,
+  float deltaTime);
+// same, with a caller-owned input map that keeps its node between steps (replays step many times)
+void stepPredictedPlayer(
+  GameState& state,
+  GameObject& player,
+  const NetGameInput& input,
+  float deltaTime,
+  std::unordered_map<uint32_t, NetGameInput>& scratchInputs);
+
 } // namespace game_engine
@@ -11,6 +11,16 @@ enum class LevelIndex: std::uint32_t  {
   LEVEL_3,
 };
 
+// the last value of each enum that goes over the wire or into a save; decoding rejects anything past it
+// (see net/net_message.h). keep these next to the enums so a new value moves the range with it
+namespace net {
+  template <typename E>
+  struct enum_range;
+}
+
+template <>
+struct net::enum_range<LevelIndex> { static constexpr LevelIndex last = LevelIndex::LEVEL_3; };
+
 const int ANIM_IDLE = 0;
 const int ANIM_RUN = 1;
 const int ANIM_SLIDE = 2;
@@ -29,6 +39,9 @@ enum class SpriteType: std::uint32_t {
   Player_Knight, Player_Mage, Minotaur_1, Skeleton_Warrior, Red_Werewolf, Player_Marie, Skeleton_Pikeman, Player_Bonkfather
 };
 
+template <>
+struct net::enum_range<SpriteType> { static constexpr SpriteType last = SpriteType::Player_Bonkfather; };
+
 struct SpriteAssetPaths {
   std::string idleTex; // need to store frame count and length for animation here too
   std::string walkTex;
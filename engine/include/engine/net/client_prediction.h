@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+
+#include "engine/net/game_net_common.h"
+
+namespace game_engine {
+
+struct GameState;
+
+struct PredictionTuning {
+  static constexpr float stepSeconds = 1.0f / 60.0f; // one input is one server tick
+  static constexpr size_t maxPendingInputs = 120;    // ~2s of unacked input before we stop keeping history
+  static constexpr float positionTolerance = 2.0f;
+  static constexpr float velocityTolerance = 10.0f;
+  static constexpr float maxSmoothedCorrection = 64.0f; // anything bigger is a teleport, just snap
+  static constexpr float correctionDecayPerSecond = 15.0f;
+};
+
+enum class PredictionResult : uint8_t {
+  Stale,     // snapshot tick already handled
+  Unacked,   // newer snapshot, but no newer input acked: nothing to check the prediction against
+  Confirmed, // server agrees with what we predicted for the acked input
+  Rewind,    // reset the player to the server state and replay the unacked inputs
+};
+
+// ClientPrediction runs the local player ahead of the server. every input sent is stepped locally
+// straight away and kept until the server acks it (NetGameObjectSnapshot::ackedInputSeq). when a
+// snapshot comes in, what the server got for the acked input is checked against what we predicted
+// for it; on a mismatch the player is put back to the server state and the unacked inputs replayed.
+// main thread only.
+class ClientPrediction {
+public:
+  void recordInput(const NetGameInput& input);
+
+  // steps player once for every recorded input that hasnt been predicted yet
+  void predictPending(GameState& state, GameObject& player);
+
+  // drops acked inputs and compares the server's player against our prediction for the acked one
+  PredictionResult acknowledge(uint64_t serverTick, const NetGameObjectSnapshot& serverPlayer);
+
+  // player already holds the server state; put back the PlayerData the server doesnt replicate
+  // (timers, swing stage, ...) from our prediction at the acked input
+  void rewind(GameObject& player) const;
+
+  // re-steps every unacked input on top of the rewound player
+  void replay(GameState& state, GameObject& player);
+
+  // offset from the new predicted position to where the player was being drawn; decays to zero
+  void startCorrection(glm::vec2 offset);
+  void decayCorrection(float deltaTime);
+  glm::vec2 correctionOffset() const {
+    return m_correction;
+  }
+
+  void reset();
+
+  uint32_t lastAckedSeq() const {
+    return m_lastAckedSeq;
+  }
+
+  size_t pendingCount() const {
+    return m_pending.size();
+  }
+
+  uint64_t mispredictions() const {
+    return m_mispredictions;
+  }
+
+private:
+  struct PendingInput {
+    NetGameInput input;
+    bool predicted = false;
+    // player state right after input was applied
+    glm::vec2 position{0.0f, 0.0f};
+    glm::vec2 velocity{0.0f, 0.0f};
+    bool grounded = false;
+    PlayerData player;
+  };
+
+  void predictOne(GameState& state, GameObject& player, PendingInput& pending);
+
+  std::deque<PendingInput> m_pending;
+  std::unordered_map<uint32_t, NetGameInput> m_stepInputs; // reused by every predicted step
+  PendingInput m_acked; // prediction for the newest acked input, kept for rewind()
+  bool m_hasAcked = false;
+  uint64_t m_lastServerTick = 0;
+  uint32_t m_lastAckedSeq = 0;
+  uint64_t m_mispredictions = 0;
+  glm::vec2 m_correction{0.0f, 0.0f};
+};
+
+} // namespace game_engine
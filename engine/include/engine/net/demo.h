@@ -0,0 +1,161 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <thread>
+#include <vector>
+
+#include "net/net_lockfree_queue.h"
+
+namespace game_engine {
+
+// demo files are an append-only log of what went over the wire for one player (client side) or one room
+// (server side), for bug reports and as a replayable benchmark workload:
+//
+//   header   u32 magic "GDEM", u16 version, u32 playerID (0 from a server), u32 roomID,
+//            u32 keyframe interval in ticks
+//   record   u8 kind, u64 tick, u32 ms since recording started, u32 body size, body
+//   trailer  u64 offset of the last Index record, u32 magic "GDEI" (only after a clean close)
+//
+// Snapshot bodies are Game_Snapshot bodies as they are after inflating, Input bodies are Game_PlayerInput
+// packets. every snapshot is a full state, so any of them can start a replay; the writer puts one every
+// keyframe interval into the index. an Index record (u64 offset of the previous Index record or 0, u32
+// count, count x {u64 tick, u64 offset}) goes out every kIndexBlockEntries keyframes, so a player walks
+// the chain back from the trailer and never has to scan the records. a demo cut short by a crash has no
+// trailer and gets its index rebuilt by one scan on open.
+enum class DemoRecordKind : uint8_t {
+  Snapshot = 1,
+  Input = 2,
+  Index = 3,
+};
+
+struct DemoKeyframe {
+  uint64_t tick = 0;
+  uint64_t offset = 0; // of a Snapshot record
+};
+
+// a record inside the mapped file; data is valid until the reader is closed
+struct DemoRecordView {
+  DemoRecordKind kind = DemoRecordKind::Snapshot;
+  uint64_t tick = 0;
+  uint32_t timeMs = 0;
+  const uint8_t* data = nullptr;
+  uint32_t size = 0;
+  uint64_t offset = 0;
+  uint64_t nextOffset = 0;
+};
+
+inline constexpr uint32_t kDemoMagic = 0x4D454447;        // "GDEM"
+inline constexpr uint32_t kDemoTrailerMagic = 0x49454447; // "GDEI"
+inline constexpr uint16_t kDemoVersion = 1;
+inline constexpr size_t kDemoHeaderSize = 4 + 2 + 4 + 4 + 4;
+inline constexpr size_t kDemoRecordHeaderSize = 1 + 8 + 4 + 4;
+inline constexpr size_t kDemoTrailerSize = 8 + 4;
+
+// the game thread (or the server's loop and encode threads) hand records over through a lock-free
+// queue; one background thread owns the file, batches records into large writes and keeps the index.
+// recording never blocks the caller: if the writer falls a whole queue behind, records are dropped
+// and counted.
+class DemoWriter {
+public:
+  static constexpr uint64_t kDefaultKeyframeInterval = 60;
+  static constexpr size_t kIndexBlockEntries = 64;
+
+  DemoWriter() = default;
+  ~DemoWriter();
+  DemoWriter(const DemoWriter&) = delete;
+  DemoWriter& operator=(const DemoWriter&) = delete;
+
+  bool open(const std::filesystem::path& path, uint32_t playerID, uint32_t roomID,
+            uint64_t keyframeInterval = kDefaultKeyframeInterval);
+  // drains the queue, writes the last index block and the trailer
+  void close();
+  bool isOpen() const { return m_running.load(std::memory_order_acquire); }
+
+  // any thread; copies the body
+  void recordSnapshot(uint64_t tick, const std::vector<uint8_t>& body);
+  void recordInput(uint64_t tick, const std::vector<uint8_t>& body);
+
+  uint64_t droppedRecords() const { return m_nDropped.load(std::memory_order_relaxed); }
+
+private:
+  struct PendingRecord {
+    DemoRecordKind kind = DemoRecordKind::Snapshot;
+    uint64_t tick = 0;
+    uint32_t timeMs = 0;
+    std::vector<uint8_t> body;
+  };
+
+  void push(DemoRecordKind kind, uint64_t tick, const std::vector<uint8_t>& body);
+  void writerLoop();
+  void appendRecord(DemoRecordKind kind, uint64_t tick, uint32_t timeMs, const uint8_t* data, uint32_t size);
+  void appendIndexBlock();
+  void flushBatch();
+
+  net::mpsc_queue<PendingRecord> m_queue{4096};
+  std::thread m_writerThd;
+  std::atomic<bool> m_running{false};
+  std::atomic<uint64_t> m_nDropped{0};
+  std::chrono::steady_clock::time_point m_tStart{};
+
+  // writer thread only (and open/close)
+  std::FILE* m_file = nullptr;
+  std::vector<PendingRecord> m_vDrained;
+  std::vector<uint8_t> m_vBatch;
+  std::vector<DemoKeyframe> m_vPendingKeyframes;
+  uint64_t m_nFileOffset = 0;
+  uint64_t m_nLastIndexOffset = 0;
+  uint64_t m_nKeyframeInterval = kDefaultKeyframeInterval;
+  uint64_t m_nNextKeyframeTick = 0;
+  bool m_bHaveKeyframe = false;
+};
+
+// maps a demo read-only. seeking to a tick is a binary search over the keyframe index and then a walk
+// over at most one keyframe interval of records.
+class DemoReader {
+public:
+  DemoReader() = default;
+  ~DemoReader();
+  DemoReader(const DemoReader&) = delete;
+  DemoReader& operator=(const DemoReader&) = delete;
+
+  bool open(const std::filesystem::path& path);
+  void close();
+  bool isOpen() const { return m_data != nullptr; }
+
+  uint32_t playerID() const { return m_playerID; }
+  uint32_t roomID() const { return m_roomID; }
+  // false when the file had no trailer (recording was cut short) and the index was rebuilt by a scan
+  bool hadIndex() const { return m_hadIndex; }
+  const std::vector<DemoKeyframe>& keyframes() const { return m_vKeyframes; }
+
+  uint64_t firstOffset() const { return kDemoHeaderSize; }
+  // false at the end of the records or on a truncated one
+  bool readRecord(uint64_t offset, DemoRecordView& out) const;
+  // Snapshot or Input record at or after offset, skipping index blocks
+  bool nextPayload(uint64_t offset, DemoRecordView& out) const;
+
+  // offset to replay from to reach tick: the last keyframe at or before it (or the first record)
+  uint64_t seekOffset(uint64_t tick) const;
+  // newest snapshot at or before tick; false if the demo starts after it
+  bool findSnapshot(uint64_t tick, DemoRecordView& out) const;
+
+private:
+  bool loadIndex();
+  void rebuildIndex();
+
+  const uint8_t* m_data = nullptr;
+  size_t m_size = 0;
+  size_t m_recordsEnd = 0;
+  bool m_mapped = false;
+  std::vector<uint8_t> m_vFallback; // file contents when it could not be mapped
+  uint32_t m_playerID = 0;
+  uint32_t m_roomID = 0;
+  bool m_hadIndex = false;
+  std::vector<DemoKeyframe> m_vKeyframes;
+};
+
+} // namespace game_engine
@@ -1,13 +1,26 @@
 #pragma once
 
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <string>
+
+#include "engine/net/client_prediction.h"
+#include "engine/net/demo.h"
 #include "engine/net/game_net_common.h"
+#include "engine/net/snapshot_interpolation.h"
 #include "net/net_client.h"
 
 namespace game_engine {
 
 class GameClient : public net::client_interface<GameMsgHeaders> {
 public:
-  GameClient() = default;
+  GameClient() {
+    SetPingMessage(GameMsgHeaders::Server_GetPing);
+    SetUnreliableMessage(GameMsgHeaders::Game_Snapshot);
+    SetUnreliableMessage(GameMsgHeaders::Game_PlayerInput);
+  }
   ~GameClient() = default;
 
   bool IsClientValidated() const {
@@ -22,6 +35,10 @@ public:
     return m_playerID;
   }
 
+  uint32_t GetRoomID() const {
+    return m_roomID;
+  }
+
   bool NeedsFullRebuild() const {
     return m_needsFullRebuild;
   }
@@ -34,32 +51,106 @@ public:
     return m_respawnRequested;
   }
 
+  // also pings the server once a second, which is where GetStats()'s rtt and jitter come from.
+  // while a demo is playing the snapshots come from the demo instead of the connection
   void ProcessServerMessages() {
+    if (m_demoReader) {
+      ProcessDemoPlayback();
+      return;
+    }
     if (!IsConnected()) {
       return;
     }
 
+    const double receivedAt = secondsNow();
+    // nothing may go out before the server has accepted the handshake, or it reads the message as the reply
+    if (m_isClientValidated && receivedAt - m_lastPingAt >= kPingIntervalSeconds) {
+      m_lastPingAt = receivedAt;
+      SendPing();
+    }
+
     bool haveNewSnapshot = false;
+    uint64_t snapshotsInBatch = 0;
     NetGameStateSnapshot newestSnapshot;
     uint64_t newestTick = m_latestServerTickReceived;
 
-    while (!Incoming().empty()) {
-      auto msg = Incoming().pop_front().msg;
+    m_vIncomingBatch.clear();
+    Incoming().pop_all(m_vIncomingBatch);
+    for (auto& owned : m_vIncomingBatch) {
+      auto& msg = owned.msg;
 
       switch (msg.header.id) {
         case GameMsgHeaders::Client_Accepted: {
           m_isClientValidated = true;
+          if (m_resumePending) {
+            net::message<GameMsgHeaders> resume;
+            resume.header.id = GameMsgHeaders::Client_ResumeSession;
+            net::ByteWriter writer;
+            writer.write_u64(m_sessionToken);
+            writer.write_u64(m_latestServerTickReceived);
+            resume.body = std::move(writer.buff);
+            resume.header.bodySize = resume.body.size();
+            Send(resume);
+          }
           break;
         }
         case GameMsgHeaders::Client_AssignID: {
           net::ByteReader reader(msg.body);
           m_playerID = reader.read_u32();
+          m_roomID = reader.i < reader.n ? reader.read_u32() : kDefaultRoomID;
+          if (reader.i < reader.n) {
+            m_sessionToken = reader.read_u64();
+            m_resumeGraceSeconds = reader.read_u32() / 1000.0;
+          }
           m_isRegistered = true;
+          m_resumePending = false;
+          if (!m_demoRecordPath.empty() && !m_demoWriter && !StartDemoRecording(m_demoRecordPath)) {
+            std::cout << "failed to record demo to " << m_demoRecordPath << std::endl;
+            m_demoRecordPath.clear();
+          }
           break;
         }
         case GameMsgHeaders::Game_Snapshot: {
           NetGameStateSnapshot latestSnapshot;
           latestSnapshot.deserealizeNetGameStateSnapshot(msg.body);
+          if (m_demoWriter) {
+            m_demoWriter->recordSnapshot(latestSnapshot.serverTick, msg.body);
+          }
+          m_interpolator.push(latestSnapshot, receivedAt); // every snapshot, not just the newest
+          ++snapshotsInBatch;
+          if (latestSnapshot.serverTick >= newestTick) {
+            newestTick = latestSnapshot.serverTick;
+            newestSnapshot = std::move(latestSnapshot);
+            haveNewSnapshot = true;
+          }
+          break;
+        }
+        case GameMsgHeaders::Client_ResumeRejected: {
+          // the server let the player go; join again from scratch
+          m_resumePending = false;
+          m_sessionToken = 0;
+          m_isRegistered = false;
+          m_prediction.reset();
+          m_inputHistory.clear();
+          ClearLatestSnapshot();
+          break;
+        }
+        case GameMsgHeaders::Game_SnapshotDelta: {
+          NetGameStateSnapshot latestSnapshot;
+          {
+            std::scoped_lock lock(m_gameStateMu);
+            latestSnapshot = m_latestSnapshot;
+          }
+          try {
+            latestSnapshot.applyNetGameStateDelta(latestSnapshot, msg.body.data(), msg.body.size());
+          } catch (const std::exception&) {
+            break; // a newer snapshot got here first and replaced the base; it already has everything
+          }
+          if (m_demoWriter) {
+            m_demoWriter->recordSnapshot(latestSnapshot.serverTick, latestSnapshot.serealizeNetGameStateSnapshot());
+          }
+          m_interpolator.push(latestSnapshot, receivedAt);
+          ++snapshotsInBatch;
           if (latestSnapshot.serverTick >= newestTick) {
             newestTick = latestSnapshot.serverTick;
             newestSnapshot = std::move(latestSnapshot);
@@ -77,24 +168,20 @@ public:
         default:
           break;
       }
+      Recycle(msg);
+    }
+
+    if (snapshotsInBatch > 1) {
+      // only the newest of a batch gets applied; the rest were superseded while queued
+      m_connection->CountSupersededSnapshots(snapshotsInBatch - (haveNewSnapshot ? 1 : 0));
     }
 
     if (haveNewSnapshot) {
-      std::scoped_lock lock(m_gameStateMu);
-      if (!m_hasSnapshot || newestSnapshot.serverTick >= m_latestSnapshot.serverTick) {
-        m_latestSnapshot = std::move(newestSnapshot);
-        m_hasSnapshot = true;
-        m_latestServerTickReceived = m_latestSnapshot.serverTick; // TODO why is this not newestSnapshot.serverTick
-        auto it = m_latestSnapshot.m_gameObjects.find({ObjectClass::Player, m_playerID});
-        if (it != m_latestSnapshot.m_gameObjects.end() &&
-            it->second.data.player.state != PlayerState::dead) {
-          m_respawnRequested = false;
-        }
-      }
+      AcceptSnapshot(std::move(newestSnapshot));
     }
   }
 
-  void RegisterWithServer(SpriteType spriteType) {
+  void RegisterWithServer(SpriteType spriteType, uint32_t roomID = kDefaultRoomID) {
     if (!IsClientValidated() || m_isRegistered) {
       return;
     }
@@ -103,21 +190,56 @@ public:
     msg.header.id = GameMsgHeaders::Client_RegisterWithServer;
     net::ByteWriter writer;
     writer.write_enum(spriteType);
+    writer.write_u32(roomID);
     msg.body = std::move(writer.buff);
     msg.header.bodySize = msg.body.size();
     Send(msg);
   }
 
   void SendInput(const NetGameInput& input) {
-    if (!IsConnected() || !m_isRegistered) {
+    if (!IsConnected() || !m_isRegistered || m_resumePending) {
       return;
     }
 
+    // resend everything the server hasnt acked yet alongside the new input (bounded), so one lost or
+    // late packet doesnt drop a press; the server skips seqs it already has
+    m_inputHistory.push_back(input);
+    while (m_inputHistory.size() > NetInputPacket::kMaxFrames ||
+           (m_inputHistory.size() > 1 && m_inputHistory.front().inputSeq <= m_prediction.lastAckedSeq())) {
+      m_inputHistory.pop_front();
+    }
+
+    m_inputPacket.frames.assign(m_inputHistory.begin(), m_inputHistory.end());
     net::message<GameMsgHeaders> msg;
     msg.header.id = GameMsgHeaders::Game_PlayerInput;
-    msg.body = input.serealizeNetGameInput();
+    msg.body = m_inputPacket.serealizeNetInputPacket();
     msg.header.bodySize = msg.body.size();
+    if (m_demoWriter) {
+      m_demoWriter->recordInput(m_latestServerTickReceived, msg.body);
+    }
     Send(msg);
+    m_prediction.recordInput(input);
+  }
+
+  // call once per frame before sampling remote entity positions
+  void BeginInterpolationFrame() {
+    m_interpolator.beginFrame(secondsNow());
+  }
+
+  SnapshotInterpolator& Interpolation() {
+    return m_interpolator;
+  }
+
+  const SnapshotInterpolator& Interpolation() const {
+    return m_interpolator;
+  }
+
+  ClientPrediction& Prediction() {
+    return m_prediction;
+  }
+
+  const ClientPrediction& Prediction() const {
+    return m_prediction;
   }
 
   void UnregisterFromServer() {
@@ -131,11 +253,47 @@ public:
 
     m_isRegistered = false;
     m_isClientValidated = false;
+    m_resumePending = false;
+    m_sessionToken = 0;
     m_playerID = 0;
+    m_roomID = kDefaultRoomID;
     m_respawnRequested = false;
+    m_prediction.reset();
+    m_inputHistory.clear();
     ClearLatestSnapshot();
   }
 
+  // call while the connection is down. reconnects (at most every kResumeRetrySeconds) and asks the server
+  // for the same player back, keeping the world, prediction and unacked inputs as they are, so play picks
+  // up from a delta instead of a rebuild. false once there is nothing to resume: no session, or its grace
+  // period has run out
+  bool ResumeSession(const std::string& host, uint16_t port) {
+    const double now = secondsNow();
+    if (m_sessionToken == 0) {
+      return false;
+    }
+    if (!m_resumePending) {
+      m_resumePending = true;
+      m_resumeDeadline = now + m_resumeGraceSeconds;
+      m_lastResumeAttemptAt = 0.0;
+    }
+    if (now > m_resumeDeadline) {
+      m_resumePending = false;
+      m_sessionToken = 0;
+      return false;
+    }
+    if (now - m_lastResumeAttemptAt >= kResumeRetrySeconds) {
+      m_lastResumeAttemptAt = now;
+      m_isClientValidated = false;
+      Connect(host, port);
+    }
+    return true;
+  }
+
+  bool IsResumingSession() const {
+    return m_resumePending;
+  }
+
   bool CopyLatestSnapshot(NetGameStateSnapshot& out) const {
     std::scoped_lock lock(m_gameStateMu);
     if (!m_hasSnapshot) {
@@ -150,6 +308,7 @@ public:
     m_latestSnapshot = NetGameStateSnapshot{};
     m_hasSnapshot = false;
     m_needsFullRebuild = true;
+    m_interpolator.clear();
   }
 
   void RequestRespawn() {
@@ -163,16 +322,161 @@ public:
     ClearLatestSnapshot();
   }
 
+  // records every snapshot received and every input packet sent until StopDemoRecording (or the
+  // client goes away). the demo is tagged with the current player and room, so start it once registered
+  bool StartDemoRecording(const std::filesystem::path& path) {
+    auto writer = std::make_unique<DemoWriter>();
+    if (!writer->open(path, m_playerID, m_roomID)) {
+      return false;
+    }
+    m_demoWriter = std::move(writer);
+    return true;
+  }
+
+  void StopDemoRecording() {
+    m_demoWriter.reset();
+  }
+
+  bool IsRecordingDemo() const {
+    return m_demoWriter != nullptr;
+  }
+
+  // replays a demo through the same latest-snapshot / interpolation path the network feeds, as the
+  // player it was recorded for. speed scales the recorded timing; 0 pauses
+  bool StartDemoPlayback(const std::filesystem::path& path, double speed = 1.0) {
+    auto reader = std::make_unique<DemoReader>();
+    if (!reader->open(path)) {
+      return false;
+    }
+    ClearLatestSnapshot();
+    m_demoReader = std::move(reader);
+    m_playerID = m_demoReader->playerID();
+    m_roomID = m_demoReader->roomID();
+    m_demoCursor = m_demoReader->firstOffset();
+    m_demoClockMs = 0.0;
+    m_demoSpeed = speed;
+    m_lastDemoAdvanceAt = secondsNow();
+    return true;
+  }
+
+  void StopDemoPlayback() {
+    m_demoReader.reset();
+    ClearLatestSnapshot();
+  }
+
+  bool IsPlayingDemo() const {
+    return m_demoReader != nullptr;
+  }
+
+  void SetDemoSpeed(double speed) {
+    m_demoSpeed = speed;
+  }
+
+  // shows the newest snapshot at or before tick straight away; playback carries on from there
+  bool SeekDemo(uint64_t tick) {
+    DemoRecordView record;
+    if (!m_demoReader || !m_demoReader->findSnapshot(tick, record)) {
+      return false;
+    }
+    NetGameStateSnapshot snapshot;
+    try {
+      snapshot.deserealizeNetGameStateSnapshot(record.data, record.size);
+    } catch (const std::exception&) {
+      return false;
+    }
+    ClearLatestSnapshot();
+    m_demoCursor = record.nextOffset;
+    m_demoClockMs = record.timeMs;
+    m_lastDemoAdvanceAt = secondsNow();
+    m_interpolator.push(snapshot, m_lastDemoAdvanceAt);
+    AcceptSnapshot(std::move(snapshot));
+    return true;
+  }
+
 private:
+  static double secondsNow() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  void AcceptSnapshot(NetGameStateSnapshot&& snapshot) {
+    std::scoped_lock lock(m_gameStateMu);
+    if (!m_hasSnapshot || snapshot.serverTick >= m_latestSnapshot.serverTick) {
+      m_latestSnapshot = std::move(snapshot);
+      m_hasSnapshot = true;
+      m_latestServerTickReceived = m_latestSnapshot.serverTick; // TODO why is this not newestSnapshot.serverTick
+      auto it = m_latestSnapshot.m_gameObjects.find({ObjectClass::Player, m_playerID});
+      if (it != m_latestSnapshot.m_gameObjects.end() &&
+          it->second.data.player.state != PlayerState::dead) {
+        m_respawnRequested = false;
+      }
+    }
+  }
+
+  // hands over every demo snapshot whose recorded arrival time the playback clock has passed.
+  // recorded inputs are only there for inspection; the snapshots already carry their effect
+  void ProcessDemoPlayback() {
+    const double now = secondsNow();
+    m_demoClockMs += (now - m_lastDemoAdvanceAt) * 1000.0 * m_demoSpeed;
+    m_lastDemoAdvanceAt = now;
+
+    bool haveNewSnapshot = false;
+    NetGameStateSnapshot newestSnapshot;
+    DemoRecordView record;
+    while (m_demoReader->nextPayload(m_demoCursor, record) && record.timeMs <= m_demoClockMs) {
+      m_demoCursor = record.nextOffset;
+      if (record.kind != DemoRecordKind::Snapshot) {
+        continue;
+      }
+      NetGameStateSnapshot snapshot;
+      try {
+        snapshot.deserealizeNetGameStateSnapshot(record.data, record.size);
+      } catch (const std::exception&) {
+        continue; // a damaged record in a bug report shouldnt end the replay
+      }
+      m_interpolator.push(snapshot, now);
+      newestSnapshot = std::move(snapshot);
+      haveNewSnapshot = true;
+    }
+
+    if (haveNewSnapshot) {
+      AcceptSnapshot(std::move(newestSnapshot));
+    }
+  }
+
+  std::vector<net::owned_message<GameMsgHeaders>> m_vIncomingBatch; // reused drain buffer
+  ClientPrediction m_prediction;
+  std::deque<NetGameInput> m_inputHistory; // sent inputs not yet known to be acked, oldest first
+  NetInputPacket m_inputPacket;
+  SnapshotInterpolator m_interpolator;
   mutable std::mutex m_gameStateMu;
   NetGameStateSnapshot m_latestSnapshot;
   uint32_t m_playerID = 0;
+  uint32_t m_roomID = kDefaultRoomID;
   bool m_isClientValidated = false;
   bool m_isRegistered = false;
   bool m_hasSnapshot = false;
   bool m_respawnRequested = false;
   bool m_needsFullRebuild = true;
   uint64_t m_latestServerTickReceived = 0;
+  static constexpr double kPingIntervalSeconds = 1.0;
+  double m_lastPingAt = 0.0;
+  uint64_t m_sessionToken = 0; // 0 = the server doesnt keep sessions
+  double m_resumeGraceSeconds = 0.0;
+  bool m_resumePending = false;
+  double m_resumeDeadline = 0.0;
+  static constexpr double kResumeRetrySeconds = 1.0;
+  double m_lastResumeAttemptAt = 0.0;
+  // GAME_DEMO_RECORD=<file> records every session from registration on, for bug reports
+  std::string m_demoRecordPath = [] {
+    const char* path = std::getenv("GAME_DEMO_RECORD");
+    return std::string(path ? path : "");
+  }();
+  std::unique_ptr<DemoWriter> m_demoWriter;
+  std::unique_ptr<DemoReader> m_demoReader;
+  uint64_t m_demoCursor = 0;
+  double m_demoClockMs = 0.0;
+  double m_demoSpeed = 1.0;
+  double m_lastDemoAdvanceAt = 0.0;
 };
 
 } // namespace game_engine
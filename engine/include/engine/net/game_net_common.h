@@ -14,15 +14,18 @@
 #include <SDL3/SDL.h>
 #include <glm/glm.hpp>
 
+#include "engine/flat_map.h"
 #include "engine/gameobject.h"
 #include "net/net_message.h"
+#include "net/net_schema.h"
 
 
 
 namespace game_engine {
 
-  static constexpr std::uint16_t VERSION = 3;
+  static constexpr std::uint16_t VERSION = 4;
   static constexpr std::uint16_t MSG_SNAPSHOT = 1;
+  static constexpr std::uint16_t MSG_SNAPSHOT_DELTA = 2;
 
   // use std::ByteWriter, ByteReader to write and read GameStateSnapshot
   // transfer the GameStateSnapshot to the game_engines GameState during renderLoop update
@@ -41,34 +44,89 @@ namespace game_engine {
     bool ultimatePressed = false;
     bool shouldSendMessage = false; // not serialized; frame-local send hint only
 
+    using wire_fields = net::fields<
+      &NetGameInput::playerID, &NetGameInput::inputSeq, &NetGameInput::leftHeld, &NetGameInput::rightHeld,
+      &NetGameInput::fireHeld, &NetGameInput::jumpPressed, &NetGameInput::meleePressed,
+      &NetGameInput::ultimatePressed>;
+
     std::vector<uint8_t> serealizeNetGameInput() const {
       net::ByteWriter bytes;
-
-      bytes.write_u32(playerID);
-      bytes.write_u32(inputSeq);
-      bytes.write_bool(leftHeld);
-      bytes.write_bool(rightHeld);
-      bytes.write_bool(fireHeld);
-      bytes.write_bool(jumpPressed);
-      bytes.write_bool(meleePressed);
-      bytes.write_bool(ultimatePressed);
-
+      net::write_wire(bytes, *this);
       return bytes.buff;
     };
 
     void deserealizeNetGameInput(const std::vector<uint8_t>& bytes) {
-
       net::ByteReader reader(bytes);
+      net::read_wire(reader, *this);
+    };
+  };
+
+  // what the client actually sends for input: the newest frame plus the ones before it the server
+  // hasnt acked yet (up to kMaxFrames), so a late or lost packet doesnt cost a jump or melee press.
+  // inputSeqs are implicit (consecutive, ending at newestSeq) and each frame's six buttons are
+  // bit-packed, delta-coded against the frame before it:
+  //   u32 newestSeq | u8 count | oldest frame: 6 bits | each newer frame: 1 (unchanged) or 0 + 6 bits
+  // holding a direction costs ~1 bit per extra frame, so 8 frames usually fit in 7 bytes.
+  struct NetInputPacket {
+    static constexpr size_t kMaxFrames = 8;
+    static constexpr unsigned kButtonBits = 6;
+
+    std::vector<NetGameInput> frames; // oldest first, consecutive inputSeq
+
+    static uint32_t packButtons(const NetGameInput& in) {
+      return (in.leftHeld ? 1u : 0u) | (in.rightHeld ? 2u : 0u) | (in.fireHeld ? 4u : 0u) |
+             (in.jumpPressed ? 8u : 0u) | (in.meleePressed ? 16u : 0u) | (in.ultimatePressed ? 32u : 0u);
+    }
+
+    static void unpackButtons(uint32_t bits, NetGameInput& out) {
+      out.leftHeld = bits & 1u;
+      out.rightHeld = bits & 2u;
+      out.fireHeld = bits & 4u;
+      out.jumpPressed = bits & 8u;
+      out.meleePressed = bits & 16u;
+      out.ultimatePressed = bits & 32u;
+    }
+
+    std::vector<uint8_t> serealizeNetInputPacket() const {
+      net::ByteWriter bytes;
+      bytes.write_u32(frames.empty() ? 0 : frames.back().inputSeq);
+      bytes.write_u8(static_cast<uint8_t>(frames.size()));
+
+      net::BitWriter bits(bytes);
+      uint32_t prev = 0;
+      for (size_t idx = 0; idx < frames.size(); ++idx) {
+        const uint32_t curr = packButtons(frames[idx]);
+        if (idx > 0 && curr == prev) {
+          bits.write_bits(1, 1);
+        } else {
+          if (idx > 0) {
+            bits.write_bits(0, 1);
+          }
+          bits.write_bits(curr, kButtonBits);
+        }
+        prev = curr;
+      }
+      bits.flush();
 
-      playerID = reader.read_u32();
-      inputSeq = reader.read_u32();
-      leftHeld = reader.read_bool();
-      rightHeld = reader.read_bool();
-      fireHeld = reader.read_bool();
-      jumpPressed = reader.read_bool();
-      meleePressed = reader.read_bool();
-      ultimatePressed = reader.read_bool();
+      return bytes.buff;
+    };
 
+    void deserealizeNetInputPacket(const std::vector<uint8_t>& bytes) {
+      net::ByteReader reader(bytes);
+      const uint32_t newestSeq = reader.read_u32();
+      const uint8_t count = reader.read_u8();
+      if (count > kMaxFrames || count > newestSeq) throw std::runtime_error("bad input packet");
+
+      frames.assign(count, NetGameInput{});
+      net::BitReader bits(reader);
+      uint32_t prev = 0;
+      for (size_t idx = 0; idx < count; ++idx) {
+        const bool unchanged = idx > 0 && bits.read_bits(1) == 1;
+        const uint32_t curr = unchanged ? prev : bits.read_bits(kButtonBits);
+        frames[idx].inputSeq = newestSeq - static_cast<uint32_t>(count - 1 - idx);
+        unpackButtons(curr, frames[idx]);
+        prev = curr;
+      }
     };
   };
 
@@ -94,6 +152,7 @@ namespace game_engine {
     float maxSpeedX;
     bool grounded;
     bool shouldFlash;
+    uint32_t ackedInputSeq = 0; // players only: newest input of theirs the server has simulated
     // std::vector<Animation> animations; // keep this on each client
     // SDL_Texture *texture; // keep on each client
     // bool dynamic; // static property
@@ -102,8 +161,29 @@ namespace game_engine {
     // SDL_FRect collider; // if server is determining collisions, dont need to send obj to client
     // Timer flashTimer; // determined by server, sends shouldFlash
     ObjectData data; // this is a union
+
+    // written ahead of the class-specific part of data
+    using wire_fields = net::fields<
+      &NetGameObjectSnapshot::id, &NetGameObjectSnapshot::layer, &NetGameObjectSnapshot::type,
+      &NetGameObjectSnapshot::spriteType, &NetGameObjectSnapshot::position, &NetGameObjectSnapshot::velocity,
+      &NetGameObjectSnapshot::acceleration, &NetGameObjectSnapshot::spriteFrame,
+      &NetGameObjectSnapshot::currentAnimation, &NetGameObjectSnapshot::animElapsed,
+      &NetGameObjectSnapshot::animTimedOut, &NetGameObjectSnapshot::presentationVariant,
+      &NetGameObjectSnapshot::direction, &NetGameObjectSnapshot::maxSpeedX, &NetGameObjectSnapshot::grounded,
+      &NetGameObjectSnapshot::shouldFlash>;
   };
 
+  // the parts of each ObjectData member a client needs. a player's ackedInputSeq follows its PlayerData
+  using PlayerDataWire = net::schema<PlayerData, net::fields<
+    &PlayerData::state, &PlayerData::healthPoints, &PlayerData::manaPoints, &PlayerData::ultimatePoints,
+    &PlayerData::unlockedUltimateOne>>;
+  using BulletDataWire = net::schema<BulletData, net::fields<&BulletData::state>>;
+  using EnemyDataWire = net::schema<EnemyData, net::fields<
+    &EnemyData::state, &EnemyData::healthPoints, &EnemyData::srcH, &EnemyData::srcW,
+    &EnemyData::hitStopRemainingSeconds, &EnemyData::pendingKnockbackDirection,
+    &EnemyData::pendingKnockbackMagnitude, &EnemyData::hasPendingKnockback>>;
+  using LevelDataWire = net::schema<LevelData, net::fields<&LevelData::src, &LevelData::dst>>;
+
   using GameObjectKey = std::pair<ObjectClass, uint32_t>;
   struct GameObjectKeyHash {
     size_t operator()(const GameObjectKey& k) const noexcept {
@@ -122,6 +202,11 @@ namespace game_engine {
     ObjectClass victimClass = ObjectClass::Level;
     uint32_t victimId = 0;
     HitStopStrength strength = HitStopStrength::Normal;
+
+    using wire_fields = net::fields<
+      &NetHitStopEvent::sequence, &NetHitStopEvent::active, &NetHitStopEvent::attackerClass,
+      &NetHitStopEvent::attackerId, &NetHitStopEvent::victimClass, &NetHitStopEvent::victimId,
+      &NetHitStopEvent::strength>;
   };
 
   struct NetGameStateSnapshot {
@@ -129,173 +214,299 @@ namespace game_engine {
     LevelIndex levelId = LevelIndex::LEVEL_1;
     uint64_t m_stateLastUpdatedAt; // when the gameState was last updated, by local or by server msg
     NetHitStopEvent hitStopEvent;
-    std::unordered_map<GameObjectKey, NetGameObjectSnapshot, GameObjectKeyHash> m_gameObjects;
+    // sorted by (class, id), so encode/decode and the per-client filters walk it in one pass
+    FlatMap<GameObjectKey, NetGameObjectSnapshot> m_gameObjects;
     // std::vector<NetGameObjectSnapshot> m_gameObjects;
     // std::vector<NetGameObjectSnapshot> m_projectiles; // bullets
+    // everything before the object list
+    using header_fields = net::fields<
+      &NetGameStateSnapshot::serverTick, &NetGameStateSnapshot::levelId,
+      &NetGameStateSnapshot::m_stateLastUpdatedAt, &NetGameStateSnapshot::hitStopEvent>;
+    using HeaderWire = net::schema<NetGameStateSnapshot, header_fields>;
+
+    static size_t objectWireSize(const NetGameObjectSnapshot& obj) {
+      size_t size = net::schema<NetGameObjectSnapshot>::kMinSize;
+      switch (obj.type) {
+        case ObjectClass::Player: return size + PlayerDataWire::kMinSize + sizeof(uint32_t);
+        case ObjectClass::Projectile: return size + BulletDataWire::kMinSize;
+        case ObjectClass::Enemy: return size + EnemyDataWire::kMinSize;
+        case ObjectClass::Level: return size + LevelDataWire::kMinSize;
+        case ObjectClass::Portal:
+        case ObjectClass::Background: return size;
+      }
+      return size;
+    }
+
+    // exact size of serealizeNetGameStateSnapshot's output
+    size_t wireSize() const {
+      size_t size = 2 * sizeof(uint16_t) + HeaderWire::kMinSize + sizeof(uint32_t);
+      for (const auto& [key, obj] : m_gameObjects) {
+        size += objectWireSize(obj);
+      }
+      return size;
+    }
+
     std::vector<std::uint8_t> serealizeNetGameStateSnapshot() const {
 
       net::ByteWriter w;
+      w.buff.reserve(wireSize());
 
       w.write_u16(VERSION);
       w.write_u16(MSG_SNAPSHOT);
+      HeaderWire::write(w, *this);
 
-      w.write_u64(serverTick);
-      w.write_enum<LevelIndex>(levelId);
-      w.write_u64(m_stateLastUpdatedAt);
-      w.write_u32(hitStopEvent.sequence);
-      w.write_bool(hitStopEvent.active);
-      w.write_enum<ObjectClass>(hitStopEvent.attackerClass);
-      w.write_u32(hitStopEvent.attackerId);
-      w.write_enum<ObjectClass>(hitStopEvent.victimClass);
-      w.write_u32(hitStopEvent.victimId);
-      w.write_enum<HitStopStrength>(hitStopEvent.strength);
-
-      // write the unordered_map
+      // objects in key order
       w.write_u32(m_gameObjects.size());
       for (auto &[key, obj] : m_gameObjects) {
-
-          w.write_u32(obj.id); // std::pair<ObjectType, uint32_t>;
-          w.write_u32(obj.layer);
-          w.write_enum<ObjectClass>(obj.type); // std::pair<ObjectType, uint32_t>;
-          w.write_enum<SpriteType>(obj.spriteType);
-          w.write_glm_vec2(obj.position);
-          w.write_glm_vec2(obj.velocity);
-          w.write_glm_vec2(obj.acceleration);
-          w.write_u32(obj.spriteFrame);
-          w.write_u32(obj.currentAnimation);
-          w.write_float(obj.animElapsed);
-          w.write_bool(obj.animTimedOut);
-          w.write_enum<PresentationVariant>(obj.presentationVariant);
-          w.write_float(obj.direction);
-          w.write_float(obj.maxSpeedX);
-          w.write_bool(obj.grounded);
-          w.write_bool(obj.shouldFlash);
-
-
-        // for ObjectData Union
-        switch (obj.type) {
-          case ObjectClass::Player: {
-            w.write_enum<PlayerState>(obj.data.player.state);
-            w.write_u32(static_cast<uint32_t>(obj.data.player.healthPoints));
-            w.write_u32(static_cast<uint32_t>(obj.data.player.manaPoints));
-            w.write_u32(static_cast<uint32_t>(obj.data.player.ultimatePoints));
-            w.write_bool(obj.data.player.unlockedUltimateOne);
-            break;
-          }
-          case ObjectClass::Projectile: {
-            w.write_enum<BulletState>(obj.data.bullet.state);
-            break;
-          }
-          case ObjectClass::Enemy: {
-            w.write_enum<EnemyState>(obj.data.enemy.state);
-            w.write_u32(static_cast<uint32_t>(obj.data.enemy.healthPoints));
-            w.write_u32(static_cast<uint32_t>(obj.data.enemy.srcH));
-            w.write_u32(static_cast<uint32_t>(obj.data.enemy.srcW));
-            w.write_float(obj.data.enemy.hitStopRemainingSeconds);
-            w.write_float(obj.data.enemy.pendingKnockbackDirection);
-            w.write_float(obj.data.enemy.pendingKnockbackMagnitude);
-            w.write_bool(obj.data.enemy.hasPendingKnockback);
-            break;
-          }
-          case ObjectClass::Level: {
-            w.write_sdl_frect(obj.data.level.src);
-            w.write_sdl_frect(obj.data.level.dst);
-            break;
-          }
-          case ObjectClass::Portal:
-          case ObjectClass::Background: {
-            break;
-          }
-        }
+        writeObject(w, obj);
       }
 
       return w.buff;
     };
 
     void deserealizeNetGameStateSnapshot(const std::vector<uint8_t>& bytes) {
+      deserealizeNetGameStateSnapshot(bytes.data(), bytes.size());
+    }
 
-      net::ByteReader r(bytes);
+    void deserealizeNetGameStateSnapshot(const uint8_t* data, size_t size) {
+
+      net::ByteReader r(data, size);
 
       auto version = r.read_u16();
       if (version != VERSION) throw std::runtime_error("bad message version");
       auto msg_snapshot = r.read_u16();
       if (msg_snapshot != MSG_SNAPSHOT) throw std::runtime_error("not a snapshot");
-      serverTick = r.read_u64();
-      levelId = r.read_enum<LevelIndex>();
-      m_stateLastUpdatedAt = r.read_u64();
-      hitStopEvent.sequence = r.read_u32();
-      hitStopEvent.active = r.read_bool();
-      hitStopEvent.attackerClass = r.read_enum<ObjectClass>();
-      hitStopEvent.attackerId = r.read_u32();
-      hitStopEvent.victimClass = r.read_enum<ObjectClass>();
-      hitStopEvent.victimId = r.read_u32();
-      hitStopEvent.strength = r.read_enum<HitStopStrength>();
+      HeaderWire::read(r, *this);
 
       size_t length = r.read_u32(); // how many NetGameObjectSnapshot there are
+      if (length > (r.n - r.i) / net::schema<NetGameObjectSnapshot>::kMinSize) {
+        throw std::runtime_error("bad object count");
+      }
+
+      // current senders write in key order so every insert below is an append; older unsorted
+      // streams still decode, just with the occasional shift
+      m_gameObjects.clear();
+      m_gameObjects.reserve(length);
 
       for (std::uint32_t idx = 0; idx < length; idx++) {
         NetGameObjectSnapshot obj;
+        readObject(r, obj);
+        m_gameObjects.insert_or_assign({ obj.type, obj.id }, obj);
+      }
+    };
 
-        obj.id = r.read_u32(); // std::pair<ObjectType, uint32_t>;
-        obj.layer = r.read_u32();
-        obj.type = r.read_enum<ObjectClass>();
-        obj.spriteType = r.read_enum<SpriteType>();
-        obj.position = r.read_glm_vec2();
-        obj.velocity = r.read_glm_vec2();
-        obj.acceleration = r.read_glm_vec2();
-        obj.spriteFrame = r.read_u32();
-        obj.currentAnimation = r.read_u32();
-        obj.animElapsed = r.read_float();
-        obj.animTimedOut = r.read_bool();
-        obj.presentationVariant = r.read_enum<PresentationVariant>();
-        obj.direction = r.read_float();
-        obj.maxSpeedX = r.read_float();
-        obj.grounded = r.read_bool();
-        obj.shouldFlash = r.read_bool();
-
-        switch (obj.type) {
-          case ObjectClass::Player: {
-            new (&obj.data.player) PlayerData{}; // set active member
-            obj.data.player.state = r.read_enum<PlayerState>();
-            obj.data.player.healthPoints = r.read_u32();
-            obj.data.player.manaPoints = r.read_u32();
-            obj.data.player.ultimatePoints = r.read_u32();
-            obj.data.player.unlockedUltimateOne = r.read_bool();
-            break;
-          }
-          case ObjectClass::Projectile: {
-            new (&obj.data.bullet) BulletData{}; // set active member
-            obj.data.bullet.state = r.read_enum<BulletState>();
-            break;
-          }
-          case ObjectClass::Enemy: {
-            new (&obj.data.enemy) EnemyData{}; // set active member
-            obj.data.enemy.state = r.read_enum<EnemyState>();
-            obj.data.enemy.healthPoints = r.read_u32();
-            obj.data.enemy.srcH = r.read_u32();
-            obj.data.enemy.srcW = r.read_u32();
-            obj.data.enemy.hitStopRemainingSeconds = r.read_float();
-            obj.data.enemy.pendingKnockbackDirection = r.read_float();
-            obj.data.enemy.pendingKnockbackMagnitude = r.read_float();
-            obj.data.enemy.hasPendingKnockback = r.read_bool();
-            break;
-          }
-          case ObjectClass::Level: {
-            // already constructed as LevelData by default ctor; optional to reconstruct:
-            new (&obj.data.level) LevelData{};
-            obj.data.level.src = r.read_sdl_frect();
-            obj.data.level.dst = r.read_sdl_frect();
-            break;
-          }
-          case ObjectClass::Portal: // TODO
-          case ObjectClass::Background: {
-            new (&obj.data.level) LevelData{};
-            break;
+    // what changed between base and this snapshot, for a client that still holds base (one resuming a
+    // dropped session). header fields as a delta, the keys that went away, then every object that is new
+    // (in full) or changed (as a field mask over base's copy); unchanged objects aren't sent at all
+    std::vector<std::uint8_t> serealizeNetGameStateDelta(const NetGameStateSnapshot& base) const {
+      net::ByteWriter w;
+      w.write_u16(VERSION);
+      w.write_u16(MSG_SNAPSHOT_DELTA);
+      w.write_u64(base.serverTick);
+      HeaderWire::write_delta(w, base, *this);
+
+      std::vector<GameObjectKey> removed;
+      std::vector<std::pair<const NetGameObjectSnapshot*, const NetGameObjectSnapshot*>> changed; // (base or null, now)
+      auto b = base.m_gameObjects.begin();
+      auto c = m_gameObjects.begin();
+      while (b != base.m_gameObjects.end() || c != m_gameObjects.end()) {
+        if (c == m_gameObjects.end() || (b != base.m_gameObjects.end() && b->first < c->first)) {
+          removed.push_back(b->first);
+          ++b;
+        } else if (b == base.m_gameObjects.end() || c->first < b->first) {
+          changed.emplace_back(nullptr, &c->second);
+          ++c;
+        } else {
+          if (objectChanged(b->second, c->second)) {
+            changed.emplace_back(&b->second, &c->second);
           }
+          ++b;
+          ++c;
         }
-        m_gameObjects[{ obj.type, obj.id }] = obj;
       }
-    };
+
+      w.write_u32(removed.size());
+      for (const GameObjectKey& key : removed) {
+        w.write_enum(key.first);
+        w.write_u32(key.second);
+      }
+      w.write_u32(changed.size());
+      for (const auto& [was, now] : changed) {
+        w.write_u8(was ? 1 : 0);
+        if (was) {
+          w.write_enum(now->type);
+          w.write_u32(now->id);
+          writeObjectDelta(w, *was, *now);
+        } else {
+          writeObject(w, *now);
+        }
+      }
+      return w.buff;
+    }
+
+    // base must be the snapshot for the delta's base tick. it may be missing objects the sender had (a
+    // client only holds the ones near it); changes to those are skipped and arrive with the next full
+    // snapshot
+    void applyNetGameStateDelta(const NetGameStateSnapshot& base, const uint8_t* data, size_t size) {
+      net::ByteReader r(data, size);
+      if (r.read_u16() != VERSION) throw std::runtime_error("bad message version");
+      if (r.read_u16() != MSG_SNAPSHOT_DELTA) throw std::runtime_error("not a snapshot delta");
+      if (r.read_u64() != base.serverTick) throw std::runtime_error("delta against another base");
+
+      if (this != &base) {
+        *this = base;
+      }
+      HeaderWire::read_delta(r, *this, *this);
+
+      const uint32_t removedCount = r.read_u32();
+      for (uint32_t i = 0; i < removedCount; ++i) {
+        const ObjectClass objClass = r.read_enum<ObjectClass>();
+        m_gameObjects.erase({objClass, r.read_u32()});
+      }
+      const uint32_t changedCount = r.read_u32();
+      for (uint32_t i = 0; i < changedCount; ++i) {
+        if (r.read_u8() == 0) {
+          NetGameObjectSnapshot obj;
+          readObject(r, obj);
+          m_gameObjects.insert_or_assign({obj.type, obj.id}, obj);
+          continue;
+        }
+        const ObjectClass objClass = r.read_enum<ObjectClass>();
+        const uint32_t id = r.read_u32();
+        auto it = m_gameObjects.find({objClass, id});
+        if (it != m_gameObjects.end()) {
+          readObjectDelta(r, it->second);
+        } else {
+          NetGameObjectSnapshot skipped;
+          skipped.type = objClass;
+          constructData(skipped);
+          readObjectDelta(r, skipped);
+        }
+      }
+    }
+
+  private:
+    static void writeObject(net::ByteWriter& w, const NetGameObjectSnapshot& obj) {
+      net::write_wire(w, obj);
+
+      // for ObjectData Union
+      switch (obj.type) {
+        case ObjectClass::Player: {
+          PlayerDataWire::write(w, obj.data.player);
+          w.write_u32(obj.ackedInputSeq);
+          break;
+        }
+        case ObjectClass::Projectile: {
+          BulletDataWire::write(w, obj.data.bullet);
+          break;
+        }
+        case ObjectClass::Enemy: {
+          EnemyDataWire::write(w, obj.data.enemy);
+          break;
+        }
+        case ObjectClass::Level: {
+          LevelDataWire::write(w, obj.data.level);
+          break;
+        }
+        case ObjectClass::Portal:
+        case ObjectClass::Background: {
+          break;
+        }
+      }
+    }
+
+    // sets the union member obj.type uses as the active one
+    static void constructData(NetGameObjectSnapshot& obj) {
+      switch (obj.type) {
+        case ObjectClass::Player: new (&obj.data.player) PlayerData{}; break;
+        case ObjectClass::Projectile: new (&obj.data.bullet) BulletData{}; break;
+        case ObjectClass::Enemy: new (&obj.data.enemy) EnemyData{}; break;
+        case ObjectClass::Level:
+        case ObjectClass::Portal: // TODO
+        case ObjectClass::Background: new (&obj.data.level) LevelData{}; break;
+      }
+    }
+
+    static void readObject(net::ByteReader& r, NetGameObjectSnapshot& obj) {
+      net::read_wire(r, obj);
+      constructData(obj);
+      switch (obj.type) {
+        case ObjectClass::Player: {
+          PlayerDataWire::read(r, obj.data.player);
+          obj.ackedInputSeq = r.read_u32();
+          break;
+        }
+        case ObjectClass::Projectile: {
+          BulletDataWire::read(r, obj.data.bullet);
+          break;
+        }
+        case ObjectClass::Enemy: {
+          EnemyDataWire::read(r, obj.data.enemy);
+          break;
+        }
+        case ObjectClass::Level: {
+          LevelDataWire::read(r, obj.data.level);
+          break;
+        }
+        case ObjectClass::Portal:
+        case ObjectClass::Background: {
+          break;
+        }
+      }
+    }
+
+    static bool objectChanged(const NetGameObjectSnapshot& was, const NetGameObjectSnapshot& now) {
+      if (net::schema<NetGameObjectSnapshot>::diff(was, now) != 0) {
+        return true;
+      }
+      switch (now.type) {
+        case ObjectClass::Player:
+          return PlayerDataWire::diff(was.data.player, now.data.player) != 0 || was.ackedInputSeq != now.ackedInputSeq;
+        case ObjectClass::Projectile: return BulletDataWire::diff(was.data.bullet, now.data.bullet) != 0;
+        case ObjectClass::Enemy: return EnemyDataWire::diff(was.data.enemy, now.data.enemy) != 0;
+        case ObjectClass::Level: return LevelDataWire::diff(was.data.level, now.data.level) != 0;
+        case ObjectClass::Portal:
+        case ObjectClass::Background: return false;
+      }
+      return false;
+    }
+
+    static void writeObjectDelta(net::ByteWriter& w, const NetGameObjectSnapshot& was, const NetGameObjectSnapshot& now) {
+      net::schema<NetGameObjectSnapshot>::write_delta(w, was, now);
+      switch (now.type) {
+        case ObjectClass::Player: {
+          PlayerDataWire::write_delta(w, was.data.player, now.data.player);
+          w.write_u32(now.ackedInputSeq);
+          break;
+        }
+        case ObjectClass::Projectile: BulletDataWire::write_delta(w, was.data.bullet, now.data.bullet); break;
+        case ObjectClass::Enemy: EnemyDataWire::write_delta(w, was.data.enemy, now.data.enemy); break;
+        case ObjectClass::Level: LevelDataWire::write_delta(w, was.data.level, now.data.level); break;
+        case ObjectClass::Portal:
+        case ObjectClass::Background: break;
+      }
+    }
+
+    // obj holds the base copy and is updated in place; its type and id are never in the mask
+    static void readObjectDelta(net::ByteReader& r, NetGameObjectSnapshot& obj) {
+      const ObjectClass type = obj.type;
+      const uint32_t id = obj.id;
+      net::schema<NetGameObjectSnapshot>::read_delta(r, obj, obj);
+      obj.type = type;
+      obj.id = id;
+      switch (type) {
+        case ObjectClass::Player: {
+          PlayerDataWire::read_delta(r, obj.data.player, obj.data.player);
+          obj.ackedInputSeq = r.read_u32();
+          break;
+        }
+        case ObjectClass::Projectile: BulletDataWire::read_delta(r, obj.data.bullet, obj.data.bullet); break;
+        case ObjectClass::Enemy: EnemyDataWire::read_delta(r, obj.data.enemy, obj.data.enemy); break;
+        case ObjectClass::Level: LevelDataWire::read_delta(r, obj.data.level, obj.data.level); break;
+        case ObjectClass::Portal:
+        case ObjectClass::Background: break;
+      }
+    }
   };
 
 
@@ -317,7 +528,19 @@ namespace game_engine {
 
     Game_Snapshot,
     Game_PlayerInput,
-    Game_PlayerRespawnRequest
+    Game_PlayerRespawnRequest,
+
+    Client_ResumeSession,
+    Client_ResumeRejected,
+    Game_SnapshotDelta
   };
 
+  // Client_RegisterWithServer: sprite type, then the u32 room to join (a body without one joins this
+  // room). Client_AssignID: player id, then the room the server put the player in, then a u64 session
+  // token (0 = none) and the u32 grace period in ms the server keeps the player for after a drop.
+  // Client_ResumeSession: that token and the u64 tick of the newest snapshot the client still has; the
+  // server answers with Client_AssignID and a Game_SnapshotDelta from that tick (or a full Game_Snapshot),
+  // or with Client_ResumeRejected once the session is gone
+  inline constexpr uint32_t kDefaultRoomID = 0;
+
 }
@@ -1,11 +1,19 @@
 #pragma once
 
+#include "engine/net/demo.h"
 #include "engine/net/game_net_common.h"
 #include "net/net_server.h"
 
+#include <array>
+#include <atomic>
+#include <deque>
+#include <filesystem>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <optional>
+#include <random>
+#include <thread>
 
 namespace game_engine {
 
@@ -21,8 +29,12 @@ enum class PlayerSessionState : uint8_t {
 struct PlayerSession {
   SpriteType spriteType = SpriteType::Player_Marie;
   PlayerSessionState lifecycle = PlayerSessionState::connected;
-  uint32_t lastInputSeq = 0;
+  uint32_t lastInputSeq = 0; // newest input applied to the simulation (what snapshots ack)
   glm::vec2 spawnPosition{0.0f, 0.0f};
+  // received but not yet due, by inputSeq. frame seq is due on tick seq + inputTickOffset
+  std::deque<NetGameInput> pendingInputs;
+  int64_t inputTickOffset = 0;
+  bool inputAligned = false;
 };
 
 struct AuthoritativeContext {
@@ -33,41 +45,363 @@ struct AuthoritativeContext {
   explicit AuthoritativeContext(GameState&& initialState);
 };
 
-class GameServer : public net::server_interface<GameMsgHeaders> {
+// area-of-interest replication: each client is only sent entities near its own player, plus the
+// always-relevant ones (every player, and whoever is in the current hit stop). exitRadius is larger
+// than enterRadius so entities sitting on the boundary dont flicker in and out of the client's world.
+struct InterestConfig {
+  bool enabled = true;
+  float enterRadius = 720.0f;
+  float exitRadius = 840.0f;
+};
+
+// a client whose connection drops keeps its player (and room, and input history) for graceSeconds. it
+// reconnects with the session token from Client_AssignID and picks the player back up from a delta
+// against the last snapshot it has, instead of registering again and rebuilding its world.
+struct SessionResumeConfig {
+  bool enabled = true;
+  double graceSeconds = 10.0;
+};
+
+// per-client snapshot rate (AIMD). every adjustEveryTicks the server looks at the client's link: a
+// deep outbound queue, a snapshot replaced before it could be written, a high rtt, rtt climbing over
+// the lowest seen (queueing somewhere on the path) or going over the byte budget backs the interval
+// off multiplicatively; otherwise it shrinks by recoverTicks. a client
+// slower than the base rate also gets a smaller interest radius, down to minDetailScale at the
+// slowest rate, so each snapshot it does get is smaller too.
+struct SnapshotRateConfig {
+  bool enabled = true;
+  uint32_t minIntervalTicks = 2;  // fastest: 30 Hz at a 60 Hz tick
+  uint32_t maxIntervalTicks = 12; // slowest: 5 Hz
+  uint32_t adjustEveryTicks = 30;
+  double backoffFactor = 2.0;
+  double recoverTicks = 0.5;
+  size_t maxQueueDepth = 8;
+  double maxRttMs = 300.0;
+  double maxRttRiseMs = 60.0;
+  double maxBytesPerSec = 0.0; // 0 = no budget
+  float minDetailScale = 0.6f;
+};
+
+struct SnapshotRate {
+  double intervalTicks = 0.0; // 0 until the first update
+  uint64_t lastSentTick = 0;
+  uint64_t lastAdjustTick = 0;
+  uint64_t supersededSeen = 0;
+  double minRttMs = 0.0; // 0 until the first rtt sample
+  float detailScale = 1.0f;
+
+  // feeds in the client's current link stats; true if the snapshot for tick is due for this client
+  bool update(const SnapshotRateConfig& config, uint32_t baseIntervalTicks, const net::connection_stats& link,
+              uint64_t tick);
+};
+
+struct ClientInterest {
+  std::vector<GameObjectKey> relevant; // sorted; what this client was sent in the last snapshot
+  SnapshotRate rate;
+};
+
+// snapshot bodies at least threshold bytes long are lz compressed for clients that advertised
+// net::kCapCompression in their handshake
+struct CompressionConfig {
+  bool enabled = true;
+  size_t threshold = 256;
+};
+
+// when the server loop's ticks actually started, over the last reporting window (about a second).
+// lateness is measured per wakeup, from the deadline of the first tick it runs to when the loop woke.
+struct TickTimingStats {
+  uint64_t ticks = 0; // simulated, including catch-up ticks run back to back after a late wakeup
+  double meanLateMs = 0.0;
+  double maxLateMs = 0.0;
+  double intervalJitterMs = 0.0; // std deviation of the spacing between tick starts
+};
+
+// one match: an authoritative GameState, the players in it and their inputs. rooms share nothing with
+// each other, so the server loop can tick them on different workers at the same time.
+//
+// threading: the worker ticking the room and the server loop thread (joins, respawns, leaves) take
+// m_stateMu for every touch of m_authCtx / m_playerSessions (the host's main thread takes it too, when
+// resetting its level). after each tick the room publishes an immutable snapshot with an atomic pointer
+// swap. the encoder members at the bottom belong to whichever encode worker has m_encoding set.
+class GameRoom : public std::enable_shared_from_this<GameRoom> {
 public:
-  GameServer(uint16_t nPort, std::unique_ptr<AuthoritativeContext> authCtx);
+  GameRoom(uint32_t roomID, std::unique_ptr<AuthoritativeContext> authCtx);
+
+  uint32_t id() const {
+    return m_roomID;
+  }
 
   std::unordered_map<uint32_t, PlayerSession> m_playerSessions;
   std::vector<uint32_t> m_vGarbageIDs;
-  NetGameStateSnapshot m_currGameSnapshot; // extracted out of m_authCtx
-  net::tsqueue<NetGameInput> m_playerInputQueue;
+  net::mpsc_queue<NetGameInput> m_playerInputQueue{1024};
+  std::vector<NetGameInput> m_vInputBatch; // reused drain buffer for applyPlayerInputs
   std::unique_ptr<AuthoritativeContext> m_authCtx;
-  mutable std::recursive_mutex m_stateMu;
+  mutable std::mutex m_stateMu; // never held while calling out of GameRoom, and never taken twice
   mutable std::mutex m_pendingLevelTransitionMu;
   std::optional<LevelIndex> m_pendingLevelTransition;
   NetHitStopEvent m_latestHitStopEvent;
-  bool m_hitStopEventDirty = false;
   uint32_t m_nextHitStopSequence = 1;
+  std::atomic<uint32_t> m_hitStopSentSequence{0}; // newest hit stop an encoder has sent
+  std::atomic<uint32_t> m_playerCount{0};
+  std::atomic<bool> m_broadcastPending{false}; // set by OnMessage, sent on the next tick
 
-protected:
-  bool OnClientConnect(std::shared_ptr<net::connection<GameMsgHeaders>> client) override;
-  void OnClientValidated(std::shared_ptr<net::connection<GameMsgHeaders>> client) override;
-  void OnClientDisconnect(std::shared_ptr<net::connection<GameMsgHeaders>> client) override;
-  void OnMessage(std::shared_ptr<net::connection<GameMsgHeaders>> client, net::message<GameMsgHeaders>& msg) override;
+  // published by whoever ticked the room, read by the encoders and the host's main thread
+  std::atomic<std::shared_ptr<const NetGameStateSnapshot>> m_publishedSnapshot;
 
-public:
-  GameObject* findPlayerById(uint32_t playerID);
+  // encoder only. broadcasts asked for while one is being encoded collapse into one more pass
+  std::atomic<uint64_t> m_encodeRequests{0};
+  std::atomic<bool> m_encoding{false};
+  std::unordered_map<uint32_t, ClientInterest> m_clientInterest;
+  std::vector<GameObjectKey> m_vRelevantScratch;
+
+  // set while the room is being recorded; the encoder records each broadcast, OnMessage each input packet
+  std::atomic<std::shared_ptr<DemoWriter>> m_demo;
+
+  // hands every queued input to its player's jitter buffer, then applies one frame per player for the
+  // coming tick (see kInputDelayTicks)
   void applyPlayerInputs();
   void step(float deltaTime);
-  void refreshGameSnapshot();
-  void broadcastSnapshot();
+  // swaps in a fresh snapshot of the authoritative state, carrying the latest hit stop until it is sent
+  void publishSnapshot();
+  // asks the server loop to broadcast this room at the end of its next tick instead of right now, so a
+  // burst of joins / respawns costs one snapshot and clients never see a state between two ticks
+  void requestBroadcast();
+  bool takeBroadcastRequest();
   bool copyCurrentSnapshot(NetGameStateSnapshot& out) const;
+  // with resume on, the encoder keeps the last kSentSnapshotsPerPlayer snapshots each player was sent,
+  // until the player leaves the room (a dropped one stays in it for the grace period); a resuming client
+  // gets a delta from the one it has (null if that isnt among them)
+  void rememberSent(uint32_t playerID, std::shared_ptr<const NetGameStateSnapshot> snapshot);
+  std::shared_ptr<const NetGameStateSnapshot> sentSnapshotAt(uint32_t playerID, uint64_t serverTick) const;
+  uint32_t playerCount() const {
+    return m_playerCount.load(std::memory_order_relaxed);
+  }
+  LevelIndex levelId() const;
   void resetAuthoritativeState(GameState&& initialState, bool refreshSpawnPositions = false);
   bool registerPlayer(uint32_t playerID, SpriteType spriteType);
   bool respawnPlayer(uint32_t playerID);
   bool removePlayer(uint32_t playerID);
   bool HasPendingLevelTransition() const;
   std::optional<LevelIndex> ConsumePendingLevelTransition();
+
+  // the one being written, the one queued behind it and whatever the socket buffers still held when
+  // the link dropped
+  static constexpr size_t kSentSnapshotsPerPlayer = 4;
+  // clients send one input frame per tick. each player's frames are lined up with the server's ticks so
+  // the first one lands kInputDelayTicks after it arrives; that much network jitter is absorbed without
+  // a tick going by with no input. a frame that still arrives late is merged into the next tick's (its
+  // presses kept) and the player is realigned; a buffer running more than kMaxInputLeadTicks ahead (a
+  // burst after a stall, or a client clock running fast) is pulled in the same way.
+  static constexpr int64_t kInputDelayTicks = 2;
+  static constexpr int64_t kMaxInputLeadTicks = 8;
+
+private:
+  // caller holds m_stateMu
+  GameObject* findPlayerById(uint32_t playerID);
+  void publishSnapshotLocked();
+  std::shared_ptr<NetGameStateSnapshot> acquireSnapshotLocked();
+
+  const uint32_t m_roomID;
+  // snapshots are published into these and refilled once nothing else holds them, so a tick reuses the
+  // object storage of one a few ticks old instead of allocating
+  static constexpr size_t kSnapshotPoolSize = 8;
+  std::array<std::shared_ptr<NetGameStateSnapshot>, kSnapshotPoolSize> m_snapshotPool;
+  size_t m_nextPooledSnapshot = 0;
+
+  struct SentSnapshots {
+    std::array<std::shared_ptr<const NetGameStateSnapshot>, kSentSnapshotsPerPlayer> ring;
+    size_t next = 0;
+  };
+  mutable std::mutex m_historyMu; // not m_stateMu: the encoders never wait on a tick
+  std::unordered_map<uint32_t, SentSnapshots> m_sentSnapshots; // player id ->
+};
+
+// the rooms one server hosts, and which room each client is in. clients name a room when they register
+// (the default room if they dont); the default room always exists, any other is made by the factory the
+// first time someone asks for it and dropped when its last player leaves. rooms are handed out as
+// shared_ptr, so a tick or an encode that is still running keeps a dropped room alive until it's done.
+// safe from any thread.
+class RoomManager {
+public:
+  using RoomFactory = std::function<std::unique_ptr<AuthoritativeContext>(uint32_t roomID)>;
+  using RoomBuilt = std::function<void(std::shared_ptr<GameRoom>)>;
+
+  explicit RoomManager(std::unique_ptr<AuthoritativeContext> defaultRoomCtx);
+  ~RoomManager();
+
+  // set before the server starts; maxRooms counts the default room
+  void setFactory(RoomFactory factory, size_t maxRooms);
+
+  std::shared_ptr<GameRoom> defaultRoom() const {
+    return m_default;
+  }
+  std::shared_ptr<GameRoom> find(uint32_t roomID) const;
+  // null if the room doesnt exist and cant be made (no factory, at maxRooms, or the factory failed).
+  // runs the factory on the calling thread
+  std::shared_ptr<GameRoom> findOrCreate(uint32_t roomID);
+  // runs the factory on the build thread instead (it loads a level, too slow for the server loop) and
+  // hands onBuilt the room there: the new one, one that got opened meanwhile, or null if the factory
+  // failed. asking for a room that is already being built waits on that build. false, and onBuilt is
+  // never called, if there is no factory or maxRooms rooms are already open or being built
+  bool buildAsync(uint32_t roomID, RoomBuilt onBuilt);
+  // waits for the builds in flight (their onBuilt has run by the time this returns); no more after it
+  void stopBuilding();
+
+  // the room a client plays in; clients that havent registered watch the default room
+  std::shared_ptr<GameRoom> roomOf(uint32_t clientID) const;
+  std::optional<uint32_t> assignedRoom(uint32_t clientID) const;
+  void assign(uint32_t clientID, const std::shared_ptr<GameRoom>& room);
+  // forgets the client's room and returns it (the default room if it had none)
+  std::shared_ptr<GameRoom> unassign(uint32_t clientID);
+  // drops the room if it isnt the default one and nobody is in it
+  void dropIfEmpty(const std::shared_ptr<GameRoom>& room);
+  // keeps only the clients watching roomID
+  void filterClients(uint32_t roomID, std::vector<std::shared_ptr<net::connection<GameMsgHeaders>>>& clients) const;
+
+  size_t roomCount() const;
+  uint32_t playerCount() const;
+  // fn on every room, one after another on the calling thread
+  void forEach(const std::function<void(GameRoom&)>& fn) const;
+
+  // tick workers, started and stopped by the server loop. 0 workers: rooms tick on the loop thread
+  void startWorkers(size_t count);
+  void stopWorkers();
+  // fn on every room, spread over the workers and the calling thread; returns once all are done.
+  // server loop thread only
+  void forEachParallel(const std::function<void(GameRoom&)>& fn);
+
+private:
+  mutable std::mutex m_mu;
+  std::shared_ptr<GameRoom> m_default;
+  std::vector<std::shared_ptr<GameRoom>> m_rooms; // sorted by id
+  std::unordered_map<uint32_t, uint32_t> m_clientRooms;
+  RoomFactory m_factory;
+  size_t m_maxRooms = 1; // open rooms plus rooms being built
+  std::unordered_map<uint32_t, std::vector<RoomBuilt>> m_building; // room id -> whoever waits on it
+  std::unique_ptr<asio::thread_pool> m_builder;
+
+  std::unique_ptr<asio::thread_pool> m_workers;
+  std::vector<std::shared_ptr<GameRoom>> m_vTickScratch;
+};
+
+// threading: rooms are ticked by the server loop (or its tick workers, see RoomManager) and publish a
+// snapshot after every tick. a small pool of encode workers, shared by every room, turns whatever a
+// room published last into per-client messages and sends them, never touching a room's m_stateMu, so
+// a slow encode or send never holds up a tick and a tick never holds up a send. the per-client link
+// and interest state lives in the client's room and is only touched by the encoder.
+class GameServer : public net::server_interface<GameMsgHeaders> {
+public:
+  // authCtx becomes the default room
+  GameServer(uint16_t nPort, std::unique_ptr<AuthoritativeContext> authCtx, size_t encodeThreads = 1);
+  ~GameServer() override;
+
+  RoomManager m_rooms;
+  InterestConfig m_interestConfig;
+  CompressionConfig m_compressionConfig;
+  SnapshotRateConfig m_snapshotRateConfig; // set before Start; read by the loop and the encoders
+  SessionResumeConfig m_resumeConfig;
+  std::atomic<uint32_t> m_baseSnapshotInterval{3}; // ticks between snapshots for a client with no history
+
+  std::atomic<bool> m_encodersRunning{true};
+  asio::thread_pool m_encodePool;
+
+  mutable std::mutex m_clientStatsMu;
+  std::vector<std::pair<uint32_t, net::connection_stats>> m_clientStats; // refreshed by pingClients
+  TickTimingStats m_tickTiming;
+
+protected:
+  bool OnClientConnect(std::shared_ptr<net::connection<GameMsgHeaders>> client) override;
+  void OnClientValidated(std::shared_ptr<net::connection<GameMsgHeaders>> client) override;
+  void OnClientDisconnect(std::shared_ptr<net::connection<GameMsgHeaders>> client) override;
+  void OnMessage(std::shared_ptr<net::connection<GameMsgHeaders>> client, net::message<GameMsgHeaders>& msg) override;
+
+  // takes the client out of its room; true if it had a player there
+  bool leaveRoom(uint32_t clientID);
+  uint64_t openSession(const std::shared_ptr<net::connection<GameMsgHeaders>>& client, uint32_t roomID);
+  // true if the session table owns this disconnect: the player is kept for a resume, or client is a
+  // connection the session has already moved on from
+  bool suspendSession(const std::shared_ptr<net::connection<GameMsgHeaders>>& client);
+  void closeSession(uint32_t playerID);
+  void resumeSession(const std::shared_ptr<net::connection<GameMsgHeaders>>& client, uint64_t token,
+                     uint64_t lastTick);
+  void sendAssignID(const std::shared_ptr<net::connection<GameMsgHeaders>>& client, uint32_t playerID,
+                    uint32_t roomID, uint64_t token);
+  // registers the client's player in room and tells it its id; false if the room turned it down
+  bool joinRoom(const std::shared_ptr<net::connection<GameMsgHeaders>>& client, SpriteType spriteType,
+                const std::shared_ptr<GameRoom>& room);
+  void scheduleEncode(GameRoom& room);
+  void runEncoder(std::shared_ptr<GameRoom> room);
+  void encodeAndSend(GameRoom& room, const std::shared_ptr<const NetGameStateSnapshot>& published);
+
+public:
+  // one fixed step of every room: drain inputs, step, then publish, or broadcast if broadcastDue or the
+  // room asked for one. server loop thread
+  void tickRooms(float deltaTime, bool broadcastDue);
+  // publishes the room's state and has an encode worker send it to the room's clients; returns without
+  // waiting
+  void broadcastSnapshot(uint32_t roomID = kDefaultRoomID);
+  void buildClientSnapshot(GameRoom& room, uint32_t clientID, const NetGameStateSnapshot& full,
+                           NetGameStateSnapshot& out, float detailScale = 1.0f);
+  bool copyCurrentSnapshot(NetGameStateSnapshot& out, uint32_t roomID = kDefaultRoomID) const;
+  // players across every room
+  uint32_t playerCount() const {
+    return m_rooms.playerCount();
+  }
+  void resetAuthoritativeState(GameState&& initialState, bool refreshSpawnPositions = false,
+                               uint32_t roomID = kDefaultRoomID);
+  std::optional<LevelIndex> ConsumePendingLevelTransition(uint32_t roomID = kDefaultRoomID);
+  // records every full snapshot broadcast in the room and every input packet its players send
+  bool startDemoRecording(const std::filesystem::path& path, uint32_t roomID = kDefaultRoomID);
+  void stopDemoRecording(uint32_t roomID = kDefaultRoomID);
+  // pings every client and refreshes the per-client stats; server loop, about once a second
+  void pingClients();
+  std::vector<std::pair<uint32_t, net::connection_stats>> copyClientStats() const;
+  void setTickTimingStats(const TickTimingStats& stats);
+  TickTimingStats tickTimingStats() const;
+  // removes the players whose connection has been gone longer than the grace period; server loop
+  void expireSessions();
+  // puts the players waiting on a room build into their now open room; server loop
+  void attachBuiltRooms();
+
+private:
+  struct PendingJoin {
+    std::weak_ptr<net::connection<GameMsgHeaders>> client;
+    SpriteType spriteType{};
+    std::shared_ptr<GameRoom> room; // null if the build failed
+  };
+  std::mutex m_builtJoinsMu;
+  std::vector<PendingJoin> m_builtJoins; // filled on the build thread, drained by attachBuiltRooms
+
+  struct ResumableSession {
+    uint32_t playerID = 0;
+    uint32_t roomID = kDefaultRoomID;
+    std::weak_ptr<net::connection<GameMsgHeaders>> connection; // the one playing it now
+    std::optional<std::chrono::steady_clock::time_point> droppedAt;
+  };
+
+  // OnClientDisconnect can come from an encode worker, the rest from the server loop
+  std::mutex m_sessionsMu;
+  std::unordered_map<uint64_t, ResumableSession> m_sessions; // by token
+  std::unordered_map<uint32_t, uint64_t> m_sessionTokens;    // player id -> token
+  std::random_device m_tokenSource; // every token straight from the OS, not a generator an observer could predict
+};
+
+struct ServerLoopConfig {
+  double tickRate = 60.0;     // fixed simulation steps per second
+  double snapshotRate = 20.0; // snapshots per second, rounded to a whole number of ticks; with
+                              // SnapshotRateConfig enabled this is each client's starting rate
+  size_t maxInputsPerTick = 64;
+  size_t tickWorkers = 0;     // threads that tick rooms alongside the loop thread; 0 = loop thread only
 };
 
+// the fixed-timestep authoritative loop, shared by the host's server thread and the dedicated server:
+// drain inputs, step every room, publish / broadcast, ping about once a second. between ticks the thread sleeps
+// until the next tick deadline, waking early only to drain messages as they arrive. runs on the calling
+// thread until keepRunning() returns false. afterTick (optional) is called on this thread after every step.
+void runServerLoop(
+  GameServer& server,
+  const std::function<bool()>& keepRunning,
+  const ServerLoopConfig& config = {},
+  const std::function<void(uint64_t tick)>& afterTick = {});
+
 } // namespace game_engine
@@ -1,19 +1,26 @@
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <cstdint>
 #include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <asio.hpp>
 
 #include "engine/level_types.h"
 #include "net/net_message.h"
+#include "net/net_schema.h"
 
 namespace game_engine {
 
 inline constexpr uint16_t GAME_SERVER_PORT = 9000;
 inline constexpr uint16_t LAN_DISCOVERY_PORT = 9001;
+// administratively scoped (site-local) group; queries go here as well as to the broadcast address, for
+// networks that filter broadcasts
+inline constexpr const char* LAN_DISCOVERY_MULTICAST_GROUP = "239.255.74.67";
 
 struct DiscoveryRequest {
   static constexpr uint32_t MAGIC = 0x4A434C41; // "AJCL"
@@ -21,6 +28,7 @@ struct DiscoveryRequest {
 
   std::vector<uint8_t> serialize() const;
   bool deserialize(const std::vector<uint8_t>& bytes);
+  bool deserialize(const uint8_t* data, size_t size);
 };
 
 struct DiscoveryResponse {
@@ -33,8 +41,13 @@ struct DiscoveryResponse {
   uint32_t playerCount = 0;
   std::string hostName;
 
+  using wire_fields = net::fields<
+    &DiscoveryResponse::ready, &DiscoveryResponse::gamePort, &DiscoveryResponse::levelId,
+    &DiscoveryResponse::playerCount, &DiscoveryResponse::hostName>;
+
   std::vector<uint8_t> serialize() const;
   bool deserialize(const std::vector<uint8_t>& bytes);
+  bool deserialize(const uint8_t* data, size_t size);
 };
 
 struct DiscoveredSessionInfo {
@@ -46,53 +59,93 @@ struct DiscoveredSessionInfo {
   uint64_t lastSeenAtMs = 0;
 };
 
+// both services run their socket on their own io thread with async handlers; the main thread only
+// starts and stops them, hands the host its current info and reads the browser's published list.
+// with multicast on, the host also listens on LAN_DISCOVERY_MULTICAST_GROUP and the browser queries it;
+// a network without multicast routing just leaves discovery to the broadcast.
+
+// answers discovery queries while ready
 class DiscoveryHostService {
 public:
   DiscoveryHostService() = default;
   ~DiscoveryHostService();
 
-  bool start(uint16_t discoveryPort = LAN_DISCOVERY_PORT);
+  bool start(uint16_t discoveryPort = LAN_DISCOVERY_PORT, bool multicast = true);
   void stop();
-  void poll();
 
   bool isStarted() const { return m_started; }
-  void setReady(bool ready) { m_ready = ready; }
+  // main thread; cheap to call every frame, the reply is only rebuilt when something changed
+  void setReady(bool ready);
   void updateInfo(std::string hostName, LevelIndex levelId, uint32_t playerCount, uint16_t gamePort);
 
 private:
+  void publishResponse();
+  void asyncReceive();
+  // re-arms the receive after a short wait, for an error that isnt about one datagram
+  void retryReceive();
+
   asio::io_context m_context;
   std::unique_ptr<asio::ip::udp::socket> m_socket;
+  std::unique_ptr<asio::steady_timer> m_receiveRetryTimer;
+  std::thread m_ioThd;
   uint16_t m_discoveryPort = LAN_DISCOVERY_PORT;
   bool m_started = false;
+
+  // main thread
   bool m_ready = false;
-  std::string m_hostName;
-  uint16_t m_gamePort = GAME_SERVER_PORT;
-  LevelIndex m_levelId = LevelIndex::LEVEL_1;
-  uint32_t m_playerCount = 0;
+  DiscoveryResponse m_info;
+
+  // the serialized reply, null while not ready; swapped in by the main thread, sent by the io thread
+  std::atomic<std::shared_ptr<const std::vector<uint8_t>>> m_response;
+
+  // io thread
+  std::array<uint8_t, 1024> m_recvBuffer{};
+  asio::ip::udp::endpoint m_remote;
 };
 
+// queries the LAN every kQueryIntervalMs and keeps a list of the hosts that answered recently
 class DiscoveryBrowserService {
 public:
+  static constexpr uint64_t kQueryIntervalMs = 750;
+  static constexpr uint64_t kSessionExpiryMs = 2500;
+
   DiscoveryBrowserService() = default;
   ~DiscoveryBrowserService();
 
-  bool start(uint16_t discoveryPort = LAN_DISCOVERY_PORT);
+  bool start(uint16_t discoveryPort = LAN_DISCOVERY_PORT, bool multicast = true);
   void stop();
-  void poll();
   void clearSessions();
 
   bool isStarted() const { return m_started; }
-  const std::vector<DiscoveredSessionInfo>& sessions() const { return m_sessions; }
+  // any thread. an immutable list, republished when a host appears, changes or expires (lastSeenAtMs
+  // is refreshed once per query round)
+  std::shared_ptr<const std::vector<DiscoveredSessionInfo>> sessions() const;
 
 private:
-  void broadcastQuery(uint64_t nowMs);
+  void sendQuery();
+  void scheduleQuery();
+  void asyncReceive();
+  // re-arms the receive after a short wait, for an error that isnt about one datagram
+  void retryReceive();
+  void publishSessions();
 
   asio::io_context m_context;
   std::unique_ptr<asio::ip::udp::socket> m_socket;
+  std::unique_ptr<asio::steady_timer> m_queryTimer;
+  std::unique_ptr<asio::steady_timer> m_receiveRetryTimer;
+  std::thread m_ioThd;
   uint16_t m_discoveryPort = LAN_DISCOVERY_PORT;
+  bool m_multicast = true;
   bool m_started = false;
-  uint64_t m_lastBroadcastAtMs = 0;
+
+  std::atomic<std::shared_ptr<const std::vector<DiscoveredSessionInfo>>> m_published{
+    std::make_shared<const std::vector<DiscoveredSessionInfo>>()};
+
+  // io thread
   std::vector<DiscoveredSessionInfo> m_sessions;
+  bool m_sessionsDirty = false;
+  std::array<uint8_t, 1024> m_recvBuffer{};
+  asio::ip::udp::endpoint m_remote;
 };
 
 } // namespace game_engine
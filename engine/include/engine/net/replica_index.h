@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "engine/flat_map.h"
+#include "engine/net/game_net_common.h"
+
+namespace game_engine {
+
+struct GameState;
+
+// ReplicaIndex remembers where each replicated object lives in a client's GameState: players and
+// enemies in gameState.layers[layer], projectiles in gameState.bullets (layer == kBulletLayer). it is
+// kept across snapshots and patched as objects spawn and despawn, so applying a snapshot doesn't have
+// to rebuild lookups over every layer (tiles included) each time.
+//
+// applying a snapshot: diff() it against the index, update the matched() objects in place,
+// applyDespawns(), spawn() each of spawned(), then commit(). only spawning allocates. main thread only.
+class ReplicaIndex {
+public:
+  static constexpr uint32_t kBulletLayer = UINT32_MAX;
+
+  struct Slot {
+    uint32_t layer = 0;
+    uint32_t index = 0;
+  };
+  struct Match {
+    GameObject* object = nullptr;
+    const NetGameObjectSnapshot* snapshot = nullptr;
+  };
+
+  // players and enemies; projectiles are tracked too, but in gameState.bullets
+  static bool isReplicatedActor(ObjectClass objClass);
+
+  const FlatMap<GameObjectKey, Slot>& slots() const {
+    return m_slots;
+  }
+  // the object key's slot points at, or null if it isnt tracked or something other than the snapshot
+  // code moved it
+  GameObject* find(GameState& state, GameObjectKey key) const;
+
+  // false if the layers were replaced (a level load) since the last commit; rebuild before diffing
+  bool tracks(const GameState& state) const;
+  // full scan of the layers and bullets
+  void rebuild(const GameState& state);
+  // removes every replicated object from the state and forgets them all
+  void purge(GameState& state);
+  void clear();
+
+  // walks the snapshot and the index side by side (both sorted by key) and sorts every replicated
+  // object into matched, spawned or despawned. an object that changed layer is despawned and spawned
+  // again. false, with the state untouched, if an index entry no longer points at its object
+  bool diff(GameState& state, const NetGameStateSnapshot& snapshot);
+  const std::vector<Match>& matched() const {
+    return m_matched;
+  }
+  const std::vector<const NetGameObjectSnapshot*>& spawned() const {
+    return m_spawned;
+  }
+  // erases what diff found despawned. a layer keeps its order, which is its draw order: whatever sat
+  // behind a hole shifts down and the tracked objects among it are repointed
+  void applyDespawns(GameState& state);
+  // appends obj, built from snap, to snap's layer (or the bullets)
+  void spawn(GameState& state, const NetGameObjectSnapshot& snap, GameObject&& obj);
+  // remembers the layers the index now describes, for tracks()
+  void commit(const GameState& state);
+
+private:
+  FlatMap<GameObjectKey, Slot> m_slots;
+  const std::vector<GameObject>* m_layersData = nullptr;
+  std::size_t m_layerCount = 0;
+  // per-snapshot scratch, kept for its capacity
+  std::vector<Match> m_matched;
+  std::vector<const NetGameObjectSnapshot*> m_spawned;
+  std::vector<GameObjectKey> m_despawned;
+  std::vector<Slot> m_holes;
+};
+
+} // namespace game_engine
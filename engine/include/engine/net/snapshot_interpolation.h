@@ -0,0 +1,80 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "engine/net/game_net_common.h"
+
+namespace game_engine {
+
+struct InterpolationConfig {
+  float delaySeconds = 0.1f;             // render remote entities this far behind the estimated server time
+  float maxExtrapolationSeconds = 0.05f; // past the newest snapshot, keep moving at most this long
+  float tickSeconds = 1.0f / 60.0f;      // server tick length, to turn serverTick into time
+  float teleportDistance = 128.0f;       // bigger jumps between two snapshots are snapped, not blended
+};
+
+// SnapshotInterpolator keeps the last few snapshots' entity positions keyed by server tick, and
+// renders remote entities at a point delaySeconds in the past by blending the two snapshots either
+// side of it. server time is estimated from when snapshots arrive, so the render clock runs smoothly
+// through arrival jitter. snapshots that arrive out of order are dropped; the buffer starts over on a
+// level change or a tick count that jumps back past everything buffered. main thread only.
+class SnapshotInterpolator {
+public:
+  static constexpr size_t kCapacity = 32;
+
+  void push(const NetGameStateSnapshot& snapshot, double receivedAtSeconds);
+
+  // picks the pair of snapshots that bracket the render time for this frame
+  void beginFrame(double nowSeconds);
+
+  // position of key at the render time; false if neither bracketing snapshot has it
+  bool sample(const GameObjectKey& key, glm::vec2& out) const;
+
+  void clear();
+
+  void setConfig(const InterpolationConfig& config) {
+    m_config = config;
+  }
+
+  const InterpolationConfig& config() const {
+    return m_config;
+  }
+
+  size_t size() const {
+    return m_count;
+  }
+
+  double renderTick() const {
+    return m_renderTick;
+  }
+
+private:
+  using Position = std::pair<GameObjectKey, glm::vec2>;
+
+  struct Frame {
+    uint64_t serverTick = 0;
+    LevelIndex levelId = LevelIndex::LEVEL_1;
+    std::vector<Position> positions; // sorted by key
+  };
+
+  const Frame& frameAt(size_t age) const; // 0 = oldest
+  static const glm::vec2* find(const Frame& frame, const GameObjectKey& key);
+
+  InterpolationConfig m_config;
+  std::array<Frame, kCapacity> m_frames;
+  size_t m_head = 0; // next slot to write
+  size_t m_count = 0;
+
+  bool m_hasClockOffset = false;
+  double m_clockOffset = 0.0; // server seconds - local seconds
+
+  double m_renderTick = 0.0;
+  const Frame* m_from = nullptr;
+  const Frame* m_to = nullptr;
+  float m_alpha = 0.0f;
+};
+
+} // namespace game_engine
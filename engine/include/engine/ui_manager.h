@@ -131,7 +131,7 @@ namespace UIManager {
 
   class UI_Manager {
     public:
-      UI_Manager(game_engine::SDLState& sdl, TTF_Font& ttfFont): sdlState(sdl),  font(ttfFont){};
+      UI_Manager(game_engine::SDLState& sdl, TTF_Font* ttfFont): sdlState(sdl),  font(ttfFont){};
       ~UI_Manager() = default;
 
       // Primitive frame lifecycle/helpers for game-side UI composition.
@@ -174,7 +174,7 @@ namespace UIManager {
       ImVec2 defaultButtonSize = ImVec2(150, 50);
       CutscenePlayer cutscenePlr;
       game_engine::SDLState& sdlState;
-      TTF_Font& font;
+      TTF_Font* font; // null on the dedicated server, which never draws
       bool wantsHandCursor = false;
       bool debugMode = false;
   };
@@ -0,0 +1,123 @@
+#include "engine/net/client_prediction.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "engine/gameplay_simulation.h"
+
+namespace game_engine {
+
+void ClientPrediction::recordInput(const NetGameInput& input) {
+  if (m_pending.size() >= PredictionTuning::maxPendingInputs) {
+    m_pending.pop_front(); // server has gone quiet; oldest input can no longer be checked
+  }
+  m_pending.push_back(PendingInput{.input = input});
+}
+
+void ClientPrediction::predictOne(GameState& state, GameObject& player, PendingInput& pending) {
+  stepPredictedPlayer(state, player, pending.input, PredictionTuning::stepSeconds, m_stepInputs);
+  pending.predicted = true;
+  pending.position = player.position;
+  pending.velocity = player.velocity;
+  pending.grounded = player.grounded;
+  pending.player = player.data.player;
+}
+
+void ClientPrediction::predictPending(GameState& state, GameObject& player) {
+  for (auto& pending : m_pending) {
+    if (!pending.predicted) {
+      predictOne(state, player, pending);
+    }
+  }
+}
+
+PredictionResult ClientPrediction::acknowledge(
+  uint64_t serverTick,
+  const NetGameObjectSnapshot& serverPlayer) {
+  if (serverTick <= m_lastServerTick && m_lastServerTick != 0) {
+    return PredictionResult::Stale;
+  }
+  m_lastServerTick = serverTick;
+
+  // the server stepped our last acked input again, or hasnt seen any yet; replaying wouldnt change anything
+  const uint32_t ackedSeq = serverPlayer.ackedInputSeq;
+  if (ackedSeq <= m_lastAckedSeq) {
+    return PredictionResult::Unacked;
+  }
+
+  bool havePrediction = false;
+  while (!m_pending.empty() && m_pending.front().input.inputSeq <= ackedSeq) {
+    if (m_pending.front().input.inputSeq == ackedSeq && m_pending.front().predicted) {
+      m_acked = m_pending.front();
+      m_hasAcked = true;
+      havePrediction = true;
+    }
+    m_pending.pop_front();
+  }
+  m_lastAckedSeq = std::max(m_lastAckedSeq, ackedSeq);
+
+  // the acked input fell out of our history (or was never predicted): the server state is the only
+  // reference we have, so rewind onto it
+  if (!havePrediction) {
+    return PredictionResult::Rewind;
+  }
+
+  const glm::vec2 dp = serverPlayer.position - m_acked.position;
+  const glm::vec2 dv = serverPlayer.velocity - m_acked.velocity;
+  const bool agrees =
+    glm::dot(dp, dp) <= PredictionTuning::positionTolerance * PredictionTuning::positionTolerance &&
+    glm::dot(dv, dv) <= PredictionTuning::velocityTolerance * PredictionTuning::velocityTolerance &&
+    serverPlayer.grounded == m_acked.grounded &&
+    serverPlayer.data.player.state == m_acked.player.state;
+  if (agrees) {
+    return PredictionResult::Confirmed;
+  }
+
+  ++m_mispredictions;
+  return PredictionResult::Rewind;
+}
+
+void ClientPrediction::rewind(GameObject& player) const {
+  if (!m_hasAcked) {
+    return;
+  }
+
+  const PlayerData& server = player.data.player;
+  PlayerData restored = m_acked.player;
+  restored.state = server.state;
+  restored.healthPoints = server.healthPoints;
+  restored.manaPoints = server.manaPoints;
+  restored.ultimatePoints = server.ultimatePoints;
+  restored.unlockedUltimateOne = server.unlockedUltimateOne;
+  player.data.player = restored;
+}
+
+void ClientPrediction::replay(GameState& state, GameObject& player) {
+  for (auto& pending : m_pending) {
+    pending.predicted = false;
+  }
+  predictPending(state, player);
+}
+
+void ClientPrediction::startCorrection(glm::vec2 offset) {
+  const float maxOffset = PredictionTuning::maxSmoothedCorrection;
+  m_correction = glm::dot(offset, offset) > maxOffset * maxOffset ? glm::vec2(0.0f) : offset;
+}
+
+void ClientPrediction::decayCorrection(float deltaTime) {
+  m_correction *= std::exp(-PredictionTuning::correctionDecayPerSecond * deltaTime);
+  if (glm::dot(m_correction, m_correction) < 0.01f) {
+    m_correction = glm::vec2(0.0f);
+  }
+}
+
+void ClientPrediction::reset() {
+  m_pending.clear();
+  m_acked = PendingInput{};
+  m_hasAcked = false;
+  m_lastServerTick = 0;
+  m_lastAckedSeq = 0;
+  m_correction = glm::vec2(0.0f);
+}
+
+} // namespace game_engine
@@ -0,0 +1,348 @@
+#include "engine/net/demo.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace game_engine {
+
+namespace {
+
+// records go to disk in batches of about this much (or whatever one drain of the queue produced)
+constexpr size_t kBatchFlushBytes = 1 << 20;
+
+template <typename T>
+void putValue(std::vector<uint8_t>& out, T value) {
+  const size_t at = out.size();
+  out.resize(at + sizeof(T));
+  std::memcpy(out.data() + at, &value, sizeof(T));
+}
+
+template <typename T>
+T getValue(const uint8_t* p) {
+  T value;
+  std::memcpy(&value, p, sizeof(T));
+  return value;
+}
+
+} // namespace
+
+DemoWriter::~DemoWriter() {
+  close();
+}
+
+bool DemoWriter::open(const std::filesystem::path& path, uint32_t playerID, uint32_t roomID,
+                      uint64_t keyframeInterval) {
+  close();
+
+  m_file = std::fopen(path.c_str(), "wb");
+  if (!m_file) {
+    return false;
+  }
+
+  m_vBatch.clear();
+  m_vPendingKeyframes.clear();
+  m_nFileOffset = 0;
+  m_nLastIndexOffset = 0;
+  m_nKeyframeInterval = std::max<uint64_t>(1, keyframeInterval);
+  m_nNextKeyframeTick = 0;
+  m_bHaveKeyframe = false;
+  m_nDropped.store(0, std::memory_order_relaxed);
+
+  putValue(m_vBatch, kDemoMagic);
+  putValue(m_vBatch, kDemoVersion);
+  putValue(m_vBatch, playerID);
+  putValue(m_vBatch, roomID);
+  putValue(m_vBatch, static_cast<uint32_t>(m_nKeyframeInterval));
+  flushBatch();
+
+  m_tStart = std::chrono::steady_clock::now();
+  m_queue.resume();
+  m_running.store(true, std::memory_order_release);
+  m_writerThd = std::thread(&DemoWriter::writerLoop, this);
+  return true;
+}
+
+void DemoWriter::close() {
+  if (!m_running.exchange(false)) {
+    return;
+  }
+  m_queue.wakeAll();
+  if (m_writerThd.joinable()) {
+    m_writerThd.join();
+  }
+
+  if (!m_vPendingKeyframes.empty()) {
+    appendIndexBlock();
+  }
+  putValue(m_vBatch, m_nLastIndexOffset);
+  putValue(m_vBatch, kDemoTrailerMagic);
+  flushBatch();
+  std::fclose(m_file);
+  m_file = nullptr;
+  m_queue.clear(); // anything pushed after the last drain
+}
+
+void DemoWriter::recordSnapshot(uint64_t tick, const std::vector<uint8_t>& body) {
+  push(DemoRecordKind::Snapshot, tick, body);
+}
+
+void DemoWriter::recordInput(uint64_t tick, const std::vector<uint8_t>& body) {
+  push(DemoRecordKind::Input, tick, body);
+}
+
+void DemoWriter::push(DemoRecordKind kind, uint64_t tick, const std::vector<uint8_t>& body) {
+  if (!isOpen()) {
+    return;
+  }
+  PendingRecord record;
+  record.kind = kind;
+  record.tick = tick;
+  record.timeMs = static_cast<uint32_t>(
+    std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_tStart).count());
+  record.body = body;
+  if (!m_queue.try_push(std::move(record))) {
+    m_nDropped.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void DemoWriter::writerLoop() {
+  while (true) {
+    m_queue.wait(); // returns straight away once close() has called wakeAll
+    const bool stopping = !m_running.load(std::memory_order_acquire);
+    m_vDrained.clear();
+    m_queue.pop_all(m_vDrained);
+    for (const PendingRecord& record : m_vDrained) {
+      appendRecord(record.kind, record.tick, record.timeMs, record.body.data(),
+                   static_cast<uint32_t>(record.body.size()));
+    }
+    flushBatch();
+    if (stopping && m_queue.empty()) {
+      return;
+    }
+  }
+}
+
+void DemoWriter::appendRecord(DemoRecordKind kind, uint64_t tick, uint32_t timeMs, const uint8_t* data,
+                              uint32_t size) {
+  // the index only ever grows forward in ticks, so a tick that goes backwards is recorded but not indexed
+  if (kind == DemoRecordKind::Snapshot && (!m_bHaveKeyframe || tick >= m_nNextKeyframeTick)) {
+    m_vPendingKeyframes.push_back(DemoKeyframe{tick, m_nFileOffset + m_vBatch.size()});
+    m_nNextKeyframeTick = tick + m_nKeyframeInterval;
+    m_bHaveKeyframe = true;
+  }
+
+  putValue(m_vBatch, static_cast<uint8_t>(kind));
+  putValue(m_vBatch, tick);
+  putValue(m_vBatch, timeMs);
+  putValue(m_vBatch, size);
+  m_vBatch.insert(m_vBatch.end(), data, data + size);
+
+  if (m_vPendingKeyframes.size() >= kIndexBlockEntries) {
+    appendIndexBlock();
+  }
+  if (m_vBatch.size() >= kBatchFlushBytes) {
+    flushBatch();
+  }
+}
+
+void DemoWriter::appendIndexBlock() {
+  const uint64_t tick = m_vPendingKeyframes.back().tick;
+  std::vector<uint8_t> body;
+  body.reserve(sizeof(uint64_t) + sizeof(uint32_t) + m_vPendingKeyframes.size() * 2 * sizeof(uint64_t));
+  putValue(body, m_nLastIndexOffset);
+  putValue(body, static_cast<uint32_t>(m_vPendingKeyframes.size()));
+  for (const DemoKeyframe& keyframe : m_vPendingKeyframes) {
+    putValue(body, keyframe.tick);
+    putValue(body, keyframe.offset);
+  }
+  m_vPendingKeyframes.clear();
+
+  const uint64_t at = m_nFileOffset + m_vBatch.size();
+  appendRecord(DemoRecordKind::Index, tick, 0, body.data(), static_cast<uint32_t>(body.size()));
+  m_nLastIndexOffset = at;
+}
+
+void DemoWriter::flushBatch() {
+  if (m_vBatch.empty()) {
+    return;
+  }
+  std::fwrite(m_vBatch.data(), 1, m_vBatch.size(), m_file);
+  std::fflush(m_file);
+  m_nFileOffset += m_vBatch.size();
+  m_vBatch.clear();
+}
+
+DemoReader::~DemoReader() {
+  close();
+}
+
+bool DemoReader::open(const std::filesystem::path& path) {
+  close();
+
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st{};
+  if (::fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= kDemoHeaderSize) {
+    void* mapped = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped != MAP_FAILED) {
+      m_data = static_cast<const uint8_t*>(mapped);
+      m_size = static_cast<size_t>(st.st_size);
+      m_mapped = true;
+    }
+  }
+  ::close(fd);
+
+  if (!m_mapped) {
+    std::ifstream in(path, std::ios::binary);
+    m_vFallback.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    if (m_vFallback.size() < kDemoHeaderSize) {
+      m_vFallback.clear();
+      return false;
+    }
+    m_data = m_vFallback.data();
+    m_size = m_vFallback.size();
+  }
+
+  if (getValue<uint32_t>(m_data) != kDemoMagic || getValue<uint16_t>(m_data + 4) != kDemoVersion) {
+    close();
+    return false;
+  }
+  m_playerID = getValue<uint32_t>(m_data + 6);
+  m_roomID = getValue<uint32_t>(m_data + 10);
+
+  m_hadIndex = loadIndex();
+  if (!m_hadIndex) {
+    rebuildIndex();
+  }
+  return true;
+}
+
+void DemoReader::close() {
+  if (m_mapped) {
+    ::munmap(const_cast<uint8_t*>(m_data), m_size);
+  }
+  m_data = nullptr;
+  m_size = 0;
+  m_recordsEnd = 0;
+  m_mapped = false;
+  m_vFallback.clear();
+  m_vKeyframes.clear();
+  m_hadIndex = false;
+}
+
+bool DemoReader::readRecord(uint64_t offset, DemoRecordView& out) const {
+  // offsets come from the file, so compare against what is left rather than add to them (no wrap)
+  if (offset < kDemoHeaderSize || offset > m_recordsEnd || m_recordsEnd - offset < kDemoRecordHeaderSize) {
+    return false;
+  }
+  const uint8_t* p = m_data + offset;
+  const uint32_t size = getValue<uint32_t>(p + 13);
+  if (m_recordsEnd - offset - kDemoRecordHeaderSize < size) {
+    return false;
+  }
+  out.kind = static_cast<DemoRecordKind>(p[0]);
+  out.tick = getValue<uint64_t>(p + 1);
+  out.timeMs = getValue<uint32_t>(p + 9);
+  out.size = size;
+  out.data = p + kDemoRecordHeaderSize;
+  out.offset = offset;
+  out.nextOffset = offset + kDemoRecordHeaderSize + size;
+  return true;
+}
+
+bool DemoReader::nextPayload(uint64_t offset, DemoRecordView& out) const {
+  while (readRecord(offset, out)) {
+    if (out.kind != DemoRecordKind::Index) {
+      return true;
+    }
+    offset = out.nextOffset;
+  }
+  return false;
+}
+
+uint64_t DemoReader::seekOffset(uint64_t tick) const {
+  const auto it = std::upper_bound(m_vKeyframes.begin(), m_vKeyframes.end(), tick,
+                                   [](uint64_t t, const DemoKeyframe& k) { return t < k.tick; });
+  return it == m_vKeyframes.begin() ? firstOffset() : std::prev(it)->offset;
+}
+
+bool DemoReader::findSnapshot(uint64_t tick, DemoRecordView& out) const {
+  bool found = false;
+  DemoRecordView record;
+  uint64_t offset = seekOffset(tick);
+  while (nextPayload(offset, record) && record.tick <= tick) {
+    if (record.kind == DemoRecordKind::Snapshot) {
+      out = record;
+      found = true;
+    }
+    offset = record.nextOffset;
+  }
+  return found;
+}
+
+bool DemoReader::loadIndex() {
+  if (m_size < kDemoHeaderSize + kDemoTrailerSize ||
+      getValue<uint32_t>(m_data + m_size - sizeof(uint32_t)) != kDemoTrailerMagic) {
+    return false;
+  }
+  m_recordsEnd = m_size - kDemoTrailerSize;
+
+  // blocks are chained newest to oldest; each one only points further back, so a bad file cant loop
+  std::vector<std::pair<const uint8_t*, uint32_t>> blocks;
+  uint64_t offset = getValue<uint64_t>(m_data + m_recordsEnd);
+  DemoRecordView record;
+  while (offset != 0) {
+    if (!readRecord(offset, record) || record.kind != DemoRecordKind::Index ||
+        record.size < sizeof(uint64_t) + sizeof(uint32_t)) {
+      return false;
+    }
+    const uint64_t previous = getValue<uint64_t>(record.data);
+    const uint32_t count = getValue<uint32_t>(record.data + sizeof(uint64_t));
+    if (previous >= offset || (record.size - sizeof(uint64_t) - sizeof(uint32_t)) / (2 * sizeof(uint64_t)) < count) {
+      return false;
+    }
+    blocks.emplace_back(record.data + sizeof(uint64_t) + sizeof(uint32_t), count);
+    offset = previous;
+  }
+
+  m_vKeyframes.clear();
+  for (auto it = blocks.rbegin(); it != blocks.rend(); ++it) {
+    for (uint32_t i = 0; i < it->second; ++i) {
+      const DemoKeyframe keyframe{getValue<uint64_t>(it->first + i * 16), getValue<uint64_t>(it->first + i * 16 + 8)};
+      if (keyframe.offset >= m_recordsEnd) {
+        m_vKeyframes.clear();
+        return false;
+      }
+      m_vKeyframes.push_back(keyframe);
+    }
+  }
+  return true;
+}
+
+void DemoReader::rebuildIndex() {
+  const uint64_t interval = std::max<uint32_t>(1, getValue<uint32_t>(m_data + 14));
+  m_recordsEnd = m_size;
+  m_vKeyframes.clear();
+
+  uint64_t offset = firstOffset();
+  uint64_t nextKeyframeTick = 0;
+  DemoRecordView record;
+  while (readRecord(offset, record)) {
+    if (record.kind == DemoRecordKind::Snapshot && (m_vKeyframes.empty() || record.tick >= nextKeyframeTick)) {
+      m_vKeyframes.push_back(DemoKeyframe{record.tick, record.offset});
+      nextKeyframeTick = record.tick + interval;
+    }
+    offset = record.nextOffset;
+  }
+  m_recordsEnd = offset; // drop a record the crash cut in half
+}
+
+} // namespace game_engine
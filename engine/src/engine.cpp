@@ -302,6 +302,25 @@ bool game_engine::Engine::handleMultiplayerConnections() {
     m_multiplayerStatus = "Host disconnected";
   };
 
+  // GAME_DEMO_PLAY=<file> (speed from GAME_DEMO_SPEED, default 1) replays a recorded demo through the
+  // client instead of joining a host
+  if (m_gameType == Client) {
+    if (const char* demoPath = std::getenv("GAME_DEMO_PLAY")) {
+      if (!m_gameClient) {
+        m_gameClient = std::make_unique<GameClient>();
+        const char* speed = std::getenv("GAME_DEMO_SPEED");
+        if (!m_gameClient->StartDemoPlayback(demoPath, speed ? std::strtod(speed, nullptr) : 1.0)) {
+          std::cout << "failed to open demo " << demoPath << std::endl;
+          m_gameClient.reset();
+          return false;
+        }
+        m_gameState.currentView = UIManager::GameView::Playing;
+        m_multiplayerStatus = "Playing demo";
+      }
+      return true;
+    }
+  }
+
   if (m_gameType == Host) {
     if (!m_discoveryHost) {
       m_discoveryHost = std::make_unique<DiscoveryHostService>();
@@ -313,10 +332,9 @@ bool game_engine::Engine::handleMultiplayerConnections() {
       }
     }
     if (m_discoveryHost) {
-      const uint32_t playerCount = m_gameServer ? static_cast<uint32_t>(m_gameServer->m_playerSessions.size()) : 0;
+      const uint32_t playerCount = m_gameServer ? m_gameServer->playerCount() : 0;
       m_discoveryHost->updateInfo("LAN Host", m_gameState.currentLevelId, playerCount, GAME_SERVER_PORT);
       m_discoveryHost->setReady(m_serverReadyForDiscovery);
-      m_discoveryHost->poll();
     }
   } else if (m_discoveryHost) {
     m_discoveryHost->stop();
@@ -334,9 +352,6 @@ bool game_engine::Engine::handleMultiplayerConnections() {
         return false;
       }
     }
-    if (m_discoveryBrowser) {
-      m_discoveryBrowser->poll();
-    }
     m_multiplayerStatus = "Searching LAN for ready hosts...";
     return true;
   }
@@ -353,7 +368,9 @@ bool game_engine::Engine::handleMultiplayerConnections() {
   if (m_gameType == Host && !m_gameServer) {
     std::cout << "starting server" << std::endl;
     m_gameServer = buildAuthoritativeStateForServer();
-    bool successStart = m_gameServer->Start();
+    // a couple of io threads keep socket reads/decompression for several clients off one core
+    const size_t ioThreads = std::clamp<size_t>(std::thread::hardware_concurrency() / 2, 1, 4);
+    bool successStart = m_gameServer->Start(ioThreads);
     if (!successStart) {
       m_multiplayerStatus = "Failed to start host server";
       return false;
@@ -377,6 +394,11 @@ bool game_engine::Engine::handleMultiplayerConnections() {
         isConnectedToServer &&
         !m_gameClient->IsConnected() &&
         (m_gameClient->IsRegistered() || m_gameClient->IsClientValidated())) {
+      // the server keeps a dropped player around for a while; try to step back into it first
+      if (m_gameClient->IsRegistered() && m_gameClient->ResumeSession(m_selectedJoinHost, m_selectedJoinPort)) {
+        m_multiplayerStatus = "Reconnecting...";
+        return true;
+      }
       returnClientToBrowse();
       return true;
     }
@@ -412,7 +434,7 @@ bool game_engine::Engine::handleMultiplayerConnections() {
     const bool hostReady = m_gameClient && m_gameClient->IsRegistered();
     m_serverReadyForDiscovery = hostReady;
     if (m_discoveryHost) {
-      const uint32_t playerCount = m_gameServer ? static_cast<uint32_t>(m_gameServer->m_playerSessions.size()) : 0;
+      const uint32_t playerCount = m_gameServer ? m_gameServer->playerCount() : 0;
       m_discoveryHost->updateInfo("LAN Host", m_gameState.currentLevelId, playerCount, GAME_SERVER_PORT);
       m_discoveryHost->setReady(hostReady);
     }
@@ -487,28 +509,30 @@ void game_engine::Engine::flushLocalInput(float deltaTime) {
     return;
   }
 
-  constexpr float kInputSendInterval = 1.0f / 60.0f;
-  m_inputSendAccumulator += deltaTime;
-  const bool hasEdgeInput =
-    m_localInput.jumpPressed || m_localInput.meleePressed || m_localInput.ultimatePressed;
-  if (m_inputSendAccumulator < kInputSendInterval && !hasEdgeInput) {
-    return;
+  // one input per server tick. the client predicts each input as exactly one fixed step, the same
+  // step the server runs, so inputs go out on a fixed cadence instead of early on edge presses (an
+  // edge press just rides along with the next tick's input)
+  constexpr float kInputSendInterval = game_engine::PredictionTuning::stepSeconds;
+  constexpr int kMaxInputsPerFrame = 4;
+  m_inputSendAccumulator =
+    std::min(m_inputSendAccumulator + deltaTime, kInputSendInterval * kMaxInputsPerFrame);
+
+  while (m_inputSendAccumulator >= kInputSendInterval) {
+    m_inputSendAccumulator -= kInputSendInterval;
+    NetGameInput outgoing = m_localInput;
+    outgoing.playerID = m_gameClient->GetPlayerID();
+    outgoing.inputSeq = ++m_localInputSeq;
+    outgoing.shouldSendMessage =
+      outgoing.leftHeld || outgoing.rightHeld || outgoing.fireHeld ||
+      outgoing.jumpPressed || outgoing.meleePressed || outgoing.ultimatePressed;
+    m_gameClient->SendInput(outgoing);
+
+    m_localInput.jumpPressed = false;
+    m_localInput.meleePressed = false;
+    m_localInput.ultimatePressed = false;
+    m_localInput.shouldSendMessage =
+      m_localInput.leftHeld || m_localInput.rightHeld || m_localInput.fireHeld;
   }
-
-  m_inputSendAccumulator = 0.0f;
-  NetGameInput outgoing = m_localInput;
-  outgoing.playerID = m_gameClient->GetPlayerID();
-  outgoing.inputSeq = ++m_localInputSeq;
-  outgoing.shouldSendMessage =
-    outgoing.leftHeld || outgoing.rightHeld || outgoing.fireHeld ||
-    outgoing.jumpPressed || outgoing.meleePressed || outgoing.ultimatePressed;
-  m_gameClient->SendInput(outgoing);
-
-  m_localInput.jumpPressed = false;
-  m_localInput.meleePressed = false;
-  m_localInput.ultimatePressed = false;
-  m_localInput.shouldSendMessage =
-    m_localInput.leftHeld || m_localInput.rightHeld || m_localInput.fireHeld;
 }
 
 void game_engine::Engine::restartMultiplayerSession() {
@@ -565,26 +589,41 @@ bool game_engine::Engine::copyHostSnapshot(NetGameStateSnapshot& out) const {
   return m_gameServer->copyCurrentSnapshot(out);
 }
 
+std::vector<std::pair<uint32_t, net::connection_stats>> game_engine::Engine::copyHostClientStats() const {
+  if (!isHostMode() || !m_gameServer) {
+    return {};
+  }
+  return m_gameServer->copyClientStats();
+}
+
+game_engine::TickTimingStats game_engine::Engine::copyHostTickTiming() const {
+  if (!isHostMode() || !m_gameServer) {
+    return {};
+  }
+  return m_gameServer->tickTimingStats();
+}
+
 std::vector<game_engine::DiscoveredSessionInfo> game_engine::Engine::copyDiscoveredSessions() const {
   if (!m_discoveryBrowser) {
     return {};
   }
-  return m_discoveryBrowser->sessions();
+  return *m_discoveryBrowser->sessions();
 }
 
 bool game_engine::Engine::selectDiscoveredSession(size_t index) {
   if (!m_discoveryBrowser) {
     return false;
   }
-  const auto& sessions = m_discoveryBrowser->sessions();
-  if (index >= sessions.size()) {
+  const auto sessions = m_discoveryBrowser->sessions();
+  if (index >= sessions->size()) {
     return false;
   }
 
-  m_selectedJoinHost = sessions[index].hostAddress;
-  m_selectedJoinPort = sessions[index].gamePort;
+  const DiscoveredSessionInfo& session = (*sessions)[index];
+  m_selectedJoinHost = session.hostAddress;
+  m_selectedJoinPort = session.gamePort;
   m_hasSelectedJoinTarget = true;
-  m_multiplayerStatus = "Selected host " + sessions[index].hostName;
+  m_multiplayerStatus = "Selected host " + session.hostName;
   return true;
 }
 
@@ -617,37 +656,9 @@ bool game_engine::Engine::isMultiplayerActive() const {
 }
 
 void game_engine::Engine::runGameServerLoopThread() {
-
-  using clock = std::chrono::steady_clock;
-  const double dt = 1.0/60.0; // 60Hz
-  const size_t maxInputsPerTick = 64;
-  constexpr uint64_t kSnapshotEveryTicks = 2;
-  auto prev = clock::now();
-  double accum = 0.0;
-  uint64_t tickCount = 0;
-
-  // determine delta for server loop
-  while (m_gameRunning.load() && m_serverLoopRunning.load() && m_gameServer) {
-    // right now the loop blocks on ProcessIncomingMessages() and only broadcasts right after a message arrives. That ties your tick rate to network traffic; if no input arrives, clients get no snapshots. Run the server loop on a fixed timestep (e.g., sleep to 60Hz), call ProcessIncomingMessages(nMaxMessagesPerTick, /*enableWaiting=*/false) to drain some inputs, then step simulation and broadcast
-    m_gameServer->ProcessIncomingMessages(maxInputsPerTick, false);
-
-    auto now = clock::now();
-    accum += std::chrono::duration<double>(now - prev).count();
-    prev = now;
-
-    // run as many fixed steps as have accumulated time
-    while (accum >= dt) {
-      m_gameServer->applyPlayerInputs();
-      m_gameServer->step(static_cast<float>(dt));
-      ++tickCount;
-      accum -= dt;
-      if (tickCount % kSnapshotEveryTicks == 0) {
-        m_gameServer->broadcastSnapshot();
-      }
-    }
-
-    std::this_thread::sleep_for(std::chrono::milliseconds(1));
-  }
+  runServerLoop(*m_gameServer, [this]() {
+    return m_gameRunning.load() && m_serverLoopRunning.load();
+  });
   m_serverLoopRunning.store(false);
 }
 
@@ -0,0 +1,836 @@
+#include "engine/net/game_server.h"
+
+#include <algorithm>
+#include <latch>
+
+#include "engine/engine.h"
+#include "engine/gameplay_simulation.h"
+
+namespace game_engine {
+
+AuthoritativeContext::AuthoritativeContext(GameState&& initialState)
+  : state(std::make_unique<GameState>(std::move(initialState))) {}
+
+namespace {
+
+ObjectData cloneObjectData(const GameObject& src) {
+  ObjectData data;
+  switch (src.objClass) {
+    case ObjectClass::Player:
+      new (&data.player) PlayerData(src.data.player);
+      break;
+    case ObjectClass::Enemy:
+      new (&data.enemy) EnemyData(src.data.enemy);
+      break;
+    case ObjectClass::Projectile:
+      new (&data.bullet) BulletData(src.data.bullet);
+      break;
+    case ObjectClass::Portal:
+      new (&data.portal) PortalData(src.data.portal.nextLevel);
+      break;
+    case ObjectClass::Level:
+    case ObjectClass::Background:
+      new (&data.level) LevelData(src.data.level);
+      break;
+  }
+  return data;
+}
+
+GameObject cloneGameObject(const GameObject& src) {
+  GameObject dst(src.spritePixelH, src.spritePixelW);
+  dst.id = src.id;
+  dst.objClass = src.objClass;
+  dst.spriteType = src.spriteType;
+  dst.data = cloneObjectData(src);
+  dst.position = src.position;
+  dst.velocity = src.velocity;
+  dst.acceleration = src.acceleration;
+  dst.direction = src.direction;
+  dst.maxSpeedX = src.maxSpeedX;
+  dst.animations = src.animations;
+  dst.currentAnimation = src.currentAnimation;
+  dst.presentationVariant = src.presentationVariant;
+  dst.dynamic = src.dynamic;
+  dst.grounded = src.grounded;
+  dst.drawScale = src.drawScale;
+  dst.spritePixelW = src.spritePixelW;
+  dst.spritePixelH = src.spritePixelH;
+  dst.baseCollider = src.baseCollider;
+  dst.collider = src.collider;
+  dst.colliderNorm = src.colliderNorm;
+  dst.flashTimer = src.flashTimer;
+  dst.shouldFlash = src.shouldFlash;
+  dst.spriteFrame = src.spriteFrame;
+  dst.renderPosition = src.renderPosition;
+  dst.renderPositionInitialized = src.renderPositionInitialized;
+  dst.texture = nullptr;
+  return dst;
+}
+
+void resetPlayerRuntimeStatePreservingUnlocks(PlayerData& playerData) {
+  const bool unlockedUltimateOne = playerData.unlockedUltimateOne;
+  playerData = PlayerData();
+  playerData.unlockedUltimateOne = unlockedUltimateOne;
+}
+
+void markPlayerDeadFromFall(GameObject& player) {
+  if (player.objClass != ObjectClass::Player ||
+      player.data.player.state == PlayerState::dead) {
+    return;
+  }
+
+  player.data.player.healthPoints = 0;
+  player.data.player.state = PlayerState::dead;
+  player.presentationVariant = PresentationVariant::Die;
+  player.currentAnimation = ANIM_DIE;
+  if (player.currentAnimation >= 0 &&
+      player.currentAnimation < static_cast<int>(player.animations.size())) {
+    player.animations[player.currentAnimation].reset();
+  }
+  player.spriteFrame = 1;
+  player.velocity = glm::vec2(0.0f);
+}
+
+} // namespace
+
+GameRoom::GameRoom(uint32_t roomID, std::unique_ptr<AuthoritativeContext> authCtx)
+  : m_authCtx(std::move(authCtx)),
+    m_roomID(roomID) {
+  publishSnapshot();
+}
+
+GameObject* GameRoom::findPlayerById(uint32_t playerID) {
+  if (!m_authCtx || !m_authCtx->state) {
+    return nullptr;
+  }
+
+  auto& state = *m_authCtx->state;
+  if (state.playerLayer < 0 || state.playerLayer >= static_cast<int>(state.layers.size())) {
+    return nullptr;
+  }
+
+  for (auto& obj : state.layers[state.playerLayer]) {
+    if (obj.objClass == ObjectClass::Player && obj.id == playerID) {
+      return &obj;
+    }
+  }
+  return nullptr;
+}
+
+void GameRoom::applyPlayerInputs() {
+  std::scoped_lock lock(m_stateMu);
+  m_vInputBatch.clear();
+  m_playerInputQueue.pop_all(m_vInputBatch);
+  if (!m_authCtx) {
+    return;
+  }
+
+  // packets repeat the frames the server hasnt acked, so most arrivals are duplicates; the rest go
+  // in order into their player's buffer (almost always at the back)
+  for (const NetGameInput& input : m_vInputBatch) {
+    auto sessionIt = m_playerSessions.find(input.playerID);
+    if (sessionIt == m_playerSessions.end() || input.inputSeq <= sessionIt->second.lastInputSeq) {
+      continue;
+    }
+    std::deque<NetGameInput>& pending = sessionIt->second.pendingInputs;
+    auto at = pending.end();
+    while (at != pending.begin() && std::prev(at)->inputSeq >= input.inputSeq) {
+      --at;
+    }
+    if (at == pending.end() || at->inputSeq != input.inputSeq) {
+      pending.insert(at, input);
+    }
+  }
+
+  const int64_t tick = static_cast<int64_t>(m_authCtx->serverTick) + 1; // the one step() runs next
+  for (auto& [playerID, session] : m_playerSessions) {
+    std::deque<NetGameInput>& pending = session.pendingInputs;
+    if (pending.empty()) {
+      continue; // nothing new: the held buttons carry over, the presses were cleared by the last step
+    }
+    bool pulledIn = false;
+    if (!session.inputAligned) {
+      session.inputTickOffset = tick + kInputDelayTicks - pending.front().inputSeq;
+      session.inputAligned = true;
+    } else if (static_cast<int64_t>(pending.back().inputSeq) + session.inputTickOffset > tick + kMaxInputLeadTicks) {
+      session.inputTickOffset = tick + kInputDelayTicks - pending.back().inputSeq;
+      pulledIn = true;
+    }
+
+    // everything due by this tick becomes one frame: the newest one's held buttons, and every press
+    bool late = false;
+    std::optional<NetGameInput> frame;
+    while (!pending.empty() && static_cast<int64_t>(pending.front().inputSeq) + session.inputTickOffset <= tick) {
+      const NetGameInput& next = pending.front();
+      late = late || static_cast<int64_t>(next.inputSeq) + session.inputTickOffset < tick;
+      if (frame) {
+        const NetGameInput earlier = *frame;
+        frame = next;
+        frame->jumpPressed = frame->jumpPressed || earlier.jumpPressed;
+        frame->meleePressed = frame->meleePressed || earlier.meleePressed;
+        frame->ultimatePressed = frame->ultimatePressed || earlier.ultimatePressed;
+      } else {
+        frame = next;
+      }
+      pending.pop_front();
+    }
+    if (!frame) {
+      continue;
+    }
+    session.lastInputSeq = frame->inputSeq;
+    m_authCtx->latestPlayerInputs.insert_or_assign(playerID, *frame);
+    if (late && !pulledIn) {
+      // give the frames after it the full delay again
+      session.inputTickOffset = tick + kInputDelayTicks - (static_cast<int64_t>(frame->inputSeq) + 1);
+    }
+  }
+}
+
+void GameRoom::step(float deltaTime) {
+  std::scoped_lock lock(m_stateMu);
+  if (!m_authCtx || !m_authCtx->state) {
+    return;
+  }
+
+  GameState& state = *m_authCtx->state;
+  ++m_authCtx->serverTick;
+  state.m_stateLastUpdatedAt = m_authCtx->serverTick;
+
+  GameplaySimulationHooks hooks;
+  hooks.onPortalTriggered = [this](LevelIndex nextLevel) {
+    std::scoped_lock lock(m_pendingLevelTransitionMu);
+    if (!m_pendingLevelTransition.has_value()) {
+      m_pendingLevelTransition = nextLevel;
+    }
+  };
+  hooks.onHitConfirmed =
+    [this](GameObjectKey attacker, GameObjectKey victim, HitStopStrength strength) {
+      m_latestHitStopEvent.sequence = m_nextHitStopSequence++;
+      m_latestHitStopEvent.active = true;
+      m_latestHitStopEvent.attackerClass = attacker.first;
+      m_latestHitStopEvent.attackerId = attacker.second;
+      m_latestHitStopEvent.victimClass = victim.first;
+      m_latestHitStopEvent.victimId = victim.second;
+      m_latestHitStopEvent.strength = strength;
+    };
+  stepGameplaySimulation(state, m_authCtx->latestPlayerInputs, deltaTime, hooks);
+
+  for (auto& [playerID, session] : m_playerSessions) {
+    (void)session;
+    if (GameObject* player = findPlayerById(playerID)) {
+      if (!player->grounded && player->position.y > 1500.0f) {
+        markPlayerDeadFromFall(*player);
+      }
+    }
+  }
+
+  for (auto& [playerID, input] : m_authCtx->latestPlayerInputs) {
+    input.jumpPressed = false;
+    input.meleePressed = false;
+    input.ultimatePressed = false;
+    (void)playerID;
+  }
+
+  for (auto& [playerID, session] : m_playerSessions) {
+    if (GameObject* player = findPlayerById(playerID)) {
+      session.lifecycle =
+        player->data.player.state == PlayerState::dead ? PlayerSessionState::dead
+                                                       : PlayerSessionState::alive;
+    }
+  }
+}
+
+void GameRoom::publishSnapshot() {
+  std::scoped_lock lock(m_stateMu);
+  publishSnapshotLocked();
+}
+
+// a hit stop rides along in every published snapshot until an encoder has actually sent one carrying it;
+// a broadcast that finds an older snapshot (or none) leaves it pending
+void GameRoom::publishSnapshotLocked() {
+  if (!m_authCtx || !m_authCtx->state) {
+    return;
+  }
+  auto snapshot = acquireSnapshotLocked();
+  m_authCtx->state->extractNetSnapshot(*snapshot);
+  snapshot->serverTick = m_authCtx->serverTick;
+  snapshot->levelId = m_authCtx->state->currentLevelId;
+  for (const auto& [playerID, session] : m_playerSessions) {
+    auto it = snapshot->m_gameObjects.find({ObjectClass::Player, playerID});
+    if (it != snapshot->m_gameObjects.end()) {
+      it->second.ackedInputSeq = session.lastInputSeq; // applyPlayerInputs -> step has run for this seq
+    }
+  }
+  if (m_latestHitStopEvent.active &&
+      m_latestHitStopEvent.sequence > m_hitStopSentSequence.load(std::memory_order_acquire)) {
+    snapshot->hitStopEvent = m_latestHitStopEvent;
+  } else {
+    snapshot->hitStopEvent.active = false;
+  }
+  m_publishedSnapshot.store(std::move(snapshot));
+}
+
+// the published pointer, the encoders and the sent snapshots kept for resume all hold references; a pooled snapshot
+// only the pool holds can be refilled. when every one is still out, a fresh one takes over a slot
+std::shared_ptr<NetGameStateSnapshot> GameRoom::acquireSnapshotLocked() {
+  for (size_t i = 0; i < kSnapshotPoolSize; ++i) {
+    const size_t idx = (m_nextPooledSnapshot + i) % kSnapshotPoolSize;
+    auto& slot = m_snapshotPool[idx];
+    if (!slot || slot.use_count() == 1) {
+      std::atomic_thread_fence(std::memory_order_acquire); // the last reader has let go of it
+      m_nextPooledSnapshot = (idx + 1) % kSnapshotPoolSize;
+      if (!slot) {
+        slot = std::make_shared<NetGameStateSnapshot>();
+      }
+      return slot;
+    }
+  }
+  auto& slot = m_snapshotPool[m_nextPooledSnapshot];
+  m_nextPooledSnapshot = (m_nextPooledSnapshot + 1) % kSnapshotPoolSize;
+  slot = std::make_shared<NetGameStateSnapshot>();
+  return slot;
+}
+
+void GameRoom::requestBroadcast() {
+  m_broadcastPending.store(true, std::memory_order_relaxed);
+}
+
+bool GameRoom::takeBroadcastRequest() {
+  return m_broadcastPending.exchange(false, std::memory_order_relaxed);
+}
+
+bool GameRoom::copyCurrentSnapshot(NetGameStateSnapshot& out) const {
+  const auto snapshot = m_publishedSnapshot.load();
+  if (!snapshot) {
+    return false;
+  }
+  out = *snapshot;
+  return true;
+}
+
+void GameRoom::rememberSent(uint32_t playerID, std::shared_ptr<const NetGameStateSnapshot> snapshot) {
+  std::scoped_lock lock(m_historyMu);
+  SentSnapshots& sent = m_sentSnapshots[playerID];
+  const size_t newest = (sent.next + kSentSnapshotsPerPlayer - 1) % kSentSnapshotsPerPlayer;
+  if (sent.ring[newest] == snapshot) {
+    return; // an encode pass that found nothing newer published
+  }
+  sent.ring[sent.next] = std::move(snapshot);
+  sent.next = (sent.next + 1) % kSentSnapshotsPerPlayer;
+}
+
+std::shared_ptr<const NetGameStateSnapshot> GameRoom::sentSnapshotAt(uint32_t playerID, uint64_t serverTick) const {
+  std::scoped_lock lock(m_historyMu);
+  const auto it = m_sentSnapshots.find(playerID);
+  if (it == m_sentSnapshots.end()) {
+    return nullptr;
+  }
+  for (const auto& snapshot : it->second.ring) {
+    if (snapshot && snapshot->serverTick == serverTick) {
+      return snapshot;
+    }
+  }
+  return nullptr;
+}
+
+LevelIndex GameRoom::levelId() const {
+  std::scoped_lock lock(m_stateMu);
+  return m_authCtx && m_authCtx->state ? m_authCtx->state->currentLevelId : LevelIndex::LEVEL_1;
+}
+
+// rebuilds the host/server’s authoritative game world from a fresh GameState, while preserving the currently connected multiplayer roster.
+void GameRoom::resetAuthoritativeState(GameState&& initialState, bool refreshSpawnPositions) {
+  std::scoped_lock lock(m_stateMu);
+  if (!m_authCtx) {
+    m_authCtx = std::make_unique<AuthoritativeContext>(std::move(initialState));
+    publishSnapshotLocked();
+    return;
+  }
+
+  m_authCtx->state = std::make_unique<GameState>(std::move(initialState));
+  m_authCtx->latestPlayerInputs.clear();
+  m_playerInputQueue.clear();
+  for (auto& [playerID, session] : m_playerSessions) {
+    session.pendingInputs.clear();
+    session.inputAligned = false;
+    (void)playerID;
+  }
+  // the sequence keeps counting: the encoders tell what has been sent by it
+  m_latestHitStopEvent = {};
+  {
+    std::scoped_lock lock(m_pendingLevelTransitionMu);
+    m_pendingLevelTransition.reset();
+  }
+
+  auto& state = *m_authCtx->state;
+  if (state.playerLayer < 0 || state.playerLayer >= static_cast<int>(state.layers.size())) {
+    publishSnapshotLocked();
+    return;
+  }
+
+  auto& layer = state.layers[state.playerLayer];
+  auto templateIt = std::find_if(
+    layer.begin(),
+    layer.end(),
+    [](const GameObject& obj) { return obj.objClass == ObjectClass::Player; });
+  if (templateIt == layer.end()) {
+    publishSnapshotLocked();
+    return;
+  }
+
+  const GameObject templatePlayer = cloneGameObject(*templateIt);
+  layer.erase(
+    std::remove_if(
+      layer.begin(),
+      layer.end(),
+      [](const GameObject& obj) { return obj.objClass == ObjectClass::Player; }),
+    layer.end());
+
+  std::vector<std::pair<uint32_t, PlayerSession>> roster;
+  roster.reserve(m_playerSessions.size());
+  for (const auto& [playerID, session] : m_playerSessions) {
+    roster.emplace_back(playerID, session);
+  }
+  std::sort(roster.begin(), roster.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+  for (std::size_t idx = 0; idx < roster.size(); ++idx) {
+    if (refreshSpawnPositions) {
+      m_playerSessions[roster[idx].first].spawnPosition = templatePlayer.position;
+      m_playerSessions[roster[idx].first].spawnPosition.x += 48.0f * static_cast<float>(idx);
+    }
+
+    GameObject player = cloneGameObject(templatePlayer);
+    player.id = roster[idx].first;
+    player.spriteType = roster[idx].second.spriteType;
+    player.position = m_playerSessions[roster[idx].first].spawnPosition;
+    player.velocity = glm::vec2(0.0f);
+    player.acceleration = templatePlayer.acceleration;
+    player.data.player = templatePlayer.data.player;
+    player.currentAnimation = ANIM_IDLE;
+    player.presentationVariant = PresentationVariant::Idle;
+    if (player.currentAnimation >= 0 &&
+        player.currentAnimation < static_cast<int>(player.animations.size())) {
+      player.animations[player.currentAnimation].reset();
+    }
+    player.spriteFrame = 1;
+    player.shouldFlash = false;
+    player.flashTimer.reset();
+    player.collider = player.baseCollider;
+    player.direction = 1.0f;
+    layer.push_back(std::move(player));
+    m_playerSessions[roster[idx].first].lifecycle = PlayerSessionState::alive;
+  }
+
+  publishSnapshotLocked();
+}
+
+bool GameRoom::registerPlayer(uint32_t playerID, SpriteType spriteType) {
+  std::scoped_lock lock(m_stateMu);
+  if (!m_authCtx || !m_authCtx->state) {
+    return false;
+  }
+
+  if (findPlayerById(playerID)) {
+    return true;
+  }
+
+  auto& state = *m_authCtx->state;
+  if (state.playerLayer < 0 || state.playerLayer >= static_cast<int>(state.layers.size())) {
+    return false;
+  }
+
+  GameObject* templatePlayer = nullptr;
+  for (auto& obj : state.layers[state.playerLayer]) {
+    if (obj.objClass == ObjectClass::Player) {
+      templatePlayer = &obj;
+      break;
+    }
+  }
+  if (!templatePlayer) {
+    return false;
+  }
+
+  if (m_playerSessions.empty()) {
+    const glm::vec2 spawnPosition = templatePlayer->position;
+    templatePlayer->id = playerID;
+    templatePlayer->spriteType = spriteType;
+    resetPlayerRuntimeStatePreservingUnlocks(templatePlayer->data.player);
+    templatePlayer->velocity = glm::vec2(0.0f);
+    templatePlayer->currentAnimation = ANIM_IDLE;
+    templatePlayer->presentationVariant = PresentationVariant::Idle;
+    templatePlayer->spriteFrame = 1;
+    m_playerSessions[playerID] = PlayerSession{
+      .spriteType = spriteType,
+      .lifecycle = PlayerSessionState::alive,
+      .lastInputSeq = 0,
+      .spawnPosition = spawnPosition,
+    };
+    m_playerCount.store(static_cast<uint32_t>(m_playerSessions.size()));
+    return true;
+  }
+
+  GameObject newPlayer = cloneGameObject(*templatePlayer);
+  newPlayer.id = playerID;
+  newPlayer.spriteType = spriteType;
+  newPlayer.position.x += 48.0f * static_cast<float>(m_playerSessions.size());
+  newPlayer.velocity = glm::vec2(0.0f);
+  resetPlayerRuntimeStatePreservingUnlocks(newPlayer.data.player);
+  newPlayer.currentAnimation = ANIM_IDLE;
+  newPlayer.presentationVariant = PresentationVariant::Idle;
+  state.layers[state.playerLayer].push_back(std::move(newPlayer));
+  m_playerSessions[playerID] = PlayerSession{
+    .spriteType = spriteType,
+    .lifecycle = PlayerSessionState::alive,
+    .lastInputSeq = 0,
+    .spawnPosition = state.layers[state.playerLayer].back().position,
+  };
+  m_playerCount.store(static_cast<uint32_t>(m_playerSessions.size()));
+  return true;
+}
+
+bool GameRoom::respawnPlayer(uint32_t playerID) {
+  std::scoped_lock lock(m_stateMu);
+  if (!m_authCtx || !m_authCtx->state) {
+    return false;
+  }
+
+  auto sessionIt = m_playerSessions.find(playerID);
+  if (sessionIt == m_playerSessions.end()) {
+    return false;
+  }
+
+  GameObject* player = findPlayerById(playerID);
+  if (!player) {
+    return false;
+  }
+
+  sessionIt->second.lifecycle = PlayerSessionState::respawning;
+  player->position = sessionIt->second.spawnPosition;
+  player->velocity = glm::vec2(0.0f);
+  resetPlayerRuntimeStatePreservingUnlocks(player->data.player);
+  player->shouldFlash = false;
+  player->flashTimer.reset();
+  player->grounded = false;
+  player->direction = 1.0f;
+  player->currentAnimation = ANIM_IDLE;
+  player->presentationVariant = PresentationVariant::Idle;
+  if (player->currentAnimation >= 0 &&
+      player->currentAnimation < static_cast<int>(player->animations.size())) {
+    player->animations[player->currentAnimation].reset();
+  }
+  player->spriteFrame = 1;
+  player->collider = player->baseCollider;
+  player->renderPosition = player->position;
+  player->renderPositionInitialized = true;
+  sessionIt->second.lifecycle = PlayerSessionState::alive;
+  m_authCtx->latestPlayerInputs[playerID] = NetGameInput{
+    .playerID = playerID,
+    .inputSeq = sessionIt->second.lastInputSeq,
+  };
+  return true;
+}
+
+bool GameRoom::removePlayer(uint32_t playerID) {
+  std::scoped_lock lock(m_stateMu);
+  if (!m_authCtx || !m_authCtx->state) {
+    return false;
+  }
+
+  bool changed = false;
+  auto& state = *m_authCtx->state;
+  if (state.playerLayer >= 0 && state.playerLayer < static_cast<int>(state.layers.size())) {
+    auto& layer = state.layers[state.playerLayer];
+    const auto oldSize = layer.size();
+    layer.erase(
+      std::remove_if(
+        layer.begin(),
+        layer.end(),
+        [playerID](const GameObject& obj) {
+          return obj.objClass == ObjectClass::Player && obj.id == playerID;
+        }),
+      layer.end());
+    changed = changed || layer.size() != oldSize;
+  }
+
+  changed = m_authCtx->latestPlayerInputs.erase(playerID) > 0 || changed;
+  changed = m_playerSessions.erase(playerID) > 0 || changed;
+  m_playerCount.store(static_cast<uint32_t>(m_playerSessions.size()));
+  {
+    std::scoped_lock historyLock(m_historyMu);
+    m_sentSnapshots.erase(playerID);
+  }
+  return changed;
+}
+
+bool GameRoom::HasPendingLevelTransition() const {
+  std::scoped_lock lock(m_pendingLevelTransitionMu);
+  return m_pendingLevelTransition.has_value();
+}
+
+std::optional<LevelIndex> GameRoom::ConsumePendingLevelTransition() {
+  std::scoped_lock lock(m_pendingLevelTransitionMu);
+  if (!m_pendingLevelTransition.has_value()) {
+    return std::nullopt;
+  }
+
+  const LevelIndex nextLevel = *m_pendingLevelTransition;
+  m_pendingLevelTransition.reset();
+  return nextLevel;
+}
+
+RoomManager::RoomManager(std::unique_ptr<AuthoritativeContext> defaultRoomCtx)
+  : m_default(std::make_shared<GameRoom>(kDefaultRoomID, std::move(defaultRoomCtx))),
+    m_rooms{m_default} {}
+
+RoomManager::~RoomManager() {
+  stopWorkers();
+  stopBuilding();
+}
+
+void RoomManager::setFactory(RoomFactory factory, size_t maxRooms) {
+  std::scoped_lock lock(m_mu);
+  m_factory = std::move(factory);
+  m_maxRooms = std::max<size_t>(1, maxRooms);
+  if (!m_builder) {
+    m_builder = std::make_unique<asio::thread_pool>(1); // one level load at a time
+  }
+}
+
+std::shared_ptr<GameRoom> RoomManager::find(uint32_t roomID) const {
+  std::scoped_lock lock(m_mu);
+  const auto it = std::lower_bound(m_rooms.begin(), m_rooms.end(), roomID,
+                                   [](const auto& room, uint32_t id) { return room->id() < id; });
+  return it != m_rooms.end() && (*it)->id() == roomID ? *it : nullptr;
+}
+
+// the factory loads a level, so it runs without m_mu held; if two callers race to make the same room
+// the first one in wins and the other's state is thrown away
+std::shared_ptr<GameRoom> RoomManager::findOrCreate(uint32_t roomID) {
+  if (auto room = find(roomID)) {
+    return room;
+  }
+
+  RoomFactory factory;
+  {
+    std::scoped_lock lock(m_mu);
+    if (!m_factory || m_rooms.size() + m_building.size() >= m_maxRooms) {
+      return nullptr;
+    }
+    factory = m_factory;
+  }
+  std::unique_ptr<AuthoritativeContext> authCtx = factory(roomID);
+  if (!authCtx) {
+    return nullptr;
+  }
+
+  auto created = std::make_shared<GameRoom>(roomID, std::move(authCtx));
+  std::scoped_lock lock(m_mu);
+  const auto it = std::lower_bound(m_rooms.begin(), m_rooms.end(), roomID,
+                                   [](const auto& room, uint32_t id) { return room->id() < id; });
+  if (it != m_rooms.end() && (*it)->id() == roomID) {
+    return *it;
+  }
+  if (m_rooms.size() + m_building.size() >= m_maxRooms) {
+    return nullptr;
+  }
+  m_rooms.insert(it, created);
+  return created;
+}
+
+// a build holds its slot against maxRooms from the moment it is asked for until the room is open
+bool RoomManager::buildAsync(uint32_t roomID, RoomBuilt onBuilt) {
+  std::unique_lock lock(m_mu);
+  const auto it = std::lower_bound(m_rooms.begin(), m_rooms.end(), roomID,
+                                   [](const auto& room, uint32_t id) { return room->id() < id; });
+  if (it != m_rooms.end() && (*it)->id() == roomID) {
+    const auto room = *it;
+    lock.unlock();
+    onBuilt(room);
+    return true;
+  }
+  if (const auto building = m_building.find(roomID); building != m_building.end()) {
+    building->second.push_back(std::move(onBuilt));
+    return true;
+  }
+  if (!m_factory || !m_builder || m_rooms.size() + m_building.size() >= m_maxRooms) {
+    return false;
+  }
+  m_building[roomID].push_back(std::move(onBuilt));
+
+  asio::post(*m_builder, [this, roomID, factory = m_factory]() {
+    std::unique_ptr<AuthoritativeContext> authCtx = factory(roomID);
+    std::shared_ptr<GameRoom> room = authCtx ? std::make_shared<GameRoom>(roomID, std::move(authCtx)) : nullptr;
+    std::vector<RoomBuilt> waiting;
+    {
+      std::scoped_lock lock(m_mu);
+      const auto building = m_building.find(roomID);
+      waiting = std::move(building->second);
+      m_building.erase(building);
+      const auto at = std::lower_bound(m_rooms.begin(), m_rooms.end(), roomID,
+                                       [](const auto& open, uint32_t id) { return open->id() < id; });
+      if (at != m_rooms.end() && (*at)->id() == roomID) {
+        room = *at; // findOrCreate got there first
+      } else if (room) {
+        m_rooms.insert(at, room);
+      }
+    }
+    for (auto& ready : waiting) {
+      ready(room);
+    }
+  });
+  return true;
+}
+
+void RoomManager::stopBuilding() {
+  std::unique_ptr<asio::thread_pool> builder;
+  {
+    std::scoped_lock lock(m_mu);
+    builder = std::move(m_builder);
+  }
+  if (builder) {
+    builder->join();
+  }
+}
+
+std::shared_ptr<GameRoom> RoomManager::roomOf(uint32_t clientID) const {
+  uint32_t roomID = kDefaultRoomID;
+  {
+    std::scoped_lock lock(m_mu);
+    const auto it = m_clientRooms.find(clientID);
+    if (it == m_clientRooms.end()) {
+      return m_default;
+    }
+    roomID = it->second;
+  }
+  auto room = find(roomID);
+  return room ? room : m_default;
+}
+
+std::optional<uint32_t> RoomManager::assignedRoom(uint32_t clientID) const {
+  std::scoped_lock lock(m_mu);
+  const auto it = m_clientRooms.find(clientID);
+  return it == m_clientRooms.end() ? std::nullopt : std::optional<uint32_t>(it->second);
+}
+
+// a room dropped between findOrCreate and here (its last player left on another thread) is put back
+void RoomManager::assign(uint32_t clientID, const std::shared_ptr<GameRoom>& room) {
+  std::scoped_lock lock(m_mu);
+  m_clientRooms[clientID] = room->id();
+  const auto it = std::lower_bound(m_rooms.begin(), m_rooms.end(), room->id(),
+                                   [](const auto& r, uint32_t id) { return r->id() < id; });
+  if (it == m_rooms.end() || (*it)->id() != room->id()) {
+    m_rooms.insert(it, room);
+  }
+}
+
+std::shared_ptr<GameRoom> RoomManager::unassign(uint32_t clientID) {
+  uint32_t roomID = kDefaultRoomID;
+  {
+    std::scoped_lock lock(m_mu);
+    const auto it = m_clientRooms.find(clientID);
+    if (it == m_clientRooms.end()) {
+      return m_default;
+    }
+    roomID = it->second;
+    m_clientRooms.erase(it);
+  }
+  auto room = find(roomID);
+  return room ? room : m_default;
+}
+
+void RoomManager::dropIfEmpty(const std::shared_ptr<GameRoom>& room) {
+  if (!room || room == m_default) {
+    return;
+  }
+  std::scoped_lock lock(m_mu);
+  if (room->playerCount() > 0) {
+    return;
+  }
+  for (const auto& [clientID, roomID] : m_clientRooms) {
+    (void)clientID;
+    if (roomID == room->id()) {
+      return;
+    }
+  }
+  std::erase(m_rooms, room);
+}
+
+void RoomManager::filterClients(
+  uint32_t roomID, std::vector<std::shared_ptr<net::connection<GameMsgHeaders>>>& clients) const {
+  std::scoped_lock lock(m_mu);
+  std::erase_if(clients, [&](const auto& client) {
+    if (!client) {
+      return true;
+    }
+    const auto it = m_clientRooms.find(client->GetID());
+    return (it == m_clientRooms.end() ? kDefaultRoomID : it->second) != roomID;
+  });
+}
+
+size_t RoomManager::roomCount() const {
+  std::scoped_lock lock(m_mu);
+  return m_rooms.size();
+}
+
+uint32_t RoomManager::playerCount() const {
+  std::scoped_lock lock(m_mu);
+  uint32_t count = 0;
+  for (const auto& room : m_rooms) {
+    count += room->playerCount();
+  }
+  return count;
+}
+
+void RoomManager::forEach(const std::function<void(GameRoom&)>& fn) const {
+  std::vector<std::shared_ptr<GameRoom>> rooms;
+  {
+    std::scoped_lock lock(m_mu);
+    rooms = m_rooms;
+  }
+  for (const auto& room : rooms) {
+    fn(*room);
+  }
+}
+
+void RoomManager::startWorkers(size_t count) {
+  stopWorkers();
+  if (count > 0) {
+    m_workers = std::make_unique<asio::thread_pool>(count);
+  }
+}
+
+void RoomManager::stopWorkers() {
+  if (m_workers) {
+    m_workers->join();
+    m_workers.reset();
+  }
+}
+
+void RoomManager::forEachParallel(const std::function<void(GameRoom&)>& fn) {
+  {
+    std::scoped_lock lock(m_mu);
+    m_vTickScratch.assign(m_rooms.begin(), m_rooms.end());
+  }
+  if (!m_workers || m_vTickScratch.size() < 2) {
+    for (const auto& room : m_vTickScratch) {
+      fn(*room);
+    }
+    m_vTickScratch.clear();
+    return;
+  }
+
+  // rooms take roughly the same time to step, so one task per room is even enough; the loop thread
+  // takes the first one itself instead of sitting idle
+  std::latch done(static_cast<std::ptrdiff_t>(m_vTickScratch.size() - 1));
+  for (size_t i = 1; i < m_vTickScratch.size(); ++i) {
+    asio::post(*m_workers, [&fn, &done, room = m_vTickScratch[i].get()]() {
+      fn(*room);
+      done.count_down();
+    });
+  }
+  fn(*m_vTickScratch.front());
+  done.wait();
+  m_vTickScratch.clear(); // dont keep dropped rooms alive until the next tick
+}
+
+} // namespace game_engine
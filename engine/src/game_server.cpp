@@ -1,101 +1,88 @@
 #include "engine/net/game_server.h"
 
 #include <algorithm>
+#include <cmath>
+#include <optional>
+#include <thread>
 
 #include "engine/engine.h"
 #include "engine/gameplay_simulation.h"
 
 namespace game_engine {
 
-AuthoritativeContext::AuthoritativeContext(GameState&& initialState)
-  : state(std::make_unique<GameState>(std::move(initialState))) {}
-
 namespace {
 
-ObjectData cloneObjectData(const GameObject& src) {
-  ObjectData data;
-  switch (src.objClass) {
-    case ObjectClass::Player:
-      new (&data.player) PlayerData(src.data.player);
-      break;
-    case ObjectClass::Enemy:
-      new (&data.enemy) EnemyData(src.data.enemy);
-      break;
-    case ObjectClass::Projectile:
-      new (&data.bullet) BulletData(src.data.bullet);
-      break;
-    case ObjectClass::Portal:
-      new (&data.portal) PortalData(src.data.portal.nextLevel);
-      break;
-    case ObjectClass::Level:
-    case ObjectClass::Background:
-      new (&data.level) LevelData(src.data.level);
-      break;
+bool isAlwaysRelevant(const GameObjectKey& key, const NetHitStopEvent& hitStop) {
+  if (key.first == ObjectClass::Player) {
+    return true;
   }
-  return data;
-}
-
-GameObject cloneGameObject(const GameObject& src) {
-  GameObject dst(src.spritePixelH, src.spritePixelW);
-  dst.id = src.id;
-  dst.objClass = src.objClass;
-  dst.spriteType = src.spriteType;
-  dst.data = cloneObjectData(src);
-  dst.position = src.position;
-  dst.velocity = src.velocity;
-  dst.acceleration = src.acceleration;
-  dst.direction = src.direction;
-  dst.maxSpeedX = src.maxSpeedX;
-  dst.animations = src.animations;
-  dst.currentAnimation = src.currentAnimation;
-  dst.presentationVariant = src.presentationVariant;
-  dst.dynamic = src.dynamic;
-  dst.grounded = src.grounded;
-  dst.drawScale = src.drawScale;
-  dst.spritePixelW = src.spritePixelW;
-  dst.spritePixelH = src.spritePixelH;
-  dst.baseCollider = src.baseCollider;
-  dst.collider = src.collider;
-  dst.colliderNorm = src.colliderNorm;
-  dst.flashTimer = src.flashTimer;
-  dst.shouldFlash = src.shouldFlash;
-  dst.spriteFrame = src.spriteFrame;
-  dst.renderPosition = src.renderPosition;
-  dst.renderPositionInitialized = src.renderPositionInitialized;
-  dst.texture = nullptr;
-  return dst;
-}
-
-void resetPlayerRuntimeStatePreservingUnlocks(PlayerData& playerData) {
-  const bool unlockedUltimateOne = playerData.unlockedUltimateOne;
-  playerData = PlayerData();
-  playerData.unlockedUltimateOne = unlockedUltimateOne;
-}
-
-void markPlayerDeadFromFall(GameObject& player) {
-  if (player.objClass != ObjectClass::Player ||
-      player.data.player.state == PlayerState::dead) {
-    return;
+  return hitStop.active &&
+         ((key.first == hitStop.attackerClass && key.second == hitStop.attackerId) ||
+          (key.first == hitStop.victimClass && key.second == hitStop.victimId));
+}
+
+// accumulates tick start times for one reporting window of TickTimingStats
+class TickTimingWindow {
+public:
+  // once per loop wakeup that runs ticks; a wakeup that catches up runs several
+  void add(double lateMs, std::optional<double> intervalMs) {
+    ++m_wakeups;
+    m_lateSum += lateMs;
+    m_lateMax = std::max(m_lateMax, lateMs);
+    if (intervalMs) {
+      ++m_intervals;
+      m_intervalSum += *intervalMs;
+      m_intervalSqSum += *intervalMs * *intervalMs;
+    }
   }
 
-  player.data.player.healthPoints = 0;
-  player.data.player.state = PlayerState::dead;
-  player.presentationVariant = PresentationVariant::Die;
-  player.currentAnimation = ANIM_DIE;
-  if (player.currentAnimation >= 0 &&
-      player.currentAnimation < static_cast<int>(player.animations.size())) {
-    player.animations[player.currentAnimation].reset();
+  TickTimingStats take() {
+    TickTimingStats stats;
+    stats.ticks = m_ticks;
+    if (m_wakeups > 0) {
+      stats.meanLateMs = m_lateSum / static_cast<double>(m_wakeups);
+      stats.maxLateMs = m_lateMax;
+    }
+    if (m_intervals > 1) {
+      const double n = static_cast<double>(m_intervals);
+      const double mean = m_intervalSum / n;
+      stats.intervalJitterMs = std::sqrt(std::max(0.0, m_intervalSqSum / n - mean * mean));
+    }
+    *this = TickTimingWindow{};
+    return stats;
   }
-  player.spriteFrame = 1;
-  player.velocity = glm::vec2(0.0f);
-}
+
+  void countTick() {
+    ++m_ticks;
+  }
+
+private:
+  uint64_t m_ticks = 0;
+  uint64_t m_wakeups = 0;
+  uint64_t m_intervals = 0;
+  double m_lateSum = 0.0;
+  double m_lateMax = 0.0;
+  double m_intervalSum = 0.0;
+  double m_intervalSqSum = 0.0;
+};
 
 } // namespace
 
-GameServer::GameServer(uint16_t nPort, std::unique_ptr<AuthoritativeContext> authCtx)
+GameServer::GameServer(uint16_t nPort, std::unique_ptr<AuthoritativeContext> authCtx, size_t encodeThreads)
   : net::server_interface<GameMsgHeaders>(nPort),
-    m_authCtx(std::move(authCtx)) {
-  refreshGameSnapshot();
+    m_rooms(std::move(authCtx)),
+    m_encodePool(std::max<size_t>(1, encodeThreads)) {
+  SetPingMessage(GameMsgHeaders::Server_GetPing);
+  // snapshots are superseded by the next one and inputs are resent until acked, so a simulated network
+  // may drop or reorder them
+  SetUnreliableMessage(GameMsgHeaders::Game_Snapshot);
+  SetUnreliableMessage(GameMsgHeaders::Game_PlayerInput);
+}
+
+GameServer::~GameServer() {
+  m_rooms.stopBuilding(); // its callbacks write m_builtJoins
+  m_encodersRunning.store(false);
+  m_encodePool.join();
 }
 
 bool GameServer::OnClientConnect(std::shared_ptr<net::connection<GameMsgHeaders>> client) {
@@ -110,11 +97,49 @@ void GameServer::OnClientValidated(std::shared_ptr<net::connection<GameMsgHeader
 }
 
 void GameServer::OnClientDisconnect(std::shared_ptr<net::connection<GameMsgHeaders>> client) {
-  if (!client) {
+  if (!client || suspendSession(client)) {
     return;
   }
-  if (removePlayer(client->GetID())) {
-    m_vGarbageIDs.push_back(client->GetID());
+  leaveRoom(client->GetID()); // may be called from an encode worker
+}
+
+bool GameServer::leaveRoom(uint32_t clientID) {
+  const std::shared_ptr<GameRoom> room = m_rooms.unassign(clientID);
+  const bool removed = room->removePlayer(clientID);
+  if (removed) {
+    std::scoped_lock lock(room->m_stateMu);
+    room->m_vGarbageIDs.push_back(clientID);
+  }
+  m_rooms.dropIfEmpty(room);
+  return removed;
+}
+
+bool GameServer::joinRoom(const std::shared_ptr<net::connection<GameMsgHeaders>>& client, SpriteType spriteType,
+                          const std::shared_ptr<GameRoom>& room) {
+  if (!room->registerPlayer(client->GetID(), spriteType)) {
+    return false;
+  }
+  m_rooms.assign(client->GetID(), room);
+  sendAssignID(client, client->GetID(), room->id(), openSession(client, room->id()));
+  room->requestBroadcast();
+  return true;
+}
+
+void GameServer::attachBuiltRooms() {
+  std::vector<PendingJoin> built;
+  {
+    std::scoped_lock lock(m_builtJoinsMu);
+    built.swap(m_builtJoins);
+  }
+  for (const PendingJoin& join : built) {
+    const auto client = join.client.lock();
+    if (join.room && client && client->IsConnected() && !m_rooms.assignedRoom(client->GetID())) {
+      joinRoom(client, join.spriteType, join.room);
+    }
+  }
+  // after every join went in, so a room some other client is joining isnt closed under it
+  for (const PendingJoin& join : built) {
+    m_rooms.dropIfEmpty(join.room);
   }
 }
 
@@ -127,398 +152,542 @@ void GameServer::OnMessage(
 
   switch (msg.header.id) {
     case GameMsgHeaders::Client_RegisterWithServer: {
-      net::ByteReader reader(msg.body);
-      const SpriteType spriteType = reader.read_enum<SpriteType>();
-      if (registerPlayer(client->GetID(), spriteType)) {
-        net::message<GameMsgHeaders> reply;
-        reply.header.id = GameMsgHeaders::Client_AssignID;
-        net::ByteWriter writer;
-        writer.write_u32(client->GetID());
-        reply.body = std::move(writer.buff);
-        reply.header.bodySize = reply.body.size();
-        MessageClient(client, reply);
-        broadcastSnapshot();
+      // sprite type, then the room to join (older clients stop after the sprite type: default room)
+      SpriteType spriteType{};
+      uint32_t roomID = kDefaultRoomID;
+      try {
+        net::ByteReader reader(msg.body);
+        spriteType = reader.read_enum<SpriteType>();
+        if (reader.i < reader.n) {
+          roomID = reader.read_u32();
+        }
+      } catch (const std::exception&) {
+        break;
+      }
+      if (const auto current = m_rooms.assignedRoom(client->GetID()); current && *current != roomID) {
+        break; // already playing in another room
       }
+      if (const std::shared_ptr<GameRoom> room = m_rooms.find(roomID)) {
+        joinRoom(client, spriteType, room);
+        break;
+      }
+      // a new room loads its level on the build thread; the player joins once attachBuiltRooms sees it.
+      // past maxRooms the register is dropped and the client stays unassigned
+      m_rooms.buildAsync(roomID, [this, weakClient = std::weak_ptr(client), spriteType](std::shared_ptr<GameRoom> room) {
+        std::scoped_lock lock(m_builtJoinsMu);
+        m_builtJoins.push_back(PendingJoin{weakClient, spriteType, std::move(room)});
+      });
       break;
     }
-    case GameMsgHeaders::Client_UnregisterWithServer:
-      if (removePlayer(client->GetID())) {
-        broadcastSnapshot();
+    case GameMsgHeaders::Client_UnregisterWithServer: {
+      const std::shared_ptr<GameRoom> room = m_rooms.roomOf(client->GetID());
+      closeSession(client->GetID());
+      if (leaveRoom(client->GetID())) {
+        room->requestBroadcast();
       }
       break;
+    }
+    case GameMsgHeaders::Client_ResumeSession: {
+      uint64_t token = 0;
+      uint64_t lastTick = 0;
+      try {
+        net::ByteReader reader(msg.body);
+        token = reader.read_u64();
+        lastTick = reader.read_u64();
+      } catch (const std::exception&) {
+        break;
+      }
+      resumeSession(client, token, lastTick);
+      break;
+    }
     case GameMsgHeaders::Game_PlayerInput: {
-      NetGameInput input;
-      input.deserealizeNetGameInput(msg.body);
-      input.playerID = client->GetID();
-      m_playerInputQueue.push_back(input);
+      NetInputPacket packet;
+      try {
+        packet.deserealizeNetInputPacket(msg.body);
+      } catch (const std::exception&) {
+        break; // malformed input from a client shouldnt take the server down
+      }
+      // OnMessage runs on the same thread that drains this queue, so never block on it; a client flooding
+      // inputs past the ring size just loses the overflow. redundant frames are dropped by
+      // applyPlayerInputs on inputSeq
+      const std::shared_ptr<GameRoom> room = m_rooms.roomOf(client->GetID());
+      if (const auto demo = room->m_demo.load()) {
+        const auto published = room->m_publishedSnapshot.load();
+        demo->recordInput(published ? published->serverTick : 0, msg.body);
+      }
+      for (NetGameInput& input : packet.frames) {
+        input.playerID = client->GetID();
+        room->m_playerInputQueue.try_push(input);
+      }
       break;
     }
-    case GameMsgHeaders::Game_PlayerRespawnRequest:
-      if (respawnPlayer(client->GetID())) {
-        broadcastSnapshot();
+    case GameMsgHeaders::Game_PlayerRespawnRequest: {
+      const std::shared_ptr<GameRoom> room = m_rooms.roomOf(client->GetID());
+      if (room->respawnPlayer(client->GetID())) {
+        room->requestBroadcast();
       }
       break;
+    }
     default:
       break;
   }
 }
 
-GameObject* GameServer::findPlayerById(uint32_t playerID) {
-  std::scoped_lock lock(m_stateMu);
-  if (!m_authCtx || !m_authCtx->state) {
-    return nullptr;
-  }
+void GameServer::tickRooms(float deltaTime, bool broadcastDue) {
+  m_rooms.forEachParallel([this, deltaTime, broadcastDue](GameRoom& room) {
+    room.applyPlayerInputs();
+    room.step(deltaTime);
+    // publish every tick (the host renders from it); the encoders send every few, or straight away
+    // when a join / respawn asked for one
+    room.publishSnapshot();
+    if (room.takeBroadcastRequest() || broadcastDue) {
+      scheduleEncode(room);
+    }
+  });
+}
 
-  auto& state = *m_authCtx->state;
-  if (state.playerLayer < 0 || state.playerLayer >= static_cast<int>(state.layers.size())) {
-    return nullptr;
+void GameServer::broadcastSnapshot(uint32_t roomID) {
+  if (const auto room = m_rooms.find(roomID)) {
+    room->publishSnapshot();
+    scheduleEncode(*room);
   }
+}
 
-  for (auto& obj : state.layers[state.playerLayer]) {
-    if (obj.objClass == ObjectClass::Player && obj.id == playerID) {
-      return &obj;
-    }
+// a room is on at most one encode worker at a time. requests that arrive while it is being encoded
+// collapse into one more pass, which just sends whatever is published by then
+void GameServer::scheduleEncode(GameRoom& room) {
+  room.m_encodeRequests.fetch_add(1);
+  if (!room.m_encoding.exchange(true)) {
+    asio::post(m_encodePool, [this, room = room.shared_from_this()]() { runEncoder(room); });
   }
-  return nullptr;
 }
 
-void GameServer::applyPlayerInputs() {
-  std::scoped_lock lock(m_stateMu);
-  while (!m_playerInputQueue.empty()) {
-    const NetGameInput input = m_playerInputQueue.pop_front();
-    if (!m_authCtx) {
-      continue;
-    }
-    auto sessionIt = m_playerSessions.find(input.playerID);
-    if (sessionIt == m_playerSessions.end()) {
-      continue;
+void GameServer::runEncoder(std::shared_ptr<GameRoom> room) {
+  while (m_encodersRunning.load()) {
+    const uint64_t handled = room->m_encodeRequests.load();
+    if (const auto snapshot = room->m_publishedSnapshot.load()) {
+      encodeAndSend(*room, snapshot);
     }
-    if (input.inputSeq <= sessionIt->second.lastInputSeq) {
-      continue;
+    room->m_encoding.store(false);
+    // a request that came in after the load above may have seen m_encoding still set and left it to us
+    if (room->m_encodeRequests.load() == handled || room->m_encoding.exchange(true)) {
+      return;
     }
-    sessionIt->second.lastInputSeq = input.inputSeq;
-    m_authCtx->latestPlayerInputs[input.playerID] = input; // store only the latest input from each player
   }
+  room->m_encoding.store(false);
 }
 
-void GameServer::step(float deltaTime) {
-  std::scoped_lock lock(m_stateMu);
-  if (!m_authCtx || !m_authCtx->state) {
-    return;
-  }
-
-  GameState& state = *m_authCtx->state;
-  ++m_authCtx->serverTick;
-  state.m_stateLastUpdatedAt = m_authCtx->serverTick;
-
-  GameplaySimulationHooks hooks;
-  hooks.onPortalTriggered = [this](LevelIndex nextLevel) {
-    std::scoped_lock lock(m_pendingLevelTransitionMu);
-    if (!m_pendingLevelTransition.has_value()) {
-      m_pendingLevelTransition = nextLevel;
+void GameServer::encodeAndSend(GameRoom& room, const std::shared_ptr<const NetGameStateSnapshot>& published) {
+  const NetGameStateSnapshot& snapshot = *published;
+  net::message<GameMsgHeaders> rawMsg;
+  rawMsg.header.id = GameMsgHeaders::Game_Snapshot;
+  net::message<GameMsgHeaders> packedMsg;
+  bool packed = false;
+  if (!m_interestConfig.enabled) {
+    // everyone in the room gets the same snapshot: encode (and compress) it once
+    rawMsg.body = snapshot.serealizeNetGameStateSnapshot();
+    rawMsg.header.bodySize = rawMsg.body.size();
+    packedMsg = rawMsg;
+    packed = m_compressionConfig.enabled && net::compress_message(packedMsg, m_compressionConfig.threshold);
+  }
+
+  // a recorded room keeps the whole snapshot, whatever each client ends up being sent
+  if (const auto demo = room.m_demo.load()) {
+    if (m_interestConfig.enabled) {
+      rawMsg.body = snapshot.serealizeNetGameStateSnapshot();
     }
-  };
-  hooks.onHitConfirmed =
-    [this](GameObjectKey attacker, GameObjectKey victim, HitStopStrength strength) {
-      m_latestHitStopEvent.sequence = m_nextHitStopSequence++;
-      m_latestHitStopEvent.active = true;
-      m_latestHitStopEvent.attackerClass = attacker.first;
-      m_latestHitStopEvent.attackerId = attacker.second;
-      m_latestHitStopEvent.victimClass = victim.first;
-      m_latestHitStopEvent.victimId = victim.second;
-      m_latestHitStopEvent.strength = strength;
-      m_hitStopEventDirty = true;
-    };
-  stepGameplaySimulation(state, m_authCtx->latestPlayerInputs, deltaTime, hooks);
-
-  for (auto& [playerID, session] : m_playerSessions) {
-    (void)session;
-    if (GameObject* player = findPlayerById(playerID)) {
-      if (!player->grounded && player->position.y > 1500.0f) {
-        markPlayerDeadFromFall(*player);
+    demo->recordSnapshot(snapshot.serverTick, rawMsg.body);
+  }
+
+  // snapshots are latest-only: a client that cant keep up gets the newest one next instead of a backlog.
+  // iterate a copy: MessageClient erases disconnected clients, and io threads add new ones
+  auto clients = CopyConnections();
+  m_rooms.filterClients(room.id(), clients);
+  NetGameStateSnapshot clientSnapshot;
+  for (const auto& client : clients) {
+    ClientInterest& interest = room.m_clientInterest[client->GetID()];
+    if (m_snapshotRateConfig.enabled) {
+      const bool due = interest.rate.update(
+        m_snapshotRateConfig, m_baseSnapshotInterval.load(std::memory_order_relaxed), client->GetStats(),
+        snapshot.serverTick);
+      // a hit stop is an event, not state: everyone gets the snapshot carrying it
+      if (!due && !snapshot.hitStopEvent.active) {
+        continue;
       }
+      interest.rate.lastSentTick = snapshot.serverTick;
     }
-  }
 
-  for (auto& [playerID, input] : m_authCtx->latestPlayerInputs) {
-    input.jumpPressed = false;
-    input.meleePressed = false;
-    input.ultimatePressed = false;
-    (void)playerID;
+    const bool clientInflates = client->RemoteSupports(net::kCapCompression);
+    if (m_interestConfig.enabled) {
+      buildClientSnapshot(room, client->GetID(), snapshot, clientSnapshot, interest.rate.detailScale);
+      rawMsg.body = clientSnapshot.serealizeNetGameStateSnapshot();
+      rawMsg.header.bodySize = rawMsg.body.size();
+      if (m_compressionConfig.enabled && clientInflates) {
+        net::compress_message(rawMsg, m_compressionConfig.threshold);
+      }
+      MessageClientLatest(client, rawMsg);
+    } else {
+      MessageClientLatest(client, packed && clientInflates ? packedMsg : rawMsg);
+    }
+    if (m_resumeConfig.enabled) {
+      room.rememberSent(client->GetID(), published);
+    }
   }
 
-  for (auto& [playerID, session] : m_playerSessions) {
-    if (GameObject* player = findPlayerById(playerID)) {
-      session.lifecycle =
-        player->data.player.state == PlayerState::dead ? PlayerSessionState::dead
-                                                       : PlayerSessionState::alive;
-    }
+  if (snapshot.hitStopEvent.active) {
+    room.m_hitStopSentSequence.store(snapshot.hitStopEvent.sequence, std::memory_order_release);
   }
+
+  // forget interest for clients that have gone (or left the room)
+  std::erase_if(room.m_clientInterest, [&clients](const auto& entry) {
+    return std::none_of(clients.begin(), clients.end(), [&entry](const auto& client) {
+      return client->GetID() == entry.first;
+    });
+  });
 }
 
-void GameServer::refreshGameSnapshot() {
-  std::scoped_lock lock(m_stateMu);
-  if (!m_authCtx || !m_authCtx->state) {
-    return;
+bool GameServer::startDemoRecording(const std::filesystem::path& path, uint32_t roomID) {
+  const auto room = m_rooms.find(roomID);
+  if (!room) {
+    return false;
   }
-  m_currGameSnapshot = m_authCtx->state->extractNetSnapshot();
-  m_currGameSnapshot.serverTick = m_authCtx->serverTick;
-  m_currGameSnapshot.levelId = m_authCtx->state->currentLevelId;
-  if (m_hitStopEventDirty) {
-    m_currGameSnapshot.hitStopEvent = m_latestHitStopEvent;
-    m_hitStopEventDirty = false;
-  } else {
-    m_currGameSnapshot.hitStopEvent.active = false;
+  auto writer = std::make_shared<DemoWriter>();
+  if (!writer->open(path, 0, roomID)) {
+    return false;
   }
+  room->m_demo.store(std::move(writer));
+  return true;
 }
 
-void GameServer::broadcastSnapshot() {
-  refreshGameSnapshot();
-  net::message<GameMsgHeaders> msg;
-  msg.header.id = GameMsgHeaders::Game_Snapshot;
-  msg.body = m_currGameSnapshot.serealizeNetGameStateSnapshot();
-  msg.header.bodySize = msg.body.size();
-  BroadcastToClients(msg);
+// the file is finished by whichever of us or an encode worker lets go of the writer last
+void GameServer::stopDemoRecording(uint32_t roomID) {
+  if (const auto room = m_rooms.find(roomID)) {
+    room->m_demo.store(nullptr);
+  }
+}
+
+void GameServer::sendAssignID(const std::shared_ptr<net::connection<GameMsgHeaders>>& client, uint32_t playerID,
+                              uint32_t roomID, uint64_t token) {
+  net::message<GameMsgHeaders> reply;
+  reply.header.id = GameMsgHeaders::Client_AssignID;
+  net::ByteWriter writer;
+  writer.write_u32(playerID);
+  writer.write_u32(roomID);
+  writer.write_u64(token);
+  writer.write_u32(static_cast<uint32_t>(std::lround(m_resumeConfig.graceSeconds * 1000.0)));
+  reply.body = std::move(writer.buff);
+  reply.header.bodySize = reply.body.size();
+  MessageClient(client, reply);
 }
 
-bool GameServer::copyCurrentSnapshot(NetGameStateSnapshot& out) const {
-  std::scoped_lock lock(m_stateMu);
-  if (!m_authCtx || !m_authCtx->state) {
+// 0 = no session (resume turned off)
+uint64_t GameServer::openSession(const std::shared_ptr<net::connection<GameMsgHeaders>>& client, uint32_t roomID) {
+  if (!m_resumeConfig.enabled) {
+    return 0;
+  }
+  std::scoped_lock lock(m_sessionsMu);
+  uint64_t token = 0;
+  while (token == 0 || m_sessions.contains(token)) {
+    token = (static_cast<uint64_t>(m_tokenSource()) << 32) | m_tokenSource();
+  }
+  m_sessions[token] = ResumableSession{client->GetID(), roomID, client, std::nullopt};
+  m_sessionTokens[client->GetID()] = token;
+  return token;
+}
+
+bool GameServer::suspendSession(const std::shared_ptr<net::connection<GameMsgHeaders>>& client) {
+  std::scoped_lock lock(m_sessionsMu);
+  const auto tokenIt = m_sessionTokens.find(client->GetID());
+  if (tokenIt == m_sessionTokens.end()) {
     return false;
   }
-  out = m_currGameSnapshot;
+  ResumableSession& session = m_sessions.at(tokenIt->second);
+  const auto current = session.connection.lock();
+  if (current && current != client) {
+    return true; // the connection a resume replaced, reporting in late
+  }
+  if (!session.droppedAt) {
+    session.droppedAt = std::chrono::steady_clock::now();
+  }
   return true;
 }
 
-// rebuilds the host/server’s authoritative game world from a fresh GameState, while preserving the currently connected multiplayer roster.
-void GameServer::resetAuthoritativeState(GameState&& initialState, bool refreshSpawnPositions) {
-  std::scoped_lock lock(m_stateMu);
-  if (!m_authCtx) {
-    m_authCtx = std::make_unique<AuthoritativeContext>(std::move(initialState));
-    refreshGameSnapshot();
-    return;
+void GameServer::closeSession(uint32_t playerID) {
+  std::scoped_lock lock(m_sessionsMu);
+  const auto tokenIt = m_sessionTokens.find(playerID);
+  if (tokenIt != m_sessionTokens.end()) {
+    m_sessions.erase(tokenIt->second);
+    m_sessionTokens.erase(tokenIt);
   }
+}
 
-  m_authCtx->state = std::make_unique<GameState>(std::move(initialState));
-  m_authCtx->latestPlayerInputs.clear();
-  while (!m_playerInputQueue.empty()) {
-    m_playerInputQueue.pop_front();
-  }
-  m_latestHitStopEvent = {};
-  m_hitStopEventDirty = false;
-  m_nextHitStopSequence = 1;
+void GameServer::expireSessions() {
+  const auto now = std::chrono::steady_clock::now();
+  const auto grace = std::chrono::duration<double>(m_resumeConfig.graceSeconds);
+  std::vector<uint32_t> expired;
   {
-    std::scoped_lock lock(m_pendingLevelTransitionMu);
-    m_pendingLevelTransition.reset();
+    std::scoped_lock lock(m_sessionsMu);
+    for (auto it = m_sessions.begin(); it != m_sessions.end();) {
+      if (it->second.droppedAt && now - *it->second.droppedAt > grace) {
+        expired.push_back(it->second.playerID);
+        m_sessionTokens.erase(it->second.playerID);
+        it = m_sessions.erase(it);
+      } else {
+        ++it;
+      }
+    }
   }
-
-  auto& state = *m_authCtx->state;
-  if (state.playerLayer < 0 || state.playerLayer >= static_cast<int>(state.layers.size())) {
-    refreshGameSnapshot();
-    return;
+  for (const uint32_t playerID : expired) {
+    const std::shared_ptr<GameRoom> room = m_rooms.roomOf(playerID);
+    if (leaveRoom(playerID)) {
+      room->requestBroadcast();
+    }
   }
+}
 
-  auto& layer = state.layers[state.playerLayer];
-  auto templateIt = std::find_if(
-    layer.begin(),
-    layer.end(),
-    [](const GameObject& obj) { return obj.objClass == ObjectClass::Player; });
-  if (templateIt == layer.end()) {
-    refreshGameSnapshot();
+// the new connection takes over the session's player id, so the room, the input history and the
+// per-client interest and rate state all carry on as if the link had never dropped
+void GameServer::resumeSession(const std::shared_ptr<net::connection<GameMsgHeaders>>& client, uint64_t token,
+                               uint64_t lastTick) {
+  std::shared_ptr<net::connection<GameMsgHeaders>> previous;
+  ResumableSession session;
+  bool found = false;
+  if (!m_rooms.assignedRoom(client->GetID())) { // a client already playing cant take over another player
+    std::scoped_lock lock(m_sessionsMu);
+    const auto it = token != 0 ? m_sessions.find(token) : m_sessions.end();
+    if (it != m_sessions.end()) {
+      previous = it->second.connection.lock();
+      it->second.connection = client;
+      it->second.droppedAt.reset();
+      session = it->second;
+      found = true;
+    }
+  }
+  const std::shared_ptr<GameRoom> room = found ? m_rooms.find(session.roomID) : nullptr;
+  if (!room) {
+    net::message<GameMsgHeaders> reply;
+    reply.header.id = GameMsgHeaders::Client_ResumeRejected;
+    MessageClient(client, reply);
     return;
   }
 
-  const GameObject templatePlayer = cloneGameObject(*templateIt);
-  layer.erase(
-    std::remove_if(
-      layer.begin(),
-      layer.end(),
-      [](const GameObject& obj) { return obj.objClass == ObjectClass::Player; }),
-    layer.end());
-
-  std::vector<std::pair<uint32_t, PlayerSession>> roster;
-  roster.reserve(m_playerSessions.size());
-  for (const auto& [playerID, session] : m_playerSessions) {
-    roster.emplace_back(playerID, session);
+  if (previous && previous != client) {
+    previous->Disconnect(); // a half-open link the server hadnt noticed yet
   }
-  std::sort(roster.begin(), roster.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+  client->SetID(session.playerID);
+  sendAssignID(client, session.playerID, session.roomID, token);
 
-  for (std::size_t idx = 0; idx < roster.size(); ++idx) {
-    if (refreshSpawnPositions) {
-      m_playerSessions[roster[idx].first].spawnPosition = templatePlayer.position;
-      m_playerSessions[roster[idx].first].spawnPosition.x += 48.0f * static_cast<float>(idx);
-    }
+  // everything since the client's last snapshot, or all of it if that one is too old to still be here
+  const auto current = room->m_publishedSnapshot.load();
+  if (!current) {
+    return;
+  }
+  net::message<GameMsgHeaders> catchUp;
+  if (const auto base = room->sentSnapshotAt(session.playerID, lastTick)) {
+    catchUp.header.id = GameMsgHeaders::Game_SnapshotDelta;
+    catchUp.body = current->serealizeNetGameStateDelta(*base);
+  } else {
+    catchUp.header.id = GameMsgHeaders::Game_Snapshot;
+    catchUp.body = current->serealizeNetGameStateSnapshot();
+  }
+  catchUp.header.bodySize = catchUp.body.size();
+  MessageClient(client, catchUp);
+}
 
-    GameObject player = cloneGameObject(templatePlayer);
-    player.id = roster[idx].first;
-    player.spriteType = roster[idx].second.spriteType;
-    player.position = m_playerSessions[roster[idx].first].spawnPosition;
-    player.velocity = glm::vec2(0.0f);
-    player.acceleration = templatePlayer.acceleration;
-    player.data.player = templatePlayer.data.player;
-    player.currentAnimation = ANIM_IDLE;
-    player.presentationVariant = PresentationVariant::Idle;
-    if (player.currentAnimation >= 0 &&
-        player.currentAnimation < static_cast<int>(player.animations.size())) {
-      player.animations[player.currentAnimation].reset();
+void GameServer::pingClients() {
+  const auto clients = CopyConnections();
+  std::vector<std::pair<uint32_t, net::connection_stats>> stats;
+  stats.reserve(clients.size());
+  for (const auto& client : clients) {
+    if (!client || !client->IsConnected()) {
+      continue;
     }
-    player.spriteFrame = 1;
-    player.shouldFlash = false;
-    player.flashTimer.reset();
-    player.collider = player.baseCollider;
-    player.direction = 1.0f;
-    layer.push_back(std::move(player));
-    m_playerSessions[roster[idx].first].lifecycle = PlayerSessionState::alive;
+    client->SendPing();
+    stats.emplace_back(client->GetID(), client->GetStats());
   }
 
-  refreshGameSnapshot();
+  std::scoped_lock lock(m_clientStatsMu);
+  m_clientStats = std::move(stats);
 }
 
-bool GameServer::registerPlayer(uint32_t playerID, SpriteType spriteType) {
-  std::scoped_lock lock(m_stateMu);
-  if (!m_authCtx || !m_authCtx->state) {
-    return false;
-  }
+std::vector<std::pair<uint32_t, net::connection_stats>> GameServer::copyClientStats() const {
+  std::scoped_lock lock(m_clientStatsMu);
+  return m_clientStats;
+}
 
-  if (findPlayerById(playerID)) {
-    return true;
-  }
+void GameServer::setTickTimingStats(const TickTimingStats& stats) {
+  std::scoped_lock lock(m_clientStatsMu);
+  m_tickTiming = stats;
+}
 
-  auto& state = *m_authCtx->state;
-  if (state.playerLayer < 0 || state.playerLayer >= static_cast<int>(state.layers.size())) {
-    return false;
-  }
+TickTimingStats GameServer::tickTimingStats() const {
+  std::scoped_lock lock(m_clientStatsMu);
+  return m_tickTiming;
+}
 
-  GameObject* templatePlayer = nullptr;
-  for (auto& obj : state.layers[state.playerLayer]) {
-    if (obj.objClass == ObjectClass::Player) {
-      templatePlayer = &obj;
-      break;
-    }
+bool SnapshotRate::update(
+  const SnapshotRateConfig& config, uint32_t baseIntervalTicks, const net::connection_stats& link, uint64_t tick) {
+  const double minInterval = std::max<uint32_t>(1, config.minIntervalTicks);
+  const double maxInterval = std::max<double>(minInterval, config.maxIntervalTicks);
+  const double baseInterval = std::clamp<double>(baseIntervalTicks, minInterval, maxInterval);
+
+  if (intervalTicks <= 0.0) {
+    intervalTicks = baseInterval;
+    lastAdjustTick = tick;
+    supersededSeen = link.snapshotsSuperseded;
+    return true; // first snapshot goes out straight away
   }
-  if (!templatePlayer) {
-    return false;
+  if (tick < lastSentTick || tick < lastAdjustTick) {
+    lastAdjustTick = tick; // the server's tick count restarted (new authoritative state)
+    return true;
   }
 
-  if (m_playerSessions.empty()) {
-    const glm::vec2 spawnPosition = templatePlayer->position;
-    templatePlayer->id = playerID;
-    templatePlayer->spriteType = spriteType;
-    resetPlayerRuntimeStatePreservingUnlocks(templatePlayer->data.player);
-    templatePlayer->velocity = glm::vec2(0.0f);
-    templatePlayer->currentAnimation = ANIM_IDLE;
-    templatePlayer->presentationVariant = PresentationVariant::Idle;
-    templatePlayer->spriteFrame = 1;
-    m_playerSessions[playerID] = PlayerSession{
-      .spriteType = spriteType,
-      .lifecycle = PlayerSessionState::alive,
-      .lastInputSeq = 0,
-      .spawnPosition = spawnPosition,
-    };
-    return true;
+  if (link.hasRtt && (minRttMs <= 0.0 || link.rttMs < minRttMs)) {
+    minRttMs = link.rttMs;
   }
 
-  GameObject newPlayer = cloneGameObject(*templatePlayer);
-  newPlayer.id = playerID;
-  newPlayer.spriteType = spriteType;
-  newPlayer.position.x += 48.0f * static_cast<float>(m_playerSessions.size());
-  newPlayer.velocity = glm::vec2(0.0f);
-  resetPlayerRuntimeStatePreservingUnlocks(newPlayer.data.player);
-  newPlayer.currentAnimation = ANIM_IDLE;
-  newPlayer.presentationVariant = PresentationVariant::Idle;
-  state.layers[state.playerLayer].push_back(std::move(newPlayer));
-  m_playerSessions[playerID] = PlayerSession{
-    .spriteType = spriteType,
-    .lifecycle = PlayerSessionState::alive,
-    .lastInputSeq = 0,
-    .spawnPosition = state.layers[state.playerLayer].back().position,
-  };
-  return true;
-}
+  if (tick >= lastAdjustTick + config.adjustEveryTicks) {
+    const bool congested =
+      link.outboundQueueDepth > config.maxQueueDepth || link.snapshotsSuperseded > supersededSeen ||
+      (link.hasRtt && (link.rttMs > config.maxRttMs || link.rttMs > minRttMs + config.maxRttRiseMs)) ||
+      (config.maxBytesPerSec > 0.0 && link.bytesOutPerSec > config.maxBytesPerSec);
+    intervalTicks = congested ? intervalTicks * config.backoffFactor : intervalTicks - config.recoverTicks;
+    intervalTicks = std::clamp(intervalTicks, minInterval, maxInterval);
+    lastAdjustTick = tick;
+    supersededSeen = link.snapshotsSuperseded;
 
-bool GameServer::respawnPlayer(uint32_t playerID) {
-  std::scoped_lock lock(m_stateMu);
-  if (!m_authCtx || !m_authCtx->state) {
-    return false;
+    // full detail at or above the base rate, shrinking towards minDetailScale at the slowest
+    detailScale = 1.0f;
+    if (intervalTicks > baseInterval && maxInterval > baseInterval) {
+      const float t = static_cast<float>((intervalTicks - baseInterval) / (maxInterval - baseInterval));
+      detailScale = 1.0f - t * (1.0f - config.minDetailScale);
+    }
   }
 
-  auto sessionIt = m_playerSessions.find(playerID);
-  if (sessionIt == m_playerSessions.end()) {
-    return false;
-  }
+  return tick >= lastSentTick + static_cast<uint64_t>(std::lround(intervalTicks));
+}
 
-  GameObject* player = findPlayerById(playerID);
-  if (!player) {
-    return false;
+// filters full down to what clientID should see. a client without a player yet (not registered)
+// only gets the always-relevant entities. encode worker holding the room.
+void GameServer::buildClientSnapshot(
+  GameRoom& room, uint32_t clientID, const NetGameStateSnapshot& full, NetGameStateSnapshot& out,
+  float detailScale) {
+  out.serverTick = full.serverTick;
+  out.levelId = full.levelId;
+  out.m_stateLastUpdatedAt = full.m_stateLastUpdatedAt;
+  out.hitStopEvent = full.hitStopEvent;
+  out.m_gameObjects.clear();
+
+  ClientInterest& interest = room.m_clientInterest[clientID];
+  const auto anchorIt = full.m_gameObjects.find({ObjectClass::Player, clientID});
+  const float enter = m_interestConfig.enterRadius * detailScale;
+  const float exit = m_interestConfig.exitRadius * detailScale;
+  const float enterSq = enter * enter;
+  const float exitSq = exit * exit;
+
+  std::vector<GameObjectKey>& relevantScratch = room.m_vRelevantScratch;
+  relevantScratch.clear();
+  for (const auto& [key, obj] : full.m_gameObjects) {
+    bool relevant = isAlwaysRelevant(key, full.hitStopEvent);
+    if (!relevant && anchorIt != full.m_gameObjects.end()) {
+      const bool wasRelevant = std::binary_search(interest.relevant.begin(), interest.relevant.end(), key);
+      const glm::vec2 d = obj.position - anchorIt->second.position;
+      relevant = glm::dot(d, d) <= (wasRelevant ? exitSq : enterSq);
+    }
+    if (relevant) {
+      out.m_gameObjects.emplace(key, obj);
+      relevantScratch.push_back(key);
+    }
   }
 
-  sessionIt->second.lifecycle = PlayerSessionState::respawning;
-  player->position = sessionIt->second.spawnPosition;
-  player->velocity = glm::vec2(0.0f);
-  resetPlayerRuntimeStatePreservingUnlocks(player->data.player);
-  player->shouldFlash = false;
-  player->flashTimer.reset();
-  player->grounded = false;
-  player->direction = 1.0f;
-  player->currentAnimation = ANIM_IDLE;
-  player->presentationVariant = PresentationVariant::Idle;
-  if (player->currentAnimation >= 0 &&
-      player->currentAnimation < static_cast<int>(player->animations.size())) {
-    player->animations[player->currentAnimation].reset();
-  }
-  player->spriteFrame = 1;
-  player->collider = player->baseCollider;
-  player->renderPosition = player->position;
-  player->renderPositionInitialized = true;
-  sessionIt->second.lifecycle = PlayerSessionState::alive;
-  m_authCtx->latestPlayerInputs[playerID] = NetGameInput{
-    .playerID = playerID,
-    .inputSeq = sessionIt->second.lastInputSeq,
-  };
-  return true;
+  // full is walked in key order, so the scratch list is already sorted for the binary_search above
+  interest.relevant.swap(relevantScratch);
 }
 
-bool GameServer::removePlayer(uint32_t playerID) {
-  std::scoped_lock lock(m_stateMu);
-  if (!m_authCtx || !m_authCtx->state) {
-    return false;
-  }
+bool GameServer::copyCurrentSnapshot(NetGameStateSnapshot& out, uint32_t roomID) const {
+  const auto room = m_rooms.find(roomID);
+  return room && room->copyCurrentSnapshot(out);
+}
 
-  bool changed = false;
-  auto& state = *m_authCtx->state;
-  if (state.playerLayer >= 0 && state.playerLayer < static_cast<int>(state.layers.size())) {
-    auto& layer = state.layers[state.playerLayer];
-    const auto oldSize = layer.size();
-    layer.erase(
-      std::remove_if(
-        layer.begin(),
-        layer.end(),
-        [playerID](const GameObject& obj) {
-          return obj.objClass == ObjectClass::Player && obj.id == playerID;
-        }),
-      layer.end());
-    changed = changed || layer.size() != oldSize;
+void GameServer::resetAuthoritativeState(GameState&& initialState, bool refreshSpawnPositions, uint32_t roomID) {
+  if (const auto room = m_rooms.find(roomID)) {
+    room->resetAuthoritativeState(std::move(initialState), refreshSpawnPositions);
   }
-
-  changed = m_authCtx->latestPlayerInputs.erase(playerID) > 0 || changed;
-  changed = m_playerSessions.erase(playerID) > 0 || changed;
-  return changed;
 }
 
-bool GameServer::HasPendingLevelTransition() const {
-  std::scoped_lock lock(m_pendingLevelTransitionMu);
-  return m_pendingLevelTransition.has_value();
+std::optional<LevelIndex> GameServer::ConsumePendingLevelTransition(uint32_t roomID) {
+  const auto room = m_rooms.find(roomID);
+  return room ? room->ConsumePendingLevelTransition() : std::nullopt;
 }
 
-std::optional<LevelIndex> GameServer::ConsumePendingLevelTransition() {
-  std::scoped_lock lock(m_pendingLevelTransitionMu);
-  if (!m_pendingLevelTransition.has_value()) {
-    return std::nullopt;
-  }
+void runServerLoop(
+  GameServer& server,
+  const std::function<bool()>& keepRunning,
+  const ServerLoopConfig& config,
+  const std::function<void(uint64_t tick)>& afterTick) {
+
+  using clock = std::chrono::steady_clock;
+  using millis = std::chrono::duration<double, std::milli>;
+  const double tickRate = config.tickRate > 0.0 ? config.tickRate : 60.0;
+  const double dt = 1.0 / tickRate;
+  const auto tickPeriod = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(dt));
+  // remote entities are interpolated between snapshots on the client (InterpolationConfig's 100ms delay
+  // covers two snapshot intervals at 20 Hz) and the local player is predicted
+  const uint64_t snapshotEveryTicks =
+    std::max<uint64_t>(1, static_cast<uint64_t>(std::lround(tickRate / std::max(config.snapshotRate, 1.0))));
+  // with adaptive rates the encoders wake every tick and sends to whichever clients are due, so
+  // any interval is exact (and clients end up spread over different ticks)
+  server.m_baseSnapshotInterval.store(static_cast<uint32_t>(snapshotEveryTicks));
+  const uint64_t broadcastEveryTicks = server.m_snapshotRateConfig.enabled ? 1 : snapshotEveryTicks;
+  const uint64_t pingEveryTicks = std::max<uint64_t>(1, static_cast<uint64_t>(std::lround(tickRate)));
+  // after a stall (level load, debugger) drop the backlog instead of running a burst of catch-up ticks:
+  // a wakeup runs at most two ticks back to back, which still absorbs ordinary scheduling jitter
+  const auto maxBacklog = tickPeriod;
+
+  server.m_rooms.startWorkers(config.tickWorkers);
+  clock::time_point nextTick = clock::now() + tickPeriod;
+  std::optional<clock::time_point> lastTickStart;
+  TickTimingWindow timing;
+  uint64_t tickCount = 0;
+
+  while (keepRunning()) {
+    // sleep until the deadline, but drain messages as they land so an input is queued the moment it
+    // arrives rather than when the next poll happens to come round
+    if (!server.WaitForIncoming(nextTick) && clock::now() < nextTick) {
+      std::this_thread::sleep_until(nextTick); // queue was stopped (server shutting down)
+    }
+    server.ProcessIncomingMessages(config.maxInputsPerTick, false);
+    server.attachBuiltRooms();
 
-  const LevelIndex nextLevel = *m_pendingLevelTransition;
-  m_pendingLevelTransition.reset();
-  return nextLevel;
+    const auto now = clock::now();
+    if (now < nextTick) {
+      continue;
+    }
+    if (now - nextTick > maxBacklog) {
+      nextTick = now - maxBacklog;
+    }
+
+    timing.add(millis(now - nextTick).count(),
+               lastTickStart ? std::optional<double>(millis(now - *lastTickStart).count()) : std::nullopt);
+    lastTickStart = now;
+
+    // run every step whose deadline has passed
+    while (nextTick <= now) {
+      ++tickCount;
+      timing.countTick();
+      server.tickRooms(static_cast<float>(dt), tickCount % broadcastEveryTicks == 0);
+      nextTick += tickPeriod;
+      if (tickCount % pingEveryTicks == 0) {
+        server.pingClients();
+        server.expireSessions();
+        server.setTickTimingStats(timing.take());
+      }
+      if (afterTick) {
+        afterTick(tickCount);
+      }
+    }
+  }
+  server.m_rooms.stopWorkers();
 }
 
 } // namespace game_engine
@@ -517,7 +517,9 @@ void updateDynamicObject(
         if (player.weaponTimer.isTimedOut() && player.manaPoints > 10) {
           player.weaponTimer.reset();
           player.manaPoints = std::clamp(player.manaPoints - 2, 0, player.maxManaPoints);
-          state.bullets.push_back(makeBulletFromPlayer(obj, state));
+          if (!hooks.predictionOnly) {
+            state.bullets.push_back(makeBulletFromPlayer(obj, state));
+          }
         }
       } else if (handleJump) {
         setPresentation(obj, idlePresentation);
@@ -972,7 +974,7 @@ void collisionResponse(
       case ObjectClass::Enemy:
         if (objB.data.enemy.state != EnemyState::dead) {
           if (objA.data.player.state == PlayerState::ultimate) {
-            if (isUltimateDamageActive(objA)) {
+            if (isUltimateDamageActive(objA) && !hooks.predictionOnly) {
               const DamageEnemyResult result = damageEnemy(
                 state,
                 objB,
@@ -992,22 +994,24 @@ void collisionResponse(
               }
             }
           } else if (objA.data.player.state == PlayerState::swingWeapon) {
-            const DamageEnemyResult result = damageEnemy(
-              state,
-              objB,
-              objA.data.player.meleeDamage,
-              objA.id,
-              0,
-              false,
-              HitStopStrength::Normal,
-              objA.direction,
-              enemyKnockbackMagnitude(EnemyImpactType::Melee));
-            if (result.applied) {
-              emitHitConfirmed(
-                hooks,
-                {objA.objClass, objA.id},
-                {objB.objClass, objB.id},
-                HitStopStrength::Normal);
+            if (!hooks.predictionOnly) {
+              const DamageEnemyResult result = damageEnemy(
+                state,
+                objB,
+                objA.data.player.meleeDamage,
+                objA.id,
+                0,
+                false,
+                HitStopStrength::Normal,
+                objA.direction,
+                enemyKnockbackMagnitude(EnemyImpactType::Melee));
+              if (result.applied) {
+                emitHitConfirmed(
+                  hooks,
+                  {objA.objClass, objA.id},
+                  {objB.objClass, objB.id},
+                  HitStopStrength::Normal);
+              }
             }
             if (shouldBlockSwingPassThrough()) {
               blockHorizontalPassThrough();
@@ -1274,4 +1278,39 @@ void stepGameplaySimulation(
   purgeFinishedDeadEnemies(state);
 }
 
+// stepPredictedPlayer runs the same player update and collision pass the server does, for one player
+// only. a dead player is left alone; death and respawn always come from the server.
+void stepPredictedPlayer(
+  GameState& state,
+  GameObject& player,
+  const NetGameInput& input,
+  float deltaTime) {
+  std::unordered_map<uint32_t, NetGameInput> playerInputs;
+  stepPredictedPlayer(state, player, input, deltaTime, playerInputs);
+}
+
+void stepPredictedPlayer(
+  GameState& state,
+  GameObject& player,
+  const NetGameInput& input,
+  float deltaTime,
+  std::unordered_map<uint32_t, NetGameInput>& scratchInputs) {
+  if (player.objClass != ObjectClass::Player || player.data.player.state == PlayerState::dead) {
+    return;
+  }
+
+  // overwrite the one entry in place; clear + insert would allocate a node every step
+  if (scratchInputs.size() == 1 && scratchInputs.begin()->first == player.id) {
+    scratchInputs.begin()->second = input;
+  } else {
+    scratchInputs.clear();
+    scratchInputs.emplace(player.id, input);
+  }
+
+  GameplaySimulationHooks hooks;
+  hooks.predictionOnly = true;
+  updateDynamicObject(state, player, scratchInputs, hooks, deltaTime);
+  resolveObjectCollisions(state, player, hooks);
+}
+
 } // namespace game_engine
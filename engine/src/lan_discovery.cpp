@@ -1,7 +1,7 @@
 #include "engine/net/lan_discovery.h"
 
-#include <array>
 #include <algorithm>
+#include <chrono>
 
 namespace game_engine {
 
@@ -13,10 +13,16 @@ uint64_t nowMs() {
     std::chrono::duration_cast<std::chrono::milliseconds>(clock::now().time_since_epoch()).count());
 }
 
-bool isWouldBlock(const asio::error_code& ec) {
-  return ec == asio::error::would_block || ec == asio::error::try_again;
+// a udp receive fails like this for one datagram (an ICMP port unreachable answering an earlier send,
+// or a datagram bigger than the buffer); the socket is fine and the next receive can go right away
+bool isDatagramError(const asio::error_code& ec) {
+  return ec == asio::error::connection_refused || ec == asio::error::connection_reset ||
+         ec == asio::error::message_size;
 }
 
+// anything else (interface gone, out of buffers) would most likely fail again at once
+constexpr std::chrono::milliseconds kReceiveRetryDelay{100};
+
 } // namespace
 
 std::vector<uint8_t> DiscoveryRequest::serialize() const {
@@ -27,8 +33,12 @@ std::vector<uint8_t> DiscoveryRequest::serialize() const {
 }
 
 bool DiscoveryRequest::deserialize(const std::vector<uint8_t>& bytes) {
+  return deserialize(bytes.data(), bytes.size());
+}
+
+bool DiscoveryRequest::deserialize(const uint8_t* data, size_t size) {
   try {
-    net::ByteReader reader(bytes);
+    net::ByteReader reader(data, size);
     return reader.read_u32() == MAGIC && reader.read_u16() == VERSION;
   } catch (...) {
     return false;
@@ -39,25 +49,21 @@ std::vector<uint8_t> DiscoveryResponse::serialize() const {
   net::ByteWriter writer;
   writer.write_u32(MAGIC);
   writer.write_u16(VERSION);
-  writer.write_bool(ready);
-  writer.write_u16(gamePort);
-  writer.write_enum<LevelIndex>(levelId);
-  writer.write_u32(playerCount);
-  writer.write_string(hostName);
+  net::write_wire(writer, *this);
   return writer.buff;
 }
 
 bool DiscoveryResponse::deserialize(const std::vector<uint8_t>& bytes) {
+  return deserialize(bytes.data(), bytes.size());
+}
+
+bool DiscoveryResponse::deserialize(const uint8_t* data, size_t size) {
   try {
-    net::ByteReader reader(bytes);
+    net::ByteReader reader(data, size);
     if (reader.read_u32() != MAGIC || reader.read_u16() != VERSION) {
       return false;
     }
-    ready = reader.read_bool();
-    gamePort = reader.read_u16();
-    levelId = reader.read_enum<LevelIndex>();
-    playerCount = reader.read_u32();
-    hostName = reader.read_string();
+    net::read_wire(reader, *this);
     return true;
   } catch (...) {
     return false;
@@ -68,13 +74,14 @@ DiscoveryHostService::~DiscoveryHostService() {
   stop();
 }
 
-bool DiscoveryHostService::start(uint16_t discoveryPort) {
+bool DiscoveryHostService::start(uint16_t discoveryPort, bool multicast) {
   if (m_started) {
     return true;
   }
 
   asio::error_code ec;
   m_discoveryPort = discoveryPort;
+  m_context.restart();
   m_socket = std::make_unique<asio::ip::udp::socket>(m_context);
   m_socket->open(asio::ip::udp::v4(), ec);
   if (ec) {
@@ -89,23 +96,35 @@ bool DiscoveryHostService::start(uint16_t discoveryPort) {
     return false;
   }
 
-  m_socket->non_blocking(true, ec);
-  if (ec) {
-    m_socket.reset();
-    return false;
+  if (multicast) {
+    // best effort: without a multicast route the host still answers broadcasts
+    m_socket->set_option(
+      asio::ip::multicast::join_group(asio::ip::make_address_v4(LAN_DISCOVERY_MULTICAST_GROUP)), ec);
   }
 
-  m_hostName = asio::ip::host_name(ec);
-  if (ec || m_hostName.empty()) {
-    m_hostName = "LAN Host";
+  if (m_info.hostName.empty()) {
+    m_info.hostName = asio::ip::host_name(ec);
+    if (ec || m_info.hostName.empty()) {
+      m_info.hostName = "LAN Host";
+    }
   }
+  m_receiveRetryTimer = std::make_unique<asio::steady_timer>(m_context);
   m_started = true;
+  publishResponse();
+  asyncReceive();
+  m_ioThd = std::thread([this]() { m_context.run(); });
   return true;
 }
 
 void DiscoveryHostService::stop() {
   m_ready = false;
   m_started = false;
+  m_response.store(nullptr);
+  m_context.stop();
+  if (m_ioThd.joinable()) {
+    m_ioThd.join();
+  }
+  m_receiveRetryTimer.reset();
   if (m_socket) {
     asio::error_code ec;
     m_socket->close(ec);
@@ -113,64 +132,87 @@ void DiscoveryHostService::stop() {
   }
 }
 
+void DiscoveryHostService::setReady(bool ready) {
+  if (ready != m_ready) {
+    m_ready = ready;
+    publishResponse();
+  }
+}
+
 void DiscoveryHostService::updateInfo(
   std::string hostName,
   LevelIndex levelId,
   uint32_t playerCount,
   uint16_t gamePort) {
-  if (!hostName.empty()) {
-    m_hostName = std::move(hostName);
+  const bool renamed = !hostName.empty() && hostName != m_info.hostName;
+  if (!renamed && levelId == m_info.levelId && playerCount == m_info.playerCount && gamePort == m_info.gamePort) {
+    return;
   }
-  m_levelId = levelId;
-  m_playerCount = playerCount;
-  m_gamePort = gamePort;
+  if (renamed) {
+    m_info.hostName = std::move(hostName);
+  }
+  m_info.levelId = levelId;
+  m_info.playerCount = playerCount;
+  m_info.gamePort = gamePort;
+  publishResponse();
 }
 
-void DiscoveryHostService::poll() {
-  if (!m_started || !m_socket) {
+void DiscoveryHostService::publishResponse() {
+  if (!m_ready || !m_started) {
+    m_response.store(nullptr);
     return;
   }
+  m_info.ready = true;
+  m_response.store(std::make_shared<const std::vector<uint8_t>>(m_info.serialize()));
+}
 
-  std::array<uint8_t, 1024> recvBuffer{};
-  for (;;) {
-    asio::ip::udp::endpoint remote;
-    asio::error_code ec;
-    const size_t bytes = m_socket->receive_from(asio::buffer(recvBuffer), remote, 0, ec);
-    if (ec) {
-      if (isWouldBlock(ec)) {
-        break;
-      }
-      break;
-    }
-
-    std::vector<uint8_t> payload(recvBuffer.begin(), recvBuffer.begin() + bytes);
-    DiscoveryRequest request;
-    if (!request.deserialize(payload) || !m_ready) {
-      continue;
+void DiscoveryHostService::retryReceive() {
+  m_receiveRetryTimer->expires_after(kReceiveRetryDelay);
+  m_receiveRetryTimer->async_wait([this](const asio::error_code& ec) {
+    if (!ec) {
+      asyncReceive();
     }
+  });
+}
 
-    DiscoveryResponse response;
-    response.ready = true;
-    response.gamePort = m_gamePort;
-    response.levelId = m_levelId;
-    response.playerCount = m_playerCount;
-    response.hostName = m_hostName;
-    const auto responseBytes = response.serialize();
-    m_socket->send_to(asio::buffer(responseBytes), remote, 0, ec);
-  }
+void DiscoveryHostService::asyncReceive() {
+  m_socket->async_receive_from(
+    asio::buffer(m_recvBuffer),
+    m_remote,
+    [this](const asio::error_code& ec, size_t bytes) {
+      if (ec == asio::error::operation_aborted) {
+        return;
+      }
+      if (ec && !isDatagramError(ec)) {
+        retryReceive();
+        return;
+      }
+      if (!ec) {
+        DiscoveryRequest request;
+        const auto response = m_response.load();
+        if (response && request.deserialize(m_recvBuffer.data(), bytes)) {
+          // one small datagram; sending it in place is cheaper than keeping the reply alive for an async send
+          asio::error_code sendEc;
+          m_socket->send_to(asio::buffer(*response), m_remote, 0, sendEc);
+        }
+      }
+      asyncReceive();
+    });
 }
 
 DiscoveryBrowserService::~DiscoveryBrowserService() {
   stop();
 }
 
-bool DiscoveryBrowserService::start(uint16_t discoveryPort) {
+bool DiscoveryBrowserService::start(uint16_t discoveryPort, bool multicast) {
   if (m_started) {
     return true;
   }
 
   asio::error_code ec;
   m_discoveryPort = discoveryPort;
+  m_multicast = multicast;
+  m_context.restart();
   m_socket = std::make_unique<asio::ip::udp::socket>(m_context);
   m_socket->open(asio::ip::udp::v4(), ec);
   if (ec) {
@@ -186,44 +228,57 @@ bool DiscoveryBrowserService::start(uint16_t discoveryPort) {
     return false;
   }
 
-  m_socket->non_blocking(true, ec);
-  if (ec) {
-    m_socket.reset();
-    return false;
-  }
-
-  m_lastBroadcastAtMs = 0;
   m_sessions.clear();
+  publishSessions();
+  m_queryTimer = std::make_unique<asio::steady_timer>(m_context);
+  m_receiveRetryTimer = std::make_unique<asio::steady_timer>(m_context);
   m_started = true;
+  scheduleQuery();
+  asyncReceive();
+  m_ioThd = std::thread([this]() { m_context.run(); });
   return true;
 }
 
 void DiscoveryBrowserService::stop() {
   m_started = false;
-  m_lastBroadcastAtMs = 0;
+  m_context.stop();
+  if (m_ioThd.joinable()) {
+    m_ioThd.join();
+  }
+  m_queryTimer.reset();
+  m_receiveRetryTimer.reset();
   if (m_socket) {
     asio::error_code ec;
     m_socket->close(ec);
     m_socket.reset();
   }
   m_sessions.clear();
+  publishSessions();
 }
 
 void DiscoveryBrowserService::clearSessions() {
-  m_sessions.clear();
+  m_published.store(std::make_shared<const std::vector<DiscoveredSessionInfo>>());
+  if (m_started) {
+    asio::post(m_context, [this]() {
+      m_sessions.clear();
+      publishSessions();
+    });
+  } else {
+    m_sessions.clear();
+  }
 }
 
-void DiscoveryBrowserService::broadcastQuery(uint64_t now) {
-  if (!m_socket) {
-    return;
-  }
-  constexpr uint64_t kBroadcastIntervalMs = 750;
-  if (now - m_lastBroadcastAtMs < kBroadcastIntervalMs) {
-    return;
-  }
+std::shared_ptr<const std::vector<DiscoveredSessionInfo>> DiscoveryBrowserService::sessions() const {
+  return m_published.load();
+}
 
-  m_lastBroadcastAtMs = now;
-  const auto requestBytes = DiscoveryRequest{}.serialize();
+void DiscoveryBrowserService::publishSessions() {
+  m_published.store(std::make_shared<const std::vector<DiscoveredSessionInfo>>(m_sessions));
+  m_sessionsDirty = false;
+}
+
+void DiscoveryBrowserService::sendQuery() {
+  static const std::vector<uint8_t> requestBytes = DiscoveryRequest{}.serialize();
   asio::error_code ec;
 
   const asio::ip::udp::endpoint broadcastEndpoint(
@@ -235,69 +290,93 @@ void DiscoveryBrowserService::broadcastQuery(uint64_t now) {
     asio::ip::make_address_v4("127.0.0.1"),
     m_discoveryPort);
   m_socket->send_to(asio::buffer(requestBytes), loopbackEndpoint, 0, ec);
-}
 
-void DiscoveryBrowserService::poll() {
-  if (!m_started || !m_socket) {
-    return;
+  if (m_multicast) {
+    const asio::ip::udp::endpoint multicastEndpoint(
+      asio::ip::make_address_v4(LAN_DISCOVERY_MULTICAST_GROUP),
+      m_discoveryPort);
+    m_socket->send_to(asio::buffer(requestBytes), multicastEndpoint, 0, ec);
   }
+}
 
-  const uint64_t now = nowMs();
-  broadcastQuery(now);
+// one query round: ask again, drop the hosts that stopped answering and publish what changed since the
+// last round
+void DiscoveryBrowserService::scheduleQuery() {
+  sendQuery();
 
-  std::array<uint8_t, 1024> recvBuffer{};
-  for (;;) {
-    asio::ip::udp::endpoint remote;
-    asio::error_code ec;
-    const size_t bytes = m_socket->receive_from(asio::buffer(recvBuffer), remote, 0, ec);
-    if (ec) {
-      if (isWouldBlock(ec)) {
-        break;
-      }
-      break;
-    }
+  const uint64_t now = nowMs();
+  const size_t before = m_sessions.size();
+  std::erase_if(m_sessions, [now](const DiscoveredSessionInfo& session) {
+    return now - session.lastSeenAtMs > kSessionExpiryMs;
+  });
+  if (m_sessions.size() != before || m_sessionsDirty) {
+    publishSessions();
+  }
 
-    std::vector<uint8_t> payload(recvBuffer.begin(), recvBuffer.begin() + bytes);
-    DiscoveryResponse response;
-    if (!response.deserialize(payload) || !response.ready) {
-      continue;
+  m_queryTimer->expires_after(std::chrono::milliseconds(kQueryIntervalMs));
+  m_queryTimer->async_wait([this](const asio::error_code& ec) {
+    if (!ec) {
+      scheduleQuery();
     }
+  });
+}
 
-    const std::string hostAddress = remote.address().to_string();
-    auto it = std::find_if(
-      m_sessions.begin(),
-      m_sessions.end(),
-      [&](const DiscoveredSessionInfo& session) {
-        return session.hostAddress == hostAddress && session.gamePort == response.gamePort;
-      });
-
-    if (it == m_sessions.end()) {
-      m_sessions.push_back(DiscoveredSessionInfo{
-        .hostName = response.hostName,
-        .hostAddress = hostAddress,
-        .gamePort = response.gamePort,
-        .levelId = response.levelId,
-        .playerCount = response.playerCount,
-        .lastSeenAtMs = now,
-      });
-    } else {
-      it->hostName = response.hostName;
-      it->levelId = response.levelId;
-      it->playerCount = response.playerCount;
-      it->lastSeenAtMs = now;
+void DiscoveryBrowserService::retryReceive() {
+  m_receiveRetryTimer->expires_after(kReceiveRetryDelay);
+  m_receiveRetryTimer->async_wait([this](const asio::error_code& ec) {
+    if (!ec) {
+      asyncReceive();
     }
-  }
+  });
+}
 
-  constexpr uint64_t kSessionExpiryMs = 2500;
-  m_sessions.erase(
-    std::remove_if(
-      m_sessions.begin(),
-      m_sessions.end(),
-      [now](const DiscoveredSessionInfo& session) {
-        return now - session.lastSeenAtMs > kSessionExpiryMs;
-      }),
-      m_sessions.end()
-  );
+void DiscoveryBrowserService::asyncReceive() {
+  m_socket->async_receive_from(
+    asio::buffer(m_recvBuffer),
+    m_remote,
+    [this](const asio::error_code& ec, size_t bytes) {
+      if (ec == asio::error::operation_aborted) {
+        return;
+      }
+      if (ec && !isDatagramError(ec)) {
+        retryReceive();
+        return;
+      }
+      DiscoveryResponse response;
+      if (!ec && response.deserialize(m_recvBuffer.data(), bytes) && response.ready) {
+        const uint64_t now = nowMs();
+        const std::string hostAddress = m_remote.address().to_string();
+        auto it = std::find_if(
+          m_sessions.begin(),
+          m_sessions.end(),
+          [&](const DiscoveredSessionInfo& session) {
+            return session.hostAddress == hostAddress && session.gamePort == response.gamePort;
+          });
+
+        if (it == m_sessions.end()) {
+          m_sessions.push_back(DiscoveredSessionInfo{
+            .hostName = response.hostName,
+            .hostAddress = hostAddress,
+            .gamePort = response.gamePort,
+            .levelId = response.levelId,
+            .playerCount = response.playerCount,
+            .lastSeenAtMs = now,
+          });
+          publishSessions();
+        } else if (it->hostName != response.hostName || it->levelId != response.levelId ||
+                   it->playerCount != response.playerCount) {
+          it->hostName = response.hostName;
+          it->levelId = response.levelId;
+          it->playerCount = response.playerCount;
+          it->lastSeenAtMs = now;
+          publishSessions();
+        } else {
+          it->lastSeenAtMs = now;
+          m_sessionsDirty = true; // a host answering every round on the same state doesnt need a new list
+        }
+      }
+      asyncReceive();
+    });
 }
 
 } // namespace game_engine
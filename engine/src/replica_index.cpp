@@ -0,0 +1,183 @@
+#include "engine/net/replica_index.h"
+
+#include <algorithm>
+
+#include "engine/engine.h"
+
+namespace game_engine {
+
+namespace {
+
+std::vector<GameObject>& slotContainer(GameState& state, uint32_t layer) {
+  return layer == ReplicaIndex::kBulletLayer ? state.bullets : state.layers[layer];
+}
+
+} // namespace
+
+bool ReplicaIndex::isReplicatedActor(ObjectClass objClass) {
+  return objClass == ObjectClass::Player || objClass == ObjectClass::Enemy;
+}
+
+GameObject* ReplicaIndex::find(GameState& state, GameObjectKey key) const {
+  const auto it = m_slots.find(key);
+  if (it == m_slots.end()) {
+    return nullptr;
+  }
+  const Slot slot = it->second;
+  if (slot.layer != kBulletLayer && slot.layer >= state.layers.size()) {
+    return nullptr;
+  }
+  auto& objects = slotContainer(state, slot.layer);
+  if (slot.index >= objects.size()) {
+    return nullptr;
+  }
+  GameObject& obj = objects[slot.index];
+  return obj.dynamic && obj.objClass == key.first && obj.id == key.second ? &obj : nullptr;
+}
+
+bool ReplicaIndex::tracks(const GameState& state) const {
+  return m_layersData == state.layers.data() && m_layerCount == state.layers.size();
+}
+
+// only needed when the layers were replaced (level load) or edited behind our back
+void ReplicaIndex::rebuild(const GameState& state) {
+  m_slots.clear();
+  for (std::size_t layerIdx = 0; layerIdx < state.layers.size(); ++layerIdx) {
+    const auto& layer = state.layers[layerIdx];
+    for (std::size_t objIdx = 0; objIdx < layer.size(); ++objIdx) {
+      const auto& obj = layer[objIdx];
+      if (obj.dynamic && isReplicatedActor(obj.objClass)) {
+        m_slots.append_unsorted(
+          GameObjectKey{obj.objClass, obj.id},
+          Slot{static_cast<uint32_t>(layerIdx), static_cast<uint32_t>(objIdx)});
+      }
+    }
+  }
+  for (std::size_t idx = 0; idx < state.bullets.size(); ++idx) {
+    const auto& bullet = state.bullets[idx];
+    m_slots.append_unsorted(GameObjectKey{bullet.objClass, bullet.id}, Slot{kBulletLayer, static_cast<uint32_t>(idx)});
+  }
+  m_slots.sort_unique();
+}
+
+void ReplicaIndex::purge(GameState& state) {
+  for (auto& layer : state.layers) {
+    std::erase_if(layer, [](const GameObject& obj) { return obj.dynamic && isReplicatedActor(obj.objClass); });
+  }
+  state.bullets.clear();
+  m_slots.clear();
+}
+
+void ReplicaIndex::clear() {
+  m_slots.clear();
+  m_layersData = nullptr;
+  m_layerCount = 0;
+}
+
+bool ReplicaIndex::diff(GameState& state, const NetGameStateSnapshot& snapshot) {
+  m_matched.clear();
+  m_spawned.clear();
+  m_despawned.clear();
+
+  auto it = m_slots.begin();
+  const auto collectDespawned = [&](GameObjectKey until, bool toEnd) {
+    for (; it != m_slots.end() && (toEnd || it->first < until); ++it) {
+      if (!find(state, it->first)) {
+        return false;
+      }
+      m_despawned.push_back(it->first);
+    }
+    return true;
+  };
+
+  for (const auto& [key, snap] : snapshot.m_gameObjects) {
+    if (!isReplicatedActor(snap.type) && snap.type != ObjectClass::Projectile) {
+      continue;
+    }
+    if (!collectDespawned(key, false)) {
+      return false;
+    }
+    if (it == m_slots.end() || key < it->first) {
+      m_spawned.push_back(&snap);
+      continue;
+    }
+
+    GameObject* obj = find(state, key);
+    if (!obj) {
+      return false;
+    }
+    const uint32_t layer = snap.type == ObjectClass::Projectile ? kBulletLayer : snap.layer;
+    if (it->second.layer != layer) {
+      // moved to another layer: rebuilt there
+      m_despawned.push_back(key);
+      m_spawned.push_back(&snap);
+    } else {
+      m_matched.push_back(Match{obj, &snap});
+    }
+    ++it;
+  }
+  return collectDespawned({}, true);
+}
+
+// one pass per layer that lost something, from its first hole on
+void ReplicaIndex::applyDespawns(GameState& state) {
+  m_holes.clear();
+  for (const GameObjectKey& key : m_despawned) {
+    const auto it = m_slots.find(key);
+    if (it != m_slots.end()) {
+      m_holes.push_back(it->second);
+      m_slots.erase(it);
+    }
+  }
+  std::sort(m_holes.begin(), m_holes.end(), [](const Slot& a, const Slot& b) {
+    return a.layer != b.layer ? a.layer < b.layer : a.index < b.index;
+  });
+
+  for (std::size_t hole = 0; hole < m_holes.size();) {
+    const uint32_t layer = m_holes[hole].layer;
+    auto& objects = slotContainer(state, layer);
+    std::size_t write = m_holes[hole].index;
+    for (std::size_t read = write; read < objects.size(); ++read) {
+      if (hole < m_holes.size() && m_holes[hole].layer == layer && m_holes[hole].index == read) {
+        ++hole;
+        continue;
+      }
+      if (write != read) {
+        objects[write] = std::move(objects[read]);
+        const GameObject& moved = objects[write];
+        if (moved.dynamic) {
+          const auto movedIt = m_slots.find({moved.objClass, moved.id});
+          if (movedIt != m_slots.end() && movedIt->second.layer == layer && movedIt->second.index == read) {
+            movedIt->second.index = static_cast<uint32_t>(write);
+          }
+        }
+      }
+      ++write;
+    }
+    objects.erase(objects.begin() + static_cast<std::ptrdiff_t>(write), objects.end());
+    while (hole < m_holes.size() && m_holes[hole].layer == layer) {
+      ++hole;
+    }
+  }
+}
+
+void ReplicaIndex::spawn(GameState& state, const NetGameObjectSnapshot& snap, GameObject&& obj) {
+  Slot slot{kBulletLayer, 0};
+  if (snap.type != ObjectClass::Projectile) {
+    if (snap.layer >= state.layers.size()) {
+      state.layers.resize(snap.layer + 1);
+    }
+    slot.layer = snap.layer;
+  }
+  auto& objects = slotContainer(state, slot.layer);
+  slot.index = static_cast<uint32_t>(objects.size());
+  objects.push_back(std::move(obj));
+  m_slots.insert_or_assign(GameObjectKey{snap.type, snap.id}, slot);
+}
+
+void ReplicaIndex::commit(const GameState& state) {
+  m_layersData = state.layers.data();
+  m_layerCount = state.layers.size();
+}
+
+} // namespace game_engine
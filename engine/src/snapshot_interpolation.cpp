@@ -0,0 +1,146 @@
+#include "engine/net/snapshot_interpolation.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace game_engine {
+
+namespace {
+
+// how fast the server clock estimate follows a snapshot that arrived earlier / later than expected.
+// early arrivals mean we were overestimating latency so catch up quickly; late ones are usually
+// jitter, so only drift slowly (that still follows a real latency increase)
+constexpr double kClockCatchUpRate = 0.25;
+constexpr double kClockDriftRate = 0.02;
+constexpr double kClockResetSeconds = 1.0;
+
+bool keyLess(const std::pair<GameObjectKey, glm::vec2>& a, const GameObjectKey& b) {
+  return a.first < b;
+}
+
+} // namespace
+
+const SnapshotInterpolator::Frame& SnapshotInterpolator::frameAt(size_t age) const {
+  return m_frames[(m_head + kCapacity - m_count + age) % kCapacity];
+}
+
+const glm::vec2* SnapshotInterpolator::find(const Frame& frame, const GameObjectKey& key) {
+  const auto it = std::lower_bound(frame.positions.begin(), frame.positions.end(), key, keyLess);
+  return it != frame.positions.end() && it->first == key ? &it->second : nullptr;
+}
+
+void SnapshotInterpolator::push(const NetGameStateSnapshot& snapshot, double receivedAtSeconds) {
+  if (m_count > 0) {
+    const Frame& newest = frameAt(m_count - 1);
+    if (snapshot.serverTick <= newest.serverTick) {
+      // a duplicate, or one overtaken by a newer snapshot: nothing to add. only a jump back further
+      // than everything buffered means the server started counting again
+      const uint64_t span = std::max<uint64_t>(newest.serverTick - frameAt(0).serverTick, kCapacity);
+      if (newest.serverTick - snapshot.serverTick <= span) {
+        return;
+      }
+      clear();
+    } else if (snapshot.levelId != newest.levelId) {
+      clear(); // nothing carries over between levels
+    }
+  }
+
+  Frame& frame = m_frames[m_head];
+  frame.serverTick = snapshot.serverTick;
+  frame.levelId = snapshot.levelId;
+  frame.positions.clear();
+  frame.positions.reserve(snapshot.m_gameObjects.size());
+  for (const auto& [key, obj] : snapshot.m_gameObjects) {
+    frame.positions.emplace_back(key, obj.position); // already in key order
+  }
+  m_head = (m_head + 1) % kCapacity;
+  m_count = std::min(m_count + 1, kCapacity);
+
+  const double target = static_cast<double>(snapshot.serverTick) * m_config.tickSeconds - receivedAtSeconds;
+  if (!m_hasClockOffset || std::abs(target - m_clockOffset) > kClockResetSeconds) {
+    m_clockOffset = target;
+    m_hasClockOffset = true;
+  } else {
+    const double rate = target > m_clockOffset ? kClockCatchUpRate : kClockDriftRate;
+    m_clockOffset += (target - m_clockOffset) * rate;
+  }
+}
+
+void SnapshotInterpolator::beginFrame(double nowSeconds) {
+  m_from = m_to = nullptr;
+  m_alpha = 0.0f;
+  if (m_count == 0) {
+    return;
+  }
+
+  m_renderTick = (nowSeconds + m_clockOffset - m_config.delaySeconds) / m_config.tickSeconds;
+
+  const Frame& oldest = frameAt(0);
+  const Frame& newest = frameAt(m_count - 1);
+  if (m_count == 1 || m_renderTick <= static_cast<double>(oldest.serverTick)) {
+    m_from = m_to = m_count == 1 ? &newest : &oldest;
+    return;
+  }
+
+  if (m_renderTick >= static_cast<double>(newest.serverTick)) {
+    // ran past the newest snapshot: keep going along the last segment, but not for long
+    const double maxTick =
+      static_cast<double>(newest.serverTick) + m_config.maxExtrapolationSeconds / m_config.tickSeconds;
+    const double tick = std::min(m_renderTick, maxTick);
+    m_from = &frameAt(m_count - 2);
+    m_to = &newest;
+    m_alpha = static_cast<float>(
+      (tick - static_cast<double>(m_from->serverTick)) /
+      static_cast<double>(m_to->serverTick - m_from->serverTick));
+    return;
+  }
+
+  for (size_t age = m_count - 1; age-- > 0;) {
+    const Frame& frame = frameAt(age);
+    if (static_cast<double>(frame.serverTick) <= m_renderTick) {
+      m_from = &frame;
+      m_to = &frameAt(age + 1);
+      m_alpha = static_cast<float>(
+        (m_renderTick - static_cast<double>(m_from->serverTick)) /
+        static_cast<double>(m_to->serverTick - m_from->serverTick));
+      return;
+    }
+  }
+}
+
+bool SnapshotInterpolator::sample(const GameObjectKey& key, glm::vec2& out) const {
+  if (!m_from || !m_to) {
+    return false;
+  }
+
+  const glm::vec2* a = find(*m_from, key);
+  const glm::vec2* b = m_to == m_from ? a : find(*m_to, key);
+  if (!a && !b) {
+    return false;
+  }
+  if (!a || !b) {
+    out = a ? *a : *b; // appeared or vanished between the two snapshots
+    return true;
+  }
+
+  const glm::vec2 d = *b - *a;
+  if (glm::dot(d, d) > m_config.teleportDistance * m_config.teleportDistance) {
+    out = m_alpha < 1.0f ? *a : *b;
+    return true;
+  }
+  out = *a + d * m_alpha;
+  return true;
+}
+
+void SnapshotInterpolator::clear() {
+  for (auto& frame : m_frames) {
+    frame.positions.clear();
+  }
+  m_head = 0;
+  m_count = 0;
+  m_hasClockOffset = false;
+  m_from = m_to = nullptr;
+  m_alpha = 0.0f;
+}
+
+} // namespace game_engine
@@ -126,15 +126,15 @@ namespace UIManager {
     SDL_RenderTexture(sdlState.renderer, scene.tex, &src, &dst);
 
     // renderPresent(sdlState);
-    if (drawDialogue && !scene.dialogue.empty()) {
+    if (drawDialogue && font && !scene.dialogue.empty()) {
       // 2) build a text surface with SDL_ttf
       const auto text = scene.dialogue.at(cutscenePlr.currDialogueIdx);
       std::string shown = text.substr(0, visible);
       // std::cout << "visible chars: " << shown << std::endl;
       SDL_Color fg{0,0,0,0};
       // SDL_Surface* surf = TTF_RenderText_Blended(&font, text.c_str(), text.length(), fg);   // blended = alpha
-      TTF_SetFontHinting(&font, TTF_HINTING_MONO);
-      SDL_Surface* surf = TTF_RenderText_Solid(&font, shown.c_str(), shown.length(), fg);   // blended = alpha
+      TTF_SetFontHinting(font, TTF_HINTING_MONO);
+      SDL_Surface* surf = TTF_RenderText_Solid(font, shown.c_str(), shown.length(), fg);   // blended = alpha
 
       if (surf) {
           // 3) turn it into a texture so the renderer can draw it
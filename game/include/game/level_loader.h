@@ -0,0 +1,30 @@
+#pragma once
+
+#include "engine/level_types.h"
+#include "game/game_resources.h"
+#include "game/progression_service.h"
+
+namespace game_engine {
+struct SDLState;
+struct GameState;
+}
+
+namespace game {
+
+// Builds the tiles, colliders and objects of resources.m_currLevel into newGameState. Needs no Engine,
+// so the dedicated server can link it without the window, renderer or UI.
+bool initAllTiles(
+  game_engine::SDLState& sdlState,
+  GameResources& resources,
+  game_engine::GameState& newGameState,
+  ProgressionService& progService);
+
+// Loads levelId without textures or audio and builds a fresh authoritative state for it (dedicated server).
+bool loadHeadlessLevel(
+  game_engine::SDLState& sdlState,
+  GameResources& resources,
+  ProgressionService& progService,
+  LevelIndex levelId,
+  game_engine::GameState& out);
+
+} // namespace game
@@ -3,6 +3,7 @@
 #include <vector>
 #include <memory>
 #include "net/net_message.h"
+#include "net/net_schema.h"
 #include "engine/level_types.h"
 
 
@@ -18,6 +19,8 @@ namespace game {
     // uint32_t lvlid;
     LevelIndex lvlid;
     bool complete;
+
+    using wire_fields = net::fields<&LevelProgressRecord::lvlid, &LevelProgressRecord::complete>;
   };
 
   struct CharacterProgressRecord {
@@ -25,11 +28,17 @@ namespace game {
     SpriteType spriteType;
     bool unlockedUltOne;
     bool unlockedUltTwo;
+
+    using wire_fields = net::fields<
+      &CharacterProgressRecord::spriteType, &CharacterProgressRecord::unlockedUltOne,
+      &CharacterProgressRecord::unlockedUltTwo>;
   };
 
   struct InventoryItemRecord {
     uint32_t id;
     uint32_t amount;
+
+    using wire_fields = net::fields<&InventoryItemRecord::id, &InventoryItemRecord::amount>;
   };
 
 
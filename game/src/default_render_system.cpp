@@ -56,34 +56,100 @@ public:
           gameState.mapViewport.x);
         SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
         SDL_RenderDebugText(renderer, 5, 5, debugText);
+        drawNetStats(engine, renderer);
       }
     }
   }
 
 private:
+  // one line for our connection to the server, and in host mode one per connected client
+  void drawNetStats(game_engine::Engine& engine, SDL_Renderer* renderer) {
+    if (!engine.isMultiplayerActive()) {
+      return;
+    }
+
+    char debugText[256];
+    float y = 17.0f;
+    if (auto* client = engine.getGameClient()) {
+      const net::connection_stats stats = client->GetStats();
+      SDL_snprintf(
+        debugText,
+        sizeof(debugText),
+        "RTT: %.1fms, Jitter: %.1fms, In: %.1fKB/s, Out: %.1fKB/s, Q: %zu, Sup: %llu, Mispredict: %llu",
+        stats.rttMs,
+        stats.jitterMs,
+        stats.bytesInPerSec / 1024.0,
+        stats.bytesOutPerSec / 1024.0,
+        stats.outboundQueueDepth,
+        static_cast<unsigned long long>(stats.snapshotsSuperseded),
+        static_cast<unsigned long long>(client->Prediction().mispredictions()));
+      SDL_RenderDebugText(renderer, 5, y, debugText);
+      y += 12.0f;
+    }
+
+    if (engine.isHostMode()) {
+      const game_engine::TickTimingStats tick = engine.copyHostTickTiming();
+      SDL_snprintf(
+        debugText,
+        sizeof(debugText),
+        "Server tick: %llu/s, Late: %.2fms avg %.2fms max, Jitter: %.2fms",
+        static_cast<unsigned long long>(tick.ticks),
+        tick.meanLateMs,
+        tick.maxLateMs,
+        tick.intervalJitterMs);
+      SDL_RenderDebugText(renderer, 5, y, debugText);
+      y += 12.0f;
+    }
+
+    for (const auto& [clientID, stats] : engine.copyHostClientStats()) {
+      SDL_snprintf(
+        debugText,
+        sizeof(debugText),
+        "[%u] RTT: %.1fms, Jitter: %.1fms, In: %.1fKB/s, Out: %.1fKB/s, Q: %zu/%zu, Sup: %llu",
+        clientID,
+        stats.rttMs,
+        stats.jitterMs,
+        stats.bytesInPerSec / 1024.0,
+        stats.bytesOutPerSec / 1024.0,
+        stats.outboundQueueDepth,
+        stats.outboundHighWater,
+        static_cast<unsigned long long>(stats.snapshotsSuperseded));
+      SDL_RenderDebugText(renderer, 5, y, debugText);
+      y += 12.0f;
+    }
+  }
+
   void drawObject(game_engine::Engine& engine, GameObject& obj, float deltaTime) {
     auto& gameState = engine.getGameState();
     auto& renderer = engine.getSDLState().renderer;
     const auto* frozenTarget = findFrozenTarget(gameState, obj);
     const bool isFrozen = frozenTarget != nullptr;
 
-    bool shouldInterpolate = false;
+    const game_engine::GameClient* interpolationClient = nullptr;
+    glm::vec2 predictionCorrection{0.0f, 0.0f};
     if (engine.isMultiplayerActive() && obj.dynamic) {
       const auto* client = engine.getGameClient();
       const bool isLocalPlayer =
         client && obj.objClass == ObjectClass::Player && obj.id == client->GetPlayerID();
-      shouldInterpolate = !isLocalPlayer;
+      if (isLocalPlayer) {
+        predictionCorrection = client->Prediction().correctionOffset();
+      } else {
+        interpolationClient = client;
+      }
     }
 
+    glm::vec2 interpolated{0.0f, 0.0f};
     if (isFrozen) {
+    } else if (interpolationClient &&
+               interpolationClient->Interpolation().sample({obj.objClass, obj.id}, interpolated)) {
+      // remote entities are drawn a little in the past, between the two snapshots around render time
+      obj.renderPosition = interpolated;
+      obj.renderPositionInitialized = true;
     } else if (!obj.renderPositionInitialized) {
       obj.renderPosition = obj.position;
       obj.renderPositionInitialized = true;
-    } else if (shouldInterpolate) {
-      const float blend = std::clamp(deltaTime * 15.0f, 0.0f, 1.0f);
-      obj.renderPosition += (obj.position - obj.renderPosition) * blend;
     } else {
-      obj.renderPosition = obj.position;
+      obj.renderPosition = obj.position + predictionCorrection;
     }
 
     float frameW = obj.spritePixelW;
@@ -3,10 +3,10 @@
 #include <algorithm>
 #include <type_traits>
 #include <unordered_map>
-#include <unordered_set>
 
 #include "engine/engine.h"
 #include "engine/gameplay_simulation.h"
+#include "engine/net/replica_index.h"
 
 namespace {
 
@@ -17,6 +17,7 @@ struct SimContext {
   game_engine::GameState& gameState;
   game::GameResources& resources;
   game::ProgressionService& progService;
+  game_engine::ReplicaIndex& replicas;
 };
 
 struct AudioObjectState {
@@ -37,27 +38,6 @@ using game_engine::GameObjectKey;
 using game_engine::LocalHitStopTarget;
 using game_engine::NetHitStopEvent;
 
-struct LayeredDynamicKey {
-  uint32_t layer = 0;
-  ObjectClass objClass = ObjectClass::Level;
-  uint32_t id = 0;
-
-  bool operator==(const LayeredDynamicKey& other) const {
-    return layer == other.layer && objClass == other.objClass && id == other.id;
-  }
-};
-
-struct LayeredDynamicKeyHash {
-  size_t operator()(const LayeredDynamicKey& key) const noexcept {
-    const size_t h1 = std::hash<uint32_t>{}(key.layer);
-    const size_t h2 =
-      std::hash<std::underlying_type_t<ObjectClass>>{}(static_cast<std::underlying_type_t<ObjectClass>>(key.objClass));
-    const size_t h3 = std::hash<uint32_t>{}(key.id);
-    return h1 ^ (h2 + 0x9e3779b9 + (h1 << 6) + (h1 >> 2)) ^
-           (h3 + 0x9e3779b9 + (h2 << 6) + (h2 >> 2));
-  }
-};
-
 SDL_Texture* pickEntityTexture(
   const EntityResources& entityRes,
   ObjectClass objClass,
@@ -330,100 +310,44 @@ void updateReplicatedObject(
   applyPresentation(ctx.resources, obj);
 }
 
-void purgeReplicatedActors(game_engine::GameState& gameState) {
-  for (auto& layer : gameState.layers) {
-    layer.erase(
-      std::remove_if(
-        layer.begin(),
-        layer.end(),
-        [](const GameObject& obj) {
-          return obj.dynamic &&
-                 (obj.objClass == ObjectClass::Player || obj.objClass == ObjectClass::Enemy);
-        }),
-      layer.end());
-  }
-  gameState.bullets.clear();
-}
-
-void reconcileReplicatedActors(
+// applies the snapshot's players, enemies and projectiles. the predicted local player
+// (predictedPlayerID) is only created here, never updated; that is left to reconcilePredictedPlayer.
+// returns true if it had to be (re)built from the snapshot.
+//
+// the work is proportional to the replicated objects, and only spawns allocate.
+bool reconcileReplicatedObjects(
   SimContext& ctx,
-  const game_engine::NetGameStateSnapshot& snapshot) {
-  std::unordered_map<LayeredDynamicKey, std::size_t, LayeredDynamicKeyHash> existing;
-  for (std::size_t layerIdx = 0; layerIdx < ctx.gameState.layers.size(); ++layerIdx) {
-    auto& layer = ctx.gameState.layers[layerIdx];
-    for (std::size_t objIdx = 0; objIdx < layer.size(); ++objIdx) {
-      const auto& obj = layer[objIdx];
-      if (obj.dynamic && (obj.objClass == ObjectClass::Player || obj.objClass == ObjectClass::Enemy)) {
-        existing[{static_cast<uint32_t>(layerIdx), obj.objClass, obj.id}] = objIdx;
-      }
+  const game_engine::NetGameStateSnapshot& snapshot,
+  uint32_t predictedPlayerID) {
+  game_engine::ReplicaIndex& index = ctx.replicas;
+  if (!index.tracks(ctx.gameState)) {
+    index.rebuild(ctx.gameState);
+  }
+  if (!index.diff(ctx.gameState, snapshot)) {
+    index.rebuild(ctx.gameState);
+    if (!index.diff(ctx.gameState, snapshot)) {
+      // the layers still disagree with a fresh scan: drop every replica and build them all from this
+      // snapshot rather than apply half a diff. with nothing tracked the diff cant fail
+      index.purge(ctx.gameState);
+      index.diff(ctx.gameState, snapshot);
     }
   }
 
-  std::unordered_set<LayeredDynamicKey, LayeredDynamicKeyHash> seen;
-  for (const auto& [_, snap] : snapshot.m_gameObjects) {
-    if (snap.type != ObjectClass::Player && snap.type != ObjectClass::Enemy) {
-      continue;
-    }
-    if (snap.layer >= ctx.gameState.layers.size()) {
-      ctx.gameState.layers.resize(snap.layer + 1);
+  for (const auto& [obj, snap] : index.matched()) {
+    if (!(snap->type == ObjectClass::Player && snap->id == predictedPlayerID)) {
+      updateReplicatedObject(ctx, *obj, *snap);
     }
-
-    LayeredDynamicKey key{snap.layer, snap.type, snap.id};
-    seen.insert(key);
-    auto& targetLayer = ctx.gameState.layers[snap.layer];
-    const auto it = existing.find(key);
-    if (it == existing.end()) {
-      targetLayer.push_back(buildReplicatedObject(ctx, snap));
-      existing[key] = targetLayer.size() - 1;
-    } else {
-      updateReplicatedObject(ctx, targetLayer[it->second], snap);
-    }
-  }
-
-  for (std::size_t layerIdx = 0; layerIdx < ctx.gameState.layers.size(); ++layerIdx) {
-    auto& layer = ctx.gameState.layers[layerIdx];
-    layer.erase(
-      std::remove_if(
-        layer.begin(),
-        layer.end(),
-        [&seen, layerIdx](const GameObject& obj) {
-          return obj.dynamic &&
-                 (obj.objClass == ObjectClass::Player || obj.objClass == ObjectClass::Enemy) &&
-                 !seen.contains({static_cast<uint32_t>(layerIdx), obj.objClass, obj.id});
-        }),
-      layer.end());
-  }
-}
-
-void reconcileReplicatedBullets(
-  SimContext& ctx,
-  const game_engine::NetGameStateSnapshot& snapshot) {
-  std::unordered_map<uint32_t, std::size_t> existing;
-  for (std::size_t idx = 0; idx < ctx.gameState.bullets.size(); ++idx) {
-    existing[ctx.gameState.bullets[idx].id] = idx;
   }
+  index.applyDespawns(ctx.gameState);
 
-  std::unordered_set<uint32_t> seen;
-  for (const auto& [key, snap] : snapshot.m_gameObjects) {
-    if (snap.type != ObjectClass::Projectile) {
-      continue;
-    }
-    seen.insert(key.second);
-    const auto it = existing.find(key.second);
-    if (it == existing.end()) {
-      ctx.gameState.bullets.push_back(buildReplicatedObject(ctx, snap));
-      existing[key.second] = ctx.gameState.bullets.size() - 1;
-    } else {
-      updateReplicatedObject(ctx, ctx.gameState.bullets[it->second], snap);
-    }
+  bool predictedPlayerBuilt = false;
+  for (const game_engine::NetGameObjectSnapshot* snap : index.spawned()) {
+    predictedPlayerBuilt =
+      predictedPlayerBuilt || (snap->type == ObjectClass::Player && snap->id == predictedPlayerID);
+    index.spawn(ctx.gameState, *snap, buildReplicatedObject(ctx, *snap));
   }
-
-  ctx.gameState.bullets.erase(
-    std::remove_if(
-      ctx.gameState.bullets.begin(),
-      ctx.gameState.bullets.end(),
-      [&seen](const GameObject& obj) { return !seen.contains(obj.id); }),
-    ctx.gameState.bullets.end());
+  index.commit(ctx.gameState);
+  return predictedPlayerBuilt;
 }
 
 bool syncAuthoritativeLevel(
@@ -447,44 +371,91 @@ bool syncAuthoritativeLevel(
   return true;
 }
 
-void applyAuthoritativeSnapshot(
+// returns true if the predicted local player was (re)built from this snapshot
+bool applyAuthoritativeSnapshot(
   SimContext& ctx,
   const game_engine::NetGameStateSnapshot& snapshot,
   uint32_t localPlayerID,
-  bool forceFullRebuild) {
+  bool forceFullRebuild,
+  uint32_t predictedPlayerID = 0) {
   if (!ctx.resources.m_currLevel) {
-    return;
+    return false;
   }
 
   ctx.gameState.m_stateLastUpdatedAt = snapshot.m_stateLastUpdatedAt;
   ctx.gameState.currentLevelId = snapshot.levelId;
 
   if (forceFullRebuild) {
-    purgeReplicatedActors(ctx.gameState);
+    ctx.replicas.purge(ctx.gameState);
   }
 
-  reconcileReplicatedActors(ctx, snapshot);
-  reconcileReplicatedBullets(ctx, snapshot);
+  const bool predictedPlayerBuilt = reconcileReplicatedObjects(ctx, snapshot, predictedPlayerID);
 
+  // the local player if we have it, else any player; players sort first in the index
   ctx.gameState.playerIndex = -1;
-  for (int layerIdx = 0; layerIdx < static_cast<int>(ctx.gameState.layers.size()); ++layerIdx) {
-    for (int idx = 0; idx < static_cast<int>(ctx.gameState.layers[layerIdx].size()); ++idx) {
-      const auto& obj = ctx.gameState.layers[layerIdx][idx];
-      if (obj.objClass == ObjectClass::Player && obj.id == localPlayerID) {
-        ctx.gameState.playerLayer = layerIdx;
-        ctx.gameState.playerIndex = idx;
-        return;
-      }
-    }
+  const auto& slots = ctx.replicas.slots();
+  auto it = slots.find({ObjectClass::Player, localPlayerID});
+  if (it == slots.end() && !slots.empty() && slots.begin()->first.first == ObjectClass::Player) {
+    it = slots.begin();
   }
+  if (it != slots.end()) {
+    ctx.gameState.playerLayer = static_cast<int>(it->second.layer);
+    ctx.gameState.playerIndex = static_cast<int>(it->second.index);
+  }
+  return predictedPlayerBuilt;
+}
 
-  for (int layerIdx = 0; layerIdx < static_cast<int>(ctx.gameState.layers.size()); ++layerIdx) {
-    for (int idx = 0; idx < static_cast<int>(ctx.gameState.layers[layerIdx].size()); ++idx) {
-      if (ctx.gameState.layers[layerIdx][idx].objClass == ObjectClass::Player) {
-        ctx.gameState.playerLayer = layerIdx;
-        ctx.gameState.playerIndex = idx;
-        return;
-      }
+// the local player runs ahead of the server on the client's own inputs (ClientPrediction). snapshots
+// only pull it back when the server's result for the last acked input differs from our prediction:
+// then it is reset to the server state and the unacked inputs are replayed on top, and the jump in
+// position is smoothed out at draw time.
+void reconcilePredictedPlayer(
+  SimContext& ctx,
+  game_engine::ClientPrediction& prediction,
+  const game_engine::NetGameStateSnapshot& snapshot,
+  uint32_t localPlayerID,
+  bool rebuilt) {
+  if (ctx.gameState.playerIndex < 0) {
+    return;
+  }
+  GameObject& player = ctx.engine.getPlayer();
+  if (player.objClass != ObjectClass::Player || player.id != localPlayerID) {
+    return;
+  }
+  const auto it = snapshot.m_gameObjects.find({ObjectClass::Player, localPlayerID});
+  if (it == snapshot.m_gameObjects.end()) {
+    return;
+  }
+  const game_engine::NetGameObjectSnapshot& serverPlayer = it->second;
+
+  const game_engine::PredictionResult result = prediction.acknowledge(snapshot.serverTick, serverPlayer);
+  if (rebuilt) {
+    // freshly built from the snapshot: already at the server state, just replay what's unacked
+    prediction.replay(ctx.gameState, player);
+    return;
+  }
+
+  switch (result) {
+    case game_engine::PredictionResult::Stale:
+      break;
+    case game_engine::PredictionResult::Unacked:
+    case game_engine::PredictionResult::Confirmed: {
+      // position and state are ours; health and meters always come from the server
+      auto& data = player.data.player;
+      data.healthPoints = serverPlayer.data.player.healthPoints;
+      data.manaPoints = serverPlayer.data.player.manaPoints;
+      data.ultimatePoints = serverPlayer.data.player.ultimatePoints;
+      data.unlockedUltimateOne = serverPlayer.data.player.unlockedUltimateOne;
+      player.shouldFlash = serverPlayer.shouldFlash;
+      break;
+    }
+    case game_engine::PredictionResult::Rewind: {
+      const glm::vec2 shownPosition = player.position + prediction.correctionOffset();
+      updateReplicatedObject(ctx, player, serverPlayer);
+      prediction.rewind(player);
+      prediction.replay(ctx.gameState, player);
+      prediction.startCorrection(shownPosition - player.position);
+      break;
     }
   }
 }
@@ -843,7 +814,7 @@ public:
     float deltaTime,
     const UIManager::UIActions& actions) override {
 
-    SimContext ctx{engine, engine.getGameState(), resources, progService};
+    SimContext ctx{engine, engine.getGameState(), resources, progService, m_replicas};
     const UIManager::GameView previousView = ctx.gameState.currentView;
     stepLocalHitStop(ctx.gameState, deltaTime);
 
@@ -899,6 +870,7 @@ public:
 
         // read in GameState snapshot coming from the server
         client->ProcessServerMessages();
+        client->BeginInterpolationFrame();
         game_engine::NetGameStateSnapshot latestSnapshot;
         if (client->CopyLatestSnapshot(latestSnapshot)) {
           bool levelChanged = false;
@@ -907,11 +879,23 @@ public:
           }
 
           const bool forceFullRebuild = client->NeedsFullRebuild() || levelChanged;
-          applyAuthoritativeSnapshot(
+          const bool predictedPlayerBuilt = applyAuthoritativeSnapshot(
             ctx,
             latestSnapshot,
             client->GetPlayerID(),
-            forceFullRebuild);
+            forceFullRebuild,
+            client->GetPlayerID());
+          auto& prediction = client->Prediction();
+          reconcilePredictedPlayer(
+            ctx,
+            prediction,
+            latestSnapshot,
+            client->GetPlayerID(),
+            predictedPlayerBuilt);
+          if (ctx.gameState.playerIndex >= 0 && engine.getPlayer().id == client->GetPlayerID()) {
+            prediction.predictPending(ctx.gameState, engine.getPlayer());
+          }
+          prediction.decayCorrection(deltaTime);
           startReplicatedHitStop(ctx.gameState, latestSnapshot.hitStopEvent);
           if (client->NeedsFullRebuild()) {
             client->MarkFullRebuildApplied();
@@ -983,6 +967,9 @@ public:
         0);
     }
   }
+
+private:
+  game_engine::ReplicaIndex m_replicas;
 };
 
 } // namespace
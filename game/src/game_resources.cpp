@@ -21,7 +21,7 @@ SDL_Texture* Level::loadTexture(SDL_Renderer* renderer, const std::string& filep
 }
 
 GameResources::GameResources(game_engine::SDLState& sdl, TTF_Font* fontIn, MIX_Mixer* mixerIn)
-  : mixer(mixerIn), font(fontIn), m_uiManager(sdl, *fontIn) {}
+  : mixer(mixerIn), font(fontIn), m_uiManager(sdl, fontIn) {}
 
 GameResources::~GameResources() {
   unload();
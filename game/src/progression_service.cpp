@@ -2,6 +2,10 @@
 #include <ctime>
 #include "game/progression_service.h"
 
+template <>
+struct net::enum_range<game::ProfileChunkType> {
+  static constexpr game::ProfileChunkType last = game::ProfileChunkType::InventoryProgress;
+};
 
 namespace game {
 
@@ -144,27 +148,14 @@ namespace game {
     bytes.write_u64(static_cast<std::uint64_t>(std::time(nullptr)));
 
     bytes.write_enum(ProfileChunkType::LevelProgress);
-    bytes.write_u32(m_Profile.level_records.size());
-    for (const LevelProgressRecord& lvlRec : m_Profile.level_records) {
-      bytes.write_u32(static_cast<uint32_t>(lvlRec.lvlid));
-      bytes.write_bool(lvlRec.complete);
-    }
+    net::write_wire(bytes, m_Profile.level_records);
 
     bytes.write_enum(ProfileChunkType::CharacterProgress);
-    bytes.write_u32(m_Profile.char_records.size());
-    for (const CharacterProgressRecord& charRec : m_Profile.char_records) {
-      bytes.write_u32(static_cast<uint32_t>(charRec.spriteType));
-      bytes.write_bool(charRec.unlockedUltOne);
-      bytes.write_bool(charRec.unlockedUltTwo);
-    }
+    net::write_wire(bytes, m_Profile.char_records);
 
 
     bytes.write_enum(ProfileChunkType::InventoryProgress);
-    bytes.write_u32(m_Profile.item_records.size());
-    for (const InventoryItemRecord& invRec : m_Profile.item_records) {
-      bytes.write_u32(invRec.id);
-      bytes.write_u32(invRec.amount);
-    }
+    net::write_wire(bytes, m_Profile.item_records);
 
     bytes.write_u32(MAGIC);
     // througout the game, mutate the saveState so that when user hits save we can serealize and have the engine save the new state without having to gather all the scattered data here
@@ -206,39 +197,20 @@ namespace game {
       if (chunkType != ProfileChunkType::LevelProgress) {
         throw std::runtime_error("not level progress chunk type!");
       }
-      size_t levelRecordLen = r.read_u32();
-      m_Profile.level_records.clear();
-      m_Profile.level_records.resize(levelRecordLen);
-      for (size_t i = 0; i < levelRecordLen; ++i) {
-        m_Profile.level_records[i].lvlid = static_cast<LevelIndex>(r.read_u32());
-        m_Profile.level_records[i].complete = r.read_bool();
-      }
+      net::read_wire(r, m_Profile.level_records);
 
       chunkType = r.read_enum<ProfileChunkType>();
       if (chunkType != ProfileChunkType::CharacterProgress) {
         throw std::runtime_error("not character progress chunk type!");
       }
-      size_t charRecordLen = r.read_u32();
-      m_Profile.char_records.clear();
-      m_Profile.char_records.resize(charRecordLen);
-      for (size_t i = 0; i < charRecordLen; ++i) {
-        m_Profile.char_records[i].spriteType = static_cast<SpriteType>(r.read_u32());
-        m_Profile.char_records[i].unlockedUltOne = r.read_bool();
-        m_Profile.char_records[i].unlockedUltTwo = r.read_bool();
-      }
+      net::read_wire(r, m_Profile.char_records);
 
 
       chunkType = r.read_enum<ProfileChunkType>();
       if (chunkType != ProfileChunkType::InventoryProgress) {
         throw std::runtime_error("not inventory progress chunk type!");
       }
-      size_t inventoryRecordLen = r.read_u32();
-      m_Profile.item_records.clear();
-      m_Profile.item_records.resize(inventoryRecordLen);
-      for (size_t i = 0; i < inventoryRecordLen; ++i) {
-        m_Profile.item_records[i].id = r.read_u32();
-        m_Profile.item_records[i].amount = r.read_u32();
-      }
+      net::read_wire(r, m_Profile.item_records);
 
       auto end_magic = r.read_u32();
       if (end_magic != MAGIC) throw std::runtime_error("bad end magic number!");
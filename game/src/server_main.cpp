@@ -0,0 +1,230 @@
+// Dedicated server: runs the authoritative simulation with no window, renderer or mixer. Levels are
+// loaded headless (maps, colliders and animation timings, no textures or audio) and portal transitions
+// are handled on the server loop itself, so clients follow along through the snapshot's level id.
+// Up to --rooms matches run side by side, each in its own room on its own copy of the start level;
+// --workers threads tick them and encode their snapshots. --record-demo writes the default room's
+// snapshots and inputs to a demo file (see engine/net/demo.h) that a client can play back.
+//
+//   ./game_server [--port N] [--tick-rate HZ] [--snapshot-rate HZ] [--io-threads N] [--level N] [--no-lan]
+//                 [--rooms N] [--workers N] [--record-demo PATH]
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <thread>
+
+#include "engine/engine.h"
+#include "engine/net/client_prediction.h"
+#include "engine/net/game_server.h"
+#include "engine/net/lan_discovery.h"
+#include "game/game_resources.h"
+#include "game/level_loader.h"
+#include "game/progression_service.h"
+
+namespace {
+
+std::atomic<bool> g_running{true};
+
+void handleStopSignal(int) {
+  g_running.store(false);
+}
+
+struct ServerOptions {
+  uint16_t port = game_engine::GAME_SERVER_PORT;
+  double tickRate = 60.0;
+  double snapshotRate = 20.0;
+  size_t ioThreads = std::clamp<size_t>(std::thread::hardware_concurrency() / 2, 1, 4);
+  std::optional<LevelIndex> level;
+  bool advertiseOnLan = true;
+  size_t maxRooms = 16;
+  size_t workers = std::clamp<size_t>(std::thread::hardware_concurrency() / 2, 1, 8);
+  std::string demoPath;
+};
+
+void printUsage(const char* exe) {
+  std::cout << "usage: " << exe
+            << " [--port N] [--tick-rate HZ] [--snapshot-rate HZ] [--io-threads N] [--level N] [--no-lan]"
+               " [--rooms N] [--workers N] [--record-demo PATH]\n";
+}
+
+bool parseOptions(int argc, char* argv[], ServerOptions& opts) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    const auto value = [&]() -> const char* {
+      return (i + 1 < argc) ? argv[++i] : nullptr;
+    };
+
+    if (arg == "--no-lan") {
+      opts.advertiseOnLan = false;
+      continue;
+    }
+    if (arg == "--help" || arg == "-h") {
+      return false;
+    }
+
+    const char* v = value();
+    if (!v) {
+      std::cerr << "missing value for " << arg << '\n';
+      return false;
+    }
+    if (arg == "--port") {
+      const long port = std::strtol(v, nullptr, 10);
+      if (port <= 0 || port > 65535) {
+        std::cerr << "invalid port " << v << '\n';
+        return false;
+      }
+      opts.port = static_cast<uint16_t>(port);
+    } else if (arg == "--tick-rate") {
+      opts.tickRate = std::strtod(v, nullptr);
+      // clients step prediction, interpolation and hit stops in fixed server ticks and dont learn the
+      // rate, so a server ticking at any other rate would drift out of step with all of them
+      const double clientTickRate = 1.0 / game_engine::PredictionTuning::stepSeconds;
+      if (std::abs(opts.tickRate - clientTickRate) > 0.01) {
+        std::cerr << "tick rate must be " << clientTickRate << " Hz (the rate clients simulate at)\n";
+        return false;
+      }
+    } else if (arg == "--snapshot-rate") {
+      opts.snapshotRate = std::strtod(v, nullptr);
+      if (opts.snapshotRate < 1.0) {
+        std::cerr << "snapshot rate must be at least 1 Hz\n";
+        return false;
+      }
+    } else if (arg == "--io-threads") {
+      opts.ioThreads = std::clamp<size_t>(std::strtoul(v, nullptr, 10), 1, 64);
+    } else if (arg == "--rooms") {
+      opts.maxRooms = std::clamp<size_t>(std::strtoul(v, nullptr, 10), 1, 1024);
+    } else if (arg == "--workers") {
+      opts.workers = std::clamp<size_t>(std::strtoul(v, nullptr, 10), 1, 64);
+    } else if (arg == "--record-demo") {
+      opts.demoPath = v;
+    } else if (arg == "--level") {
+      const unsigned long level = std::strtoul(v, nullptr, 10);
+      if (level > static_cast<unsigned long>(LevelIndex::LEVEL_3)) {
+        std::cerr << "unknown level " << v << '\n';
+        return false;
+      }
+      opts.level = static_cast<LevelIndex>(level);
+    } else {
+      std::cerr << "unknown option " << arg << '\n';
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  ServerOptions opts;
+  if (!parseOptions(argc, argv, opts)) {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  int exitCode = 0;
+  {
+    game_engine::SDLState sdlState{}; // no window or renderer
+    game::GameResources resources(sdlState, nullptr, nullptr); // nothing is drawn or played here
+    game::ProgressionService progService; // never loaded or saved: progress is kept by each player's client
+    const LevelIndex startLevel = opts.level.value_or(progService.getLastCompletedLevel());
+
+    game_engine::GameState levelState;
+    if (!game::loadHeadlessLevel(sdlState, resources, progService, startLevel, levelState)) {
+      std::cerr << "failed to load level " << static_cast<unsigned>(startLevel) << '\n';
+      exitCode = 1;
+    } else {
+      game_engine::GameServer server(
+        opts.port,
+        std::make_unique<game_engine::AuthoritativeContext>(std::move(levelState)),
+        opts.workers);
+      // every other room starts on its own copy of the start level. called on the room build thread while
+      // the loop keeps using the shared resources for level transitions, so each build loads with its own
+      server.m_rooms.setFactory(
+        [startLevel](uint32_t roomID) -> std::unique_ptr<game_engine::AuthoritativeContext> {
+          game_engine::SDLState roomSdl{};
+          game::GameResources roomResources(roomSdl, nullptr, nullptr);
+          game::ProgressionService roomProgress;
+          game_engine::GameState roomState;
+          if (!game::loadHeadlessLevel(roomSdl, roomResources, roomProgress, startLevel, roomState)) {
+            std::cerr << "failed to load level " << static_cast<unsigned>(startLevel) << " for room " << roomID
+                      << '\n';
+            return nullptr;
+          }
+          std::cout << "opened room " << roomID << std::endl;
+          return std::make_unique<game_engine::AuthoritativeContext>(std::move(roomState));
+        },
+        opts.maxRooms);
+      if (!server.Start(opts.ioThreads)) {
+        exitCode = 1;
+      } else {
+        std::signal(SIGINT, handleStopSignal);
+        std::signal(SIGTERM, handleStopSignal);
+
+        game_engine::DiscoveryHostService discovery;
+        if (opts.advertiseOnLan && !discovery.start()) {
+          std::cout << "LAN discovery unavailable; clients must connect by address\n";
+        }
+        if (!opts.demoPath.empty()) {
+          if (server.startDemoRecording(opts.demoPath)) {
+            std::cout << "recording room " << game_engine::kDefaultRoomID << " to " << opts.demoPath << std::endl;
+          } else {
+            std::cerr << "could not open demo file " << opts.demoPath << '\n';
+          }
+        }
+        std::cout << "dedicated server on port " << opts.port << ", level " << static_cast<unsigned>(startLevel)
+                  << ", " << opts.tickRate << " Hz, up to " << opts.maxRooms << " rooms" << std::endl;
+
+        const uint64_t statsEveryTicks = static_cast<uint64_t>(std::lround(opts.tickRate * 10.0));
+        game_engine::ServerLoopConfig loopConfig;
+        loopConfig.tickRate = opts.tickRate;
+        loopConfig.snapshotRate = opts.snapshotRate;
+        loopConfig.tickWorkers = opts.workers > 1 ? opts.workers - 1 : 0; // the loop thread ticks a room too
+
+        game_engine::runServerLoop(
+          server,
+          []() { return g_running.load(); },
+          loopConfig,
+          [&](uint64_t tick) {
+            server.m_rooms.forEach([&](game_engine::GameRoom& room) {
+              const auto nextLevel = room.ConsumePendingLevelTransition();
+              if (!nextLevel) {
+                return;
+              }
+              game_engine::GameState nextState;
+              if (game::loadHeadlessLevel(sdlState, resources, progService, *nextLevel, nextState)) {
+                room.resetAuthoritativeState(std::move(nextState), true);
+                server.broadcastSnapshot(room.id()); // clients switch level off the snapshot's level id
+                std::cout << "room " << room.id() << " switched to level " << static_cast<unsigned>(*nextLevel)
+                          << std::endl;
+              } else {
+                std::cerr << "failed to load level " << static_cast<unsigned>(*nextLevel) << '\n';
+              }
+            });
+            if (tick % statsEveryTicks == 0) {
+              const game_engine::TickTimingStats timing = server.tickTimingStats();
+              std::cout << "tick timing: " << timing.ticks << " ticks/s, late " << timing.meanLateMs << " ms avg "
+                        << timing.maxLateMs << " ms max, jitter " << timing.intervalJitterMs << " ms, "
+                        << server.playerCount() << " players in " << server.m_rooms.roomCount() << " rooms" << std::endl;
+            }
+            if (discovery.isStarted()) {
+              discovery.updateInfo("Dedicated Server", server.m_rooms.defaultRoom()->levelId(), server.playerCount(),
+                                   opts.port);
+              discovery.setReady(true);
+            }
+          });
+
+        std::cout << "shutting down" << std::endl;
+        discovery.stop();
+        server.stopDemoRecording();
+        server.Stop();
+      }
+    }
+  }
+
+  return exitCode;
+}
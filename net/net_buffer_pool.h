@@ -0,0 +1,58 @@
+#pragma once
+#include "net_common.h"
+
+namespace net
+{
+  // largest body a connection will allocate for unless told otherwise; bigger frames close the connection
+  constexpr uint32_t kDefaultMaxBodySize = 1024u * 1024u;
+
+  // buffer_pool recycles message body vectors so steady-state receive doesnt hit the allocator: the io
+  // threads acquire() a body for each incoming message and whoever consumes the message release()s it.
+  // a mutex-guarded freelist is plenty here; its only held for a vector swap.
+  class buffer_pool
+  {
+    public:
+      buffer_pool(size_t maxPooled = 256, size_t maxRetainedCapacity = 64 * 1024)
+      : m_nMaxPooled(maxPooled), m_nMaxRetainedCapacity(maxRetainedCapacity)
+      {
+        m_vFree.reserve(maxPooled);
+      }
+
+      // a vector of exactly size bytes (contents unspecified), reusing a pooled allocation when there is one
+      std::vector<uint8_t> acquire(size_t size) {
+        std::vector<uint8_t> buf;
+        {
+          std::scoped_lock lock(m_mu);
+          if (!m_vFree.empty()) {
+            buf = std::move(m_vFree.back());
+            m_vFree.pop_back();
+          }
+        }
+        buf.resize(size);
+        return buf;
+      }
+
+      // hands buf back; oversized buffers (one-off big frames) are freed rather than kept around
+      void release(std::vector<uint8_t>&& buf) {
+        if (buf.capacity() == 0 || buf.capacity() > m_nMaxRetainedCapacity) {
+          return;
+        }
+        buf.clear();
+        std::scoped_lock lock(m_mu);
+        if (m_vFree.size() < m_nMaxPooled) {
+          m_vFree.push_back(std::move(buf));
+        }
+      }
+
+      size_t pooled() const {
+        std::scoped_lock lock(m_mu);
+        return m_vFree.size();
+      }
+
+    private:
+      const size_t m_nMaxPooled;
+      const size_t m_nMaxRetainedCapacity;
+      mutable std::mutex m_mu;
+      std::vector<std::vector<uint8_t>> m_vFree;
+  };
+}
@@ -1,7 +1,7 @@
 #pragma once
 #include "net_common.h"
 #include "net_message.h"
-#include "net_ts_queue.h"
+#include "net_lockfree_queue.h"
 #include "net_server.h"
 
 namespace net {
@@ -25,6 +25,11 @@ namespace net {
 
           asio::ip::tcp::resolver::results_type endpoints = resolver.resolve(host, std::to_string(port));
 
+          // reconnecting: the previous connection and its context thread go first
+          ReleaseConnection();
+          m_qMessagesIn.resume(); // stopped by ReleaseConnection or a previous Disconnect
+          m_context.restart();
+
           m_connection = std::make_unique<connection<T>>(
             connection<T>::owner::client,
             m_context,
@@ -32,6 +37,15 @@ namespace net {
             m_qMessagesIn
           );
 
+          m_connection->SetLocalCapabilities(m_nCapabilities);
+          if (m_pingMessageId) {
+            m_connection->EnablePing(*m_pingMessageId);
+          }
+          m_connection->SetBufferPool(m_bufferPool);
+          for (T id : m_vUnreliableIds) {
+            m_connection->SetUnreliable(id);
+          }
+          m_connection->SetImpairment(m_impairIn, m_impairOut);
           m_connection->ConnectToServer(endpoints);
 
           thrContext = std::thread([this](){ m_context.run(); }); // start new thread with context
@@ -46,18 +60,7 @@ namespace net {
       }
 
       void Disconnect() {
-
-        if (IsConnected()) {
-          m_connection->Disconnect();
-        }
-
-        m_context.stop();
-
-        if (thrContext.joinable()) {
-          thrContext.join();
-        }
-
-        m_connection.release();
+        ReleaseConnection();
       }
 
       bool IsConnected() {
@@ -74,7 +77,7 @@ namespace net {
         }
       }
 
-      tsqueue<owned_message<T>>& Incoming() {
+      mpsc_queue<owned_message<T>>& Incoming() {
         return m_qMessagesIn;
       }
 
@@ -82,7 +85,51 @@ namespace net {
       //   return m_isServerValidated;
       // }
 
+      // capabilities advertised to the server on the next Connect
+      void SetCapabilities(uint32_t caps) {
+        m_nCapabilities = caps;
+      }
+
+      // ping/pong message id for the next Connect; see connection::EnablePing
+      void SetPingMessage(T id) {
+        m_pingMessageId = id;
+      }
+
+      // simulated network conditions for the next Connect; by default from NET_IMPAIR_IN / NET_IMPAIR_OUT
+      void SetImpairment(const impairment_config& in, const impairment_config& out) {
+        m_impairIn = in;
+        m_impairOut = out;
+      }
+
+      // msg id the impairment stage may drop, duplicate or reorder
+      void SetUnreliableMessage(T id) {
+        m_vUnreliableIds.push_back(id);
+      }
+
+      void SendPing() {
+        if (IsConnected()) {
+          m_connection->SendPing();
+        }
+      }
+
+      // return a drained message's body once done with it, so the next receive can reuse the allocation
+      void Recycle(message<T>& msg) {
+        m_bufferPool->release(std::move(msg.body));
+      }
+
+      connection_stats GetStats() {
+        return m_connection ? m_connection->GetStats() : connection_stats{};
+      }
+
     protected:
+      // client can always inflate compressed bodies, so advertise it unless told otherwise
+      uint32_t m_nCapabilities = kCapCompression;
+      std::optional<T> m_pingMessageId;
+      std::shared_ptr<buffer_pool> m_bufferPool = std::make_shared<buffer_pool>(64);
+      std::vector<T> m_vUnreliableIds;
+      impairment_config m_impairIn = impairment_config::from_env("NET_IMPAIR_IN");
+      impairment_config m_impairOut = impairment_config::from_env("NET_IMPAIR_OUT");
+
       // client owns the asio context
       asio::io_context m_context;
       // client does work in own thread
@@ -97,7 +144,31 @@ namespace net {
 
     private:
       // client owns the queue of messages coming in, referenced in the connection
-      tsqueue<owned_message<T>> m_qMessagesIn;
+      mpsc_queue<owned_message<T>> m_qMessagesIn{1024};
+
+      // closes the connection and stops its thread. the handlers of whatever it still had in flight (a
+      // connect or read completing with an error, the close Disconnect posts) point at it, so they are
+      // run here, on this thread, before it is freed rather than on the next run() after it is gone
+      void ReleaseConnection() {
+        if (m_connection) {
+          m_connection->Disconnect();
+        }
+
+        m_qMessagesIn.wakeAll(); // unblock the asio thread if it is waiting on a full incoming queue
+        m_context.stop();
+
+        if (thrContext.joinable()) {
+          thrContext.join();
+        }
+
+        if (m_connection) {
+          m_context.restart();
+          while (m_context.poll() > 0) {}
+          m_connection.reset();
+          // its timers queue their aborted waits as they are destroyed; those only look at the error code
+          m_context.poll();
+        }
+      }
 
   };
 
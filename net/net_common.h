@@ -10,6 +10,7 @@
 #include <algorithm>
 #include <chrono>
 #include <cstdint>
+#include <array>
 
 // #define ASIO_STANDALONE
 #include <asio.hpp>
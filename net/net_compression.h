@@ -0,0 +1,239 @@
+#pragma once
+#include "net_common.h"
+#include "net_message.h"
+#include <cstring>
+
+namespace net
+{
+  // capability bits exchanged during the connection handshake (client -> server, after the encrypted
+  // handshake value). the server only compresses towards clients that advertised kCapCompression.
+  enum capability : uint32_t
+  {
+    kCapNone = 0,
+    kCapCompression = 1u << 0,
+  };
+
+  // top bit of message_header::bodySize marks a compressed body. the remaining bits are the size on the
+  // wire; the body itself is [u32 rawSize][lz block].
+  constexpr uint32_t kCompressedBodyFlag = 0x80000000u;
+  constexpr uint32_t kBodySizeMask = ~kCompressedBodyFlag;
+
+  // refuse to inflate anything claiming to be bigger than this (a corrupt or hostile rawSize)
+  constexpr uint32_t kMaxDecompressedBody = 8u * 1024u * 1024u;
+
+  // lz is a small LZ4-style block codec (same block format: token, literals, 16 bit offset, match length).
+  // greedy single-probe hash matching; fast rather than tight, which suits per-tick snapshots.
+  namespace lz
+  {
+    constexpr size_t kMinMatch = 4;
+    constexpr size_t kHashLog = 12;
+    constexpr size_t kMaxOffset = 65535;
+    constexpr size_t kLastLiterals = 5; // block always ends in at least this many literals
+    constexpr size_t kMatchSafeDistance = 12; // no match may start closer than this to the end
+
+    inline size_t compress_bound(size_t n) {
+      return n + n / 255 + 16;
+    }
+
+    inline uint32_t read32(const uint8_t* p) {
+      uint32_t v;
+      std::memcpy(&v, p, sizeof(v));
+      return v;
+    }
+
+    inline uint32_t hash4(uint32_t v) {
+      return (v * 2654435761u) >> (32 - kHashLog);
+    }
+
+    inline uint8_t* write_length(uint8_t* op, size_t len) {
+      while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+      }
+      *op++ = static_cast<uint8_t>(len);
+      return op;
+    }
+
+    // dst must hold compress_bound(srcSize) bytes. returns compressed size.
+    inline size_t compress(const uint8_t* src, size_t srcSize, uint8_t* dst) {
+      uint32_t table[1u << kHashLog] = {};
+      const uint8_t* ip = src;
+      const uint8_t* anchor = src;
+      const uint8_t* const iend = src + srcSize;
+      uint8_t* op = dst;
+
+      auto emit = [&](const uint8_t* litEnd, size_t matchLen, size_t offset) {
+        const size_t litLen = static_cast<size_t>(litEnd - anchor);
+        uint8_t* token = op++;
+        *token = static_cast<uint8_t>((litLen >= 15 ? 15 : litLen) << 4);
+        if (litLen >= 15) {
+          op = write_length(op, litLen - 15);
+        }
+        std::memcpy(op, anchor, litLen);
+        op += litLen;
+        if (matchLen == 0) {
+          return; // final literal-only sequence
+        }
+        *op++ = static_cast<uint8_t>(offset & 0xFF);
+        *op++ = static_cast<uint8_t>(offset >> 8);
+        const size_t ml = matchLen - kMinMatch;
+        *token |= static_cast<uint8_t>(ml >= 15 ? 15 : ml);
+        if (ml >= 15) {
+          op = write_length(op, ml - 15);
+        }
+      };
+
+      if (srcSize > kMatchSafeDistance) {
+        const uint8_t* const mflimit = iend - kMatchSafeDistance;
+        const uint8_t* const matchlimit = iend - kLastLiterals;
+        size_t misses = 0;
+        while (ip < mflimit) {
+          const uint32_t seq = read32(ip);
+          const uint32_t h = hash4(seq);
+          const uint8_t* ref = src + table[h];
+          table[h] = static_cast<uint32_t>(ip - src);
+
+          if (ref >= ip || static_cast<size_t>(ip - ref) > kMaxOffset || read32(ref) != seq) {
+            ip += 1 + (misses++ >> 5); // step faster through incompressible stretches
+            continue;
+          }
+          misses = 0;
+
+          const uint8_t* mp = ip + kMinMatch;
+          const uint8_t* rp = ref + kMinMatch;
+          while (mp < matchlimit && *mp == *rp) {
+            ++mp;
+            ++rp;
+          }
+
+          emit(ip, static_cast<size_t>(mp - ip), static_cast<size_t>(ip - ref));
+          ip = mp;
+          anchor = ip;
+        }
+      }
+
+      emit(iend, 0, 0);
+      return static_cast<size_t>(op - dst);
+    }
+
+    // returns false on malformed input or if the output doesnt come out at exactly rawSize bytes
+    inline bool decompress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t rawSize) {
+      const uint8_t* ip = src;
+      const uint8_t* const iend = src + srcSize;
+      uint8_t* op = dst;
+      uint8_t* const oend = dst + rawSize;
+
+      auto read_length = [&](size_t& len) -> bool {
+        uint8_t b = 0;
+        do {
+          if (ip >= iend) {
+            return false;
+          }
+          b = *ip++;
+          len += b;
+        } while (b == 255);
+        return true;
+      };
+
+      while (ip < iend) {
+        const uint8_t token = *ip++;
+
+        size_t litLen = token >> 4;
+        if (litLen == 15 && !read_length(litLen)) {
+          return false;
+        }
+        if (litLen > static_cast<size_t>(iend - ip) || litLen > static_cast<size_t>(oend - op)) {
+          return false;
+        }
+        std::memcpy(op, ip, litLen);
+        ip += litLen;
+        op += litLen;
+
+        if (ip == iend) {
+          break; // last sequence has no match
+        }
+
+        if (iend - ip < 2) {
+          return false;
+        }
+        const size_t offset = size_t(ip[0]) | (size_t(ip[1]) << 8);
+        ip += 2;
+        if (offset == 0 || offset > static_cast<size_t>(op - dst)) {
+          return false;
+        }
+
+        size_t matchLen = token & 0x0F;
+        if (matchLen == 15 && !read_length(matchLen)) {
+          return false;
+        }
+        matchLen += kMinMatch;
+        if (matchLen > static_cast<size_t>(oend - op)) {
+          return false;
+        }
+
+        const uint8_t* match = op - offset;
+        if (offset >= matchLen) {
+          std::memcpy(op, match, matchLen);
+        } else {
+          // match overlaps its own output (a repeating run), so it has to go byte by byte
+          for (size_t i = 0; i < matchLen; ++i) {
+            op[i] = match[i];
+          }
+        }
+        op += matchLen;
+      }
+
+      return op == oend;
+    }
+  }
+
+  // compress_message swaps msg.body for [u32 rawSize][lz block] and flags the header, but only when the
+  // body is at least threshold bytes and compression actually saves something. returns true if it did.
+  template<typename T>
+  bool compress_message(message<T>& msg, size_t threshold) {
+    if (msg.body.size() < threshold || msg.body.size() > kMaxDecompressedBody ||
+        (msg.header.bodySize & kCompressedBodyFlag)) {
+      return false;
+    }
+
+    std::vector<uint8_t> packed(sizeof(uint32_t) + lz::compress_bound(msg.body.size()));
+    const uint32_t rawSize = static_cast<uint32_t>(msg.body.size());
+    std::memcpy(packed.data(), &rawSize, sizeof(rawSize));
+    const size_t n = lz::compress(msg.body.data(), msg.body.size(), packed.data() + sizeof(uint32_t));
+    if (sizeof(uint32_t) + n >= msg.body.size()) {
+      return false;
+    }
+
+    packed.resize(sizeof(uint32_t) + n);
+    msg.body = std::move(packed);
+    msg.header.bodySize = static_cast<uint32_t>(msg.body.size()) | kCompressedBodyFlag;
+    return true;
+  }
+
+  // inverse of compress_message; no-op for uncompressed messages. false if the body is corrupt.
+  template<typename T>
+  bool decompress_message(message<T>& msg) {
+    if (!(msg.header.bodySize & kCompressedBodyFlag)) {
+      return true;
+    }
+    if (msg.body.size() < sizeof(uint32_t)) {
+      return false;
+    }
+
+    uint32_t rawSize = 0;
+    std::memcpy(&rawSize, msg.body.data(), sizeof(rawSize));
+    if (rawSize > kMaxDecompressedBody) {
+      return false;
+    }
+
+    std::vector<uint8_t> raw(rawSize);
+    if (!lz::decompress(msg.body.data() + sizeof(uint32_t), msg.body.size() - sizeof(uint32_t), raw.data(), rawSize)) {
+      return false;
+    }
+
+    msg.body = std::move(raw);
+    msg.header.bodySize = rawSize;
+    return true;
+  }
+
+}
@@ -3,6 +3,11 @@
 #include "net_common.h"
 #include "net_message.h"
 #include "net_ts_queue.h"
+#include "net_lockfree_queue.h"
+#include "net_compression.h"
+#include "net_stats.h"
+#include "net_buffer_pool.h"
+#include "net_impairment.h"
 
 
 namespace net
@@ -22,7 +27,7 @@ namespace net
         client
       };
 
-      connection(owner parent, asio::io_context& asioCtx, asio::ip::tcp::socket socket, tsqueue<owned_message<T>>& qIn)
+      connection(owner parent, asio::io_context& asioCtx, asio::ip::tcp::socket socket, mpsc_queue<owned_message<T>>& qIn)
       : m_asioContext(asioCtx), m_socket(std::move(socket)), m_qMessagesIn(qIn)
       {
         m_nOwnerType = parent;
@@ -46,19 +51,74 @@ namespace net
 
       uint32_t GetID() const
       {
-        return m_id;
+        return m_id.load(std::memory_order_acquire);
+      }
+
+      // server side: hands this connection another id, e.g. the one a resumed session played under.
+      // the owner makes sure no other live connection is still using it
+      void SetID(uint32_t uid)
+      {
+        m_id.store(uid, std::memory_order_release);
+      }
+
+      // capabilities this side advertises in the handshake. clients set this before connecting.
+      void SetLocalCapabilities(uint32_t caps)
+      {
+        m_nLocalCapabilities = caps;
+      }
+
+      // what the remote advertised during validation (server side only; clients always read 0)
+      bool RemoteSupports(capability cap) const
+      {
+        return (m_nRemoteCapabilities & cap) != 0;
+      }
+
+      // messages with this id are ping/pong and handled here on the asio thread, never queued to the owner.
+      // body is [u8 0 = ping, 1 = pong][u64 sender's steady clock in us]; must be set before connecting.
+      void EnablePing(T pingId)
+      {
+        m_pingId = pingId;
+        m_bPingEnabled = true;
+      }
+
+      // the pong comes back as an rtt sample in GetStats(). either side can ping.
+      void SendPing()
+      {
+        if (!m_bPingEnabled || !IsConnected()) {
+          return;
+        }
+        TrySend(MakePing(kPing, SteadyMicros()));
+      }
+
+      connection_stats GetStats()
+      {
+        connection_stats stats;
+        m_rateMeter.sample(m_counters, stats);
+        stats.outboundQueueDepth = m_qMessagesOut.count();
+        stats.outboundHighWater = m_nOutHighWater.load(std::memory_order_relaxed);
+        m_rtt.fill(stats);
+        return stats;
+      }
+
+      // snapshots the owner threw away because a newer one replaced them (the owner knows which ids those are)
+      void CountSupersededSnapshots(uint64_t n)
+      {
+        m_counters.snapshotsSuperseded.fetch_add(n, std::memory_order_relaxed);
       }
 
     public:
       void ConnectToClient(net::server_interface<T>* server, uint32_t uid = 0) {
         if (m_nOwnerType == owner::server) {
           if (IsConnected()) {
-            m_id = uid;
+            m_id.store(uid, std::memory_order_release);
             // AsyncReadHeader();
-            // on initial connect write the raw data to the client
-            AsyncWriteValidation();
-            // and then wait for client to respond with the encrypted data and attempt to validate
-            AsyncReadValidation(server);
+            // the server may run several io threads; start the handshake on this connection's strand
+            asio::post(m_socket.get_executor(), [this, server, self = this->shared_from_this()]() {
+              // on initial connect write the raw data to the client
+              AsyncWriteValidation();
+              // and then wait for client to respond with the encrypted data and attempt to validate
+              AsyncReadValidation(server);
+            });
           }
         }
       }
@@ -81,7 +141,7 @@ namespace net
       }
 
       void Disconnect() {
-        asio::post(m_asioContext, [this]() { m_socket.close(); });
+        asio::post(m_socket.get_executor(), [this]() { m_socket.close(); });
       }
 
       bool IsConnected() const // "this" treated as const, nonmutable cant be modified
@@ -89,25 +149,160 @@ namespace net
         return m_socket.is_open();
       }
 
-      // Send puts the msg into the outbound msg queue
+      // Send puts a reliable msg into the outbound msg queue: it is always delivered, in order. safe to call
+      // from any thread: the queue is lock-free and only the caller that flips m_bWriteInFlight posts a write.
+      // if the remote stops draining and more than the outbound limit piles up, the connection is dropped
+      // right away: the callers are the server loop and the encoders, which must never wait on one client.
       void Send(const message<T>& msg) {
+        if (!TryPushReliable(msg)) {
+          // remote isnt draining its socket; dropping a message silently would desync it, so cut it loose
+          if (IsConnected()) {
+            std::cout << "[" << GetID() << "] Outbound Queue Full, Disconnecting.\n";
+            Disconnect();
+          }
+          return;
+        }
 
-        asio::post(m_asioContext,
-          [this, msg]()
-          {
-            bool asioCtxAlreadyWriting = !m_qMessagesOut.empty();
-            m_qMessagesOut.push_back(msg);
-            if (!asioCtxAlreadyWriting) {
-              AsyncWriteHeader(); // only add write header workloads to asio ctx that isnt already doing task
-            }
-          });
+        KickWriter();
+      }
+
+      // SendLatest is for state where only the newest copy matters (snapshots, redundant input packets).
+      // each message id gets one slot: a newer message replaces one that hasnt gone out yet, so a slow
+      // remote gets the freshest state at its own pace instead of a growing backlog. a slot goes out
+      // right after the reliable messages that were queued before it, and before any queued after it
+      // (ordering is exact between messages sent from the same thread), so a stale snapshot never lands
+      // after e.g. a level change that followed it.
+      void SendLatest(const message<T>& msg) {
+        {
+          std::scoped_lock lock(m_latestMu);
+          const uint64_t queuedAfter = m_nReliablePushed.load(std::memory_order_acquire);
+          auto it = std::find_if(m_vLatestOut.begin(), m_vLatestOut.end(),
+            [&msg](const latest_slot& queued) { return queued.msg.header.id == msg.header.id; });
+          if (it != m_vLatestOut.end()) {
+            it->msg = msg;
+            it->queuedAfter = queuedAfter;
+            m_counters.snapshotsSuperseded.fetch_add(1, std::memory_order_relaxed);
+          } else {
+            m_vLatestOut.push_back(latest_slot{msg, queuedAfter});
+          }
+          m_bLatestPending.store(true);
+        }
+
+        KickWriter();
+      }
+
+      // incoming bodies are taken from (and, by the owner, returned to) pool. set before connecting.
+      void SetBufferPool(std::shared_ptr<buffer_pool> pool)
+      {
+        m_bufferPool = std::move(pool);
+      }
+
+      // frames (or decompressed bodies) larger than this close the connection before anything is allocated
+      void SetMaxBodySize(uint32_t maxBodySize)
+      {
+        m_nMaxBodySize = maxBodySize;
+      }
+
+      // most reliable messages allowed to wait in the outbound queue (at most the queue's capacity)
+      void SetOutboundLimit(size_t maxQueued) {
+        m_nMaxQueuedOut = std::clamp<size_t>(maxQueued, 1, m_qMessagesOut.capacity());
+      }
+
+      // simulated network conditions for what this side receives (in) and sends (out); see net_impairment.h.
+      // a disabled config is a straight pass-through. set before connecting.
+      void SetImpairment(const impairment_config& in, const impairment_config& out)
+      {
+        m_impairIn = in.enabled() ? std::make_unique<impairment_stage<T>>(in) : nullptr;
+        m_impairOut = out.enabled() ? std::make_unique<impairment_stage<T>>(out) : nullptr;
+      }
+
+      // messages with this id tolerate being dropped, duplicated or reordered by the impairment stage.
+      // SendLatest messages always do.
+      void SetUnreliable(T id)
+      {
+        m_vUnreliableIds.push_back(id);
       }
 
     private:
+      static constexpr uint8_t kPing = 0;
+      static constexpr uint8_t kPong = 1;
+
+      static uint64_t SteadyMicros() {
+        return uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now().time_since_epoch()).count());
+      }
+
+      message<T> MakePing(uint8_t kind, uint64_t stamp) const {
+        message<T> msg;
+        msg.header.id = m_pingId;
+        ByteWriter w;
+        w.write_u8(kind);
+        w.write_u64(stamp);
+        msg.body = std::move(w.buff);
+        msg.header.bodySize = msg.body.size();
+        return msg;
+      }
+
+      bool TryPushReliable(const message<T>& msg) {
+        if (m_qMessagesOut.count() >= m_nMaxQueuedOut || !m_qMessagesOut.try_push(msg)) {
+          return false;
+        }
+        m_nReliablePushed.fetch_add(1, std::memory_order_acq_rel);
+        const size_t depth = m_qMessagesOut.count();
+        size_t highWater = m_nOutHighWater.load(std::memory_order_relaxed);
+        while (depth > highWater && !m_nOutHighWater.compare_exchange_weak(highWater, depth, std::memory_order_relaxed)) {
+        }
+        return true;
+      }
+
+      bool IsUnreliable(T id) const {
+        return std::find(m_vUnreliableIds.begin(), m_vUnreliableIds.end(), id) != m_vUnreliableIds.end();
+      }
+
+      void KickWriter() {
+        std::atomic_thread_fence(std::memory_order_seq_cst); // pairs with the fence in AsyncWriteBatch
+        if (!m_bWriteInFlight.exchange(true)) {
+          asio::post(m_socket.get_executor(), [this]() { AsyncWriteBatch(); });
+        }
+      }
+
+      // never waits: used for ping traffic, which may be sent from the asio thread that drains the queue
+      void TrySend(const message<T>& msg) {
+        if (m_qMessagesOut.try_push(msg)) {
+          m_nReliablePushed.fetch_add(1, std::memory_order_acq_rel);
+          KickWriter();
+        }
+      }
+
+      // true if msg was ping traffic (and has been dealt with)
+      bool HandlePing(const message<T>& msg) {
+        if (!m_bPingEnabled || msg.header.id != m_pingId) {
+          return false;
+        }
+        if (msg.body.size() != sizeof(uint8_t) + sizeof(uint64_t)) {
+          return true; // malformed; drop it
+        }
+        ByteReader r(msg.body);
+        const uint8_t kind = r.read_u8();
+        const uint64_t stamp = r.read_u64();
+        if (kind == kPing) {
+          TrySend(MakePing(kPong, stamp));
+        } else {
+          const uint64_t now = SteadyMicros();
+          if (now >= stamp) {
+            m_rtt.add_sample(double(now - stamp) / 1000.0);
+          }
+        }
+        return true;
+      }
+
 
       // AsyncWriteValidation has the server write the unencrypted handshake val to the client for validation. For the client, this is called in AsyncReadValidation after writing the encrypted val back to the server and so client waits at AsyncReadHeader for server writes
+      // the client's reply carries its capability bits after the encrypted value
       void AsyncWriteValidation() {
-        asio::async_write(m_socket, asio::buffer(&m_handShakeOut, sizeof(uint64_t)),
+        m_vHandshakeBuffers[0] = asio::buffer(&m_handShakeOut, sizeof(uint64_t));
+        m_vHandshakeBuffers[1] = asio::buffer(&m_nLocalCapabilities, m_nOwnerType == owner::client ? sizeof(uint32_t) : 0);
+        asio::async_write(m_socket, m_vHandshakeBuffers,
         [this](std::error_code ec, std::size_t length) {
           if (!ec) {
             // client wrote to socket the handShakeOut so sit and wait for response
@@ -121,7 +316,9 @@ namespace net
       }
 
       void AsyncReadValidation(net::server_interface<T>* server = nullptr) {
-        asio::async_read(m_socket, asio::buffer(&m_handShakeIn, sizeof(uint64_t)),
+        m_vHandshakeReadBuffers[0] = asio::buffer(&m_handShakeIn, sizeof(uint64_t));
+        m_vHandshakeReadBuffers[1] = asio::buffer(&m_nRemoteCapabilities, m_nOwnerType == owner::server ? sizeof(uint32_t) : 0);
+        asio::async_read(m_socket, m_vHandshakeReadBuffers,
         [this, server](std::error_code ec, std::size_t length) {
           if (!ec) {
             if (m_nOwnerType == owner::server) {
@@ -158,15 +355,26 @@ namespace net
           [this](std::error_code ec, std::size_t length)
           {
             if (!ec) {
-              if (m_msgTemporaryIn.header.bodySize > 0) {
-                m_msgTemporaryIn.body.resize(m_msgTemporaryIn.header.bodySize); // resize the tmp buffer for when body is copied into it
+              m_counters.bytesIn.fetch_add(length, std::memory_order_relaxed);
+              m_counters.messagesIn.fetch_add(1, std::memory_order_relaxed);
+              const uint32_t wireBodySize = m_msgTemporaryIn.header.bodySize & kBodySizeMask;
+              if (wireBodySize > m_nMaxBodySize) {
+                // dont trust the peer with our allocator
+                std::cout << "[" << GetID() << "] Oversized Body (" << wireBodySize << " bytes), Disconnecting.\n";
+                m_socket.close();
+                return;
+              }
+              if (wireBodySize > 0) {
+                // the previous body was moved into the incoming queue, so this is usually a pooled buffer
+                AcquireBody(m_msgTemporaryIn.body, wireBodySize);
                 AsyncReadBody();
               } else {
                 // no body, just header
+                m_msgTemporaryIn.body.clear(); // a ping leaves its body behind
                 AddToIncomingMessageQueue();
               }
             } else {
-              std::cout << "[" << m_id << "] Read Header Failed.\n";
+              std::cout << "[" << GetID() << "] Read Header Failed.\n";
               m_socket.close();
             }
         });
@@ -178,69 +386,228 @@ namespace net
           [this](std::error_code ec, std::size_t length)
           {
             if (!ec) {
+              m_counters.bytesIn.fetch_add(length, std::memory_order_relaxed);
+              if (!DecompressBody(m_msgTemporaryIn)) {
+                std::cout << "[" << GetID() << "] Corrupt Compressed Body.\n";
+                m_socket.close();
+                return;
+              }
               AddToIncomingMessageQueue();
             } else {
-              std::cout << "[" << m_id << "] Read Body Failed.\n";
+              std::cout << "[" << GetID() << "] Read Body Failed.\n";
               m_socket.close();
             }
         });
       }
 
-      void AsyncWriteHeader() {
-        asio::async_write(
-          m_socket,
-          asio::buffer(&m_qMessagesOut.front().header, sizeof(message_header<T>)),
+      // AsyncWriteBatch gathers every message currently queued (headers and bodies) into one buffer sequence
+      // and hands it to a single async_write, so a burst of queued messages costs one writev instead of
+      // two round-trips through the io context per message. Only ever runs on this connection's strand.
+      void AsyncWriteBatch() {
+        m_vWriteBatch.clear();
+        m_vWriteBuffers.clear();
+        if (m_impairOut && WaitOnFullImpairedLink()) {
+          return;
+        }
+
+        if (m_vWriteBatch.empty()) {
+          m_qMessagesOut.pop_all(m_vWriteBatch);
+          m_vBatchIsLatest.assign(m_vWriteBatch.size(), false);
+          if (m_bLatestPending.load()) {
+            MergeLatestSlots();
+          }
+          m_nReliableDrained += std::count(m_vBatchIsLatest.begin(), m_vBatchIsLatest.end(), false);
+
+          if (m_impairOut) {
+            ImpairOutbound();
+          }
+        }
+
+        if (m_vWriteBatch.empty()) {
+          m_bWriteInFlight.store(false);
+          // a Send may have pushed after our drain but seen the flag still set; pick it up here
+          std::atomic_thread_fence(std::memory_order_seq_cst);
+          if ((!m_qMessagesOut.empty() || m_bLatestPending.load()) && !m_bWriteInFlight.exchange(true)) {
+            AsyncWriteBatch();
+          }
+          return;
+        }
+
+        // buffers point into m_vWriteBatch, which is not touched again until the write completes
+        m_vWriteBuffers.reserve(m_vWriteBatch.size() * 2);
+        for (const auto& msg : m_vWriteBatch) {
+          m_vWriteBuffers.push_back(asio::buffer(&msg.header, sizeof(message_header<T>)));
+          if (!msg.body.empty()) {
+            m_vWriteBuffers.push_back(asio::buffer(msg.body.data(), msg.body.size()));
+          }
+        }
+
+        asio::async_write(m_socket, m_vWriteBuffers,
           [this](std::error_code ec, std::size_t length)
           {
             if (!ec) {
-              if (m_qMessagesOut.front().body.size() > 0) {
-                AsyncWriteBody();
-              } else {
-                m_qMessagesOut.pop_front();
-
-                if (!m_qMessagesOut.empty())
-                {
-                  AsyncWriteHeader();
-                }
-              }
+              m_counters.bytesOut.fetch_add(length, std::memory_order_relaxed);
+              m_counters.messagesOut.fetch_add(m_vWriteBatch.size(), std::memory_order_relaxed);
+              // anything queued while this batch was on the wire goes out in the next batch
+              AsyncWriteBatch();
             } else {
-              std::cout << "[" << m_id << "] Write Header Failed.\n";
+              std::cout << "[" << GetID() << "] Write Batch Failed.\n";
+              m_bWriteInFlight.store(false);
               m_socket.close();
             }
           });
       }
 
-      void AsyncWriteBody()
-      {
-        asio::async_write(m_socket, asio::buffer(m_qMessagesOut.front().body.data(), m_qMessagesOut.front().body.size()),
-          [this](std::error_code ec, std::size_t length)
-          {
-            if (!ec) {
-              m_qMessagesOut.pop_front(); // pop msg off queue once written to socket buffer
+      void AddToIncomingMessageQueue() {
+        if (m_impairIn) {
+          const bool unreliable = IsUnreliable(m_msgTemporaryIn.header.id);
+          m_impairIn->push(std::move(m_msgTemporaryIn), unreliable, std::chrono::steady_clock::now());
+          m_msgTemporaryIn.body.clear();
+          ReleaseImpairedInbound();
+        } else {
+          DeliverIncoming(m_msgTemporaryIn);
+        }
 
-              if (!m_qMessagesOut.empty()) {
-                AsyncWriteHeader(); // continue writing to socket if we have more messages
-              }
+        // register another async asio task
+        AsyncReadHeader();
+      }
 
-            } else {
-              std::cout << "[" << m_id << "] Write Body Failed.\n";
-              m_socket.close();
+      void DeliverIncoming(message<T>& msg) {
+        if (HandlePing(msg)) {
+          return;
+        }
+
+        // push into client or server queue. the body is moved, not copied; the owner returns it to the pool
+        if (m_nOwnerType == owner::server) {
+          // server has many connections so when we push to servers queue, we store ref to the connection
+          // push_back yields while the consumer's ring is full, which stalls this socket's reads (tcp backpressure)
+          m_qMessagesIn.push_back(owned_message<T>{ this->shared_from_this(), std::move(msg) }); // shared_from_this() gives shared pointer to connection
+        } else {
+          m_qMessagesIn.push_back(owned_message<T>{ nullptr, std::move(msg) });
+        }
+        msg.body.clear(); // moved-from; make the state explicit
+      }
+
+      // hands over every held inbound message that has "arrived" and waits for the next one. re-arming
+      // cancels the previous wait, so a message that overtook the others is not held up behind them.
+      void ReleaseImpairedInbound() {
+        m_vImpairedDue.clear();
+        m_impairIn->pop_due(std::chrono::steady_clock::now(), m_vImpairedDue);
+        for (auto& msg : m_vImpairedDue) {
+          DeliverIncoming(msg);
+        }
+        if (!m_impairIn->empty()) {
+          m_impairInTimer.expires_at(m_impairIn->next_due());
+          m_impairInTimer.async_wait([this](std::error_code ec) {
+            if (!ec && m_socket.is_open()) {
+              ReleaseImpairedInbound();
             }
           });
+        }
+      }
 
+      // slots in m_vWriteBatch (which holds just the drained reliable messages) each go in after the
+      // reliable message they were queued behind. reliable messages are numbered in push order, and
+      // m_nReliableDrained of them went out in earlier batches
+      void MergeLatestSlots() {
+        std::scoped_lock lock(m_latestMu);
+        m_bLatestPending.store(false);
+        std::sort(m_vLatestOut.begin(), m_vLatestOut.end(),
+          [](const latest_slot& a, const latest_slot& b) { return a.queuedAfter < b.queuedAfter; });
+        const size_t nReliable = m_vWriteBatch.size();
+        m_vWriteBatch.reserve(nReliable + m_vLatestOut.size());
+        for (auto slot = m_vLatestOut.rbegin(); slot != m_vLatestOut.rend(); ++slot) {
+          const uint64_t behind = slot->queuedAfter > m_nReliableDrained ? slot->queuedAfter - m_nReliableDrained : 0;
+          const size_t at = static_cast<size_t>(std::min<uint64_t>(behind, nReliable));
+          m_vWriteBatch.insert(m_vWriteBatch.begin() + at, std::move(slot->msg));
+          m_vBatchIsLatest.insert(m_vBatchIsLatest.begin() + at, true);
+        }
+        m_vLatestOut.clear();
       }
 
-      void AddToIncomingMessageQueue() {
-        // push into client or server queue
-        if (m_nOwnerType == owner::server) {
-          // server has many connections so when we push to servers queue, we store ref to the connection
-          m_qMessagesIn.push_back({ this->shared_from_this(), m_msgTemporaryIn }); // shared_from_this() gives shared pointer to connection
+      // runs the drained batch through the outbound stage, leaving only what is due in m_vWriteBatch. while
+      // messages are held back a timer restarts the writer when the next one is due.
+      void ImpairOutbound() {
+        const auto now = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < m_vWriteBatch.size(); ++i) {
+          const bool unreliable = m_vBatchIsLatest[i] || IsUnreliable(m_vWriteBatch[i].header.id);
+          m_impairOut->push(std::move(m_vWriteBatch[i]), unreliable, now);
+        }
+        m_vWriteBatch.clear();
+        m_impairOut->pop_due(now, m_vWriteBatch);
+
+        if (!m_impairOut->empty()) {
+          m_impairOutTimer.expires_at(m_impairOut->next_due());
+          m_impairOutTimer.async_wait([this](std::error_code ec) {
+            // a write in flight picks the due messages up when it completes
+            if (!ec && m_socket.is_open() && !m_bWriteInFlight.exchange(true)) {
+              AsyncWriteBatch();
+            }
+          });
+        }
+      }
+
+      // while the simulated send buffer is full nothing new is taken from the queues: only messages that
+      // have arrived go out. returns true if there is nothing to write yet; the link timer then calls back
+      // in with the write flag still held, so Send doesn't restart the writer in the meantime.
+      bool WaitOnFullImpairedLink() {
+        const auto now = std::chrono::steady_clock::now();
+        if (!m_impairOut->buffer_full(now)) {
+          return false;
+        }
+        m_impairOut->pop_due(now, m_vWriteBatch);
+        if (!m_vWriteBatch.empty()) {
+          return false;
+        }
+
+        auto wakeAt = m_impairOut->accepts_at();
+        if (!m_impairOut->empty()) {
+          wakeAt = std::min(wakeAt, m_impairOut->next_due());
+        }
+        m_impairOutTimer.expires_at(wakeAt);
+        m_impairOutTimer.async_wait([this](std::error_code ec) {
+          if (!ec && m_socket.is_open()) {
+            AsyncWriteBatch();
+          }
+        });
+        return true;
+      }
+
+      void AcquireBody(std::vector<uint8_t>& body, size_t size) {
+        if (m_bufferPool && body.capacity() < size) {
+          body = m_bufferPool->acquire(size);
         } else {
-          m_qMessagesIn.push_back({ nullptr, m_msgTemporaryIn });
+          body.resize(size);
         }
+      }
 
-        // register another async asio task
-        AsyncReadHeader();
+      // decompress_message, but inflating into a pooled buffer and bounded by m_nMaxBodySize
+      bool DecompressBody(message<T>& msg) {
+        if (!(msg.header.bodySize & kCompressedBodyFlag)) {
+          return true;
+        }
+        if (msg.body.size() < sizeof(uint32_t)) {
+          return false;
+        }
+
+        uint32_t rawSize = 0;
+        std::memcpy(&rawSize, msg.body.data(), sizeof(rawSize));
+        if (rawSize > m_nMaxBodySize || rawSize > kMaxDecompressedBody) {
+          return false;
+        }
+
+        std::vector<uint8_t> raw;
+        AcquireBody(raw, rawSize);
+        if (!lz::decompress(msg.body.data() + sizeof(uint32_t), msg.body.size() - sizeof(uint32_t), raw.data(), rawSize)) {
+          return false;
+        }
+
+        std::swap(msg.body, raw);
+        if (m_bufferPool) {
+          m_bufferPool->release(std::move(raw));
+        }
+        msg.header.bodySize = rawSize;
+        return true;
       }
 
       uint64_t encrypt(uint64_t input) {
@@ -255,24 +622,67 @@ namespace net
       // each connection has unique socket
       asio::ip::tcp::socket m_socket;
 
-      // shared context across connection instances
+      // shared context across connection instances. handlers are posted to m_socket's executor instead,
+      // which on the server is the connection's strand
       asio::io_context& m_asioContext;
 
-      // connection holds queue of msg to be sent out
-      tsqueue<message<T>> m_qMessagesOut;
+      // connection holds queue of msg to be sent out. many producers (sim/main threads), one consumer (asio)
+      mpsc_queue<message<T>> m_qMessagesOut{1024};
+      // messages currently on the wire and the gathered header/body buffers pointing into them
+      std::vector<message<T>> m_vWriteBatch;
+      std::vector<asio::const_buffer> m_vWriteBuffers;
+      std::atomic<bool> m_bWriteInFlight{false};
+      size_t m_nMaxQueuedOut = m_qMessagesOut.capacity();
+      std::atomic<size_t> m_nOutHighWater{0};
+
+      // latest-only messages, at most one per message id, waiting for the next write. queuedAfter is how
+      // many reliable messages had been queued when the slot was last filled
+      struct latest_slot {
+        message<T> msg;
+        uint64_t queuedAfter = 0;
+      };
+      std::mutex m_latestMu;
+      std::vector<latest_slot> m_vLatestOut;
+      std::atomic<bool> m_bLatestPending{false};
+      std::atomic<uint64_t> m_nReliablePushed{0};
+      uint64_t m_nReliableDrained = 0;    // writer only
+      std::vector<bool> m_vBatchIsLatest; // writer only; parallel to m_vWriteBatch while it is assembled
 
       // holds all msg recieved from remote.
       // is a reference as owner of this conn must provide the queue
-      tsqueue<owned_message<T>>& m_qMessagesIn;
+      mpsc_queue<owned_message<T>>& m_qMessagesIn;
       message<T> m_msgTemporaryIn;
+      std::shared_ptr<buffer_pool> m_bufferPool; // optional; without one bodies are plain allocations
+      uint32_t m_nMaxBodySize = kDefaultMaxBodySize;
 
       owner m_nOwnerType = owner::server;
-      uint32_t m_id = 0;
+      std::atomic<uint32_t> m_id{0}; // read by the owner's threads, changed by SetID
 
       // encryption validation
       uint64_t m_handShakeOut = 0; // sent
       uint64_t m_handShakeIn = 0; // recieved
       uint64_t m_handShakeCheck = 0; // check by server to do comparison
+
+      // capability negotiation piggybacks on the handshake
+      uint32_t m_nLocalCapabilities = kCapNone;
+      uint32_t m_nRemoteCapabilities = kCapNone;
+      std::array<asio::const_buffer, 2> m_vHandshakeBuffers;
+      std::array<asio::mutable_buffer, 2> m_vHandshakeReadBuffers;
+
+      // stats
+      connection_counters m_counters;
+      rate_meter m_rateMeter;
+      rtt_estimator m_rtt;
+      bool m_bPingEnabled = false;
+      T m_pingId{};
+
+      // optional simulated network conditions, one stage per direction; only touched on the socket's strand
+      std::vector<T> m_vUnreliableIds;
+      std::unique_ptr<impairment_stage<T>> m_impairIn;
+      std::unique_ptr<impairment_stage<T>> m_impairOut;
+      asio::steady_timer m_impairInTimer{m_socket.get_executor()};
+      asio::steady_timer m_impairOutTimer{m_socket.get_executor()};
+      std::vector<message<T>> m_vImpairedDue;
   };
 
 
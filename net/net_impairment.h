@@ -0,0 +1,199 @@
+#pragma once
+#include "net_common.h"
+#include "net_message.h"
+#include <cstdlib>
+#include <random>
+#include <string_view>
+
+namespace net
+{
+  // simulated network conditions for one direction of a connection. all zero = pass-through.
+  //
+  // we run over tcp, so the app never sees real loss, duplication or reordering of the byte stream. the
+  // stage models what a player would see instead: messages the owner marks as unreliable (snapshots,
+  // redundantly resent inputs - stuff we would put on udp) can be dropped, duplicated and overtaken;
+  // everything else keeps its order, and a "lost" reliable message shows up one retransmit timeout late
+  // with everything behind it waiting, like a tcp segment would.
+  struct impairment_config
+  {
+    double delayMs = 0.0;       // one-way latency added to every message
+    double jitterMs = 0.0;      // +- uniform spread on top of delayMs
+    double lossPercent = 0.0;
+    double duplicatePercent = 0.0;
+    double bandwidthKbps = 0.0; // 0 = unlimited
+    double retransmitMs = 200.0;
+    double sendBufferMs = 200.0; // with a bandwidth cap: how much link time may be queued before writes stall
+    uint32_t seed = 1;          // same seed + same traffic = same impairment
+
+    bool enabled() const
+    {
+      return delayMs > 0.0 || jitterMs > 0.0 || lossPercent > 0.0 || duplicatePercent > 0.0 || bandwidthKbps > 0.0;
+    }
+
+    // "delay=80,jitter=20,loss=2,dup=1,kbps=512,rto=200,buf=200,seed=7"; unknown keys and bad numbers are ignored
+    static impairment_config parse(std::string_view spec)
+    {
+      impairment_config cfg;
+      while (!spec.empty()) {
+        const size_t comma = spec.find(',');
+        const std::string_view item = spec.substr(0, comma);
+        spec = comma == std::string_view::npos ? std::string_view{} : spec.substr(comma + 1);
+
+        const size_t eq = item.find('=');
+        if (eq == std::string_view::npos) {
+          continue;
+        }
+        const std::string_view key = item.substr(0, eq);
+        const std::string value(item.substr(eq + 1));
+        char* end = nullptr;
+        const double v = std::strtod(value.c_str(), &end);
+        if (end == value.c_str() || v < 0.0) {
+          continue;
+        }
+
+        if (key == "delay") cfg.delayMs = v;
+        else if (key == "jitter") cfg.jitterMs = v;
+        else if (key == "loss") cfg.lossPercent = std::min(v, 100.0);
+        else if (key == "dup") cfg.duplicatePercent = std::min(v, 100.0);
+        else if (key == "kbps") cfg.bandwidthKbps = v;
+        else if (key == "rto") cfg.retransmitMs = v;
+        else if (key == "buf") cfg.sendBufferMs = v;
+        else if (key == "seed") cfg.seed = static_cast<uint32_t>(v);
+      }
+      return cfg;
+    }
+
+    // unset or empty variable = no impairment
+    static impairment_config from_env(const char* name)
+    {
+      const char* spec = std::getenv(name);
+      return spec ? parse(spec) : impairment_config{};
+    }
+  };
+
+  // holds messages until their simulated arrival time. not thread safe; a connection keeps one per
+  // direction and only touches it from its own strand.
+  template <typename T>
+  class impairment_stage
+  {
+    public:
+      using clock = std::chrono::steady_clock;
+
+      explicit impairment_stage(const impairment_config& cfg)
+      : m_cfg(cfg), m_rng(cfg.seed)
+      {}
+
+      void push(message<T>&& msg, bool unreliable, clock::time_point now)
+      {
+        if (unreliable && Roll(m_cfg.lossPercent)) {
+          ++m_nDropped;
+          return;
+        }
+
+        // serialise onto the (capped) link first, then propagate
+        clock::time_point departs = now;
+        if (m_cfg.bandwidthKbps > 0.0) {
+          const double wireBits = 8.0 * double(sizeof(message_header<T>) + msg.body.size());
+          departs = std::max(departs, m_tLinkFree) + Millis(wireBits / m_cfg.bandwidthKbps);
+          m_tLinkFree = departs;
+        }
+
+        if (unreliable) {
+          if (Roll(m_cfg.duplicatePercent)) {
+            ++m_nDuplicated;
+            Schedule(message<T>(msg), departs + Latency());
+          }
+          Schedule(std::move(msg), departs + Latency());
+          return;
+        }
+
+        clock::time_point due = departs + Latency();
+        if (Roll(m_cfg.lossPercent)) {
+          ++m_nRetransmitted;
+          due += Millis(m_cfg.retransmitMs);
+        }
+        // in order behind every earlier reliable message
+        due = std::max(due, m_tLastReliableDue);
+        m_tLastReliableDue = due;
+        Schedule(std::move(msg), due);
+      }
+
+      // moves every message whose arrival time has passed into out, in arrival order
+      void pop_due(clock::time_point now, std::vector<message<T>>& out)
+      {
+        while (!m_vHeap.empty() && m_vHeap.front().due <= now) {
+          std::pop_heap(m_vHeap.begin(), m_vHeap.end(), Later{});
+          out.push_back(std::move(m_vHeap.back().msg));
+          m_vHeap.pop_back();
+        }
+      }
+
+      bool empty() const { return m_vHeap.empty(); }
+
+      // a capped link with more than sendBufferMs of data waiting to go out takes nothing new, the way a
+      // full socket buffer blocks the writer; the sender's own queues back up instead
+      bool buffer_full(clock::time_point now) const
+      {
+        return m_cfg.bandwidthKbps > 0.0 && m_cfg.sendBufferMs > 0.0 && m_tLinkFree - now > Millis(m_cfg.sendBufferMs);
+      }
+
+      clock::time_point accepts_at() const { return m_tLinkFree - Millis(m_cfg.sendBufferMs); }
+
+      clock::time_point next_due() const { return m_vHeap.front().due; }
+
+      uint64_t dropped() const { return m_nDropped; }
+      uint64_t duplicated() const { return m_nDuplicated; }
+      uint64_t retransmitted() const { return m_nRetransmitted; }
+
+    private:
+      struct entry
+      {
+        clock::time_point due;
+        uint64_t order; // ties go out in push order
+        message<T> msg;
+      };
+
+      struct Later
+      {
+        bool operator()(const entry& a, const entry& b) const
+        {
+          return a.due != b.due ? a.due > b.due : a.order > b.order;
+        }
+      };
+
+      static clock::duration Millis(double ms)
+      {
+        return std::chrono::duration_cast<clock::duration>(std::chrono::duration<double, std::milli>(ms));
+      }
+
+      bool Roll(double percent)
+      {
+        return percent > 0.0 && std::uniform_real_distribution<double>(0.0, 100.0)(m_rng) < percent;
+      }
+
+      clock::duration Latency()
+      {
+        double ms = m_cfg.delayMs;
+        if (m_cfg.jitterMs > 0.0) {
+          ms += std::uniform_real_distribution<double>(-m_cfg.jitterMs, m_cfg.jitterMs)(m_rng);
+        }
+        return Millis(std::max(ms, 0.0));
+      }
+
+      void Schedule(message<T>&& msg, clock::time_point due)
+      {
+        m_vHeap.push_back(entry{due, m_nOrder++, std::move(msg)});
+        std::push_heap(m_vHeap.begin(), m_vHeap.end(), Later{});
+      }
+
+      const impairment_config m_cfg;
+      std::mt19937 m_rng;
+      std::vector<entry> m_vHeap;
+      uint64_t m_nOrder = 0;
+      clock::time_point m_tLinkFree{};
+      clock::time_point m_tLastReliableDue{};
+      uint64_t m_nDropped = 0;
+      uint64_t m_nDuplicated = 0;
+      uint64_t m_nRetransmitted = 0;
+  };
+}
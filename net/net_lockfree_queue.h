@@ -0,0 +1,340 @@
+#pragma once
+#include "net_common.h"
+#include <atomic>
+#include <condition_variable>
+
+namespace net
+{
+
+  // round requested capacity up to a power of two so ring indices can be masked instead of mod'd
+  inline size_t ring_capacity(size_t requested) {
+    size_t cap = 2;
+    while (cap < requested) {
+      cap <<= 1;
+    }
+    return cap;
+  }
+
+  // queue_waiter is the optional blocking part shared by the lock-free queues. producers only touch the
+  // mutex/condvar when the consumer has actually gone to sleep, so the push fast path stays lock-free.
+  class queue_waiter
+  {
+    public:
+      void notify() {
+        std::atomic_thread_fence(std::memory_order_seq_cst); // pairs with the fence in wait_while
+        if (m_nWaiters.load(std::memory_order_relaxed) > 0) {
+          std::scoped_lock lock(m_mu);
+          m_cv.notify_all();
+        }
+      }
+
+      // blocks while isEmpty() holds, until deadline (if any) or wakeAll. returns false on timeout/stop.
+      template<typename Pred>
+      bool wait_while(Pred isEmpty, std::optional<std::chrono::steady_clock::time_point> deadline = std::nullopt) {
+        std::unique_lock<std::mutex> ul(m_mu);
+        m_nWaiters.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst); // a producer either sees us waiting or we see its item
+        bool ready = true;
+        while (isEmpty() && !m_bStop.load(std::memory_order_acquire)) {
+          if (!deadline) {
+            m_cv.wait(ul);
+          } else if (m_cv.wait_until(ul, *deadline) == std::cv_status::timeout) {
+            ready = !isEmpty();
+            break;
+          }
+        }
+        m_nWaiters.fetch_sub(1, std::memory_order_relaxed);
+        return ready && !m_bStop.load(std::memory_order_acquire);
+      }
+
+      void wakeAll() {
+        m_bStop.store(true, std::memory_order_release);
+        std::scoped_lock lock(m_mu);
+        m_cv.notify_all();
+      }
+
+      void resume() {
+        m_bStop.store(false, std::memory_order_release);
+      }
+
+      bool stopped() const {
+        return m_bStop.load(std::memory_order_acquire);
+      }
+
+    private:
+      std::mutex m_mu;
+      std::condition_variable m_cv;
+      std::atomic<uint32_t> m_nWaiters{0};
+      std::atomic<bool> m_bStop{false};
+  };
+
+  // mpsc_queue is a bounded multi-producer single-consumer ring (sequence-numbered slots, Vyukov style).
+  // producers claim a slot with one CAS on the tail; the single consumer never CASes. interface mirrors
+  // tsqueue (push_back/pop_front/empty/count/wait/wakeAll) so it can be dropped in where tsqueue was used,
+  // plus try_push/pop_all for callers that care about fullness and batching.
+  template<typename T>
+  class mpsc_queue
+  {
+    public:
+      explicit mpsc_queue(size_t capacity = 4096)
+      : m_nCapacity(ring_capacity(capacity)), m_nMask(m_nCapacity - 1), m_slots(new slot[m_nCapacity])
+      {
+        for (size_t i = 0; i < m_nCapacity; i++) {
+          m_slots[i].seq.store(i, std::memory_order_relaxed);
+        }
+      }
+
+      mpsc_queue(const mpsc_queue<T>&) = delete;
+
+    public:
+      // try_push returns false when the ring is full; item is left untouched in that case
+      template<typename U>
+      bool try_push(U&& item) {
+        size_t pos = m_nTail.load(std::memory_order_relaxed);
+        slot* s = nullptr;
+        for (;;) {
+          s = &m_slots[pos & m_nMask];
+          size_t seq = s->seq.load(std::memory_order_acquire);
+          intptr_t diff = intptr_t(seq) - intptr_t(pos);
+          if (diff == 0) {
+            if (m_nTail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+              break;
+            }
+          } else if (diff < 0) {
+            return false; // consumer hasnt freed this slot yet -> full
+          } else {
+            pos = m_nTail.load(std::memory_order_relaxed);
+          }
+        }
+
+        s->data = std::forward<U>(item);
+        s->seq.store(pos + 1, std::memory_order_release); // publish to consumer
+        m_waiter.notify();
+        return true;
+      }
+
+      // push_back yields while full (backpressure onto the producer) and gives up once the queue is stopped
+      template<typename U>
+      bool push_back(U&& item) {
+        while (!try_push(std::forward<U>(item))) {
+          if (m_waiter.stopped()) {
+            return false;
+          }
+          std::this_thread::yield();
+        }
+        return true;
+      }
+
+      // consumer only
+      bool try_pop(T& out) {
+        size_t pos = m_nHead.load(std::memory_order_relaxed);
+        slot& s = m_slots[pos & m_nMask];
+        if (s.seq.load(std::memory_order_acquire) != pos + 1) {
+          return false;
+        }
+        out = std::move(s.data);
+        s.seq.store(pos + m_nCapacity, std::memory_order_release); // hand slot back to producers one lap later
+        m_nHead.store(pos + 1, std::memory_order_relaxed);
+        return true;
+      }
+
+      // consumer only; caller checks empty() first like with tsqueue
+      T pop_front() {
+        T item{};
+        try_pop(item);
+        return item;
+      }
+
+      // pop_all moves up to nMax items onto the end of out. out is meant to be a vector the caller keeps
+      // around between drains so steady state does no allocation. returns number moved.
+      size_t pop_all(std::vector<T>& out, size_t nMax = size_t(-1)) {
+        size_t n = 0;
+        size_t pos = m_nHead.load(std::memory_order_relaxed);
+        while (n < nMax) {
+          slot& s = m_slots[pos & m_nMask];
+          if (s.seq.load(std::memory_order_acquire) != pos + 1) {
+            break;
+          }
+          out.push_back(std::move(s.data));
+          s.seq.store(pos + m_nCapacity, std::memory_order_release);
+          pos++;
+          n++;
+        }
+        m_nHead.store(pos, std::memory_order_relaxed);
+        return n;
+      }
+
+      bool empty() const {
+        size_t pos = m_nHead.load(std::memory_order_relaxed);
+        return m_slots[pos & m_nMask].seq.load(std::memory_order_acquire) != pos + 1;
+      }
+
+      // approximate when producers are mid-push
+      size_t count() const {
+        size_t tail = m_nTail.load(std::memory_order_relaxed);
+        size_t head = m_nHead.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+      }
+
+      size_t capacity() const {
+        return m_nCapacity;
+      }
+
+      void clear() {
+        T discard{};
+        while (try_pop(discard)) {}
+      }
+
+      // wait for an item (or wakeAll)
+      void wait() {
+        m_waiter.wait_while([this]() { return empty(); });
+      }
+
+      // wait for an item until deadline; returns true if there is something to pop
+      bool wait_until(std::chrono::steady_clock::time_point deadline) {
+        return m_waiter.wait_while([this]() { return empty(); }, deadline);
+      }
+
+      void wakeAll() {
+        m_waiter.wakeAll();
+      }
+
+      // undo wakeAll so the queue can be reused (client reconnect)
+      void resume() {
+        m_waiter.resume();
+      }
+
+    private:
+      struct slot
+      {
+        std::atomic<size_t> seq{0};
+        T data{};
+      };
+
+      const size_t m_nCapacity;
+      const size_t m_nMask;
+      std::unique_ptr<slot[]> m_slots;
+
+      // head and tail on their own cache lines so producers and the consumer dont false share
+      alignas(64) std::atomic<size_t> m_nTail{0};
+      alignas(64) std::atomic<size_t> m_nHead{0};
+      alignas(64) queue_waiter m_waiter;
+  };
+
+  // spsc_queue is a bounded single-producer single-consumer ring. cheaper than mpsc_queue (no CAS, each
+  // side caches the other's index) for one thread handing work to exactly one other thread.
+  template<typename T>
+  class spsc_queue
+  {
+    public:
+      explicit spsc_queue(size_t capacity = 1024)
+      : m_nCapacity(ring_capacity(capacity)), m_nMask(m_nCapacity - 1), m_items(new T[m_nCapacity])
+      {}
+
+      spsc_queue(const spsc_queue<T>&) = delete;
+
+    public:
+      // producer only
+      template<typename U>
+      bool try_push(U&& item) {
+        size_t tail = m_nTail.load(std::memory_order_relaxed);
+        if (tail - m_nHeadCache == m_nCapacity) {
+          m_nHeadCache = m_nHead.load(std::memory_order_acquire);
+          if (tail - m_nHeadCache == m_nCapacity) {
+            return false;
+          }
+        }
+        m_items[tail & m_nMask] = std::forward<U>(item);
+        m_nTail.store(tail + 1, std::memory_order_release);
+        m_waiter.notify();
+        return true;
+      }
+
+      template<typename U>
+      bool push_back(U&& item) {
+        while (!try_push(std::forward<U>(item))) {
+          if (m_waiter.stopped()) {
+            return false;
+          }
+          std::this_thread::yield();
+        }
+        return true;
+      }
+
+      // consumer only
+      bool try_pop(T& out) {
+        size_t head = m_nHead.load(std::memory_order_relaxed);
+        if (head == m_nTailCache) {
+          m_nTailCache = m_nTail.load(std::memory_order_acquire);
+          if (head == m_nTailCache) {
+            return false;
+          }
+        }
+        out = std::move(m_items[head & m_nMask]);
+        m_nHead.store(head + 1, std::memory_order_release);
+        return true;
+      }
+
+      T pop_front() {
+        T item{};
+        try_pop(item);
+        return item;
+      }
+
+      size_t pop_all(std::vector<T>& out, size_t nMax = size_t(-1)) {
+        size_t head = m_nHead.load(std::memory_order_relaxed);
+        size_t tail = m_nTail.load(std::memory_order_acquire);
+        size_t n = std::min(tail - head, nMax);
+        for (size_t i = 0; i < n; i++) {
+          out.push_back(std::move(m_items[(head + i) & m_nMask]));
+        }
+        m_nHead.store(head + n, std::memory_order_release);
+        return n;
+      }
+
+      bool empty() const {
+        return m_nHead.load(std::memory_order_acquire) == m_nTail.load(std::memory_order_acquire);
+      }
+
+      size_t count() const {
+        return m_nTail.load(std::memory_order_acquire) - m_nHead.load(std::memory_order_acquire);
+      }
+
+      size_t capacity() const {
+        return m_nCapacity;
+      }
+
+      void clear() {
+        T discard{};
+        while (try_pop(discard)) {}
+      }
+
+      void wait() {
+        m_waiter.wait_while([this]() { return empty(); });
+      }
+
+      bool wait_until(std::chrono::steady_clock::time_point deadline) {
+        return m_waiter.wait_while([this]() { return empty(); }, deadline);
+      }
+
+      void wakeAll() {
+        m_waiter.wakeAll();
+      }
+
+      void resume() {
+        m_waiter.resume();
+      }
+
+    private:
+      const size_t m_nCapacity;
+      const size_t m_nMask;
+      std::unique_ptr<T[]> m_items;
+
+      alignas(64) std::atomic<size_t> m_nTail{0};
+      size_t m_nHeadCache = 0; // producer's view of head
+      alignas(64) std::atomic<size_t> m_nHead{0};
+      size_t m_nTailCache = 0; // consumer's view of tail
+      alignas(64) queue_waiter m_waiter;
+  };
+
+}
@@ -2,6 +2,7 @@
 #include "net_common.h"
 #include <glm/glm.hpp>
 #include <SDL3/SDL.h>
+#include <utility>
 
 namespace net
 {
@@ -90,6 +91,18 @@ namespace net
     }
   };
 
+  // every enum read off the wire names its last value, and a decode fails on anything outside
+  // 0..last, so a corrupt or hostile byte never becomes an enumerator that doesnt exist:
+  //   template <> struct net::enum_range<Color> { static constexpr Color last = Color::Blue; };
+  template <typename E>
+  struct enum_range;
+
+  template <typename E>
+  bool enum_in_range(std::underlying_type_t<E> v)
+  {
+    return std::cmp_greater_equal(v, 0) && std::cmp_less_equal(v, std::to_underlying(enum_range<E>::last));
+  }
+
   struct ByteWriter {
     std::vector<uint8_t> buff;
 
@@ -142,46 +155,15 @@ namespace net
       write_float(v.h);
     };
 
+    // enums go out at the width of their underlying type
     template<class EnumType>
     void write_enum(const EnumType& v) {
-      // check if its type enum
       static_assert(std::is_enum_v<EnumType>, "write_enum requires an enum type.");
-      // if valid enum get size of enum
       using U = std::underlying_type_t<EnumType>;
-      U data = static_cast<U>(v);
-      size_t d_size = sizeof(v);
-      switch (d_size) {
-        case 0:
-        {
-          static_assert("Unsupported enum type");
-          break;
-        }
-        case 1:
-        {
-          write_u8(static_cast<std::uint8_t>(data));
-          break;
-        }
-        case 2:
-        {
-          write_u16(static_cast<std::uint16_t>(data));
-          break;
-        }
-        case 4:
-        {
-          write_u32(static_cast<std::uint32_t>(data));
-          break;
-        }
-        case 8:
-        {
-          write_u64(static_cast<std::uint64_t>(data));
-          break;
-        }
-      }
-      // use size of enum to switch number of bytes to write
-
+      static_assert(sizeof(U) == 1 || sizeof(U) == 2 || sizeof(U) == 4 || sizeof(U) == 8, "Unsupported enum type");
+      const U data = static_cast<U>(v);
+      write_bytes(&data, sizeof(U));
     };
-
-
   };
 
   struct ByteReader {
@@ -191,6 +173,8 @@ namespace net
 
     // set pointer to input data onto ByteReader
     ByteReader(const std::vector<std::uint8_t>& b): p(b.data()), n(b.size()), i(0) {}
+    // same, over bytes that dont live in a vector (a mapped file)
+    ByteReader(const std::uint8_t* data, size_t size): p(data), n(size), i(0) {}
 
     // copy into out address the value of size sz from position p+i
     // advance index i forward size of the data that was copied
@@ -207,7 +191,7 @@ namespace net
     std::uint32_t read_u32() { std::uint32_t v; read_bytes(&v, sizeof(v)); return v; };
     std::uint64_t read_u64() { std::uint64_t v; read_bytes(&v, sizeof(v)); return v; };
     std::float_t read_float() { std::float_t v; read_bytes(&v, sizeof(v)); return v; };
-    bool read_bool() { bool v; read_bytes(&v, sizeof(v)); return v; };
+    bool read_bool() { return read_u8() != 0; }; // any nonzero byte, never a bool with a stray bit pattern
     std::string read_string() {
       const std::uint32_t length = read_u32();
       std::string out(length, '\0');
@@ -236,48 +220,65 @@ namespace net
     // EntityType t = r.read_enum<EntityType>();
     template<class EnumType>
     EnumType read_enum() {
-      // check if its type enum
-      static_assert(std::is_enum_v<EnumType>, "write_enum requires an enum type.");
-      // if valid enum get size of enum
+      static_assert(std::is_enum_v<EnumType>, "read_enum requires an enum type.");
       using U = std::underlying_type_t<EnumType>;
+      static_assert(sizeof(U) == 1 || sizeof(U) == 2 || sizeof(U) == 4 || sizeof(U) == 8, "Unsupported enum type");
       U data{};
-      size_t d_size = sizeof(U);
-
-      switch (d_size) {
-        case 0:
-        {
-          static_assert("0 data enum");
-          break;
-        }
-        case 1:
-        {
-          data = static_cast<U>(read_u8());
-          break;
-        }
-        case 2:
-        {
-          data = static_cast<U>(read_u16());
-          break;
-        }
-        case 4:
-        {
-          data = static_cast<U>(read_u32());
-          break;
-        }
-        case 8:
-        {
-          data = static_cast<U>(read_u64());
-          break;
-        }
-        default: {
-          static_assert("Unsupported enum type");
-          break;
-        }
+      read_bytes(&data, sizeof(U));
+      if (!enum_in_range<EnumType>(data)) throw std::runtime_error("enum out of range");
+      return static_cast<EnumType>(data);
+    };
+
+  };
+
+  // packs values narrower than a byte back to back (lsb first) onto the end of a ByteWriter.
+  // call flush() when done; the last byte is zero padded.
+  struct BitWriter {
+    std::vector<std::uint8_t>& buff;
+    std::uint32_t scratch = 0;
+    unsigned used = 0;
+
+    explicit BitWriter(ByteWriter& w): buff(w.buff) {}
+
+    // count <= 24
+    void write_bits(std::uint32_t v, unsigned count) {
+      scratch |= (v & ((1u << count) - 1u)) << used;
+      used += count;
+      while (used >= 8) {
+        buff.push_back(static_cast<std::uint8_t>(scratch));
+        scratch >>= 8;
+        used -= 8;
       }
+    };
 
-      return static_cast<EnumType>(data);
+    void flush() {
+      if (used > 0) {
+        buff.push_back(static_cast<std::uint8_t>(scratch));
+        scratch = 0;
+        used = 0;
+      }
     };
+  };
 
+  // reads what BitWriter wrote, continuing from the ByteReader's position. throws on underflow like ByteReader.
+  struct BitReader {
+    ByteReader& reader;
+    std::uint32_t scratch = 0;
+    unsigned avail = 0;
+
+    explicit BitReader(ByteReader& r): reader(r) {}
+
+    // count <= 24
+    std::uint32_t read_bits(unsigned count) {
+      while (avail < count) {
+        scratch |= static_cast<std::uint32_t>(reader.read_u8()) << avail;
+        avail += 8;
+      }
+      const std::uint32_t v = scratch & ((1u << count) - 1u);
+      scratch >>= count;
+      avail -= count;
+      return v;
+    };
   };
 
 }
@@ -0,0 +1,385 @@
+#pragma once
+#include "net_message.h"
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace net
+{
+  // wire structs list their fields once, as pointers to members in wire order:
+  //
+  //   struct score { uint32_t id; float value; using wire_fields = net::fields<&score::id, &score::value>; };
+  //
+  // and schema<S> generates the encode, decode, exact size and diff routines from that list, so the
+  // two sides of the format can't drift apart. the bytes are the same ones ByteWriter's write_u32 /
+  // write_float / write_enum / ... calls would produce in that order. fields that sit next to each other
+  // in memory and on the wire (no padding between them) go out and come back in a single memcpy; bools and
+  // enums are checked on the way back in, one at a time.
+  // a struct can also get a schema over a subset of its fields: net::schema<S, net::fields<...>>.
+  template <auto... Members>
+  struct fields {};
+
+  template <typename S, typename Fields = typename S::wire_fields>
+  struct schema;
+
+  template <typename S>
+  concept has_wire_fields = requires { typename S::wire_fields; };
+
+  // fixed size values whose wire form is their in-memory bytes
+  template <typename F>
+  inline constexpr bool is_raw_wire_v =
+    std::is_arithmetic_v<F> || std::is_enum_v<F> || std::is_same_v<F, glm::vec2> || std::is_same_v<F, SDL_FRect>;
+
+  // raw on the way out, but not every byte pattern is a valid value: these are read one at a time and
+  // checked (see ByteReader::read_bool / read_enum) instead of being copied in with their neighbours
+  template <typename F>
+  inline constexpr bool is_checked_wire_v = std::is_same_v<F, bool> || std::is_enum_v<F>;
+
+  static_assert(sizeof(glm::vec2) == 2 * sizeof(float) && sizeof(SDL_FRect) == 4 * sizeof(float));
+  static_assert(sizeof(bool) == 1);
+
+  template <typename M>
+  struct member_traits;
+
+  template <typename C, typename F>
+  struct member_traits<F C::*>
+  {
+    using type = F;
+  };
+
+  template <auto M>
+  using member_t = typename member_traits<decltype(M)>::type;
+
+  template <typename F, bool = has_wire_fields<F>>
+  struct nested_schema
+  {
+    using type = void;
+  };
+
+  template <typename F>
+  struct nested_schema<F, true>
+  {
+    using type = schema<F>;
+  };
+
+  // how one field type is written. kFixed types always take kSize bytes; the others report their
+  // size per value (kSize is then the smallest they can be)
+  template <typename F>
+  struct wire_codec
+  {
+    static_assert(is_raw_wire_v<F> || has_wire_fields<F>,
+                  "no wire format for this type: give it wire_fields or a wire_codec specialisation");
+
+    using nested = typename nested_schema<F>::type;
+    static constexpr bool kRaw = is_raw_wire_v<F>;
+    static constexpr bool kRawRead = kRaw && !is_checked_wire_v<F>; // decoded with a plain memcpy
+    static constexpr bool kFixed = [] {
+      if constexpr (is_raw_wire_v<F>) return true;
+      else return nested::kFixed;
+    }();
+    static constexpr size_t kSize = [] {
+      if constexpr (is_raw_wire_v<F>) return sizeof(F);
+      else return nested::kMinSize;
+    }();
+
+    static size_t size(const F& v)
+    {
+      if constexpr (kFixed) return kSize;
+      else return nested::encoded_size(v);
+    }
+
+    static void write(uint8_t*& out, const F& v)
+    {
+      if constexpr (kRaw) {
+        std::memcpy(out, &v, sizeof(F));
+        out += sizeof(F);
+      } else {
+        nested::write_to(out, v);
+      }
+    }
+
+    static void read(ByteReader& r, F& v)
+    {
+      if constexpr (std::is_same_v<F, bool>) v = r.read_bool();
+      else if constexpr (std::is_enum_v<F>) v = r.read_enum<F>();
+      else if constexpr (kRaw) r.read_bytes(&v, sizeof(F));
+      else nested::read(r, v);
+    }
+
+    // bitwise for raw values: a float that changed from 0 to -0 still has to be sent
+    static bool equal(const F& a, const F& b)
+    {
+      if constexpr (kRaw) return std::memcmp(&a, &b, sizeof(F)) == 0;
+      else return nested::diff(a, b) == 0;
+    }
+  };
+
+  // u32 length, then the bytes (ByteWriter::write_string)
+  template <>
+  struct wire_codec<std::string>
+  {
+    static constexpr bool kRaw = false;
+    static constexpr bool kRawRead = false;
+    static constexpr bool kFixed = false;
+    static constexpr size_t kSize = sizeof(uint32_t);
+
+    static size_t size(const std::string& v) { return kSize + v.size(); }
+
+    static void write(uint8_t*& out, const std::string& v)
+    {
+      const uint32_t length = static_cast<uint32_t>(v.size());
+      std::memcpy(out, &length, sizeof(length));
+      out += sizeof(length);
+      if (length > 0) {
+        std::memcpy(out, v.data(), length);
+        out += length;
+      }
+    }
+
+    static void read(ByteReader& r, std::string& v) { v = r.read_string(); }
+
+    static bool equal(const std::string& a, const std::string& b) { return a == b; }
+  };
+
+  // u32 count, then each element; an array of raw values is one memcpy
+  template <typename E>
+  struct wire_codec<std::vector<E>>
+  {
+    using element = wire_codec<E>;
+    static constexpr bool kRaw = false;
+    static constexpr bool kRawRead = false;
+    static constexpr bool kFixed = false;
+    static constexpr size_t kSize = sizeof(uint32_t);
+
+    static size_t size(const std::vector<E>& v)
+    {
+      if constexpr (element::kFixed) {
+        return kSize + v.size() * element::kSize;
+      } else {
+        size_t total = kSize;
+        for (const E& e : v) {
+          total += element::size(e);
+        }
+        return total;
+      }
+    }
+
+    static void write(uint8_t*& out, const std::vector<E>& v)
+    {
+      const uint32_t count = static_cast<uint32_t>(v.size());
+      std::memcpy(out, &count, sizeof(count));
+      out += sizeof(count);
+      if constexpr (element::kRaw) {
+        if (count > 0) {
+          std::memcpy(out, v.data(), count * sizeof(E));
+          out += count * sizeof(E);
+        }
+      } else {
+        for (const E& e : v) {
+          element::write(out, e);
+        }
+      }
+    }
+
+    static void read(ByteReader& r, std::vector<E>& v)
+    {
+      const uint32_t count = r.read_u32();
+      // dont let a corrupt count allocate more elements than the rest of the buffer could hold
+      if (element::kSize > 0 && count > (r.n - r.i) / element::kSize) {
+        throw std::runtime_error("buffer underflow");
+      }
+      v.resize(count);
+      if constexpr (element::kRawRead) {
+        if (count > 0) {
+          r.read_bytes(v.data(), count * sizeof(E));
+        }
+      } else {
+        for (E& e : v) {
+          element::read(r, e);
+        }
+      }
+    }
+
+    static bool equal(const std::vector<E>& a, const std::vector<E>& b)
+    {
+      if (a.size() != b.size()) {
+        return false;
+      }
+      for (size_t i = 0; i < a.size(); ++i) {
+        if (!element::equal(a[i], b[i])) {
+          return false;
+        }
+      }
+      return true;
+    }
+  };
+
+  template <typename S, auto... Ms>
+  struct schema<S, fields<Ms...>>
+  {
+    static constexpr size_t kFieldCount = sizeof...(Ms);
+    static_assert(kFieldCount > 0 && kFieldCount <= 64, "a schema has 1 to 64 fields");
+
+    static constexpr bool kFixed = (wire_codec<member_t<Ms>>::kFixed && ...);
+    static constexpr size_t kMinSize = (wire_codec<member_t<Ms>>::kSize + ...);
+
+    // smallest unsigned type with a bit per field, for delta masks
+    using mask_type = std::conditional_t<kFieldCount <= 8, uint8_t,
+                      std::conditional_t<kFieldCount <= 16, uint16_t,
+                      std::conditional_t<kFieldCount <= 32, uint32_t, uint64_t>>>;
+
+    static size_t encoded_size(const S& s)
+    {
+      if constexpr (kFixed) return kMinSize;
+      else return (wire_codec<member_t<Ms>>::size(s.*Ms) + ...);
+    }
+
+    // appends s to w, growing the buffer once by exactly encoded_size(s)
+    static void write(ByteWriter& w, const S& s)
+    {
+      const size_t at = w.buff.size();
+      w.buff.resize(at + encoded_size(s));
+      uint8_t* out = w.buff.data() + at;
+      write_to(out, s);
+    }
+
+    // out must have room for encoded_size(s)
+    static void write_to(uint8_t*& out, const S& s)
+    {
+      const uint8_t* run = nullptr;
+      size_t runLen = 0;
+      (WriteField<Ms>(out, s, run, runLen), ...);
+      FlushWrite(out, run, runLen);
+    }
+
+    // throws std::runtime_error on a short buffer, like ByteReader
+    static void read(ByteReader& r, S& s)
+    {
+      uint8_t* run = nullptr;
+      size_t runLen = 0;
+      (ReadField<Ms>(r, s, run, runLen), ...);
+      FlushRead(r, run, runLen);
+    }
+
+    // bit i is set when field i differs between a and b
+    static uint64_t diff(const S& a, const S& b)
+    {
+      uint64_t mask = 0;
+      size_t bit = 0;
+      ((mask |= wire_codec<member_t<Ms>>::equal(a.*Ms, b.*Ms) ? 0 : (uint64_t(1) << bit), ++bit), ...);
+      return mask;
+    }
+
+    // mask_type of changed fields, then just those fields
+    static void write_delta(ByteWriter& w, const S& base, const S& s)
+    {
+      const uint64_t mask = diff(base, s);
+      size_t total = sizeof(mask_type);
+      size_t bit = 0;
+      ((total += (mask >> bit & 1) ? wire_codec<member_t<Ms>>::size(s.*Ms) : 0, ++bit), ...);
+
+      const size_t at = w.buff.size();
+      w.buff.resize(at + total);
+      uint8_t* out = w.buff.data() + at;
+      const mask_type m = static_cast<mask_type>(mask);
+      std::memcpy(out, &m, sizeof(m));
+      out += sizeof(m);
+      bit = 0;
+      ((((mask >> bit & 1) ? wire_codec<member_t<Ms>>::write(out, s.*Ms) : void()), ++bit), ...);
+    }
+
+    // s starts as base and gets the fields write_delta sent
+    static void read_delta(ByteReader& r, const S& base, S& s)
+    {
+      mask_type m{};
+      r.read_bytes(&m, sizeof(m));
+      if (&s != &base) {
+        s = base;
+      }
+      size_t bit = 0;
+      ((((m >> bit & 1) ? wire_codec<member_t<Ms>>::read(r, s.*Ms) : void()), ++bit), ...);
+    }
+
+  private:
+    // raw fields are collected into a run for as long as each one starts where the last one ended in
+    // memory; the run goes out as one memcpy when something breaks it. the addresses are constant
+    // offsets from s, so after inlining the compiler resolves every branch here
+    template <auto M>
+    static void WriteField(uint8_t*& out, const S& s, const uint8_t*& run, size_t& runLen)
+    {
+      using F = member_t<M>;
+      if constexpr (is_raw_wire_v<F>) {
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(&(s.*M));
+        if (runLen > 0 && p != run + runLen) {
+          FlushWrite(out, run, runLen);
+        }
+        if (runLen == 0) {
+          run = p;
+        }
+        runLen += sizeof(F);
+      } else {
+        FlushWrite(out, run, runLen);
+        wire_codec<F>::write(out, s.*M);
+      }
+    }
+
+    static void FlushWrite(uint8_t*& out, const uint8_t* run, size_t& runLen)
+    {
+      if (runLen > 0) {
+        std::memcpy(out, run, runLen);
+        out += runLen;
+        runLen = 0;
+      }
+    }
+
+    template <auto M>
+    static void ReadField(ByteReader& r, S& s, uint8_t*& run, size_t& runLen)
+    {
+      using F = member_t<M>;
+      if constexpr (wire_codec<F>::kRawRead) {
+        uint8_t* p = reinterpret_cast<uint8_t*>(&(s.*M));
+        if (runLen > 0 && p != run + runLen) {
+          FlushRead(r, run, runLen);
+        }
+        if (runLen == 0) {
+          run = p;
+        }
+        runLen += sizeof(F);
+      } else {
+        FlushRead(r, run, runLen);
+        wire_codec<F>::read(r, s.*M);
+      }
+    }
+
+    static void FlushRead(ByteReader& r, uint8_t* run, size_t& runLen)
+    {
+      if (runLen > 0) {
+        r.read_bytes(run, runLen);
+        runLen = 0;
+      }
+    }
+  };
+
+  // any codec-supported value, wire_fields structs included
+  template <typename T>
+  size_t wire_size(const T& v)
+  {
+    return wire_codec<T>::size(v);
+  }
+
+  template <typename T>
+  void write_wire(ByteWriter& w, const T& v)
+  {
+    const size_t at = w.buff.size();
+    w.buff.resize(at + wire_codec<T>::size(v));
+    uint8_t* out = w.buff.data() + at;
+    wire_codec<T>::write(out, v);
+  }
+
+  template <typename T>
+  void read_wire(ByteReader& r, T& v)
+  {
+    wire_codec<T>::read(r, v);
+  }
+}
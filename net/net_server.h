@@ -1,7 +1,7 @@
 #pragma once
 #include "net_common.h"
 #include "net_message.h"
-#include "net_ts_queue.h"
+#include "net_lockfree_queue.h"
 #include "net_connection.h"
 
 namespace net
@@ -21,18 +21,26 @@ namespace net
         Stop();
       }
 
-      bool Start() {
+      // nIoThreads threads all run the one io context. each connection's socket is bound to its own strand,
+      // so a connection's handlers never run concurrently while different connections proceed in parallel.
+      bool Start(size_t nIoThreads = 1) {
         try {
           AsyncWaitForClientConnection(); // give context work first so it doesn't close on startup
 
-          m_threadContext = std::thread([this]() { m_asioContext.run(); });
+          nIoThreads = std::max<size_t>(nIoThreads, 1);
+          for (size_t i = 0; i < nIoThreads; ++i) {
+            m_vThreadContext.emplace_back([this]() { m_asioContext.run(); });
+          }
 
         } catch (std::exception& e) {
           std::cerr << "Server Exception " << e.what() << "\n";
           return false;
         }
 
-        std::cout << "Server Started!\n";
+        std::cout << "Server Started! (" << nIoThreads << " io threads)\n";
+        if (m_impairIn.enabled() || m_impairOut.enabled()) {
+          std::cout << "Server simulating network impairment (NET_IMPAIR_IN / NET_IMPAIR_OUT)\n";
+        }
         return true;
       }
 
@@ -42,10 +50,14 @@ namespace net
 
         m_asioContext.stop();
 
-        if (m_threadContext.joinable())
+        for (auto& thread : m_vThreadContext)
         {
-          m_threadContext.join();
+          if (thread.joinable())
+          {
+            thread.join();
+          }
         }
+        m_vThreadContext.clear();
 
 
         std::cout << "Server Stopped!\n" << std::endl;
@@ -53,7 +65,8 @@ namespace net
       }
 
       void AsyncWaitForClientConnection() {
-        m_asioAccepter.async_accept(
+        // accepted sockets get a fresh strand as their executor; every completion handler for that socket runs on it
+        m_asioAccepter.async_accept(asio::make_strand(m_asioContext),
           [this](std::error_code ec, asio::ip::tcp::socket socket) {
             if (!ec) {
               std::cout << "Server New Connection: " << socket.remote_endpoint() << "\n";
@@ -65,17 +78,40 @@ namespace net
                 m_qMessagesIn
               );
 
+              if (m_pingMessageId) {
+                newconn->EnablePing(*m_pingMessageId);
+              }
+              if (m_nOutboundLimit) {
+                newconn->SetOutboundLimit(m_nOutboundLimit);
+              }
+              newconn->SetBufferPool(m_bufferPool);
+              newconn->SetMaxBodySize(m_nMaxBodySize);
+              for (T id : m_vUnreliableIds) {
+                newconn->SetUnreliable(id);
+              }
+              if (m_impairIn.enabled() || m_impairOut.enabled()) {
+                // same conditions for every client, but not the same dice
+                impairment_config in = m_impairIn;
+                impairment_config out = m_impairOut;
+                in.seed += nIDCounter;
+                out.seed += nIDCounter;
+                newconn->SetImpairment(in, out);
+              }
+
               if (OnClientConnect(newconn)) {
 
                 // add to container of conns
-                m_deqConns.push_back(std::move(newconn));
+                {
+                  std::scoped_lock lock(m_connsMu);
+                  m_deqConns.push_back(newconn);
+                }
 
-                m_deqConns.back()->ConnectToClient(this, nIDCounter++);
+                newconn->ConnectToClient(this, nIDCounter++);
 
-                std::cout << "[ ConnID: " << m_deqConns.back()->GetID() << "] Connection Approved\n";
+                std::cout << "[ ConnID: " << newconn->GetID() << "] Connection Approved\n";
 
               } else {
-                std::cout << "Server Denied Connection: " << socket.remote_endpoint() << "\n";
+                std::cout << "Server Denied Connection\n";
               }
             } else {
               std::cout << "Server New Connection Error" << ec.message() << "\n";
@@ -86,23 +122,39 @@ namespace net
           });
       }
 
+      // the io threads add connections while the owner sends and removes them, so iterate a copy
+      std::vector<std::shared_ptr<connection<T>>> CopyConnections() const {
+        std::scoped_lock lock(m_connsMu);
+        return { m_deqConns.begin(), m_deqConns.end() };
+      }
+
+      size_t ConnectionCount() const {
+        std::scoped_lock lock(m_connsMu);
+        return m_deqConns.size();
+      }
+
       void MessageClient(std::shared_ptr<connection<T>> client, const message<T>& msg) {
         if (client && client->IsConnected()) {
           client->Send(msg);
         } else {
           OnClientDisconnect(client); // allow user to handle
-          client.reset();
-          m_deqConns.erase(
-            std::remove(m_deqConns.begin(), m_deqConns.end(), client),
-            m_deqConns.end()
-          );
+          RemoveConnection(client);
+        }
+      }
+
+      // latest-only variant of MessageClient: an unsent msg with the same id is replaced rather than queued behind
+      void MessageClientLatest(std::shared_ptr<connection<T>> client, const message<T>& msg) {
+        if (client && client->IsConnected()) {
+          client->SendLatest(msg);
+        } else {
+          OnClientDisconnect(client);
+          RemoveConnection(client);
         }
       }
 
       void BroadcastToClients(const message<T>& msg, std::shared_ptr<connection<T>> pIgnoreClient = nullptr)
       {
-        bool shouldErase = false;
-        for (auto& client : m_deqConns)
+        for (auto& client : CopyConnections())
         {
           if (client && client->IsConnected())
           {
@@ -114,20 +166,43 @@ namespace net
           else
           {
             OnClientDisconnect(client);
-            client.reset();
-            // can't do erase here or could break the for loop
-            shouldErase = true;
+            RemoveConnection(client);
           }
         }
 
-        if (shouldErase)
-        {
-          m_deqConns.erase(
-            std::remove(m_deqConns.begin(), m_deqConns.end(), nullptr),
-            m_deqConns.end()
-          );
-        }
+      }
+
+      // reliable messages a connection accepted after this may have queued before it is considered stalled
+      void SetOutboundLimit(size_t maxQueued) {
+        m_nOutboundLimit = maxQueued;
+      }
+
+      // connections accepted after this close on any frame bigger than this, before allocating for it
+      void SetMaxBodySize(uint32_t maxBodySize) {
+        m_nMaxBodySize = maxBodySize;
+      }
+
+      // connections accepted after this answer (and can send) pings on msg id
+      void SetPingMessage(T id) {
+        m_pingMessageId = id;
+      }
+
+      // simulated network conditions for connections accepted after this; by default they come from the
+      // NET_IMPAIR_IN / NET_IMPAIR_OUT environment variables (see impairment_config::parse)
+      void SetImpairment(const impairment_config& in, const impairment_config& out) {
+        m_impairIn = in;
+        m_impairOut = out;
+      }
 
+      // msg id the impairment stage may drop, duplicate or reorder (state that is resent or superseded anyway)
+      void SetUnreliableMessage(T id) {
+        m_vUnreliableIds.push_back(id);
+      }
+
+      // blocks until a message is queued or deadline passes, for loops that have their own schedule (a
+      // tick) but want to handle input as soon as it lands. true if there is something to process
+      bool WaitForIncoming(std::chrono::steady_clock::time_point deadline) {
+        return m_qMessagesIn.wait_until(deadline);
       }
 
       // setting unsigned int to -1 sets it to max number;
@@ -139,25 +214,30 @@ namespace net
           m_qMessagesIn.wait();
         }
 
-        size_t nMessageCount = 0;
+        // drain everything available (up to nMax) in one pass over the ring, then dispatch
+        m_vIncomingBatch.clear();
+        m_qMessagesIn.pop_all(m_vIncomingBatch, nMaxMessages);
 
-        // for now its ok to process one message at a time, but later we might want to process a bunch
-        // that have queued up
-        // limit max number of messages being read on single Update call
-        while (nMessageCount < nMaxMessages && !m_qMessagesIn.empty())
+        for (auto& msg : m_vIncomingBatch)
         {
-          auto msg = m_qMessagesIn.pop_front();
-
           // std::cout << "ProcessIncomingMessages:" << msg << std::endl;
 
           OnMessage(msg.remote, msg.msg);
+          m_bufferPool->release(std::move(msg.msg.body)); // OnMessage may have taken it, then this is a no-op
+        }
 
-          nMessageCount++;
-        };
-
+        m_vIncomingBatch.clear(); // drop connection refs now rather than on the next call
       }
 
       protected:
+        void RemoveConnection(const std::shared_ptr<connection<T>>& client) {
+          std::scoped_lock lock(m_connsMu);
+          m_deqConns.erase(
+            std::remove(m_deqConns.begin(), m_deqConns.end(), client),
+            m_deqConns.end()
+          );
+        }
+
         virtual bool OnClientConnect(std::shared_ptr<connection<T>> client)
         {
 
@@ -182,19 +262,30 @@ namespace net
       protected:
 
         asio::io_context m_asioContext;
-        std::thread m_threadContext;
+        std::vector<std::thread> m_vThreadContext;
 
-        tsqueue<owned_message<T>> m_qMessagesIn; // server owns this incoming msg queue, passed as ref to connection
+        mpsc_queue<owned_message<T>> m_qMessagesIn{8192}; // server owns this incoming msg queue, passed as ref to connection
+        std::vector<owned_message<T>> m_vIncomingBatch; // reused drain buffer for ProcessIncomingMessages
 
-        // container of all valid conns
+        // container of all valid conns. pushed to from the io threads, guarded by m_connsMu
         std::deque<std::shared_ptr<connection<T>>> m_deqConns;
+        mutable std::mutex m_connsMu;
 
         // socket of asio server is abstracted, accepter listens on socket for connections
         asio::ip::tcp::acceptor m_asioAccepter;
 
-        // identify clients via ID
+        // identify clients via ID. only the accept handler touches it and accepts are never concurrent
         uint32_t nIDCounter = 10000;
 
+        std::optional<T> m_pingMessageId;
+        size_t m_nOutboundLimit = 0; // 0 = the connection's queue capacity
+        uint32_t m_nMaxBodySize = kDefaultMaxBodySize;
+        std::vector<T> m_vUnreliableIds;
+        impairment_config m_impairIn = impairment_config::from_env("NET_IMPAIR_IN");
+        impairment_config m_impairOut = impairment_config::from_env("NET_IMPAIR_OUT");
+        // incoming bodies shared by every connection; ProcessIncomingMessages hands them back after OnMessage
+        std::shared_ptr<buffer_pool> m_bufferPool = std::make_shared<buffer_pool>();
+
 
   };
 
@@ -0,0 +1,116 @@
+#pragma once
+#include "net_common.h"
+#include <atomic>
+#include <cmath>
+
+namespace net
+{
+  // plain copy of a connection's numbers for display / tuning. rates are per second, averaged over the
+  // last sampling window (about a second).
+  struct connection_stats
+  {
+    uint64_t bytesIn = 0;
+    uint64_t bytesOut = 0;
+    uint64_t messagesIn = 0;
+    uint64_t messagesOut = 0;
+    double bytesInPerSec = 0.0;
+    double bytesOutPerSec = 0.0;
+    double messagesInPerSec = 0.0;
+    double messagesOutPerSec = 0.0;
+    size_t outboundQueueDepth = 0; // reliable messages waiting to be written
+    size_t outboundHighWater = 0;  // deepest the reliable queue has been
+    bool hasRtt = false;
+    double rttMs = 0.0;    // smoothed round trip
+    double jitterMs = 0.0; // smoothed deviation of the round trip
+    uint64_t snapshotsSuperseded = 0; // replaced by a newer one before being sent / applied
+  };
+
+  // counters the asio thread bumps as it reads and writes; readable from any thread
+  struct connection_counters
+  {
+    std::atomic<uint64_t> bytesIn{0};
+    std::atomic<uint64_t> bytesOut{0};
+    std::atomic<uint64_t> messagesIn{0};
+    std::atomic<uint64_t> messagesOut{0};
+    std::atomic<uint64_t> snapshotsSuperseded{0};
+  };
+
+  // turns the running totals into per-second rates. sample() recomputes them once the window has passed,
+  // so it can be called every frame from whoever displays the stats.
+  class rate_meter
+  {
+    public:
+      void sample(const connection_counters& counters, connection_stats& out)
+      {
+        std::scoped_lock lock(m_mu);
+        const auto now = std::chrono::steady_clock::now();
+        out.bytesIn = counters.bytesIn.load(std::memory_order_relaxed);
+        out.bytesOut = counters.bytesOut.load(std::memory_order_relaxed);
+        out.messagesIn = counters.messagesIn.load(std::memory_order_relaxed);
+        out.messagesOut = counters.messagesOut.load(std::memory_order_relaxed);
+        out.snapshotsSuperseded = counters.snapshotsSuperseded.load(std::memory_order_relaxed);
+
+        if (!m_bStarted) {
+          m_bStarted = true;
+          m_tLast = now;
+          m_last = out;
+        }
+
+        const double elapsed = std::chrono::duration<double>(now - m_tLast).count();
+        if (elapsed >= kWindowSeconds) {
+          m_rates[0] = double(out.bytesIn - m_last.bytesIn) / elapsed;
+          m_rates[1] = double(out.bytesOut - m_last.bytesOut) / elapsed;
+          m_rates[2] = double(out.messagesIn - m_last.messagesIn) / elapsed;
+          m_rates[3] = double(out.messagesOut - m_last.messagesOut) / elapsed;
+          m_tLast = now;
+          m_last = out;
+        }
+
+        out.bytesInPerSec = m_rates[0];
+        out.bytesOutPerSec = m_rates[1];
+        out.messagesInPerSec = m_rates[2];
+        out.messagesOutPerSec = m_rates[3];
+      }
+
+    private:
+      static constexpr double kWindowSeconds = 1.0;
+      std::mutex m_mu;
+      bool m_bStarted = false;
+      std::chrono::steady_clock::time_point m_tLast;
+      connection_stats m_last;
+      double m_rates[4] = {};
+  };
+
+  // smoothed rtt and jitter from ping round trips, the same filter tcp uses for its retransmit timer
+  // (rfc 6298: srtt gain 1/8, rttvar gain 1/4)
+  class rtt_estimator
+  {
+    public:
+      void add_sample(double rttMs)
+      {
+        std::scoped_lock lock(m_mu);
+        if (!m_bHasSample) {
+          m_srtt = rttMs;
+          m_rttvar = rttMs / 2.0;
+          m_bHasSample = true;
+          return;
+        }
+        m_rttvar = 0.75 * m_rttvar + 0.25 * std::abs(m_srtt - rttMs);
+        m_srtt = 0.875 * m_srtt + 0.125 * rttMs;
+      }
+
+      void fill(connection_stats& out) const
+      {
+        std::scoped_lock lock(m_mu);
+        out.hasRtt = m_bHasSample;
+        out.rttMs = m_srtt;
+        out.jitterMs = m_rttvar;
+      }
+
+    private:
+      mutable std::mutex m_mu;
+      bool m_bHasSample = false;
+      double m_srtt = 0.0;
+      double m_rttvar = 0.0;
+  };
+}
@@ -1,12 +1,31 @@
+#include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <cmath>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <latch>
+#include <set>
+#include <thread>
 #include <unordered_map>
 
 #include "engine/engine.h"
 #include "engine/gameobject.h"
 #include "engine/gameplay_simulation.h"
+#include "engine/net/client_prediction.h"
+#include "engine/net/demo.h"
+#include "engine/net/game_client.h"
 #include "engine/net/game_net_common.h"
+#include "engine/net/game_server.h"
+#include "engine/net/replica_index.h"
+#include "engine/net/snapshot_interpolation.h"
+#include "net/net_buffer_pool.h"
+#include "net/net_compression.h"
+#include "net/net_impairment.h"
+#include "net/net_lockfree_queue.h"
+#include "net/net_schema.h"
+#include "net/net_stats.h"
 
 namespace {
 
@@ -37,7 +56,8 @@ bool equalSnapshots(const game_engine::NetGameObjectSnapshot& a,
       return a.data.player.state == b.data.player.state &&
              a.data.player.healthPoints == b.data.player.healthPoints &&
              a.data.player.manaPoints == b.data.player.manaPoints &&
-             a.data.player.ultimatePoints == b.data.player.ultimatePoints;
+             a.data.player.ultimatePoints == b.data.player.ultimatePoints &&
+             a.ackedInputSeq == b.ackedInputSeq;
     case ObjectClass::Enemy:
       return a.data.enemy.state == b.data.enemy.state &&
              a.data.enemy.healthPoints == b.data.enemy.healthPoints &&
@@ -101,6 +121,7 @@ game_engine::NetGameStateSnapshot makeSnapshot() {
   player.data.player.healthPoints = 88;
   player.data.player.manaPoints = 42;
   player.data.player.ultimatePoints = 17;
+  player.ackedInputSeq = 321;
   snap.m_gameObjects[{player.type, player.id}] = player;
 
   NetGameObjectSnapshot enemy{};
@@ -483,6 +504,1271 @@ void testEnemyHitStopSnapshotRoundTrip() {
   assert(enemy.hasPendingKnockback);
 }
 
+game_engine::NetGameObjectSnapshot serverPlayerAt(const GameObject& player, uint32_t ackedSeq) {
+  game_engine::NetGameObjectSnapshot snap{};
+  snap.id = player.id;
+  snap.type = ObjectClass::Player;
+  snap.position = player.position;
+  snap.velocity = player.velocity;
+  snap.grounded = player.grounded;
+  new (&snap.data.player) PlayerData{};
+  snap.data.player = player.data.player;
+  snap.ackedInputSeq = ackedSeq;
+  return snap;
+}
+
+void testClientPredictionConfirmsThenReplaysAfterMismatch() {
+  using namespace game_engine;
+  auto state = makeGameplayState();
+  state.layers[0].push_back(makeFloor());
+  state.layers[1].push_back(makePlayer());
+  GameObject& player = state.layers[1][0];
+
+  ClientPrediction prediction;
+  for (uint32_t seq = 1; seq <= 5; ++seq) {
+    NetGameInput input{};
+    input.playerID = player.id;
+    input.inputSeq = seq;
+    input.rightHeld = true;
+    input.fireHeld = true;
+    prediction.recordInput(input);
+    prediction.predictPending(state, player);
+  }
+  assert(prediction.pendingCount() == 5);
+  assert(state.bullets.empty()); // prediction never spawns bullets
+  assert(player.position.x > 0.0f);
+
+  // replay the same inputs on a fresh player to get what the server would have for input 3
+  auto serverState = makeGameplayState();
+  serverState.layers[0].push_back(makeFloor());
+  serverState.layers[1].push_back(makePlayer());
+  GameObject& serverPlayer = serverState.layers[1][0];
+  NetGameInput serverInput{};
+  serverInput.playerID = serverPlayer.id;
+  serverInput.rightHeld = true;
+  serverInput.fireHeld = true;
+  for (uint32_t seq = 1; seq <= 3; ++seq) {
+    serverInput.inputSeq = seq;
+    stepPredictedPlayer(serverState, serverPlayer, serverInput, PredictionTuning::stepSeconds);
+  }
+
+  assert(prediction.acknowledge(10, serverPlayerAt(serverPlayer, 3)) == PredictionResult::Confirmed);
+  assert(prediction.pendingCount() == 2);
+  assert(prediction.acknowledge(10, serverPlayerAt(serverPlayer, 3)) == PredictionResult::Stale);
+  // a newer snapshot acking the same input has nothing new to compare
+  assert(prediction.acknowledge(11, serverPlayerAt(serverPlayer, 3)) == PredictionResult::Unacked);
+  assert(prediction.pendingCount() == 2 && prediction.mispredictions() == 0);
+
+  // server disagrees about input 4 (pushed back by something we didnt see)
+  serverInput.inputSeq = 4;
+  stepPredictedPlayer(serverState, serverPlayer, serverInput, PredictionTuning::stepSeconds);
+  serverPlayer.position.x -= 20.0f;
+  const auto mismatch = serverPlayerAt(serverPlayer, 4);
+  assert(prediction.acknowledge(12, mismatch) == PredictionResult::Rewind);
+  assert(prediction.mispredictions() == 1);
+  assert(prediction.pendingCount() == 1);
+
+  player.position = mismatch.position;
+  player.velocity = mismatch.velocity;
+  player.grounded = mismatch.grounded;
+  player.data.player = mismatch.data.player;
+  prediction.rewind(player);
+  prediction.replay(state, player);
+
+  serverInput.inputSeq = 5;
+  stepPredictedPlayer(serverState, serverPlayer, serverInput, PredictionTuning::stepSeconds);
+  assert(closeVec2(player.position, serverPlayer.position, 1e-3f));
+  assert(prediction.lastAckedSeq() == 4);
+}
+
+void testSnapshotInterpolatorBracketsAndExtrapolates() {
+  using namespace game_engine;
+  SnapshotInterpolator interp;
+  InterpolationConfig config;
+  config.delaySeconds = 0.05f;
+  config.maxExtrapolationSeconds = 0.05f;
+  interp.setConfig(config);
+
+  const GameObjectKey enemyKey{ObjectClass::Enemy, 2};
+  for (uint64_t tick : {30u, 33u, 36u}) {
+    NetGameStateSnapshot snap{};
+    snap.serverTick = tick;
+    NetGameObjectSnapshot enemy{};
+    enemy.id = 2;
+    enemy.type = ObjectClass::Enemy;
+    enemy.position = {static_cast<float>(tick), 5.0f};
+    snap.m_gameObjects[enemyKey] = enemy;
+    interp.push(snap, static_cast<double>(tick) * config.tickSeconds); // zero latency
+  }
+  assert(interp.size() == 3);
+
+  glm::vec2 pos{};
+  interp.beginFrame(36.0 * config.tickSeconds);
+  assert(interp.sample(enemyKey, pos));
+  assert(closeVec2(pos, {33.0f, 5.0f}, 1e-3f)); // delay puts render time right on tick 33
+
+  interp.beginFrame(37.5 * config.tickSeconds);
+  assert(interp.sample(enemyKey, pos));
+  assert(closeVec2(pos, {34.5f, 5.0f}, 1e-3f));
+
+  interp.beginFrame(60.0 * config.tickSeconds);
+  assert(interp.sample(enemyKey, pos));
+  assert(closeVec2(pos, {39.0f, 5.0f}, 1e-3f)); // extrapolation capped 3 ticks past the newest
+
+  assert(!interp.sample({ObjectClass::Enemy, 99}, pos));
+}
+
+void testReplicaIndexTracksSpawnsDespawnsAndLayerMoves() {
+  using namespace game_engine;
+
+  NetGameStateSnapshot snap;
+  const auto put = [&](ObjectClass type, uint32_t id, uint32_t layer, float x) {
+    NetGameObjectSnapshot obj{};
+    obj.id = id;
+    obj.type = type;
+    obj.layer = layer;
+    obj.position = {x, 0.f};
+    snap.m_gameObjects[{type, id}] = obj;
+  };
+  // what the client does with a snapshot, minus the sprites
+  ReplicaIndex index;
+  const auto apply = [&](GameState& state) {
+    if (!index.tracks(state)) {
+      index.rebuild(state);
+    }
+    assert(index.diff(state, snap));
+    for (const auto& [obj, from] : index.matched()) {
+      obj->position = from->position;
+    }
+    index.applyDespawns(state);
+    for (const NetGameObjectSnapshot* from : index.spawned()) {
+      GameObject obj(32, 32);
+      obj.id = from->id;
+      obj.objClass = from->type;
+      obj.dynamic = true;
+      obj.position = from->position;
+      index.spawn(state, *from, std::move(obj));
+    }
+    index.commit(state);
+  };
+  const auto at = [&](GameState& state, ObjectClass type, uint32_t id) {
+    const auto it = index.slots().find({type, id});
+    assert(it != index.slots().end() && index.find(state, {type, id}));
+    return std::pair{it->second.layer, it->second.index};
+  };
+
+  GameState state = makeGameplayState();
+  state.layers[1].push_back(makeFloor());
+  put(ObjectClass::Player, 1, 1, 0.f);
+  put(ObjectClass::Enemy, 5, 1, 50.f);
+  put(ObjectClass::Enemy, 6, 1, 60.f);
+  put(ObjectClass::Enemy, 7, 1, 70.f);
+  put(ObjectClass::Projectile, 9, 0, 90.f);
+  apply(state);
+  assert(state.layers[1].size() == 5 && state.bullets.size() == 1);
+  assert(at(state, ObjectClass::Enemy, 7) == std::pair(1u, 4u));
+  assert(at(state, ObjectClass::Projectile, 9).first == ReplicaIndex::kBulletLayer);
+  state.layers[1].push_back(makeHazard()); // untracked, drawn after the enemies
+
+  // a despawn closes its hole without reordering the layer, and the objects behind it are repointed
+  snap.m_gameObjects.erase({ObjectClass::Enemy, 5});
+  snap.m_gameObjects.at({ObjectClass::Enemy, 7}).position.x = 75.f;
+  apply(state);
+  assert(state.layers[1].size() == 5);
+  assert(state.layers[1][0].objClass == ObjectClass::Level && state.layers[1][4].objClass == ObjectClass::Level);
+  assert(at(state, ObjectClass::Enemy, 6) == std::pair(1u, 2u));
+  assert(at(state, ObjectClass::Enemy, 7) == std::pair(1u, 3u));
+  assert(state.layers[1][3].position.x == 75.f);
+
+  // a layer change moves the object over
+  snap.m_gameObjects.at({ObjectClass::Enemy, 6}).layer = 0;
+  apply(state);
+  assert(at(state, ObjectClass::Enemy, 6) == std::pair(0u, 0u));
+  assert(at(state, ObjectClass::Enemy, 7) == std::pair(1u, 2u) && state.layers[1].size() == 4);
+
+  // an object moved behind the index's back fails the diff until a rescan
+  std::swap(state.layers[1][1], state.layers[1][2]);
+  assert(!index.diff(state, snap));
+  index.rebuild(state);
+  assert(index.diff(state, snap));
+
+  // a level load swaps the layers out: the index notices and rescans them
+  GameState loaded = makeGameplayState();
+  loaded.layers[1].push_back(makeFloor());
+  GameObject enemy = makeEnemy(0.f);
+  enemy.id = 7;
+  loaded.layers[1].push_back(enemy);
+  assert(!index.tracks(loaded));
+  apply(loaded);
+  assert(at(loaded, ObjectClass::Enemy, 7) == std::pair(1u, 1u) && loaded.layers[1][1].position.x == 75.f);
+  assert(at(loaded, ObjectClass::Player, 1).first == 1u && at(loaded, ObjectClass::Enemy, 6).first == 0u);
+  assert(loaded.layers[1].size() == 3 && loaded.bullets.size() == 1);
+}
+
+void testSnapshotInterpolatorDropsOutOfOrderTicks() {
+  using namespace game_engine;
+  SnapshotInterpolator interp;
+  InterpolationConfig config;
+  config.delaySeconds = 0.05f;
+  interp.setConfig(config);
+
+  const GameObjectKey enemyKey{ObjectClass::Enemy, 2};
+  const auto push = [&](uint64_t tick, float x, LevelIndex level = LevelIndex::LEVEL_1) {
+    NetGameStateSnapshot snap{};
+    snap.serverTick = tick;
+    snap.levelId = level;
+    NetGameObjectSnapshot enemy{};
+    enemy.id = 2;
+    enemy.type = ObjectClass::Enemy;
+    enemy.position = {x, 5.0f};
+    snap.m_gameObjects[enemyKey] = enemy;
+    interp.push(snap, static_cast<double>(tick) * config.tickSeconds);
+  };
+
+  // tick 33 shows up after 36 and 36 comes twice: both are dropped, the buffer keeps going
+  push(30, 30.0f);
+  push(36, 36.0f);
+  push(33, 1000.0f);
+  push(36, 1000.0f);
+  assert(interp.size() == 2);
+  glm::vec2 pos{};
+  interp.beginFrame(36.0 * config.tickSeconds);
+  assert(interp.sample(enemyKey, pos));
+  assert(closeVec2(pos, {33.0f, 5.0f}, 1e-3f));
+
+  // a tick count starting over, far behind everything buffered, starts the buffer over
+  push(2, 2.0f);
+  assert(interp.size() == 1);
+  push(5, 5.0f);
+  assert(interp.size() == 2);
+
+  // so does a level change
+  push(8, 8.0f, LevelIndex::LEVEL_2);
+  assert(interp.size() == 1);
+}
+
+void testNetInputPacketRedundantFramesRoundTrip() {
+  using namespace game_engine;
+  NetInputPacket packet;
+  for (uint32_t seq = 41; seq <= 48; ++seq) {
+    NetGameInput in{};
+    in.inputSeq = seq;
+    in.rightHeld = true;
+    in.jumpPressed = seq == 45; // one edge press in the middle of a held direction
+    packet.frames.push_back(in);
+  }
+
+  const auto bytes = packet.serealizeNetInputPacket();
+  // u32 + u8, then 6 bits + 7 delta bits, plus 2x6 bits for the press and the release after it
+  assert(bytes.size() == 4 + 1 + 4);
+
+  NetInputPacket decoded;
+  decoded.deserealizeNetInputPacket(bytes);
+  assert(decoded.frames.size() == packet.frames.size());
+  for (size_t idx = 0; idx < packet.frames.size(); ++idx) {
+    assert(decoded.frames[idx].inputSeq == packet.frames[idx].inputSeq);
+    assert(decoded.frames[idx].rightHeld);
+    assert(!decoded.frames[idx].leftHeld);
+    assert(decoded.frames[idx].jumpPressed == (decoded.frames[idx].inputSeq == 45));
+  }
+
+  auto truncated = bytes;
+  truncated.pop_back();
+  bool threw = false;
+  try {
+    decoded.deserealizeNetInputPacket(truncated);
+  } catch (const std::runtime_error&) {
+    threw = true;
+  }
+  assert(threw);
+}
+
+void testRttEstimatorSmoothsPingSamples() {
+  net::rtt_estimator rtt;
+  net::connection_stats stats;
+  rtt.fill(stats);
+  assert(!stats.hasRtt);
+
+  rtt.add_sample(40.0);
+  rtt.fill(stats);
+  assert(stats.hasRtt);
+  assert(std::fabs(stats.rttMs - 40.0) < 1e-9);
+  assert(std::fabs(stats.jitterMs - 20.0) < 1e-9);
+
+  // a steady link settles on its rtt with the jitter decaying away
+  for (int i = 0; i < 100; ++i) {
+    rtt.add_sample(40.0);
+  }
+  rtt.fill(stats);
+  assert(std::fabs(stats.rttMs - 40.0) < 1e-6);
+  assert(stats.jitterMs < 0.01);
+
+  // one spike moves the average by an eighth and the jitter by a quarter of the deviation
+  rtt.add_sample(120.0);
+  rtt.fill(stats);
+  assert(std::fabs(stats.rttMs - 50.0) < 1e-3);
+  assert(std::fabs(stats.jitterMs - 20.0) < 0.01);
+
+  net::connection_counters counters;
+  counters.bytesIn = 512;
+  counters.messagesOut = 3;
+  counters.snapshotsSuperseded = 2;
+  net::rate_meter meter;
+  meter.sample(counters, stats);
+  assert(stats.bytesIn == 512);
+  assert(stats.messagesOut == 3);
+  assert(stats.snapshotsSuperseded == 2);
+  assert(stats.bytesInPerSec == 0.0); // no full window yet
+}
+
+void testConnectionCoalescesLatestOnlyMessages() {
+  using namespace game_engine;
+  asio::io_context ctx;
+  net::mpsc_queue<net::owned_message<GameMsgHeaders>> incoming(16);
+  auto conn = std::make_shared<net::connection<GameMsgHeaders>>(
+    net::connection<GameMsgHeaders>::owner::server, ctx, asio::ip::tcp::socket(ctx), incoming);
+
+  // nothing runs the context, so everything stays queued: three snapshots collapse into one slot,
+  // and a different latest-only id gets its own
+  net::message<GameMsgHeaders> snapshot;
+  snapshot.header.id = GameMsgHeaders::Game_Snapshot;
+  for (int i = 0; i < 3; ++i) {
+    conn->SendLatest(snapshot);
+  }
+  net::message<GameMsgHeaders> other;
+  other.header.id = GameMsgHeaders::Game_PlayerInput;
+  conn->SendLatest(other);
+  assert(conn->GetStats().snapshotsSuperseded == 2);
+  assert(conn->GetStats().outboundQueueDepth == 0);
+
+  // reliable messages queue up to the limit and are tracked by the high-water mark
+  conn->SetOutboundLimit(2);
+  net::message<GameMsgHeaders> control;
+  control.header.id = GameMsgHeaders::Client_Accepted;
+  conn->Send(control);
+  conn->Send(control);
+  conn->Send(control); // over the limit on a dead socket: dropped with the connection, not queued
+  const auto stats = conn->GetStats();
+  assert(stats.outboundQueueDepth == 2);
+  assert(stats.outboundHighWater == 2);
+}
+
+void testConnectionFlushesLatestSlotsInReliableOrder() {
+  using namespace game_engine;
+  asio::io_context ctx;
+  asio::ip::tcp::acceptor acceptor(ctx, asio::ip::tcp::endpoint(asio::ip::address_v4::loopback(), 0));
+  asio::ip::tcp::socket peer(ctx);
+  peer.connect(acceptor.local_endpoint());
+  net::mpsc_queue<net::owned_message<GameMsgHeaders>> incoming(16);
+  auto conn = std::make_shared<net::connection<GameMsgHeaders>>(
+    net::connection<GameMsgHeaders>::owner::server, ctx, acceptor.accept(), incoming);
+
+  // a snapshot queued before a reliable message goes out ahead of it, one queued after goes out behind it
+  net::message<GameMsgHeaders> snapshot;
+  snapshot.header.id = GameMsgHeaders::Game_Snapshot;
+  net::message<GameMsgHeaders> control;
+  control.header.id = GameMsgHeaders::Client_Accepted;
+  net::message<GameMsgHeaders> input;
+  input.header.id = GameMsgHeaders::Game_PlayerInput;
+  conn->SendLatest(snapshot);
+  conn->Send(control);
+  conn->SendLatest(input);
+  conn->Send(control);
+  ctx.run();
+
+  const GameMsgHeaders expected[] = {
+    GameMsgHeaders::Game_Snapshot, GameMsgHeaders::Client_Accepted,
+    GameMsgHeaders::Game_PlayerInput, GameMsgHeaders::Client_Accepted};
+  for (const auto id : expected) {
+    net::message_header<GameMsgHeaders> header;
+    asio::read(peer, asio::buffer(&header, sizeof(header)));
+    assert(header.id == id);
+  }
+}
+
+void testConnectionDropsStalledRemoteWithoutWaiting() {
+  using namespace game_engine;
+  asio::io_context ctx;
+  asio::ip::tcp::acceptor acceptor(ctx, asio::ip::tcp::endpoint(asio::ip::address_v4::loopback(), 0));
+  asio::ip::tcp::socket peer(ctx);
+  peer.connect(acceptor.local_endpoint());
+  net::mpsc_queue<net::owned_message<GameMsgHeaders>> incoming(16);
+  auto conn = std::make_shared<net::connection<GameMsgHeaders>>(
+    net::connection<GameMsgHeaders>::owner::server, ctx, acceptor.accept(), incoming);
+  conn->SetOutboundLimit(2);
+
+  // nothing drains the queue (ctx isnt running): the send past the limit cuts the client loose at once
+  // instead of holding up the server loop or an encoder
+  net::message<GameMsgHeaders> control;
+  control.header.id = GameMsgHeaders::Client_Accepted;
+  conn->Send(control);
+  conn->Send(control);
+  const auto before = std::chrono::steady_clock::now();
+  conn->Send(control);
+  assert(std::chrono::steady_clock::now() - before < std::chrono::milliseconds(100));
+  ctx.run();
+  assert(!conn->IsConnected());
+}
+
+void testBufferPoolReusesBodies() {
+  net::buffer_pool pool(2, 1024);
+  std::vector<uint8_t> a = pool.acquire(100);
+  assert(a.size() == 100);
+  const uint8_t* storage = a.data();
+  pool.release(std::move(a));
+  assert(pool.pooled() == 1);
+
+  // the next acquire that fits reuses the same allocation
+  std::vector<uint8_t> b = pool.acquire(64);
+  assert(b.size() == 64);
+  assert(b.data() == storage);
+  assert(pool.pooled() == 0);
+
+  // one-off big frames arent kept, and the pool never holds more than maxPooled
+  pool.release(pool.acquire(4096));
+  assert(pool.pooled() == 0);
+  std::vector<uint8_t> c = pool.acquire(10);
+  std::vector<uint8_t> d = pool.acquire(10);
+  pool.release(std::move(b));
+  pool.release(std::move(c));
+  pool.release(std::move(d));
+  assert(pool.pooled() == 2);
+}
+
+void testImpairmentStageDelaysDropsAndKeepsReliableOrder() {
+  using namespace game_engine;
+  using clock = std::chrono::steady_clock;
+  using ms = std::chrono::milliseconds;
+
+  const auto cfg = net::impairment_config::parse("delay=50,jitter=20,loss=30,dup=20,rto=200,seed=7,bogus=1");
+  assert(cfg.enabled());
+  assert(cfg.delayMs == 50.0 && cfg.jitterMs == 20.0 && cfg.lossPercent == 30.0 && cfg.retransmitMs == 200.0);
+  assert(!net::impairment_config::parse("").enabled());
+
+  auto makeMsg = [](GameMsgHeaders id, uint32_t n) {
+    net::message<GameMsgHeaders> msg;
+    msg.header.id = id;
+    msg << n;
+    return msg;
+  };
+
+  net::impairment_stage<GameMsgHeaders> stage(cfg);
+  const auto t0 = clock::now();
+  constexpr uint32_t kEach = 200;
+  for (uint32_t i = 0; i < kEach; ++i) {
+    stage.push(makeMsg(GameMsgHeaders::Game_AddPlayer, i), false, t0);
+    stage.push(makeMsg(GameMsgHeaders::Game_Snapshot, i), true, t0);
+  }
+
+  // nothing arrives before the minimum delay
+  std::vector<net::message<GameMsgHeaders>> out;
+  stage.pop_due(t0 + ms(29), out);
+  assert(out.empty());
+
+  // reliable messages are never lost, only late, and always in order; unreliable ones get dropped and duplicated
+  stage.pop_due(t0 + ms(50 + 20 + 200 * kEach + 1), out);
+  assert(stage.empty());
+  uint32_t reliable = 0;
+  uint32_t unreliable = 0;
+  for (auto& msg : out) {
+    uint32_t n = 0;
+    msg >> n;
+    if (msg.header.id == GameMsgHeaders::Game_AddPlayer) {
+      assert(n == reliable);
+      ++reliable;
+    } else {
+      ++unreliable;
+    }
+  }
+  assert(reliable == kEach);
+  assert(stage.retransmitted() > 0);
+  assert(stage.dropped() > 0 && stage.duplicated() > 0);
+  assert(unreliable == kEach - stage.dropped() + stage.duplicated());
+
+  // the same seed and traffic give the same result
+  net::impairment_stage<GameMsgHeaders> again(cfg);
+  for (uint32_t i = 0; i < kEach; ++i) {
+    again.push(makeMsg(GameMsgHeaders::Game_AddPlayer, i), false, t0);
+    again.push(makeMsg(GameMsgHeaders::Game_Snapshot, i), true, t0);
+  }
+  assert(again.dropped() == stage.dropped() && again.duplicated() == stage.duplicated());
+
+  // a bandwidth cap spaces messages out by their size on the wire
+  net::impairment_stage<GameMsgHeaders> narrow(net::impairment_config::parse("kbps=8"));
+  net::message<GameMsgHeaders> big;
+  big.header.id = GameMsgHeaders::Game_Snapshot;
+  big.body.resize(1000 - sizeof(net::message_header<GameMsgHeaders>));
+  narrow.push(net::message<GameMsgHeaders>(big), false, t0);
+  narrow.push(net::message<GameMsgHeaders>(big), false, t0);
+  out.clear();
+  narrow.pop_due(t0 + ms(999), out);
+  assert(out.empty());
+  narrow.pop_due(t0 + ms(1001), out);
+  assert(out.size() == 1);
+  narrow.pop_due(t0 + ms(2001), out);
+  assert(out.size() == 2);
+}
+
+void testFlatMapKeepsSnapshotObjectsSorted() {
+  using namespace game_engine;
+
+  FlatMap<GameObjectKey, int> map;
+  map.append_unsorted({ObjectClass::Enemy, 7}, 1);
+  map.append_unsorted({ObjectClass::Player, 2}, 2);
+  map.append_unsorted({ObjectClass::Enemy, 3}, 3);
+  map.append_unsorted({ObjectClass::Enemy, 7}, 4); // later duplicate wins
+  map.sort_unique();
+
+  assert(map.size() == 3);
+  assert(std::is_sorted(map.begin(), map.end(), [](const auto& a, const auto& b) { return a.first < b.first; }));
+  assert(map.at({ObjectClass::Enemy, 7}) == 4);
+  assert(map.contains({ObjectClass::Player, 2}));
+  assert(map.find({ObjectClass::Player, 9}) == map.end());
+
+  assert(!map.emplace({ObjectClass::Enemy, 3}, 99).second); // emplace never overwrites
+  assert(map.at({ObjectClass::Enemy, 3}) == 3);
+  map[{ObjectClass::Enemy, 5}] = 5; // lands between 3 and 7
+  assert(std::next(map.find({ObjectClass::Enemy, 3}))->first == GameObjectKey(ObjectClass::Enemy, 5));
+  assert(map.erase({ObjectClass::Enemy, 5}) == 1);
+  assert(map.erase({ObjectClass::Enemy, 5}) == 0);
+
+  const size_t capacity = map.capacity();
+  map.clear();
+  assert(map.empty() && map.capacity() == capacity);
+
+  // decoding into a reused snapshot replaces its contents and keeps key order
+  NetGameStateSnapshot snap{};
+  snap.m_stateLastUpdatedAt = 1;
+  for (uint32_t id : {4u, 1u, 3u}) {
+    NetGameObjectSnapshot obj{};
+    obj.id = id;
+    obj.type = ObjectClass::Enemy;
+    new (&obj.data.enemy) EnemyData{};
+    snap.m_gameObjects[{obj.type, obj.id}] = obj;
+  }
+  NetGameStateSnapshot decoded{};
+  decoded.m_gameObjects[{ObjectClass::Enemy, 42}] = {};
+  decoded.deserealizeNetGameStateSnapshot(snap.serealizeNetGameStateSnapshot());
+  assert(decoded.m_gameObjects.size() == 3);
+  assert(!decoded.m_gameObjects.contains({ObjectClass::Enemy, 42}));
+  uint32_t expectedId = 1;
+  for (const auto& [key, obj] : decoded.m_gameObjects) {
+    assert(key.second == expectedId && obj.id == expectedId);
+    expectedId = expectedId == 1 ? 3 : 4;
+  }
+}
+
+void testSnapshotRateBacksOffAndRecovers() {
+  using namespace game_engine;
+
+  SnapshotRateConfig config;
+  net::connection_stats link;
+  SnapshotRate rate;
+  uint64_t tick = 100;
+
+  assert(rate.update(config, 3, link, tick)); // first snapshot is always due
+  rate.lastSentTick = tick;
+  assert(rate.intervalTicks == 3.0);
+  assert(!rate.update(config, 3, link, tick + 2));
+  assert(rate.update(config, 3, link, tick + 3));
+
+  // a backed up queue doubles the interval at the next adjustment and trims the interest radius
+  link.outboundQueueDepth = config.maxQueueDepth + 1;
+  tick += config.adjustEveryTicks;
+  rate.update(config, 3, link, tick);
+  assert(rate.intervalTicks == 6.0);
+  assert(rate.detailScale < 1.0f);
+  tick += config.adjustEveryTicks;
+  rate.update(config, 3, link, tick);
+  tick += config.adjustEveryTicks;
+  rate.update(config, 3, link, tick);
+  assert(rate.intervalTicks == config.maxIntervalTicks);
+  assert(std::fabs(rate.detailScale - config.minDetailScale) < 1e-5f);
+
+  // a snapshot replaced before it was written counts as congestion too, once
+  link.outboundQueueDepth = 0;
+  link.snapshotsSuperseded = 1;
+  tick += config.adjustEveryTicks;
+  rate.update(config, 3, link, tick);
+  assert(rate.intervalTicks == config.maxIntervalTicks);
+
+  // a clean link creeps back up, past the base rate down to the configured fastest
+  for (int i = 0; i < 40; ++i) {
+    tick += config.adjustEveryTicks;
+    rate.update(config, 3, link, tick);
+  }
+  assert(rate.intervalTicks == config.minIntervalTicks);
+  assert(rate.detailScale == 1.0f);
+
+  // the server restarting its tick count doesnt starve the client
+  rate.lastSentTick = tick;
+  assert(rate.update(config, 3, link, 5));
+}
+
+void testWireSchemaMatchesHandWrittenLayout() {
+  using namespace game_engine;
+
+  // same bytes as the write_* sequence the structs used before they had schemas
+  NetGameInput input{};
+  input.playerID = 7;
+  input.inputSeq = 1234;
+  input.rightHeld = true;
+  input.ultimatePressed = true;
+  net::ByteWriter expected;
+  expected.write_u32(7);
+  expected.write_u32(1234);
+  for (bool held : {false, true, false, false, false, true}) {
+    expected.write_bool(held);
+  }
+  assert(input.serealizeNetGameInput() == expected.buff);
+  assert(net::schema<NetGameInput>::kFixed && net::schema<NetGameInput>::kMinSize == expected.buff.size());
+
+  DiscoveryResponse response;
+  response.ready = true;
+  response.gamePort = 9100;
+  response.levelId = LevelIndex::LEVEL_2;
+  response.playerCount = 3;
+  response.hostName = "host";
+  expected.buff.clear();
+  expected.write_u32(DiscoveryResponse::MAGIC);
+  expected.write_u16(DiscoveryResponse::VERSION);
+  expected.write_bool(true);
+  expected.write_u16(9100);
+  expected.write_enum<LevelIndex>(LevelIndex::LEVEL_2);
+  expected.write_u32(3);
+  expected.write_string("host");
+  assert(response.serialize() == expected.buff);
+  DiscoveryResponse decoded;
+  assert(decoded.deserialize(expected.buff));
+  assert(decoded.gamePort == 9100 && decoded.levelId == LevelIndex::LEVEL_2 && decoded.hostName == "host");
+  expected.buff.pop_back();
+  assert(!decoded.deserialize(expected.buff)); // truncated
+
+  NetGameStateSnapshot snap{};
+  snap.serverTick = 5;
+  snap.m_stateLastUpdatedAt = 5;
+  NetGameObjectSnapshot player{};
+  player.id = 1;
+  player.type = ObjectClass::Player;
+  new (&player.data.player) PlayerData{};
+  snap.m_gameObjects[{player.type, player.id}] = player;
+  NetGameObjectSnapshot enemy{};
+  enemy.id = 2;
+  enemy.type = ObjectClass::Enemy;
+  new (&enemy.data.enemy) EnemyData{};
+  snap.m_gameObjects[{enemy.type, enemy.id}] = enemy;
+  assert(snap.serealizeNetGameStateSnapshot().size() == snap.wireSize());
+
+  // deltas carry only the changed fields
+  NetGameInput next = input;
+  next.inputSeq = 1235;
+  next.ultimatePressed = false;
+  assert(net::schema<NetGameInput>::diff(input, next) == ((1u << 1) | (1u << 7)));
+  net::ByteWriter delta;
+  net::schema<NetGameInput>::write_delta(delta, input, next);
+  assert(delta.buff.size() == sizeof(uint8_t) + sizeof(uint32_t) + sizeof(bool));
+  net::ByteReader reader(delta.buff);
+  NetGameInput applied{};
+  net::schema<NetGameInput>::read_delta(reader, input, applied);
+  assert(applied.inputSeq == 1235 && applied.rightHeld && !applied.ultimatePressed && applied.playerID == 7);
+}
+
+void testWireDecodeChecksBoolsAndEnums() {
+  using namespace game_engine;
+  NetHitStopEvent event{};
+  event.sequence = 3;
+  event.active = true;
+  event.attackerClass = ObjectClass::Player;
+  event.victimClass = ObjectClass::Enemy;
+  event.strength = HitStopStrength::Heavy;
+  net::ByteWriter w;
+  net::write_wire(w, event);
+
+  // sequence, then the active byte: anything nonzero is true
+  std::vector<uint8_t> bytes = w.buff;
+  bytes[4] = 7;
+  NetHitStopEvent decoded{};
+  net::ByteReader r(bytes);
+  net::read_wire(r, decoded);
+  assert(decoded.active && decoded.strength == HitStopStrength::Heavy);
+
+  // an enum past its last value fails the decode, wherever it sits
+  const auto rejects = [](const std::vector<uint8_t>& corrupt) {
+    NetHitStopEvent out{};
+    net::ByteReader reader(corrupt);
+    try {
+      net::read_wire(reader, out);
+    } catch (const std::runtime_error&) {
+      return true;
+    }
+    return false;
+  };
+  bytes = w.buff;
+  bytes.back() = 9; // strength
+  assert(rejects(bytes));
+  bytes = w.buff;
+  bytes[5] = 200; // attackerClass
+  assert(rejects(bytes));
+
+  net::ByteWriter sprite;
+  sprite.write_u32(99);
+  net::ByteReader spriteReader(sprite.buff);
+  bool threw = false;
+  try {
+    spriteReader.read_enum<SpriteType>();
+  } catch (const std::runtime_error&) {
+    threw = true;
+  }
+  assert(threw);
+}
+
+void testRoomManagerRoutesClientsAndTicksRooms() {
+  using namespace game_engine;
+
+  const auto makeRoomCtx = [] {
+    GameState state = makeGameplayState();
+    state.layers[1].push_back(makePlayer(1));
+    return std::make_unique<AuthoritativeContext>(std::move(state));
+  };
+
+  RoomManager rooms(makeRoomCtx());
+  assert(rooms.roomCount() == 1);
+  assert(rooms.findOrCreate(5) == nullptr); // no factory: default room only
+  assert(rooms.roomOf(42) == rooms.defaultRoom());
+
+  rooms.setFactory([&](uint32_t) { return makeRoomCtx(); }, 3);
+  const auto room5 = rooms.findOrCreate(5);
+  const auto room2 = rooms.findOrCreate(2);
+  assert(room5 && room2 && room5->id() == 5 && rooms.findOrCreate(5) == room5);
+  assert(rooms.findOrCreate(9) == nullptr); // at maxRooms
+  assert(rooms.roomCount() == 3);
+
+  assert(room5->registerPlayer(42, SpriteType::Player_Marie));
+  rooms.assign(42, room5);
+  assert(rooms.roomOf(42) == room5);
+  assert(rooms.assignedRoom(42) == 5u);
+  assert(!rooms.assignedRoom(7));
+  assert(rooms.playerCount() == 1);
+
+  // each room is ticked exactly once per pass, with or without workers
+  for (size_t workers : {size_t(0), size_t(3)}) {
+    rooms.startWorkers(workers);
+    std::atomic<int> visits{0};
+    rooms.forEachParallel([&](GameRoom& room) {
+      room.applyPlayerInputs();
+      room.step(1.0f / 60.0f);
+      room.publishSnapshot();
+      visits.fetch_add(1);
+    });
+    rooms.stopWorkers();
+    assert(visits.load() == 3);
+  }
+
+  // the rooms are independent
+  NetGameStateSnapshot snap5;
+  NetGameStateSnapshot snap2;
+  assert(room5->copyCurrentSnapshot(snap5) && room2->copyCurrentSnapshot(snap2));
+  assert(snap5.m_gameObjects.contains({ObjectClass::Player, 42}));
+  assert(!snap2.m_gameObjects.contains({ObjectClass::Player, 42}));
+  assert(snap5.serverTick == 2 && snap2.serverTick == 2);
+
+  // publishing refills snapshots nobody holds anymore, and never one that is still held
+  {
+    const auto held = room5->m_publishedSnapshot.load();
+    std::set<const NetGameStateSnapshot*> published;
+    for (int i = 0; i < 32; ++i) {
+      room5->publishSnapshot();
+      published.insert(room5->m_publishedSnapshot.load().get());
+    }
+    assert(!published.contains(held.get()));
+    assert(published.size() < 32);
+    assert(held->m_gameObjects.contains({ObjectClass::Player, 42}));
+  }
+
+  // an empty room other than the default is dropped once its last player is gone
+  rooms.dropIfEmpty(room2);
+  assert(rooms.find(2) == nullptr);
+  const auto left = rooms.unassign(42);
+  assert(left == room5 && left->removePlayer(42));
+  rooms.dropIfEmpty(left);
+  assert(rooms.find(5) == nullptr && rooms.roomCount() == 1);
+  rooms.dropIfEmpty(rooms.defaultRoom());
+  assert(rooms.roomCount() == 1);
+
+  // builds run off the calling thread, share one build per room, and hold their slot under maxRooms
+  {
+    std::latch built(3);
+    std::vector<std::shared_ptr<GameRoom>> results(3);
+    const auto onBuilt = [&](size_t slot) {
+      return [&, slot](std::shared_ptr<GameRoom> room) {
+        results[slot] = std::move(room);
+        built.count_down();
+      };
+    };
+    assert(rooms.buildAsync(7, onBuilt(0)));
+    assert(rooms.buildAsync(7, onBuilt(1)));
+    assert(rooms.buildAsync(8, onBuilt(2)));
+    assert(!rooms.buildAsync(9, [](std::shared_ptr<GameRoom>) { assert(false); }));
+    assert(rooms.findOrCreate(9) == nullptr);
+    built.wait();
+    assert(results[0] && results[0] == results[1] && results[0]->id() == 7);
+    assert(results[2] && results[2]->id() == 8);
+    assert(rooms.find(7) == results[0] && rooms.roomCount() == 3);
+  }
+  rooms.stopBuilding();
+  assert(!rooms.buildAsync(10, [](std::shared_ptr<GameRoom>) {}));
+}
+
+void testDemoRecordsSeeksAndReplays() {
+  using namespace game_engine;
+
+  const std::filesystem::path path = std::filesystem::temp_directory_path() / "net_common_tests.demo";
+  {
+    DemoWriter writer;
+    assert(writer.open(path, 7, 3, 10));
+    for (uint64_t tick = 100; tick < 400; ++tick) {
+      NetGameStateSnapshot snap;
+      snap.serverTick = tick;
+      snap.m_gameObjects[{ObjectClass::Player, 7}] = NetGameObjectSnapshot{};
+      snap.m_gameObjects[{ObjectClass::Player, 7}].id = 7;
+      snap.m_gameObjects[{ObjectClass::Player, 7}].type = ObjectClass::Player;
+      writer.recordSnapshot(tick, snap.serealizeNetGameStateSnapshot());
+      writer.recordInput(tick, {1, 2, 3});
+    }
+    writer.close();
+    assert(writer.droppedRecords() == 0);
+  }
+
+  DemoReader reader;
+  assert(reader.open(path));
+  assert(reader.hadIndex() && reader.playerID() == 7 && reader.roomID() == 3);
+  assert(reader.keyframes().size() == 30); // one every 10 ticks, spread over several index blocks
+
+  // seeking lands on the keyframe at or before the tick, then walks to the exact snapshot
+  DemoRecordView record;
+  assert(reader.readRecord(reader.seekOffset(255), record) && record.tick == 250);
+  assert(reader.findSnapshot(255, record) && record.kind == DemoRecordKind::Snapshot && record.tick == 255);
+  NetGameStateSnapshot decoded;
+  decoded.deserealizeNetGameStateSnapshot(record.data, record.size);
+  assert(decoded.serverTick == 255 && decoded.m_gameObjects.contains({ObjectClass::Player, 7}));
+  assert(reader.findSnapshot(100000, record) && record.tick == 399);
+  assert(!reader.findSnapshot(99, record));
+
+  // a trailer pointing near the top of the offset range must not wrap past the bounds check: the index is
+  // rebuilt by a scan instead
+  reader.close();
+  {
+    std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+    const uint64_t corrupt = ~uint64_t{0} - 5;
+    file.seekp(static_cast<std::streamoff>(std::filesystem::file_size(path) - kDemoTrailerSize));
+    file.write(reinterpret_cast<const char*>(&corrupt), sizeof(corrupt));
+  }
+  assert(reader.open(path));
+  assert(!reader.hadIndex() && reader.keyframes().size() == 30);
+  assert(!reader.readRecord(~uint64_t{0} - 5, record));
+  assert(reader.findSnapshot(255, record) && record.tick == 255);
+
+  // a recording cut short by a crash has no trailer: the index is rebuilt and a half written record is ignored
+  reader.close();
+  std::filesystem::resize_file(path, std::filesystem::file_size(path) - 40);
+  assert(reader.open(path));
+  assert(!reader.hadIndex() && reader.keyframes().size() == 30);
+  assert(reader.findSnapshot(377, record) && record.tick == 377);
+
+  // playback feeds the client's latest snapshot, as the recorded player
+  GameClient client;
+  assert(client.StartDemoPlayback(path, 1e9));
+  client.ProcessServerMessages();
+  NetGameStateSnapshot latest;
+  assert(client.IsPlayingDemo() && client.GetPlayerID() == 7);
+  assert(client.CopyLatestSnapshot(latest) && latest.serverTick >= 398);
+  client.SetDemoSpeed(0.0); // paused
+  assert(client.SeekDemo(120));
+  assert(client.CopyLatestSnapshot(latest) && latest.serverTick == 120);
+  client.StopDemoPlayback();
+  reader.close();
+  std::filesystem::remove(path);
+}
+
+void testInterestFilterKeepsNearbyObjectsWithHysteresis() {
+  using namespace game_engine;
+
+  GameServer server(47612, std::make_unique<AuthoritativeContext>(makeGameplayState()));
+  GameRoom& room = *server.m_rooms.defaultRoom();
+  const InterestConfig& cfg = server.m_interestConfig; // enter 720, exit 840
+
+  NetGameStateSnapshot full;
+  const auto place = [&](ObjectClass type, uint32_t id, glm::vec2 position) {
+    NetGameObjectSnapshot obj{};
+    obj.id = id;
+    obj.type = type;
+    obj.position = position;
+    full.m_gameObjects[{type, id}] = obj;
+  };
+  const auto between = 0.5f * (cfg.enterRadius + cfg.exitRadius);
+  place(ObjectClass::Player, 1, {0.f, 0.f});
+  place(ObjectClass::Player, 2, {10000.f, 0.f});
+  place(ObjectClass::Enemy, 10, {100.f, 0.f});
+  place(ObjectClass::Enemy, 11, {between, 0.f});
+  place(ObjectClass::Enemy, 12, {cfg.exitRadius + 100.f, 0.f});
+  place(ObjectClass::Enemy, 13, {-5000.f, 0.f}); // the hit stop's victim
+  full.hitStopEvent.active = true;
+  full.hitStopEvent.attackerClass = ObjectClass::Player;
+  full.hitStopEvent.attackerId = 2;
+  full.hitStopEvent.victimClass = ObjectClass::Enemy;
+  full.hitStopEvent.victimId = 13;
+
+  NetGameStateSnapshot out;
+  const auto sent = [&](ObjectClass type, uint32_t id) { return out.m_gameObjects.contains({type, id}); };
+  const auto move = [&](uint32_t id, float x) { full.m_gameObjects.at({ObjectClass::Enemy, id}).position.x = x; };
+
+  // players and hit stop participants always go out, wherever they are; the rest inside enterRadius
+  server.buildClientSnapshot(room, 1, full, out);
+  assert(sent(ObjectClass::Player, 1) && sent(ObjectClass::Player, 2) && sent(ObjectClass::Enemy, 13));
+  assert(sent(ObjectClass::Enemy, 10) && !sent(ObjectClass::Enemy, 11) && !sent(ObjectClass::Enemy, 12));
+
+  // between the radii an object is only kept if it was sent last time
+  move(11, cfg.enterRadius - 10.f);
+  server.buildClientSnapshot(room, 1, full, out);
+  assert(sent(ObjectClass::Enemy, 11));
+  move(11, between);
+  server.buildClientSnapshot(room, 1, full, out);
+  assert(sent(ObjectClass::Enemy, 11));
+  move(11, cfg.exitRadius + 10.f);
+  server.buildClientSnapshot(room, 1, full, out);
+  assert(!sent(ObjectClass::Enemy, 11));
+  move(11, between);
+  server.buildClientSnapshot(room, 1, full, out);
+  assert(!sent(ObjectClass::Enemy, 11));
+
+  // a client without a player of its own only gets what is always relevant
+  server.buildClientSnapshot(room, 99, full, out);
+  assert(out.m_gameObjects.size() == 3 && sent(ObjectClass::Player, 1) && sent(ObjectClass::Player, 2) &&
+         sent(ObjectClass::Enemy, 13));
+  full.hitStopEvent.active = false;
+  server.buildClientSnapshot(room, 99, full, out);
+  assert(out.m_gameObjects.size() == 2 && !sent(ObjectClass::Enemy, 13));
+
+  // detailScale shrinks both radii
+  move(10, 0.6f * cfg.enterRadius);
+  server.buildClientSnapshot(room, 1, full, out, 0.5f);
+  assert(!sent(ObjectClass::Enemy, 10)); // was sent, but is past the halved exitRadius too
+  server.buildClientSnapshot(room, 1, full, out, 0.5f);
+  assert(!sent(ObjectClass::Enemy, 10)); // and past the halved enterRadius
+  move(10, 0.45f * cfg.enterRadius);
+  server.buildClientSnapshot(room, 1, full, out, 0.5f);
+  assert(sent(ObjectClass::Enemy, 10));
+}
+
+void testSnapshotDeltaResumesFromBase() {
+  using namespace game_engine;
+
+  const NetGameStateSnapshot base = makeSnapshot();
+  NetGameStateSnapshot now = base;
+  now.serverTick = 130;
+  now.hitStopEvent.active = false;
+  now.m_gameObjects.at({ObjectClass::Player, 1}).position = {3.f, 2.f};
+  now.m_gameObjects.at({ObjectClass::Player, 1}).data.player.healthPoints = 60;
+  now.m_gameObjects.at({ObjectClass::Player, 1}).ackedInputSeq = 400;
+  now.m_gameObjects.erase({ObjectClass::Projectile, 3});
+  NetGameObjectSnapshot bullet = base.m_gameObjects.at({ObjectClass::Projectile, 3});
+  bullet.id = 9;
+  bullet.position = {11.f, 8.f};
+  now.m_gameObjects[{bullet.type, bullet.id}] = bullet;
+
+  const std::vector<uint8_t> delta = now.serealizeNetGameStateDelta(base);
+  assert(delta.size() < now.serealizeNetGameStateSnapshot().size()); // the enemy and level arent in it
+
+  NetGameStateSnapshot applied;
+  applied.applyNetGameStateDelta(base, delta.data(), delta.size());
+  assert(applied.serealizeNetGameStateSnapshot() == now.serealizeNetGameStateSnapshot());
+
+  // in place, as the client does it
+  NetGameStateSnapshot inPlace = base;
+  inPlace.applyNetGameStateDelta(inPlace, delta.data(), delta.size());
+  assert(inPlace.serealizeNetGameStateSnapshot() == now.serealizeNetGameStateSnapshot());
+
+  // a client holding only part of base gets the part it has brought up to date, plus the new objects
+  NetGameStateSnapshot partial = base;
+  partial.m_gameObjects.erase({ObjectClass::Player, 1});
+  partial.applyNetGameStateDelta(partial, delta.data(), delta.size());
+  assert(!partial.m_gameObjects.contains({ObjectClass::Player, 1}));
+  assert(!partial.m_gameObjects.contains({ObjectClass::Projectile, 3}));
+  assert(partial.m_gameObjects.at({ObjectClass::Projectile, 9}).position.x == 11.f);
+  assert(partial.serverTick == 130 && !partial.hitStopEvent.active);
+
+  NetGameStateSnapshot otherBase = base;
+  otherBase.serverTick = 101;
+  bool threw = false;
+  try {
+    NetGameStateSnapshot out;
+    out.applyNetGameStateDelta(otherBase, delta.data(), delta.size());
+  } catch (const std::runtime_error&) {
+    threw = true;
+  }
+  assert(threw);
+
+  // the room keeps the last few snapshots each player was sent to diff a resuming client against
+  GameState state = makeGameplayState();
+  GameRoom room(kDefaultRoomID, std::make_unique<AuthoritativeContext>(std::move(state)));
+  for (uint64_t tick = 1; tick <= 10; ++tick) {
+    auto snap = std::make_shared<NetGameStateSnapshot>();
+    snap->serverTick = tick;
+    room.rememberSent(1, snap);
+    room.rememberSent(1, snap); // an encode pass that found nothing newer
+    if (tick % 3 == 0) {
+      room.rememberSent(2, snap); // a client on a slower rate
+    }
+  }
+  assert(room.sentSnapshotAt(1, 10) && room.sentSnapshotAt(1, 10)->serverTick == 10);
+  assert(room.sentSnapshotAt(1, 7));
+  assert(!room.sentSnapshotAt(1, 6)); // aged out
+  assert(room.sentSnapshotAt(2, 3) && room.sentSnapshotAt(2, 9));
+  assert(!room.sentSnapshotAt(2, 8)); // never sent to it
+  assert(!room.sentSnapshotAt(3, 10));
+  room.removePlayer(1);
+  assert(!room.sentSnapshotAt(1, 10));
+
+  // what is kept for resume still leaves the snapshot pool a free slot every tick
+  std::set<const NetGameStateSnapshot*> published;
+  for (int tick = 0; tick < 100; ++tick) {
+    room.publishSnapshot();
+    const auto snap = room.m_publishedSnapshot.load();
+    published.insert(snap.get());
+    room.rememberSent(2, snap);
+    if (tick % 3 == 0) {
+      room.rememberSent(4, snap);
+    }
+  }
+  assert(published.size() <= 8); // the pool's slots, each refilled over and over
+}
+
+void testLanDiscoveryFindsHostOnLoopback() {
+  using namespace game_engine;
+  using namespace std::chrono_literals;
+
+  // a port of its own, so a game running on this machine doesnt answer
+  constexpr uint16_t kPort = 47191;
+  const auto waitFor = [](const auto& done) {
+    const auto giveUpAt = std::chrono::steady_clock::now() + 3s;
+    while (!done() && std::chrono::steady_clock::now() < giveUpAt) {
+      std::this_thread::sleep_for(10ms);
+    }
+    return done();
+  };
+
+  DiscoveryHostService host;
+  DiscoveryBrowserService browser;
+  assert(host.start(kPort) && browser.start(kPort));
+  host.updateInfo("test host", LevelIndex::LEVEL_2, 2, 9100);
+
+  // not ready yet: queries go unanswered
+  std::this_thread::sleep_for(std::chrono::milliseconds(DiscoveryBrowserService::kQueryIntervalMs + 250));
+  assert(browser.sessions()->empty());
+
+  host.setReady(true);
+  // the same host can also answer from its LAN address, via the broadcast
+  const auto loopbackEntry = [&](const std::shared_ptr<const std::vector<DiscoveredSessionInfo>>& sessions) {
+    const auto it = std::find_if(sessions->begin(), sessions->end(), [](const DiscoveredSessionInfo& session) {
+      return session.hostAddress == "127.0.0.1";
+    });
+    return it == sessions->end() ? nullptr : &*it;
+  };
+  assert(waitFor([&] { return loopbackEntry(browser.sessions()) != nullptr; }));
+  const auto found = browser.sessions();
+  const DiscoveredSessionInfo* session = loopbackEntry(found);
+  assert(session->hostName == "test host" && session->gamePort == 9100 && session->levelId == LevelIndex::LEVEL_2);
+
+  // a change is republished as a new list; the one already handed out stays as it was
+  host.updateInfo("test host", LevelIndex::LEVEL_2, 3, 9100);
+  assert(waitFor([&] {
+    const auto sessions = browser.sessions();
+    const DiscoveredSessionInfo* now = loopbackEntry(sessions);
+    return now && now->playerCount == 3;
+  }));
+  assert(session->playerCount == 2);
+
+  browser.clearSessions();
+  assert(browser.sessions()->empty());
+  host.stop();
+  browser.stop();
+  assert(browser.sessions()->empty());
+}
+
+void testRoomInputJitterBufferAppliesOneFramePerTick() {
+  using namespace game_engine;
+
+  GameState state = makeGameplayState();
+  state.layers[1].push_back(makePlayer(1));
+  GameRoom room(kDefaultRoomID, std::make_unique<AuthoritativeContext>(std::move(state)));
+  assert(room.registerPlayer(42, SpriteType::Player_Marie));
+  const PlayerSession& session = room.m_playerSessions.at(42);
+  const auto push = [&](uint32_t seq, bool jump = false, bool melee = false, bool ultimate = false) {
+    NetGameInput input{};
+    input.playerID = 42;
+    input.inputSeq = seq;
+    input.rightHeld = true;
+    input.jumpPressed = jump;
+    input.meleePressed = melee;
+    input.ultimatePressed = ultimate;
+    assert(room.m_playerInputQueue.try_push(input));
+  };
+  const auto applied = [&]() { return room.m_authCtx->latestPlayerInputs.at(42); };
+  const auto tick = [&]() {
+    room.applyPlayerInputs();
+    const uint32_t seq = session.lastInputSeq;
+    room.step(1.0f / 60.0f);
+    return seq;
+  };
+
+  // the first frame is held back kInputDelayTicks, then one frame goes in per tick
+  static_assert(GameRoom::kInputDelayTicks == 2);
+  push(1);
+  assert(tick() == 0);
+  push(2, true);
+  assert(tick() == 0);
+  push(3);
+  assert(tick() == 1 && applied().rightHeld);
+  room.applyPlayerInputs();
+  assert(session.lastInputSeq == 2 && applied().jumpPressed);
+  room.step(1.0f / 60.0f);
+  assert(tick() == 3 && !applied().jumpPressed); // presses last one tick
+
+  // nothing arrived: the held buttons carry over
+  assert(tick() == 3 && applied().rightHeld);
+
+  // 4 is late; it and 5 (due now) go in together with both presses, and 6 gets the full delay again
+  push(4, false, true);
+  push(5, false, false, true);
+  push(6);
+  room.applyPlayerInputs();
+  assert(session.lastInputSeq == 5 && applied().meleePressed && applied().ultimatePressed);
+  room.step(1.0f / 60.0f);
+  push(5);
+  push(6); // repeats of frames already applied or buffered
+  assert(tick() == 5);
+  assert(session.pendingInputs.size() == 1);
+  assert(tick() == 6);
+
+  // a burst far ahead of the delay is pulled in rather than queued up
+  for (uint32_t seq = 7; seq <= 20; ++seq) {
+    push(seq, seq == 8);
+  }
+  room.applyPlayerInputs();
+  assert(session.lastInputSeq == 20 - GameRoom::kInputDelayTicks && applied().jumpPressed);
+  room.step(1.0f / 60.0f);
+  assert(tick() == 19);
+  assert(tick() == 20 && session.pendingInputs.empty());
+}
+
+void testMpscQueueMultiProducerDrain() {
+  net::mpsc_queue<uint32_t> q(64);
+  assert(q.capacity() == 64);
+  assert(q.empty());
+
+  constexpr uint32_t kProducers = 4;
+  constexpr uint32_t kPerProducer = 5000;
+  std::vector<std::thread> producers;
+  for (uint32_t p = 0; p < kProducers; ++p) {
+    producers.emplace_back([&q, p]() {
+      for (uint32_t i = 0; i < kPerProducer; ++i) {
+        q.push_back(p * kPerProducer + i);
+      }
+    });
+  }
+
+  // per-producer order must survive, and nothing may be lost or duplicated
+  std::vector<uint32_t> nextExpected(kProducers, 0);
+  std::vector<uint32_t> batch;
+  uint32_t received = 0;
+  while (received < kProducers * kPerProducer) {
+    batch.clear();
+    q.pop_all(batch, 16);
+    assert(batch.size() <= 16);
+    for (uint32_t v : batch) {
+      const uint32_t p = v / kPerProducer;
+      assert(v % kPerProducer == nextExpected[p]);
+      ++nextExpected[p];
+    }
+    received += static_cast<uint32_t>(batch.size());
+  }
+  for (auto& t : producers) {
+    t.join();
+  }
+  assert(q.empty());
+}
+
+void testLzRoundTripSnapshotAndNoise() {
+  using namespace game_engine;
+  enum class TestMsg : uint32_t { Snapshot = 1 };
+
+  // a realistic snapshot: many similar enemies compress well
+  auto snap = makeSnapshot();
+  for (uint32_t id = 10; id < 200; ++id) {
+    NetGameObjectSnapshot enemy = snap.m_gameObjects.at({ObjectClass::Enemy, 2});
+    enemy.id = id;
+    enemy.position.x += static_cast<float>(id);
+    snap.m_gameObjects[{ObjectClass::Enemy, id}] = enemy;
+  }
+
+  net::message<TestMsg> msg;
+  msg.header.id = TestMsg::Snapshot;
+  msg.body = snap.serealizeNetGameStateSnapshot();
+  msg.header.bodySize = msg.body.size();
+  const auto raw = msg.body;
+
+  assert(net::compress_message(msg, 256));
+  assert(msg.header.bodySize & net::kCompressedBodyFlag);
+  assert(msg.body.size() < raw.size() / 2);
+  assert(net::decompress_message(msg));
+  assert(msg.body == raw);
+  assert(msg.header.bodySize == raw.size());
+
+  // below threshold stays raw
+  net::message<TestMsg> small;
+  small.body.assign(100, 0);
+  assert(!net::compress_message(small, 256));
+
+  // incompressible data is left alone; long runs exercise overlapping matches
+  std::vector<uint8_t> noise(4096);
+  uint32_t x = 12345;
+  for (auto& b : noise) {
+    x = x * 1103515245u + 12345u;
+    b = static_cast<uint8_t>(x >> 24);
+  }
+  std::vector<uint8_t> mixed = noise;
+  mixed.insert(mixed.end(), 3000, 7);
+  mixed.insert(mixed.end(), noise.begin(), noise.begin() + 100);
+  std::vector<uint8_t> packed(net::lz::compress_bound(mixed.size()));
+  const size_t n = net::lz::compress(mixed.data(), mixed.size(), packed.data());
+  std::vector<uint8_t> unpacked(mixed.size());
+  assert(net::lz::decompress(packed.data(), n, unpacked.data(), unpacked.size()));
+  assert(unpacked == mixed);
+
+  // truncated input must be rejected, not overrun
+  assert(!net::lz::decompress(packed.data(), n / 2, unpacked.data(), unpacked.size()));
+}
+
+void testSpscQueueFullAndWrap() {
+  net::spsc_queue<int> q(4);
+  for (int round = 0; round < 3; ++round) {
+    for (int i = 0; i < 4; ++i) {
+      assert(q.try_push(round * 10 + i));
+    }
+    assert(!q.try_push(99)); // bounded
+    assert(q.count() == 4);
+    int v = 0;
+    assert(q.try_pop(v) && v == round * 10);
+    std::vector<int> rest;
+    assert(q.pop_all(rest) == 3);
+    assert(rest.front() == round * 10 + 1 && rest.back() == round * 10 + 3);
+    assert(q.empty());
+  }
+  // timed wait returns false on an empty queue instead of blocking forever
+  assert(!q.wait_until(std::chrono::steady_clock::now() + std::chrono::milliseconds(5)));
+}
+
+
 void testEnemyKnockbackDelayedUntilHitStopEnds() {
   auto state = makeGameplayState();
   state.layers[0].push_back(makeFloor());
@@ -681,12 +1967,109 @@ void testDeadEnemyGetsPurgedAfterDeathAnimation() {
   assert(state.layers[1][0].objClass == ObjectClass::Player);
 }
 
+void testClientPingWaitsForHandshake() {
+  using namespace game_engine;
+
+  constexpr uint16_t kPort = 47611;
+  GameServer server(kPort, std::make_unique<AuthoritativeContext>(makeGameplayState()));
+  assert(server.Start());
+
+  // the client is polled straight after Connect, before the handshake: a ping sent then would be read
+  // as the handshake reply and get the client dropped
+  GameClient client;
+  assert(client.Connect("127.0.0.1", kPort));
+  const auto giveUpAt = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+  while (!client.IsClientValidated() && std::chrono::steady_clock::now() < giveUpAt) {
+    client.ProcessServerMessages();
+    server.ProcessIncomingMessages(-1, false);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(50)); // let anything queued reach the socket
+  assert(client.IsClientValidated() && client.IsConnected());
+  assert(client.GetStats().messagesOut == 0); // nothing went out before Client_Accepted
+
+  // the first ping goes out once the handshake is through
+  client.ProcessServerMessages();
+  const auto pingBy = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+  while (client.GetStats().messagesOut == 0 && std::chrono::steady_clock::now() < pingBy) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  assert(client.GetStats().messagesOut == 1 && client.IsConnected());
+
+  client.Disconnect();
+  server.Stop();
+}
+
+void testClientReconnectsWithOperationsInFlight() {
+  using namespace game_engine;
+
+  constexpr uint16_t kPort = 47613;
+  GameServer server(kPort, std::make_unique<AuthoritativeContext>(makeGameplayState()));
+  assert(server.Start());
+
+  GameClient client;
+  assert(client.Connect("127.0.0.1", kPort));
+  const auto giveUpAt = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+  while (!client.IsClientValidated() && std::chrono::steady_clock::now() < giveUpAt) {
+    client.ProcessServerMessages();
+    server.ProcessIncomingMessages(-1, false);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  assert(client.IsClientValidated());
+
+  // each Connect tears down a connection with a read pending, or one still connecting or handshaking:
+  // their handlers must all have run before it is freed
+  for (int attempt = 0; attempt < 20; ++attempt) {
+    assert(client.Connect("127.0.0.1", kPort));
+    if (attempt % 2 == 1) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+  }
+  client.Disconnect();
+  assert(!client.IsConnected());
+
+  assert(client.Connect("127.0.0.1", kPort));
+  const auto connectBy = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+  while (!client.IsConnected() && std::chrono::steady_clock::now() < connectBy) {
+    server.ProcessIncomingMessages(-1, false);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  assert(client.IsConnected());
+
+  client.Disconnect();
+  server.Stop();
+}
+
 } // namespace
 
 int main(){
   testNetGameInputRoundTrip();
+  testNetInputPacketRedundantFramesRoundTrip();
   testNetGameStateSnapshotRoundTrip();
   testEnemyHitStopSnapshotRoundTrip();
+  testClientPredictionConfirmsThenReplaysAfterMismatch();
+  testSnapshotInterpolatorBracketsAndExtrapolates();
+  testSnapshotInterpolatorDropsOutOfOrderTicks();
+  testReplicaIndexTracksSpawnsDespawnsAndLayerMoves();
+  testRttEstimatorSmoothsPingSamples();
+  testConnectionCoalescesLatestOnlyMessages();
+  testConnectionFlushesLatestSlotsInReliableOrder();
+  testConnectionDropsStalledRemoteWithoutWaiting();
+  testBufferPoolReusesBodies();
+  testImpairmentStageDelaysDropsAndKeepsReliableOrder();
+  testFlatMapKeepsSnapshotObjectsSorted();
+  testSnapshotRateBacksOffAndRecovers();
+  testWireSchemaMatchesHandWrittenLayout();
+  testWireDecodeChecksBoolsAndEnums();
+  testRoomManagerRoutesClientsAndTicksRooms();
+  testDemoRecordsSeeksAndReplays();
+  testInterestFilterKeepsNearbyObjectsWithHysteresis();
+  testSnapshotDeltaResumesFromBase();
+  testLanDiscoveryFindsHostOnLoopback();
+  testRoomInputJitterBufferAppliesOneFramePerTick();
+  testMpscQueueMultiProducerDrain();
+  testSpscQueueFullAndWrap();
+  testLzRoundTripSnapshotAndNoise();
   testPassiveUltimateChargeGain();
   testKillRewardGainFromMelee();
   testUltimateRequiresFullMeter();
@@ -701,6 +2084,8 @@ int main(){
   testFatalEnemyHitDisablesColliderImmediately();
   testDeadEnemyNoLongerBlocksPlayerCollision();
   testDeadEnemyGetsPurgedAfterDeathAnimation();
+  testClientPingWaitsForHandshake();
+  testClientReconnectsWithOperationsInFlight();
   std::cout << "All net_common tests passed\n";
   return 0;
 }